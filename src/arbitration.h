@@ -0,0 +1,168 @@
+// A/B line arbitration: the feed is published twice, on line A and line B (different multicast groups, and
+// usually different NICs and network paths). Both lines are received, on one ring or on a ring per line, and
+// every payload from either line goes to parsePayload. The sequencer is shared, so the first copy of each
+// sequence number is applied and the second is dropped as a duplicate (seq < nextSeq, or its window bit is
+// already set). A message lost on one line is therefore filled in from the other as soon as that copy
+// arrives, and only counted as lost if neither line delivers it before the gap deadline.
+//
+// On top of that the arbiter records, per payload, which line won the race and by how much (from the
+// kernel receive timestamps, which both lines share), so the faster path can be identified.
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <poll.h>
+#include "ring.h"
+#include "demux.h"
+#include "parse.h"
+#include "sequencer.h"
+#include "recovery.h"
+#include "moldudp64.h"
+#include "latency.h"
+#include "stats_page.h"
+
+constexpr uint32_t AB_LINES = 2;
+// Races are matched on the first sequence number of the payload, over the last RACE_SLOTS payloads
+constexpr size_t RACE_SLOTS = 4096;
+// Lead histogram, bucket i counts races won by a lead of bit_width(ns) == i (up to ~8ms)
+constexpr size_t LEAD_BUCKETS = 24;
+
+// A multicast group/port carrying one copy of the feed, in network byte order
+struct FeedLine {
+    uint32_t    mcast_ip;
+    uint16_t    dest_port;
+};
+
+struct LineStats {
+    uint64_t    payloads = 0;       // payloads received on this line
+    uint64_t    wins = 0;           // races won: this line's copy arrived first and the other line's copy later
+    uint64_t    soleCopies = 0;     // payloads only this line delivered (lost, or too late to race, on the other)
+    uint64_t    leadNsTotal = 0;    // sum of the winning margins
+    uint64_t    leadNsMax = 0;
+    uint64_t    lead[LEAD_BUCKETS] = {};
+};
+
+class LineArbiter {
+public:
+    LineStats lines[AB_LINES];
+
+    // Record a payload of len bytes from line at kernel receive time tsNs, before it is handed to parsePayload.
+    // One too short to hold a sequence number is counted but takes part in no race
+    void onPayload(uint32_t line, const char *payload, ssize_t len, uint64_t tsNs) {
+        lines[line].payloads++;
+        if (!hasPayloadSequence(len)) return;
+        uint32_t seq = peekPayloadSequence(payload);
+        Race &race = races[seq % RACE_SLOTS];
+        // A copy later than the gap deadline is not a race any more, the first one is treated as a sole copy
+        if (race.pending && race.seq == seq && (int64_t)(tsNs - race.tsNs) <= (int64_t) GAP_TIMEOUT_NS) {
+            // The same payload on the same line again is a retransmission, not a race
+            if (race.line == line) return;
+            LineStats &winner = lines[race.line];
+            uint64_t lead = tsNs > race.tsNs ? tsNs - race.tsNs : 0;
+            winner.wins++;
+            winner.leadNsTotal += lead;
+            if (lead > winner.leadNsMax) winner.leadNsMax = lead;
+            winner.lead[std::min<size_t>(std::bit_width(lead), LEAD_BUCKETS - 1)]++;
+            race.pending = false;
+            return;
+        }
+        // A slot still waiting for its second copy when it is reused never got one
+        if (race.pending) lines[race.line].soleCopies++;
+        race = Race{seq, line, true, tsNs};
+    }
+
+private:
+    struct Race {
+        uint32_t    seq = 0;
+        uint32_t    line = 0;
+        bool        pending = false;
+        uint64_t    tsNs = 0;
+    };
+    Race races[RACE_SLOTS];
+};
+
+// Which of the lines a datagram belongs to, -1 if none
+inline int matchLine(const FeedLine *lines, uint32_t daddr, uint16_t dport) {
+    for (uint32_t i = 0; i < AB_LINES; i++) {
+        if (lines[i].mcast_ip == daddr && lines[i].dest_port == dport) return i;
+    }
+    return -1;
+}
+
+inline void printArbitrationStats(const LineArbiter &arb) {
+    static const char name[AB_LINES] = {'A', 'B'};
+    uint64_t races = arb.lines[0].wins + arb.lines[1].wins;
+    for (uint32_t i = 0; i < AB_LINES; i++) {
+        const LineStats &l = arb.lines[i];
+        printf("[line %c] payloads=%lu wins=%lu (%.1f%%) sole_copies=%lu mean_lead=%luns max_lead=%luns | lead ",
+               name[i], l.payloads, l.wins, races ? 100.0 * l.wins / races : 0.0, l.soleCopies,
+               l.wins ? l.leadNsTotal / l.wins : 0, l.leadNsMax);
+        for (size_t b = 0; b < LEAD_BUCKETS; b++) {
+            if (l.lead[b]) printf("<%zu:%lu ", (size_t) 1 << b, l.lead[b]);
+        }
+        printf("\n");
+    }
+    printf("[arbitration] parsed=%u duplicates_dropped=%u out_of_order=%u lost=%u gap_timeouts=%lu\n",
+           GlobalState::sequencer.stats.parsedMessages, GlobalState::sequencer.stats.duplicates,
+           GlobalState::sequencer.stats.outOfOrderMessages, GlobalState::sequencer.stats.lostMessages,
+           GlobalState::gapDeadline.expirations);
+}
+
+// Receive both lines and arbitrate between them. With one ring, both lines are demuxed from it. With a
+// ring per line, ring i only accepts line i (rings on the same NIC each see both lines). A single thread
+// walks every ready block of every ring, so there is nothing to synchronise, and reports once a second.
+inline void arbitrationLoop(RxRing *rings, uint32_t ringCount, const FeedLine *lines, GapClock clock) {
+    auto arb = std::make_unique<LineArbiter>();
+    pollfd pfds[AB_LINES]{};
+    uint32_t blockIdx[AB_LINES] = {};
+    RingStatsWriter ringStats[AB_LINES];
+    for (uint32_t r = 0; r < ringCount; r++) {
+        pfds[r].fd = rings[r].sockfd;
+        pfds[r].events = POLLIN;
+        ringStats[r].attach(statsPage.ring(r), rings[r]);
+    }
+
+    uint64_t nextReport = tscClock.nowNs() + 1'000'000'000ULL;
+    for (;;) {
+        bool progressed = false;
+        for (uint32_t r = 0; r < ringCount; r++) {
+            tpacket_block_desc *block_ptr = rings[r].block(blockIdx[r]);
+            if (!RxRing::ready(block_ptr)) continue;
+
+            forEachPacket(block_ptr, [&](tpacket3_hdr *pkt) {
+                uint32_t daddr;
+                uint16_t dport;
+                ssize_t payload_length;
+                char *payload = extractUdpDatagram((char *)pkt + pkt->tp_mac, pkt->tp_snaplen, daddr, dport, payload_length);
+                if (!payload || payload_length == 0) return;
+                int line = matchLine(lines, daddr, dport);
+                if (line < 0 || (ringCount > 1 && (uint32_t) line != r)) return;
+                uint64_t tsNs = RxRing::packetNs(pkt);
+                arb->onPayload(line, payload, payload_length, tsNs);
+                latency.beginPacket(tsNs);
+                parsePayload(payload, payload_length);
+            });
+
+            ringStats[r].onBlock(rings[r], blockIdx[r]);
+            uint64_t nowNs = blockTimeNs(clock, block_ptr);
+            release_block(block_ptr);
+            blockIdx[r] = (blockIdx[r] + 1) % rings[r].blockNr;
+            serviceGaps(nowNs);
+            progressed = true;
+        }
+
+        if (!progressed) {
+            bool gapOpen = GlobalState::sequencer.gapExists();
+            poll(pfds, ringCount, gapOpen ? GAP_POLL_MS : 1000);
+            if (gapOpen && clock == GapClock::Tsc) serviceGaps(tscClock.nowNs());
+        }
+        uint64_t now = tscClock.nowNs();
+        if (now >= nextReport) {
+            printArbitrationStats(*arb);
+            if (gapRecovery.enabled()) printRecoveryStats(gapRecovery);
+            nextReport = now + 1'000'000'000ULL;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+// Asynchronous binary logging: the thread running the parser only copies each logged message, as it came off
+// the wire, into a fixed size record in an SPSC ring. A formatter thread pinned to a non-critical core turns the
+// records into text and writes them out in batches, so the receive loop never formats, never makes a syscall
+// and never waits on the output. When the formatter falls behind and the ring fills up, records are dropped
+// and counted instead of stalling the feed, and the formatter notes the drop in the output.
+// Only one thread may log (the ring has a single producer), which holds for every receive mode since the
+// sequencer has a single owner too.
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include "itch.h"
+#include "spsc.h"
+#include "cpu.h"
+
+constexpr size_t LOG_RING_RECORDS = 16384;      // 1MB of records
+constexpr size_t LOG_BATCH_BYTES = 64 * 1024;   // formatted text handed to one write()
+constexpr size_t MAX_LOG_LINE = 1024;           // longest line a formatter may produce
+constexpr long LOG_IDLE_SLEEP_NS = 100'000;     // formatter sleep while the ring is empty
+
+// One logged message, copied as is
+struct alignas(CACHE_LINE_SIZE) LogRecord {
+    char    msg[MAX_MESSAGE_SIZE];
+};
+
+static_assert(sizeof(LogRecord) == CACHE_LINE_SIZE, "a log record should fill one cache line");
+
+// Formats the message of a record into out (at least MAX_LOG_LINE bytes), returns the length written
+using LogFormatter = size_t (*)(const char *msg, char *out);
+
+class AsyncLog {
+public:
+    // Hot path. Copy a message of a known type into the ring, false if it was dropped (ring full)
+    bool push(const char *msg) {
+        LogRecord *r = m_ring.claim();
+        if (!r) [[unlikely]] {
+            m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        std::memcpy(r->msg, msg, messageSize(msg[0]));
+        m_ring.publish();
+        return true;
+    }
+
+    // Start the formatter thread writing to fd, pinned to cpu (-1 = not pinned)
+    void start(int fd, LogFormatter format, int cpu) {
+        if (m_running.load(std::memory_order_relaxed)) return;
+        m_fd = fd;
+        m_format = format;
+        m_running.store(true, std::memory_order_release);
+        m_thread = std::thread([this, cpu] {
+            if (cpu >= 0) pinToCpu(cpu);
+            run();
+        });
+    }
+
+    // Write out every record logged so far and stop the formatter
+    void stop() {
+        if (!m_running.load(std::memory_order_relaxed)) return;
+        m_running.store(false, std::memory_order_release);
+        m_thread.join();
+    }
+
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t written() const { return m_written.load(std::memory_order_relaxed); }
+
+private:
+    SpscRing<LogRecord, LOG_RING_RECORDS> m_ring;
+    // Producer line
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_dropped{0};
+    // Formatter line
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_written{0};
+    std::atomic<bool> m_running{false};
+    std::thread m_thread;
+    int m_fd = STDOUT_FILENO;
+    LogFormatter m_format = nullptr;
+
+    // Format whatever is in the ring into the batch buffer and write it out, sleep while there is nothing.
+    // The stop flag is read before draining, so every record pushed before stop() is written
+    void run() {
+        std::unique_ptr<char[]> batch(new char[LOG_BATCH_BYTES]);
+        uint64_t reportedDrops = 0;
+        LogRecord r;
+        for (;;) {
+            bool running = m_running.load(std::memory_order_acquire);
+            size_t used = 0, records = 0;
+            while (used + MAX_LOG_LINE <= LOG_BATCH_BYTES && m_ring.tryPop(r)) {
+                used += m_format(r.msg, batch.get() + used);
+                records++;
+            }
+            uint64_t drops = m_dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops && used + MAX_LOG_LINE <= LOG_BATCH_BYTES) {
+                used += snprintf(batch.get() + used, MAX_LOG_LINE, "*** %lu log records dropped ***\n", drops - reportedDrops);
+                reportedDrops = drops;
+            }
+            if (used) {
+                writeAll(batch.get(), used);
+                m_written.store(m_written.load(std::memory_order_relaxed) + records, std::memory_order_relaxed);
+                continue;
+            }
+            if (!running) return;
+            timespec idle{0, LOG_IDLE_SLEEP_NS};
+            nanosleep(&idle, nullptr);
+        }
+    }
+
+    void writeAll(const char *buf, size_t len) {
+        while (len) {
+            ssize_t n = write(m_fd, buf, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return; // nowhere to report it, the rest of the batch is lost
+            }
+            buf += n;
+            len -= n;
+        }
+    }
+};
+
+// The log of the parse path, written through Logger (parse.h)
+inline AsyncLog asyncLog;
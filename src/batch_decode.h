@@ -0,0 +1,307 @@
+// Batch decoder: decodes a whole payload at once into structure of arrays columns (type, timestamp, sequence
+// number, order ref, shares, price, symbol), for consumers that scan a column at a time instead of reacting
+// to one message struct after another.
+//
+// Finding the message boundaries is serial (each size comes from the type byte before it), so that is done
+// first, scalar, into the offset column. The columns are then filled per message: the header (timestamp and
+// sequence number) and the order ref and shares are pulled out of two 16 byte loads with a byte shuffle each,
+// which swaps them to host order and zero fills whatever the type doesn't have. The shuffle masks are
+// generated from the layout tables in itch.h. Price and symbol sit at different offsets in every type and are
+// read with a single bswap or copy.
+//
+// The instruction set is picked at runtime from what the CPU supports (AVX-512BW, AVX2, SSE4.1, else scalar),
+// so the same binary runs everywhere. AVX2 shuffles two messages per instruction and AVX-512 four, then packs
+// the results straight into the columns.
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include "parse.h"
+#include "itch.h"
+
+// Most messages a payload can hold (1472 byte UDP payload / 12 byte smallest message)
+constexpr uint32_t MAX_BATCH_MESSAGES = 128;
+// Bytes the shuffle path reads from the start of a message (header, then 16 bytes of body). Messages closer
+// than this to the end of the payload are decoded scalar, so nothing past the payload is ever read
+constexpr size_t BATCH_SIMD_READ_LEN = MESSAGE_HEADER_LEN + 16;
+
+struct MessageBatch {
+    uint32_t    count = 0;
+    alignas(64) uint64_t    timestamp[MAX_BATCH_MESSAGES];
+    alignas(64) uint64_t    orderRef[MAX_BATCH_MESSAGES];     // 0 if the type has none
+    alignas(64) uint32_t    seq[MAX_BATCH_MESSAGES];
+    alignas(64) uint32_t    shares[MAX_BATCH_MESSAGES];       // shares, executed or cancelled shares, 0 if none
+    alignas(64) uint32_t    price[MAX_BATCH_MESSAGES];        // price or executed price, 0 if none
+    alignas(64) uint16_t    offset[MAX_BATCH_MESSAGES];       // of the message in the payload, for other fields
+    alignas(64) char        type[MAX_BATCH_MESSAGES];
+    alignas(64) char        symbol[MAX_BATCH_MESSAGES][8];    // as sent (space padded), zeroes if none
+};
+
+enum class BatchIsa {
+    Scalar, Sse41, Avx2, Avx512
+};
+
+namespace batch_detail {
+
+// Where each column is in every message type. A column the type doesn't have is read from offset 0 (every
+// message is at least 12 bytes) and masked to zero, so types can be mixed without a branch per column
+struct Columns {
+    uint8_t     orderRef = 0;
+    uint8_t     shares = 0;
+    uint8_t     price = 0;
+    uint8_t     symbol = 0;
+    uint64_t    orderRefMask = 0;
+    uint32_t    sharesMask = 0;
+    uint32_t    priceMask = 0;
+    uint64_t    symbolMask = 0;
+    bool        outsideShuffle = false;     // order ref or shares past the 16 bytes the shuffle path reads
+};
+
+// First of names with the given width in a layout, nullptr if none
+template<size_t N>
+constexpr const FieldLayout *findColumn(const MessageLayout &l, const char *const (&names)[N], uint8_t width) {
+    for (const char *name : names) {
+        const FieldLayout *f = l.field(name);
+        if (f && f->width == width) return f;
+    }
+    return nullptr;
+}
+
+inline constexpr std::array<Columns, 256> COLUMNS = [] {
+    std::array<Columns, 256> columns{};
+    const char *const orderRef[] = {"orderRefNumber"};
+    const char *const shares[] = {"shares", "executedShares", "cancelledShares"};
+    const char *const price[] = {"price", "executedPrice"};
+    const char *const symbol[] = {"stock"};
+    auto inside = [](const FieldLayout *f) {
+        return !f || (f->offset >= MESSAGE_HEADER_LEN && f->offset + f->width <= BATCH_SIMD_READ_LEN);
+    };
+    for (const MessageLayout &l : MESSAGE_LAYOUTS) {
+        Columns &c = columns[(uint8_t) l.type];
+        if (const FieldLayout *f = findColumn(l, orderRef, 8)) c.orderRef = f->offset, c.orderRefMask = ~0ULL;
+        if (const FieldLayout *f = findColumn(l, shares, 4)) c.shares = f->offset, c.sharesMask = ~0U;
+        if (const FieldLayout *f = findColumn(l, price, 4)) c.price = f->offset, c.priceMask = ~0U;
+        if (const FieldLayout *f = findColumn(l, symbol, 8)) c.symbol = f->offset, c.symbolMask = ~0ULL;
+        c.outsideShuffle = !inside(findColumn(l, orderRef, 8)) || !inside(findColumn(l, shares, 4));
+    }
+    return columns;
+}();
+
+// Shuffle of the first 16 bytes of a message: timestamp (bytes 1-6) to the low qword, sequence number
+// (bytes 7-10) to dword 2, both swapped to host order. 0x80 zeroes a byte
+alignas(16) inline constexpr uint8_t HEADER_SHUFFLE[16] = {
+    6, 5, 4, 3, 2, 1, 0x80, 0x80, 10, 9, 8, 7, 0x80, 0x80, 0x80, 0x80
+};
+
+// Shuffle of the 16 bytes after the header, per type: order ref to the low qword and shares to dword 2.
+// Types with either outside those bytes get an all zero mask and are decoded by decodeTail instead
+inline constexpr auto BODY_SHUFFLE = [] {
+    std::array<std::array<uint8_t, 16>, 256> masks{};
+    for (auto &m : masks) m.fill(0x80);
+    for (const MessageLayout &l : MESSAGE_LAYOUTS) {
+        const Columns &c = COLUMNS[(uint8_t) l.type];
+        if (c.outsideShuffle) continue;
+        auto &m = masks[(uint8_t) l.type];
+        for (int k = 0; c.orderRefMask && k < 8; k++) m[k] = c.orderRef - MESSAGE_HEADER_LEN + 7 - k;
+        for (int k = 0; c.sharesMask && k < 4; k++) m[8 + k] = c.shares - MESSAGE_HEADER_LEN + 3 - k;
+    }
+    return masks;
+}();
+
+inline const __m128i *bodyShuffle(char type) {
+    return reinterpret_cast<const __m128i *>(BODY_SHUFFLE[(uint8_t) type].data());
+}
+
+// Walk the message boundaries into the offset column, stopping at an unknown type or a truncated message.
+// Returns the bytes covered
+inline size_t findMessages(const char *buf, size_t len, MessageBatch &b) {
+    size_t pos = 0;
+    uint32_t n = 0;
+    while (pos < len && n < MAX_BATCH_MESSAGES) {
+        size_t size = MESSAGE_SIZES[(uint8_t) buf[pos]];
+        if (size == 0 || pos + size > len) break;
+        b.offset[n++] = pos;
+        pos += size;
+    }
+    b.count = n;
+    return pos;
+}
+
+// Messages at the start of the batch that the shuffle path can read without running past the payload
+inline uint32_t simdSafe(const MessageBatch &b, size_t len) {
+    uint32_t n = b.count;
+    while (n > 0 && b.offset[n - 1] + BATCH_SIMD_READ_LEN > len) n--;
+    return n;
+}
+
+inline void decodeBody(const Columns &c, const char *msg, MessageBatch &b, uint32_t i) {
+    size_t offset = c.orderRef;
+    b.orderRef[i] = read8Bytes(msg, offset) & c.orderRefMask;
+    offset = c.shares;
+    b.shares[i] = read4Bytes(msg, offset) & c.sharesMask;
+}
+
+// The columns every path fills one message at a time, after the shuffled ones
+inline void decodeTail(const char *msg, MessageBatch &b, uint32_t i) {
+    const Columns &c = COLUMNS[(uint8_t) msg[0]];
+    if (c.outsideShuffle) [[unlikely]] decodeBody(c, msg, b, i);
+    b.type[i] = msg[0];
+    size_t offset = c.price;
+    b.price[i] = read4Bytes(msg, offset) & c.priceMask;
+    uint64_t symbol;
+    std::memcpy(&symbol, msg + c.symbol, 8);
+    symbol &= c.symbolMask;
+    std::memcpy(b.symbol[i], &symbol, 8);
+}
+
+inline void decodeScalar(const char *msg, MessageBatch &b, uint32_t i) {
+    size_t offset = 1;
+    b.timestamp[i] = readTimestamp(msg, offset);
+    b.seq[i] = read4Bytes(msg, offset);
+    decodeBody(COLUMNS[(uint8_t) msg[0]], msg, b, i);
+    decodeTail(msg, b, i);
+}
+
+inline size_t decodeBatchScalar(const char *buf, size_t len, MessageBatch &b) {
+    size_t consumed = findMessages(buf, len, b);
+    for (uint32_t i = 0; i < b.count; i++) decodeScalar(buf + b.offset[i], b, i);
+    return consumed;
+}
+
+__attribute__((target("sse4.1")))
+inline size_t decodeBatchSse41(const char *buf, size_t len, MessageBatch &b) {
+    size_t consumed = findMessages(buf, len, b);
+    uint32_t safe = simdSafe(b, len);
+    const __m128i headerMask = _mm_load_si128((const __m128i *) HEADER_SHUFFLE);
+    uint32_t i = 0;
+    for (; i < safe; i++) {
+        const char *msg = buf + b.offset[i];
+        __m128i h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) msg), headerMask);
+        __m128i body = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(msg + MESSAGE_HEADER_LEN)),
+                                        _mm_loadu_si128(bodyShuffle(msg[0])));
+        b.timestamp[i] = _mm_cvtsi128_si64(h);
+        b.seq[i] = _mm_extract_epi32(h, 2);
+        b.orderRef[i] = _mm_cvtsi128_si64(body);
+        b.shares[i] = _mm_extract_epi32(body, 2);
+        decodeTail(msg, b, i);
+    }
+    for (; i < b.count; i++) decodeScalar(buf + b.offset[i], b, i);
+    return consumed;
+}
+
+__attribute__((target("avx2")))
+inline __m256i load2(const void *lo, const void *hi) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) lo)),
+                                   _mm_loadu_si128((const __m128i *) hi), 1);
+}
+
+__attribute__((target("avx2")))
+inline size_t decodeBatchAvx2(const char *buf, size_t len, MessageBatch &b) {
+    size_t consumed = findMessages(buf, len, b);
+    uint32_t safe = simdSafe(b, len);
+    const __m256i headerMask = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) HEADER_SHUFFLE));
+    // Each lane holds one message: qword 0 of a lane is the 64 bit column, dword 2 the 32 bit one
+    const __m256i dwords = _mm256_setr_epi32(2, 6, 0, 0, 0, 0, 0, 0);
+    uint32_t i = 0;
+    for (; i + 2 <= safe; i += 2) {
+        const char *m0 = buf + b.offset[i], *m1 = buf + b.offset[i + 1];
+        __m256i h = _mm256_shuffle_epi8(load2(m0, m1), headerMask);
+        __m256i body = _mm256_shuffle_epi8(load2(m0 + MESSAGE_HEADER_LEN, m1 + MESSAGE_HEADER_LEN),
+                                           load2(bodyShuffle(m0[0]), bodyShuffle(m1[0])));
+        _mm_storeu_si128((__m128i *) &b.timestamp[i], _mm256_castsi256_si128(_mm256_permute4x64_epi64(h, 0b1000)));
+        _mm_storeu_si128((__m128i *) &b.orderRef[i], _mm256_castsi256_si128(_mm256_permute4x64_epi64(body, 0b1000)));
+        _mm_storel_epi64((__m128i *) &b.seq[i], _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(h, dwords)));
+        _mm_storel_epi64((__m128i *) &b.shares[i], _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(body, dwords)));
+        decodeTail(m0, b, i);
+        decodeTail(m1, b, i + 1);
+    }
+    for (; i < b.count; i++) decodeScalar(buf + b.offset[i], b, i);
+    return consumed;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline __m512i load4(const void *m0, const void *m1, const void *m2, const void *m3) {
+    __m512i v = _mm512_zextsi128_si512(_mm_loadu_si128((const __m128i *) m0));
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) m1), 1);
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) m2), 2);
+    return _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *) m3), 3);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline size_t decodeBatchAvx512(const char *buf, size_t len, MessageBatch &b) {
+    size_t consumed = findMessages(buf, len, b);
+    uint32_t safe = simdSafe(b, len);
+    const __m512i headerMask = _mm512_maskz_broadcast_i32x4(0xffff, _mm_load_si128((const __m128i *) HEADER_SHUFFLE));
+    uint32_t i = 0;
+    for (; i + 4 <= safe; i += 4) {
+        const char *m0 = buf + b.offset[i], *m1 = buf + b.offset[i + 1];
+        const char *m2 = buf + b.offset[i + 2], *m3 = buf + b.offset[i + 3];
+        __m512i h = _mm512_shuffle_epi8(load4(m0, m1, m2, m3), headerMask);
+        __m512i body = _mm512_shuffle_epi8(
+            load4(m0 + MESSAGE_HEADER_LEN, m1 + MESSAGE_HEADER_LEN, m2 + MESSAGE_HEADER_LEN, m3 + MESSAGE_HEADER_LEN),
+            load4(bodyShuffle(m0[0]), bodyShuffle(m1[0]), bodyShuffle(m2[0]), bodyShuffle(m3[0])));
+        // Compress qword 0 (and dword 2) of every lane together, one store per column (the maskz forms are the
+        // same instructions, without GCC's undefined register warnings)
+        _mm256_storeu_si256((__m256i *) &b.timestamp[i], _mm512_maskz_extracti64x4_epi64(0xf, _mm512_maskz_compress_epi64(0x55, h), 0));
+        _mm256_storeu_si256((__m256i *) &b.orderRef[i], _mm512_maskz_extracti64x4_epi64(0xf, _mm512_maskz_compress_epi64(0x55, body), 0));
+        _mm_storeu_si128((__m128i *) &b.seq[i], _mm512_maskz_extracti32x4_epi32(0xf, _mm512_maskz_compress_epi32(0x4444, h), 0));
+        _mm_storeu_si128((__m128i *) &b.shares[i], _mm512_maskz_extracti32x4_epi32(0xf, _mm512_maskz_compress_epi32(0x4444, body), 0));
+        decodeTail(m0, b, i);
+        decodeTail(m1, b, i + 1);
+        decodeTail(m2, b, i + 2);
+        decodeTail(m3, b, i + 3);
+    }
+    for (; i < b.count; i++) decodeScalar(buf + b.offset[i], b, i);
+    return consumed;
+}
+
+} // namespace batch_detail
+
+// Decode buf into b, returns the bytes decoded. Less than len means the payload holds more than
+// MAX_BATCH_MESSAGES (call again from there) or an unknown type or truncated message was found at that point
+using BatchDecoder = size_t (*)(const char *buf, size_t len, MessageBatch &b);
+
+inline const char *batchIsaName(BatchIsa isa) {
+    switch (isa) {
+        case BatchIsa::Sse41: return "sse4.1";
+        case BatchIsa::Avx2: return "avx2";
+        case BatchIsa::Avx512: return "avx512bw";
+        default: return "scalar";
+    }
+}
+
+inline bool batchIsaSupported(BatchIsa isa) {
+    __builtin_cpu_init();
+    switch (isa) {
+        case BatchIsa::Sse41: return __builtin_cpu_supports("sse4.1");
+        case BatchIsa::Avx2: return __builtin_cpu_supports("avx2");
+        case BatchIsa::Avx512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        default: return true;
+    }
+}
+
+inline BatchDecoder batchDecoderFor(BatchIsa isa) {
+    switch (isa) {
+        case BatchIsa::Sse41: return batch_detail::decodeBatchSse41;
+        case BatchIsa::Avx2: return batch_detail::decodeBatchAvx2;
+        case BatchIsa::Avx512: return batch_detail::decodeBatchAvx512;
+        default: return batch_detail::decodeBatchScalar;
+    }
+}
+
+// Widest instruction set this CPU supports
+inline BatchIsa bestBatchIsa() {
+    for (BatchIsa isa : {BatchIsa::Avx512, BatchIsa::Avx2, BatchIsa::Sse41}) {
+        if (batchIsaSupported(isa)) return isa;
+    }
+    return BatchIsa::Scalar;
+}
+
+// Picked once at startup
+inline const BatchIsa batchIsa = bestBatchIsa();
+inline const BatchDecoder activeBatchDecoder = batchDecoderFor(batchIsa);
+
+inline size_t decodeBatch(const char *buf, size_t len, MessageBatch &b) {
+    return activeBatchDecoder(buf, len, b);
+}
@@ -0,0 +1,202 @@
+// Multi-channel feeds (--channels): exchanges split their symbols over many multicast groups and ports, each
+// channel a sequence stream of its own. The single ring loop receives every channel on the one ring and demuxes
+// each datagram to its channel by (group, port), through an open addressed table of CHANNEL_SLOTS keys (1 KB,
+// 16 cache lines that stay in L1 however many channels there are) instead of a compare per channel. Every
+// channel has its own sequencer, gap deadline and counters; channel 0 is the feed's first channel and uses
+// GlobalState::sequencer and gapDeadline, so gap recovery (--retransmit) and the stats page cover it as they do
+// a single channel feed. The books are shared, a symbol is only ever on one channel.
+#pragma once
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include "parse.h"
+#include "sequencer.h"
+#include "demux.h"
+#include "recovery.h"
+#include "stats_page.h"
+
+constexpr uint32_t MAX_CHANNELS = 64;
+constexpr size_t CHANNEL_SLOTS = 128; // a power of 2, at least twice MAX_CHANNELS so probes stay short
+constexpr uint32_t NO_CHANNEL = UINT32_MAX;
+constexpr uint32_t CHANNEL_REPORT_SECONDS = 10;
+
+// Counters of a channel, single writer (statsAdd) like the stats page: the receive loop, read by the reporter
+struct ChannelStats {
+    std::atomic<uint64_t>   packets{0};
+    std::atomic<uint64_t>   bytes{0};
+};
+
+struct Channel {
+    uint32_t        group;      // network byte order
+    uint16_t        port;       // network byte order
+    Sequencer       *sequencer;
+    GapDeadline     *gapDeadline;
+    ChannelStats    stats;
+};
+
+class ChannelTable {
+public:
+    // Add a channel, false (after printing why) if it is already there or the table is full
+    bool add(uint32_t group, uint16_t port) {
+        if (find(group, port) != NO_CHANNEL) {
+            fprintf(stderr, "Channel %s:%u is listed twice\n", inet_ntoa(in_addr{group}), ntohs(port));
+            return false;
+        }
+        if (m_count == MAX_CHANNELS) {
+            fprintf(stderr, "Too many channels, at most %u\n", MAX_CHANNELS);
+            return false;
+        }
+        Channel &c = m_channels[m_count];
+        c.group = group;
+        c.port = port;
+        if (m_count == 0) {
+            c.sequencer = &GlobalState::sequencer;
+            c.gapDeadline = &GlobalState::gapDeadline;
+        } else {
+            m_sequencers.push_back(std::make_unique<Sequencer>());
+            m_gapDeadlines.push_back(std::make_unique<GapDeadline>());
+            c.sequencer = m_sequencers.back().get();
+            c.gapDeadline = m_gapDeadlines.back().get();
+        }
+        uint64_t k = key(group, port);
+        size_t i = slot(k);
+        while (m_keys[i]) i = (i + 1) & (CHANNEL_SLOTS - 1);
+        m_keys[i] = k;
+        m_slotChannel[i] = m_count++;
+        return true;
+    }
+
+    // Add the channels of a comma separated list of group:port, or of a file (one per line) given as @path.
+    // Returns false (after printing why) if one can't be read or there are none
+    bool addAll(const char *spec) {
+        std::vector<std::string> entries;
+        if (spec[0] == '@') {
+            std::ifstream f(spec + 1);
+            if (!f) {
+                fprintf(stderr, "Failed to open channel file %s\n", spec + 1);
+                return false;
+            }
+            for (std::string line; std::getline(f, line);) entries.push_back(line);
+        } else {
+            std::string list = spec;
+            for (size_t start = 0, comma;; start = comma + 1) {
+                comma = list.find(',', start);
+                entries.push_back(list.substr(start, comma - start));
+                if (comma == std::string::npos) break;
+            }
+        }
+        size_t added = 0;
+        for (std::string &e : entries) {
+            size_t first = e.find_first_not_of(" \t\r"), last = e.find_last_not_of(" \t\r");
+            if (first == std::string::npos) continue;
+            e = e.substr(first, last - first + 1);
+            size_t colon = e.find(':');
+            in_addr group{};
+            int port = colon == std::string::npos ? 0 : atoi(e.c_str() + colon + 1);
+            if (colon == std::string::npos || inet_pton(AF_INET, e.substr(0, colon).c_str(), &group) != 1 || port <= 0 || port > 65535) {
+                fprintf(stderr, "Not a channel (group:port): %s\n", e.c_str());
+                return false;
+            }
+            if (!add(group.s_addr, htons(port))) return false;
+            added++;
+        }
+        if (!added) fprintf(stderr, "No channels in %s\n", spec);
+        return added != 0;
+    }
+
+    // Hot path. Channel of a destination group and port (network byte order), NO_CHANNEL if it isn't one of ours
+    uint32_t find(uint32_t group, uint16_t port) const {
+        uint64_t k = key(group, port);
+        for (size_t i = slot(k);; i = (i + 1) & (CHANNEL_SLOTS - 1)) {
+            if (m_keys[i] == k) return m_slotChannel[i];
+            if (m_keys[i] == 0) return NO_CHANNEL;
+        }
+    }
+
+    // Hot path. Decode a frame and return its UDP payload if it is for one of the channels, which is then the
+    // one the parse functions sequence against. nullptr (and nothing selected) otherwise
+    char *demux(char *buf, uint32_t capLen, ssize_t &payload_length) {
+        uint32_t daddr;
+        uint16_t dport;
+        char *payload = extractUdpDatagram(buf, capLen, daddr, dport, payload_length);
+        if (!payload) return nullptr;
+        uint32_t c = find(daddr, dport);
+        if (c == NO_CHANNEL) {
+            statsAdd(m_unknown);
+            return nullptr;
+        }
+        Channel &ch = m_channels[c];
+        statsAdd(ch.stats.packets);
+        statsAdd(ch.stats.bytes, payload_length);
+        GlobalState::current = ch.sequencer;
+        return payload;
+    }
+
+    // Whether any channel has a gap open
+    bool gapExists() const {
+        for (uint32_t c = 0; c < m_count; c++) {
+            if (m_channels[c].sequencer->gapExists()) return true;
+        }
+        return false;
+    }
+
+    // At a block boundary or idle poll: channel 0 through serviceGaps (recovery and the stats page), the
+    // deadlines of the others straight away
+    void serviceGaps(uint64_t nowNs) {
+        ::serviceGaps(nowNs);
+        for (uint32_t c = 1; c < m_count; c++) m_channels[c].gapDeadline->poll(*m_channels[c].sequencer, nowNs);
+    }
+
+    uint32_t count() const { return m_count; }
+    const Channel &at(uint32_t c) const { return m_channels[c]; }
+    // Datagrams for a group and port that isn't a channel
+    uint64_t unknown() const { return m_unknown.load(std::memory_order_relaxed); }
+
+private:
+    // Zero is never a key, group 0.0.0.0 isn't multicast
+    uint64_t        m_keys[CHANNEL_SLOTS] = {};
+    uint8_t         m_slotChannel[CHANNEL_SLOTS] = {};
+    uint32_t        m_count = 0;
+    std::atomic<uint64_t> m_unknown{0};
+    Channel         m_channels[MAX_CHANNELS];
+    std::vector<std::unique_ptr<Sequencer>>     m_sequencers;
+    std::vector<std::unique_ptr<GapDeadline>>   m_gapDeadlines;
+
+    static uint64_t key(uint32_t group, uint16_t port) { return (uint64_t) group << 16 | port; }
+    static size_t slot(uint64_t k) { return (k * 0x9E3779B97F4A7C15ULL) >> (64 - std::countr_zero(CHANNEL_SLOTS)); }
+};
+
+// Every channel's counters, one line each
+inline void printChannelStats(const ChannelTable &channels) {
+    for (uint32_t c = 0; c < channels.count(); c++) {
+        const Channel &ch = channels.at(c);
+        const SequencerStats &s = ch.sequencer->stats;
+        printf("[channel %u %s:%u] packets=%lu bytes=%lu parsed=%u lost=%u out_of_order=%u duplicates=%u gap_timeouts=%lu\n",
+               c, inet_ntoa(in_addr{ch.group}), ntohs(ch.port), ch.stats.packets.load(std::memory_order_relaxed),
+               ch.stats.bytes.load(std::memory_order_relaxed), s.parsedMessages, s.lostMessages, s.outOfOrderMessages,
+               s.duplicates, ch.gapDeadline->expirations);
+    }
+    printf("[channels] datagrams for other groups/ports=%lu\n", channels.unknown());
+}
+
+// Print every channel's counters every seconds from a thread of its own
+inline void startChannelReporter(const ChannelTable &channels, uint32_t seconds) {
+    std::thread([&channels, seconds] {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::seconds(seconds));
+            printChannelStats(channels);
+            fflush(stdout);
+        }
+    }).detach();
+}
+
+// Channels of the feed, the single ring loop's demux (--channels, otherwise only MULTICAST_IP:PORT)
+inline ChannelTable feedChannels;
@@ -0,0 +1,59 @@
+// Ethernet/IP/UDP demux shared by the live ring loop and the offline file ingest path
+#pragma once
+#include <cstdint>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+
+constexpr uint32_t ETH_HEADER_LEN = 14;
+constexpr uint32_t UDP_HEADER_LEN = 8;
+
+// Decode an Ethernet frame and return a pointer to its UDP payload if it is a complete IPv4 UDP datagram,
+// nullptr otherwise. The destination group and port (network byte order) are returned in daddr and dport so
+// the caller can tell which feed it belongs to. capLen is the number of bytes of the frame that were actually
+// captured (tp_snaplen on the ring, incl_len in a pcap), so a truncated frame is never read past its end.
+inline char* extractUdpDatagram(char *buf, uint32_t capLen, uint32_t &daddr, uint16_t &dport, ssize_t &payload_length) {
+    // We dont need to parse the dest MAC because its already encoded in the dest IP (01:00:5e:01:01:01 => 239.1.1.1)
+    // but the ethertype must be IPv4. The live socket is bound with ETH_P_IP so this only filters anything
+    // when reading a capture file, which can contain ARP, IPv6 etc.
+    if (capLen < ETH_HEADER_LEN + sizeof(iphdr) || ((ethhdr*) buf)->h_proto != htons(ETH_P_IP)) return nullptr;
+
+    // Skip the ethernet header (14 bytes) and go directly to the ip header
+    iphdr* ip_header = (iphdr*)(buf + ETH_HEADER_LEN);
+
+    // Filter by protocol (must be UDP i.e. 17)
+    if (ip_header->protocol != IPPROTO_UDP) return nullptr;
+    daddr = ip_header->daddr;
+
+    // We need the IP header length to determine the offset of the UDP header (IP header length is variable from 20-60 bytes)
+    // we cannot just conclude that there are no options and use 20 bytes, so we must find it through the header fields.
+    // The header length is determined by the internet header length (IHL) field (4 bit) which gives us its length in 32 bit words (4 bytes)
+    // so multiply this by 4 to get the length in bytes (using IPv6 would be much simpler here, as the header is a static 20 bytes)
+    uint32_t ip_header_length = ip_header->ihl * 4;
+    if (ETH_HEADER_LEN + ip_header_length + UDP_HEADER_LEN > capLen) return nullptr;
+
+    // Now get the UDP header for the dest port
+    udphdr* udp_header = (udphdr*)(buf + ETH_HEADER_LEN + ip_header_length);
+    dport = udp_header->dest;
+
+    // And determine the size using the IP header. The IP payload size is equal to the total length field (16 bit) - IHL (4 bit) * 4, which we already have.
+    // Then we can get the UDP payload size by taking away the UDP header from that value
+    payload_length = (ssize_t) ntohs(ip_header->tot_len) - ip_header_length - UDP_HEADER_LEN;
+    uint32_t payload_offset = ETH_HEADER_LEN + ip_header_length + UDP_HEADER_LEN;
+    if (payload_length < 0 || payload_offset + payload_length > capLen) return nullptr;
+
+    // FINALLY get a pointer to the UDP payload using basic pointer arithmetic
+    return buf + payload_offset;
+}
+
+// As extractUdpDatagram, but only returns the payload if it is addressed to the multicast group/port we are
+// listening on (mcast_ip and dest_port in network byte order)
+inline char* extractUdpPayload(char *buf, uint32_t capLen, uint32_t mcast_ip, uint16_t dest_port, ssize_t &payload_length) {
+    uint32_t daddr;
+    uint16_t dport;
+    char *payload = extractUdpDatagram(buf, capLen, daddr, dport, payload_length);
+    if (!payload || daddr != mcast_ip || dport != dest_port) return nullptr;
+    return payload;
+}
@@ -0,0 +1,166 @@
+// PACKET_FANOUT receive mode: N AF_PACKET sockets in one fanout group, each with its own TPACKET_V3 ring
+// and pinned RX worker. Workers only demux, publishing payload descriptors into their own SPSC hand-off
+// ring (the same RX stage as the pipelined mode). A single merge thread then k-way merges the per-worker
+// streams by sequence number back into one stream for parsePayload and the sequencer, and releases every
+// worker's blocks in order.
+//
+// Each worker's stream is in order on its own (the kernel hands a worker frames in arrival order), so the
+// head of each hand-off ring is that worker's lowest pending sequence number. The merger takes the lowest
+// head, but when it is not the next expected sequence number and another worker has nothing queued yet,
+// it waits up to MERGE_WAIT_SPINS for that worker to catch up rather than feeding the sequencer an
+// out-of-order payload that is only late by a few hundred nanoseconds.
+#pragma once
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <immintrin.h>
+#include "cpu.h"
+#include "ring.h"
+#include "pipeline.h"
+#include "parse.h"
+#include "sequencer.h"
+#include "recovery.h"
+#include "moldudp64.h"
+
+constexpr uint32_t MERGE_WAIT_SPINS = 512;
+
+// Merge side state for one worker stream, written only by the merge thread
+struct alignas(CACHE_LINE_SIZE) MergeStreamStats {
+    std::atomic<uint64_t>   merged{0};          // payloads taken from this worker
+    std::atomic<uint64_t>   highestSeq{0};      // highest first-sequence number taken from this worker
+};
+
+struct FanoutWorker {
+    RxRing              ring;
+    Pipeline            pipeline;   // hand-off ring + RX stage counters, parse stage counters written by the merger
+    MergeStreamStats    merge;
+    std::thread         thread;
+};
+
+struct alignas(CACHE_LINE_SIZE) MergeStats {
+    std::atomic<uint64_t>   inOrder{0};         // payloads whose first message was the next expected sequence number
+    std::atomic<uint64_t>   waits{0};           // merge decisions that had to wait for an empty worker
+    std::atomic<uint64_t>   waitTimeouts{0};    // waits that gave up and merged out of order
+};
+
+struct Fanout {
+    std::vector<std::unique_ptr<FanoutWorker>> workers;
+    MergeStats stats;
+};
+
+// Open n rings of the same geometry in the same fanout group (load balanced), returns false if any of them fail
+inline bool openFanout(const std::string &nic, uint32_t n, Fanout &fanout, const RingGeometry &geometry = RingGeometry{}) {
+    uint16_t groupId = getpid() & 0xffff;
+    for (uint32_t i = 0; i < n; i++) {
+        auto w = std::make_unique<FanoutWorker>();
+        if (!openRxRing(nic, w->ring, geometry) || !joinFanoutGroup(w->ring, groupId, PACKET_FANOUT_LB)) return false;
+        w->pipeline.ringStats.attach(statsPage.ring(i), w->ring);
+        fanout.workers.push_back(std::move(w));
+    }
+    return true;
+}
+
+// Start one pinned RX worker per ring on cores firstCpu, firstCpu + 1, ...
+inline void startFanoutWorkers(Fanout &fanout, int firstCpu, uint32_t mcast_ip, uint16_t dest_port) {
+    for (size_t i = 0; i < fanout.workers.size(); i++) {
+        FanoutWorker *w = fanout.workers[i].get();
+        int cpu = firstCpu + i;
+        w->thread = std::thread([w, cpu, mcast_ip, dest_port] {
+            pinToCpu(cpu);
+            raisePriority();
+            rxLoop(w->ring, w->pipeline, mcast_ip, dest_port);
+        });
+    }
+}
+
+// Merge stage, runs until keepRunning() returns false (checked once per merged payload or idle poll).
+// The merger owns the sequencer and polls the gap deadline at every block boundary of every worker, and
+// while idle with a gap open (TSC clock only).
+template<typename KeepRunning>
+inline void mergeLoop(Fanout &fanout, KeepRunning &&keepRunning, GapClock clock = GapClock::Tsc) {
+    size_t n = fanout.workers.size();
+    uint32_t waitSpins = 0;
+    while (keepRunning()) {
+        int best = -1;
+        uint32_t bestSeq = UINT32_MAX;
+        bool anyEmpty = false;
+        for (size_t i = 0; i < n; i++) {
+            FanoutWorker &w = *fanout.workers[i];
+            const PayloadDesc *head = w.pipeline.queue.peek();
+            // End of block markers carry no data, hand the block straight back to the kernel. Payloads too short
+            // to hold a sequence number can't be merged on one, they go straight to the parser (which rejects them)
+            while (head && !hasPayloadSequence(head->len)) {
+                if (head->len != 0) {
+                    PayloadDesc d{};
+                    w.pipeline.queue.tryPop(d);
+                    parsePayload(d.payload, d.len);
+                    bump(w.pipeline.parse.payloads);
+                    head = w.pipeline.queue.peek();
+                    continue;
+                }
+                tpacket_block_desc *block_ptr = w.ring.block(head->block);
+                uint64_t nowNs = blockTimeNs(clock, block_ptr);
+                release_block(block_ptr);
+                PayloadDesc done;
+                w.pipeline.queue.tryPop(done);
+                w.pipeline.parse.blocksReleased.store(w.pipeline.parse.blocksReleased.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                serviceGaps(nowNs);
+                head = w.pipeline.queue.peek();
+            }
+            if (!head) {
+                anyEmpty = true;
+                continue;
+            }
+            uint32_t seq = peekPayloadSequence(head->payload);
+            if (seq < bestSeq) {
+                bestSeq = seq;
+                best = i;
+            }
+        }
+
+        if (best < 0) {
+            if (clock == GapClock::Tsc && GlobalState::sequencer.gapExists()) serviceGaps(tscClock.nowNs());
+            _mm_pause();
+            continue;
+        }
+
+        bool inOrder = bestSeq == GlobalState::sequencer.nextExpected();
+        if (!inOrder && anyEmpty) {
+            if (waitSpins++ == 0) bump(fanout.stats.waits);
+            if (waitSpins < MERGE_WAIT_SPINS) {
+                _mm_pause();
+                continue;
+            }
+            bump(fanout.stats.waitTimeouts);
+        }
+        waitSpins = 0;
+        if (inOrder) bump(fanout.stats.inOrder);
+
+        FanoutWorker &w = *fanout.workers[best];
+        PayloadDesc d{};
+        w.pipeline.queue.tryPop(d);
+        latency.beginPacket(d.tsNs);
+        parsePayload(d.payload, d.len);
+        bump(w.pipeline.parse.payloads);
+        bump(w.merge.merged);
+        if (bestSeq > w.merge.highestSeq.load(std::memory_order_relaxed)) w.merge.highestSeq.store(bestSeq, std::memory_order_relaxed);
+    }
+}
+
+inline void printFanoutStats(const Fanout &fanout) {
+    for (size_t i = 0; i < fanout.workers.size(); i++) {
+        const FanoutWorker &w = *fanout.workers[i];
+        printf("[worker %zu] pkts=%lu payloads=%lu merged=%lu highest_seq=%lu queue=%zu max=%lu full_spins=%lu block_wait_spins=%lu\n", i,
+               w.pipeline.rx.packets.load(std::memory_order_relaxed), w.pipeline.rx.payloads.load(std::memory_order_relaxed),
+               w.merge.merged.load(std::memory_order_relaxed), w.merge.highestSeq.load(std::memory_order_relaxed),
+               w.pipeline.queue.size(), w.pipeline.rx.maxOccupancy.load(std::memory_order_relaxed),
+               w.pipeline.rx.ringFullSpins.load(std::memory_order_relaxed), w.pipeline.rx.blockWaitSpins.load(std::memory_order_relaxed));
+    }
+    printf("[merge] in_order=%lu waits=%lu wait_timeouts=%lu | parsed=%u out_of_order=%u duplicates=%u lost=%u gap_timeouts=%lu\n",
+           fanout.stats.inOrder.load(std::memory_order_relaxed), fanout.stats.waits.load(std::memory_order_relaxed),
+           fanout.stats.waitTimeouts.load(std::memory_order_relaxed), GlobalState::sequencer.stats.parsedMessages,
+           GlobalState::sequencer.stats.outOfOrderMessages, GlobalState::sequencer.stats.duplicates, GlobalState::sequencer.stats.lostMessages,
+           GlobalState::gapDeadline.expirations);
+}
@@ -0,0 +1,184 @@
+// Offline ingest mode: mmap a pcap capture or a raw ITCH message file (the itch_data.bin format used by the
+// replay server) and push it through the same demux and parseMessage path as the live ring loop, so throughput
+// can be measured deterministically without a NIC or a second machine running the replay server.
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parse.h"
+#include "demux.h"
+
+// pcap magic numbers (microsecond and nanosecond timestamp variants), as written by the capturing host
+constexpr uint32_t PCAP_MAGIC_US = 0xa1b2c3d4;
+constexpr uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+constexpr uint32_t LINKTYPE_ETHERNET = 1;
+
+// Max UDP payload used to pack raw ITCH messages, same as the replay server
+constexpr uint32_t MAX_UDP_PAYLOAD = 1472;
+
+struct PcapFileHeader {
+    uint32_t    magic;
+    uint16_t    versionMajor;
+    uint16_t    versionMinor;
+    int32_t     thisZone;
+    uint32_t    sigFigs;
+    uint32_t    snapLen;
+    uint32_t    linkType;
+};
+
+struct PcapRecordHeader {
+    uint32_t    tsSec;
+    uint32_t    tsFrac;     // microseconds or nanoseconds depending on the magic
+    uint32_t    inclLen;    // bytes captured
+    uint32_t    origLen;    // bytes on the wire
+};
+
+struct IngestStats {
+    uint64_t    frames = 0;     // frames (pcap) or packed payloads (raw) read from the file
+    uint64_t    payloads = 0;   // payloads handed to parseMessage
+    uint64_t    bytes = 0;      // payload bytes handed to parseMessage
+    long long   nanos = 0;      // time spent in the ingest loop
+};
+
+// Read only, private mapping of a whole file. MAP_POPULATE prefaults the page tables so the timed loop
+// measures parsing and not page faults.
+class MappedFile {
+public:
+    explicit MappedFile(const char *path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror("Failed to open input file");
+            return;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            if (p == MAP_FAILED) {
+                perror("Failed to mmap input file");
+            } else {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                m_data = static_cast<char*>(p);
+                m_size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() { if (m_data) munmap(m_data, m_size); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile& operator=(const MappedFile &) = delete;
+
+    bool ok() const { return m_data != nullptr; }
+    char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // A pcap starts with one of the pcap magic numbers in either byte order, anything else is treated as raw ITCH
+    bool isPcap() const {
+        if (m_size < sizeof(PcapFileHeader)) return false;
+        uint32_t magic;
+        std::memcpy(&magic, m_data, sizeof(magic));
+        return magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+               magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    }
+
+private:
+    char *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// Walk every record of an Ethernet pcap, demux it and call onPayload(payload, length, tsNs) for each UDP payload
+// addressed to mcast_ip:dest_port (network byte order), tsNs being the capture time of the frame in nanoseconds.
+// Returns false if the capture can't be read.
+template<typename PayloadHandler>
+bool ingestPcap(const MappedFile &file, uint32_t mcast_ip, uint16_t dest_port, IngestStats &stats, PayloadHandler &&onPayload) {
+    PcapFileHeader fileHeader;
+    std::memcpy(&fileHeader, file.data(), sizeof(fileHeader));
+    // A capture written on a host of the other endianness has every header field byte swapped
+    bool swapped = fileHeader.magic != PCAP_MAGIC_US && fileHeader.magic != PCAP_MAGIC_NS;
+    auto field = [swapped](uint32_t v) { return swapped ? __builtin_bswap32(v) : v; };
+    uint64_t fracToNs = field(fileHeader.magic) == PCAP_MAGIC_NS ? 1 : 1000;
+
+    if (field(fileHeader.linkType) != LINKTYPE_ETHERNET) {
+        fprintf(stderr, "Unsupported pcap link type %u (only Ethernet captures are supported)\n", field(fileHeader.linkType));
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t pos = sizeof(PcapFileHeader);
+    while (pos + sizeof(PcapRecordHeader) <= file.size()) {
+        PcapRecordHeader rec;
+        std::memcpy(&rec, file.data() + pos, sizeof(rec));
+        pos += sizeof(rec);
+        uint32_t capLen = field(rec.inclLen);
+        if (pos + capLen > file.size()) break; // truncated final record
+        char *frame = file.data() + pos;
+        pos += capLen;
+        __builtin_prefetch(file.data() + pos);
+        stats.frames++;
+
+        ssize_t payload_length;
+        char *payload = extractUdpPayload(frame, capLen, mcast_ip, dest_port, payload_length);
+        if (!payload) continue;
+        stats.payloads++;
+        stats.bytes += payload_length;
+        onPayload(payload, payload_length, field(rec.tsSec) * 1'000'000'000ULL + field(rec.tsFrac) * fracToNs);
+    }
+    stats.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// Raw ITCH files have no framing, so payloads are packed from consecutive messages exactly like the replay server
+// does: the end of the one starting at pos in the size bytes of data, after as many whole messages as fit in
+// MAX_UDP_PAYLOAD bytes, counted into msgs. It stops before a message of an unknown type (boundaries can't be
+// recovered after that) or one cut short by the end of the data, so it is pos if there is no message at pos
+inline size_t rawPayloadEnd(const char *data, size_t size, size_t pos, size_t &msgs) {
+    size_t start = pos;
+    while (pos < size) {
+        size_t msgSize = getMessageSize(data[pos]);
+        if (msgSize == 0 || pos - start + msgSize > MAX_UDP_PAYLOAD || pos + msgSize > size) break;
+        pos += msgSize;
+        msgs++;
+    }
+    return pos;
+}
+
+// Every payload (offset, length) of a raw ITCH file loaded up front, the messages in them counted into msgs.
+// For benchmarks that time parsing without the file I/O
+inline std::vector<std::pair<size_t, size_t>> packRawPayloads(const char *data, size_t size, size_t &msgs) {
+    std::vector<std::pair<size_t, size_t>> payloads;
+    size_t pos = 0, end;
+    while ((end = rawPayloadEnd(data, size, pos, msgs)) != pos) {
+        payloads.emplace_back(pos, end - pos);
+        pos = end;
+    }
+    return payloads;
+}
+
+// Call onPayload(payload, length, tsNs) for each payload of a raw ITCH file. There is no capture time, so tsNs
+// is the ITCH timestamp of the payload's first message.
+// Returns false if an unknown message type is found (message boundaries can't be recovered after that).
+template<typename PayloadHandler>
+bool ingestRaw(const MappedFile &file, IngestStats &stats, PayloadHandler &&onPayload) {
+    auto start = std::chrono::steady_clock::now();
+    size_t pos = 0, msgs = 0;
+    while (pos < file.size()) {
+        size_t end = rawPayloadEnd(file.data(), file.size(), pos, msgs);
+        if (end == pos) break;
+        stats.frames++;
+        stats.payloads++;
+        stats.bytes += end - pos;
+        onPayload(file.data() + pos, (ssize_t)(end - pos), peekTimestamp(file.data() + pos));
+        pos = end;
+    }
+    stats.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    bool ok = pos == file.size() || getMessageSize(file.data()[pos]) != 0;
+    if (!ok) fprintf(stderr, "Unknown ITCH message type 0x%02x at offset %zu, stopping\n", (unsigned char) file.data()[pos], pos);
+    return ok;
+}
@@ -0,0 +1,85 @@
+// Consumer API of the decode loop: a handler derives from FeedHandler<Handler> (CRTP) and defines the callbacks
+// it wants, each taking a view of the message (message_view.h, valid only for the duration of the call). The loop
+// is instantiated against the handler, so every callback is a direct call the compiler can inline, and the
+// callbacks a handler doesn't define are the empty defaults below, which compile away.
+//
+//  struct Printer: FeedHandler<Printer> {
+//      void onAddOrder(const TradeView &v) { printf("%lu\n", v.orderRefNumber()); }
+//  };
+//  Printer p;
+//  p.decode(payload, len);
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "itch.h"
+#include "message_view.h"
+
+template<typename Derived>
+class FeedHandler {
+public:
+    // Callbacks, hidden (not overridden) by the handler's own
+    void onAddOrder(const TradeView &) {}
+    void onTrade(const TradeView &) {}
+    void onExecute(const OrderExecutedView &) {}
+    void onExecuteWithPrice(const OrderExecutedWithPriceView &) {}
+    void onCancel(const OrderCancelView &) {}
+    void onSystemEvent(const SystemEventView &) {}
+    // Every other type in the layout tables
+    void onOtherMessage(const MessageView &) {}
+    // A type with no layout, and a message running past the end of its payload (available = bytes left)
+    void onUnknownMessage(const char *, size_t) {}
+    void onTruncatedMessage(const char *, size_t) {}
+
+    // Hand one message of a known type (its size already checked) to its callback
+    void dispatch(const char *msg) {
+        Derived &h = derived();
+        switch (msg[0]) {
+            case 'A': h.onAddOrder(TradeView(msg)); break;
+            case 'P': h.onTrade(TradeView(msg)); break;
+            case 'E': h.onExecute(OrderExecutedView(msg)); break;
+            case 'X': h.onExecuteWithPrice(OrderExecutedWithPriceView(msg)); break;
+            case 'C': h.onCancel(OrderCancelView(msg)); break;
+            case 'S': h.onSystemEvent(SystemEventView(msg)); break;
+            default: h.onOtherMessage(MessageView(msg)); break;
+        }
+    }
+
+    // Decode a bare run of messages (raw framing), returns the bytes decoded. Without the size of an unknown
+    // type there is no way to find the next message, so an unknown or truncated message ends the payload
+    size_t decode(const char *buf, size_t len) {
+        size_t pos = 0;
+        while (pos < len) {
+            size_t size = MESSAGE_SIZES[(uint8_t) buf[pos]];
+            if (size == 0) [[unlikely]] {
+                derived().onUnknownMessage(buf + pos, len - pos);
+                return pos;
+            }
+            if (pos + size > len) [[unlikely]] {
+                derived().onTruncatedMessage(buf + pos, len - pos);
+                return pos;
+            }
+            dispatch(buf + pos);
+            pos += size;
+        }
+        return pos;
+    }
+
+    // Decode one message whose length is already known (a MoldUDP64 message block), skipped if its type is
+    // unknown or it is shorter than its type
+    void decodeOne(const char *msg, size_t len) {
+        if (len == 0) [[unlikely]] return;
+        size_t size = MESSAGE_SIZES[(uint8_t) msg[0]];
+        if (size == 0) [[unlikely]] {
+            derived().onUnknownMessage(msg, len);
+            return;
+        }
+        if (len < size) [[unlikely]] {
+            derived().onTruncatedMessage(msg, len);
+            return;
+        }
+        dispatch(msg);
+    }
+
+private:
+    Derived &derived() { return static_cast<Derived &>(*this); }
+};
@@ -13,23 +13,26 @@
 #include <thread>
 #include <sched.h>
 #include "parse.h"
+#include "message_view.h"
 
-// Convert network to host order 64bit (equivalent of ntohll)
+// Convert network to host order 64bit (equivalent of ntohll), a single bswap on little endian hosts
 inline uint64_t ntohll(uint64_t &networkOrder) {
-    uint8_t *p = reinterpret_cast<uint8_t*>(&networkOrder);
-    uint64_t hostOrder = 0;
-    for(int i = 0; i < 8; i++)
-        hostOrder = hostOrder << 8 | p[i];
-    return hostOrder;
-    
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(networkOrder);
+#else
+    return networkOrder;
+#endif
 }
 
 inline uint64_t readTimestamp(const char* buf, size_t &offset) {
-    uint64_t tmp = 0;
-    // first 2 MSBs are empty (all 0), then store the timestamp value
-    std::memcpy(reinterpret_cast<char*>(&tmp) + 2, buf + offset, 6); // upper 6 bytes
+    // 6 bytes, read as a 2 byte and a 4 byte load (assembling them in a temporary and reading that back as
+    // 8 bytes would stall on store forwarding)
+    uint16_t hi;
+    uint32_t lo;
+    std::memcpy(&hi, buf + offset, 2);
+    std::memcpy(&lo, buf + offset + 2, 4);
     offset += 6;
-    return ntohll(tmp); // convert to host byte order
+    return (uint64_t) ntohs(hi) << 32 | ntohl(lo); // convert to host byte order
 }
 
 
@@ -49,17 +52,6 @@ inline uint32_t read4Bytes(const char* buf, size_t &offset) {
     return ntohl(tmp); // convert to host byte order
 } 
 
-// Same function from server side (itch message generator)
-inline void getDelta(uint64_t timestamp) {
-    using namespace std::chrono;
-    auto now = system_clock::now();
-    auto midnight = floor<days>(now);
-    auto since_midnight = now - midnight;
-    uint64_t nano = duration_cast<nanoseconds>(since_midnight).count();
-    uint64_t delta_ns = nano - timestamp;
-    //std::cout << " | " << delta_ns << " ns";
-}
-
 inline void nsToTimeStr(uint64_t ns_since_midnight, char *out) {
     // 1. Extract total seconds and remaining nanoseconds
     uint64_t total_sec = ns_since_midnight / 1'000'000'000ULL;
@@ -154,7 +146,10 @@ inline void releaseFrame(tpacket_hdr *hdr) {
     hdr->tp_status = TP_STATUS_KERNEL;
 }
 
-// Block equivalent of the above
+// Block equivalent of the above. Every message view into the block is invalid from here on
 inline void release_block(tpacket_block_desc *hdr) {
     hdr->hdr.bh1.block_status = TP_STATUS_KERNEL;
+#ifdef MDFH_CHECK_VIEWS
+    viewEpoch++;
+#endif
 }
@@ -0,0 +1,114 @@
+// 2 MB pages for the big hot tables. The order table alone is 24 MB, 6144 4 KB pages against a dTLB of a few
+// dozen entries (and an STLB of a couple of thousand), so order lookups, which land anywhere in it, mostly miss
+// the TLB and pay a page walk. On 2 MB pages it is 12 entries. HugePageAllocator maps its memory directly:
+// until hugePages.enable() (--resident) as plain lazily faulted 4 KB pages, after it from the hugetlbfs pool
+// (vm.nr_hugepages) if any pages are reserved there, otherwise 2 MB aligned with MADV_HUGEPAGE so transparent
+// hugepages can back it, and either way prefaulted so the first message doesn't pay for the page faults.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr size_t SMALL_PAGE_SIZE = 4096;
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+// What an allocation ended up on
+enum class PageBacking : uint8_t { Small, Transparent, HugeTlb };
+constexpr size_t PAGE_BACKINGS = 3;
+constexpr const char *PAGE_BACKING_NAMES[PAGE_BACKINGS] = {"4 KB pages", "transparent hugepages", "hugetlbfs pages"};
+
+// Write every 4 KB page of [p, p + bytes) back with what it holds, so each one is faulted in (writable, not
+// the shared zero page) without changing it. Only while nothing else is using the memory
+inline void prefault(void *p, size_t bytes) {
+    volatile char *c = (volatile char *) p;
+    for (size_t i = 0; i < bytes; i += SMALL_PAGE_SIZE) c[i] = c[i];
+    if (bytes) c[bytes - 1] = c[bytes - 1];
+}
+
+// Bytes of the mapping holding p the kernel currently backs with transparent hugepages (its AnonHugePages in
+// /proc/self/smaps), 0 if it can't tell
+inline size_t transparentHugeBytes(const void *p) {
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (!f) return 0;
+    char line[256];
+    bool inside = false;
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        uintptr_t start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            inside = start <= (uintptr_t) p && (uintptr_t) p < end;
+        } else if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb * 1024;
+}
+
+class HugePages {
+public:
+    // From now on allocations are placed on hugepages and prefaulted
+    void enable() { m_enabled = true; }
+    bool enabled() const { return m_enabled; }
+
+    static size_t roundUp(size_t bytes) { return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1); }
+
+    void *allocate(size_t bytes) {
+        size_t len = roundUp(bytes);
+        if (!m_enabled) {
+            void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) throw std::bad_alloc();
+            return p;
+        }
+        void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB | MAP_POPULATE, -1, 0);
+        if (p != MAP_FAILED) {
+            m_bytes[(size_t) PageBacking::HugeTlb] += len;
+            return p;
+        }
+        // No hugetlbfs pages to spare: map a 2 MB more than needed and keep the 2 MB aligned part, which
+        // transparent hugepages can back whole
+        void *raw = mmap(nullptr, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        uintptr_t start = ((uintptr_t) raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        if (start > (uintptr_t) raw) munmap(raw, start - (uintptr_t) raw);
+        munmap((void *) (start + len), (uintptr_t) raw + HUGE_PAGE_SIZE - start);
+        p = (void *) start;
+        madvise(p, len, MADV_HUGEPAGE);
+        prefault(p, len);
+        m_bytes[(size_t) (transparentHugeBytes(p) ? PageBacking::Transparent : PageBacking::Small)] += len;
+        return p;
+    }
+
+    void deallocate(void *p, size_t bytes) { munmap(p, roundUp(bytes)); }
+
+    // Bytes placed on each kind of page since enable()
+    size_t bytes(PageBacking backing) const { return m_bytes[(size_t) backing]; }
+
+private:
+    bool    m_enabled = false;
+    size_t  m_bytes[PAGE_BACKINGS] = {};
+};
+
+// Process wide, constant initialized so it is usable from the constructors of other globals
+inline constinit HugePages hugePages;
+
+// For the std containers of the big tables. Every allocation is its own mapping of whole 2 MB pages, so this
+// is only for a few large arrays allocated up front
+template<typename T>
+struct HugePageAllocator {
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template<typename U> HugePageAllocator(const HugePageAllocator<U> &) {}
+
+    T *allocate(size_t n) { return (T *) hugePages.allocate(n * sizeof(T)); }
+    void deallocate(T *p, size_t n) { hugePages.deallocate(p, n * sizeof(T)); }
+
+    template<typename U> bool operator==(const HugePageAllocator<U> &) const { return true; }
+};
@@ -0,0 +1,242 @@
+// Message layouts of the feed, described once and used for everything that needs to know them: message sizes
+// (what the dispatch switch in handler.h checks before handing a message on), the field offsets of the message
+// views, generic field decoding and the replay server's packing.
+//
+// Every message starts with the same 11 byte header: type (1), timestamp (6, nanoseconds since midnight) and a
+// 4 byte sequence number, which takes the place of ITCH 5.0's stock locate and tracking number. The body follows.
+// All ITCH 5.0 message types are described, with the spec's body so their size matches the spec. The exception
+// is the five types the feed generator publishes (A, P, E, X, C), which are described as it writes them: P has
+// no match number, E has no match number, X is an execution with price and C is a cancel.
+//
+// Only depends on the standard library, so it can be shared with the replay server.
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// How a field is encoded. Integers and prices are big endian, prices have 4 implied decimal places (8 for Price8)
+enum class FieldType : uint8_t {
+    Alpha,      // left justified, space padded ASCII
+    Integer,
+    Price4,
+    Price8,
+    Timestamp   // 6 byte nanoseconds since midnight
+};
+
+struct FieldLayout {
+    const char  *name;
+    uint8_t     offset;
+    uint8_t     width;
+    FieldType   type;
+};
+
+struct MessageLayout {
+    char                type;
+    const char          *name;
+    uint8_t             size;
+    uint8_t             fieldCount;
+    const FieldLayout   *fields;
+
+    // Field with this name, nullptr if there is none
+    constexpr const FieldLayout *field(std::string_view fieldName) const {
+        for (uint8_t i = 0; i < fieldCount; i++) {
+            if (fieldName == fields[i].name) return &fields[i];
+        }
+        return nullptr;
+    }
+};
+
+constexpr size_t MESSAGE_HEADER_LEN = 11;
+
+namespace itch_layout {
+
+struct FieldDef {
+    const char  *name;
+    uint8_t     width;
+    FieldType   type;
+};
+
+// Lay out the header followed by body, each field at the end of the one before it
+template<size_t N>
+struct Fields {
+    std::array<FieldLayout, N + 3> fields{};
+    uint8_t size = 0;
+
+    constexpr Fields(const FieldDef (&body)[N]) {
+        const FieldDef header[3] = {
+            {"messageType", 1, FieldType::Alpha},
+            {"timestamp", 6, FieldType::Timestamp},
+            {"sequenceNumber", 4, FieldType::Integer},
+        };
+        size_t i = 0;
+        for (const FieldDef &f : header) add(i++, f);
+        for (const FieldDef &f : body) add(i++, f);
+    }
+
+private:
+    constexpr void add(size_t i, const FieldDef &f) {
+        fields[i] = FieldLayout{f.name, size, f.width, f.type};
+        size += f.width;
+    }
+};
+
+constexpr FieldType A = FieldType::Alpha, I = FieldType::Integer, P4 = FieldType::Price4, P8 = FieldType::Price8;
+
+// System event
+inline constexpr Fields S({{"eventCode", 1, A}});
+// Stock directory
+inline constexpr Fields R({{"stock", 8, A}, {"marketCategory", 1, A}, {"financialStatus", 1, A}, {"roundLotSize", 4, I},
+    {"roundLotsOnly", 1, A}, {"issueClassification", 1, A}, {"issueSubType", 2, A}, {"authenticity", 1, A},
+    {"shortSaleThreshold", 1, A}, {"ipoFlag", 1, A}, {"luldReferencePriceTier", 1, A}, {"etpFlag", 1, A},
+    {"etpLeverageFactor", 4, I}, {"inverseIndicator", 1, A}});
+// Stock trading action
+inline constexpr Fields H({{"stock", 8, A}, {"tradingState", 1, A}, {"reserved", 1, A}, {"reason", 4, A}});
+// Reg SHO short sale price test restricted indicator
+inline constexpr Fields Y({{"stock", 8, A}, {"regShoAction", 1, A}});
+// Market participant position
+inline constexpr Fields L({{"mpid", 4, A}, {"stock", 8, A}, {"primaryMarketMaker", 1, A}, {"marketMakerMode", 1, A},
+    {"marketParticipantState", 1, A}});
+// MWCB decline level
+inline constexpr Fields V({{"level1", 8, P8}, {"level2", 8, P8}, {"level3", 8, P8}});
+// MWCB status
+inline constexpr Fields W({{"breachedLevel", 1, A}});
+// IPO quoting period update
+inline constexpr Fields K({{"stock", 8, A}, {"ipoQuotationReleaseTime", 4, I}, {"ipoQuotationReleaseQualifier", 1, A},
+    {"ipoPrice", 4, P4}});
+// LULD auction collar
+inline constexpr Fields J({{"stock", 8, A}, {"auctionCollarReferencePrice", 4, P4}, {"upperAuctionCollarPrice", 4, P4},
+    {"lowerAuctionCollarPrice", 4, P4}, {"auctionCollarExtension", 4, I}});
+// Operational halt
+inline constexpr Fields h({{"stock", 8, A}, {"marketCode", 1, A}, {"operationalHaltAction", 1, A}});
+// Add order (A) and trade (P) as the feed generator writes them
+inline constexpr Fields AP({{"orderRefNumber", 8, I}, {"buySellIndicator", 1, A}, {"shares", 4, I}, {"stock", 8, A},
+    {"price", 4, P4}});
+// Add order with MPID attribution
+inline constexpr Fields F({{"orderRefNumber", 8, I}, {"buySellIndicator", 1, A}, {"shares", 4, I}, {"stock", 8, A},
+    {"price", 4, P4}, {"attribution", 4, A}});
+// Order executed
+inline constexpr Fields E({{"orderRefNumber", 8, I}, {"executedShares", 4, I}});
+// Order executed with price
+inline constexpr Fields X({{"orderRefNumber", 8, I}, {"executedShares", 4, I}, {"printable", 1, A},
+    {"executedPrice", 4, P4}});
+// Order cancel
+inline constexpr Fields C({{"orderRefNumber", 8, I}, {"cancelledShares", 4, I}});
+// Order delete
+inline constexpr Fields D({{"orderRefNumber", 8, I}});
+// Order replace
+inline constexpr Fields U({{"originalOrderRefNumber", 8, I}, {"newOrderRefNumber", 8, I}, {"shares", 4, I},
+    {"price", 4, P4}});
+// Cross trade
+inline constexpr Fields Q({{"shares", 8, I}, {"stock", 8, A}, {"crossPrice", 4, P4}, {"matchNumber", 8, I},
+    {"crossType", 1, A}});
+// Broken trade
+inline constexpr Fields B({{"matchNumber", 8, I}});
+// Net order imbalance indicator
+inline constexpr Fields NOII({{"pairedShares", 8, I}, {"imbalanceShares", 8, I}, {"imbalanceDirection", 1, A},
+    {"stock", 8, A}, {"farPrice", 4, P4}, {"nearPrice", 4, P4}, {"currentReferencePrice", 4, P4}, {"crossType", 1, A},
+    {"priceVariationIndicator", 1, A}});
+// Retail price improvement indicator
+inline constexpr Fields N({{"stock", 8, A}, {"interestFlag", 1, A}});
+// Direct listing with capital raise price discovery
+inline constexpr Fields O({{"stock", 8, A}, {"openEligibilityStatus", 1, A}, {"minimumAllowablePrice", 4, P4},
+    {"maximumAllowablePrice", 4, P4}, {"nearExecutionPrice", 4, P4}, {"nearExecutionTime", 8, I},
+    {"lowerPriceRangeCollar", 4, P4}, {"upperPriceRangeCollar", 4, P4}});
+
+template<const auto &F>
+constexpr MessageLayout layout(char type, const char *name) {
+    return MessageLayout{type, name, F.size, (uint8_t) F.fields.size(), F.fields.data()};
+}
+
+} // namespace itch_layout
+
+// Every message type of the feed
+inline constexpr MessageLayout MESSAGE_LAYOUTS[] = {
+    itch_layout::layout<itch_layout::S>('S', "System Event"),
+    itch_layout::layout<itch_layout::R>('R', "Stock Directory"),
+    itch_layout::layout<itch_layout::H>('H', "Stock Trading Action"),
+    itch_layout::layout<itch_layout::Y>('Y', "Reg SHO Restriction"),
+    itch_layout::layout<itch_layout::L>('L', "Market Participant Position"),
+    itch_layout::layout<itch_layout::V>('V', "MWCB Decline Level"),
+    itch_layout::layout<itch_layout::W>('W', "MWCB Status"),
+    itch_layout::layout<itch_layout::K>('K', "IPO Quoting Period Update"),
+    itch_layout::layout<itch_layout::J>('J', "LULD Auction Collar"),
+    itch_layout::layout<itch_layout::h>('h', "Operational Halt"),
+    itch_layout::layout<itch_layout::AP>('A', "Add Order"),
+    itch_layout::layout<itch_layout::F>('F', "Add Order with MPID"),
+    itch_layout::layout<itch_layout::E>('E', "Order Executed"),
+    itch_layout::layout<itch_layout::X>('X', "Order Executed with Price"),
+    itch_layout::layout<itch_layout::C>('C', "Order Cancel"),
+    itch_layout::layout<itch_layout::D>('D', "Order Delete"),
+    itch_layout::layout<itch_layout::U>('U', "Order Replace"),
+    itch_layout::layout<itch_layout::AP>('P', "Trade"),
+    itch_layout::layout<itch_layout::Q>('Q', "Cross Trade"),
+    itch_layout::layout<itch_layout::B>('B', "Broken Trade"),
+    itch_layout::layout<itch_layout::NOII>('I', "Net Order Imbalance Indicator"),
+    itch_layout::layout<itch_layout::N>('N', "Retail Price Improvement Indicator"),
+    itch_layout::layout<itch_layout::O>('O', "Direct Listing with Capital Raise"),
+};
+
+// Layout index of every type byte, -1 for types the feed doesn't have
+inline constexpr std::array<int8_t, 256> LAYOUT_INDEX = [] {
+    std::array<int8_t, 256> index{};
+    index.fill(-1);
+    for (size_t i = 0; i < std::size(MESSAGE_LAYOUTS); i++) index[(uint8_t) MESSAGE_LAYOUTS[i].type] = i;
+    return index;
+}();
+
+// Size of every type byte, 0 for unknown types
+inline constexpr std::array<uint8_t, 256> MESSAGE_SIZES = [] {
+    std::array<uint8_t, 256> sizes{};
+    for (const MessageLayout &l : MESSAGE_LAYOUTS) sizes[(uint8_t) l.type] = l.size;
+    return sizes;
+}();
+
+// Offset of the stock field of every type byte, 0 for types without one (it is never in the header)
+inline constexpr std::array<uint8_t, 256> STOCK_OFFSETS = [] {
+    std::array<uint8_t, 256> offsets{};
+    for (const MessageLayout &l : MESSAGE_LAYOUTS) {
+        if (const FieldLayout *f = l.field("stock")) offsets[(uint8_t) l.type] = f->offset;
+    }
+    return offsets;
+}();
+
+// Size of the longest message type
+inline constexpr size_t MAX_MESSAGE_SIZE = [] {
+    size_t max = 0;
+    for (const MessageLayout &l : MESSAGE_LAYOUTS) max = l.size > max ? l.size : max;
+    return max;
+}();
+
+// Layout of a type byte, nullptr if the type is unknown
+constexpr const MessageLayout *layoutOf(char type) {
+    int8_t i = LAYOUT_INDEX[(uint8_t) type];
+    return i < 0 ? nullptr : &MESSAGE_LAYOUTS[i];
+}
+
+// Size of a message from its type byte, 0 if the type is unknown
+constexpr size_t messageSize(char type) {
+    return MESSAGE_SIZES[(uint8_t) type];
+}
+
+// Offset of a field, for decoding at a fixed position. Fails to compile (in a constant expression) if the
+// type or field doesn't exist
+constexpr size_t fieldOffset(char type, std::string_view name) {
+    const MessageLayout *l = layoutOf(type);
+    if (!l || !l->field(name)) throw "no such message field";
+    return l->field(name)->offset;
+}
+
+// Decode an integer, price or timestamp field (big endian, any width up to 8)
+inline uint64_t readField(const char *msg, const FieldLayout &f) {
+    uint64_t v = 0;
+    for (uint8_t i = 0; i < f.width; i++) v = v << 8 | (uint8_t) msg[f.offset + i];
+    return v;
+}
+
+// The header and the layouts of the types the handler decodes by hand must agree with the parsers in parse.cpp
+static_assert(fieldOffset('A', "timestamp") == 1 && fieldOffset('A', "sequenceNumber") == 7 &&
+              fieldOffset('A', "orderRefNumber") == MESSAGE_HEADER_LEN);
+static_assert(messageSize('A') == 36 && messageSize('P') == 36 && messageSize('E') == 23 &&
+              messageSize('X') == 28 && messageSize('S') == 12 && messageSize('C') == 23);
+static_assert(messageSize('R') == 39 && messageSize('I') == 50 && messageSize('O') == 48 && messageSize('F') == 40);
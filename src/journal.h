@@ -0,0 +1,399 @@
+// Capture journal: every accepted feed payload is appended, with its kernel receive time, to a preallocated
+// memory mapped file, so whatever the handler received can be replayed after an incident.
+//
+// The receive loop only copies the payload into the mapping and bumps its write position: no syscalls and
+// (normally) no page faults. A writer thread does everything else off the hot path: it prefaults the pages just
+// ahead of the write position, starts writeback of the ones behind it (sync_file_range), and prepares the next
+// segment before the current one fills up, so rotation on the hot path is a pointer swap. Full segments are
+// handed back to the writer to be trimmed to their used size and closed. If the next segment isn't ready in
+// time the payload is dropped and counted rather than waited for.
+//
+// Segment file (<prefix>.NNNN): a JournalFileHeader, a sparse index of (sequence number, record offset) with
+// an entry every JOURNAL_INDEX_INTERVAL bytes of data, then the records, each a JournalRecord and its payload
+// padded to 8 bytes. Records are only ever appended and the file is zero filled, so a record of length 0 ends
+// the data even if the handler died before closing the segment (empty payloads are never recorded, there is
+// nothing in them to replay).
+// The index and JournalReader::seek assume sequence numbers rise through the file: out of order payloads are
+// still recorded, and found by reading on from the seek position.
+#pragma once
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cpu.h"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+constexpr uint64_t JOURNAL_MAGIC = 0x4c4e524a4846444d; // "MDFHJRNL"
+constexpr uint32_t JOURNAL_VERSION = 1;
+constexpr size_t JOURNAL_PAGE_SIZE = 4096;
+constexpr size_t JOURNAL_DEFAULT_SIZE = 1ULL << 30;     // preallocated size of each segment
+constexpr size_t JOURNAL_INDEX_INTERVAL = 16 * 1024;    // data bytes between sparse index entries
+constexpr size_t JOURNAL_PREFAULT_AHEAD = 8 << 20;      // mapped ahead of the write position by the writer
+constexpr size_t JOURNAL_WRITEBACK_CHUNK = 4 << 20;     // data written back per sync_file_range
+constexpr long JOURNAL_WRITER_SLEEP_NS = 1'000'000;
+// A segment that can't be created (disk full, permissions) is retried after 1, 2, 4 ... writer sleeps, up to
+// this many (about a second)
+constexpr uint32_t JOURNAL_RETRY_MAX_SLEEPS = 1024;
+
+struct JournalFileHeader {
+    uint64_t    magic;
+    uint32_t    version;
+    uint32_t    segment;        // segment number, consecutive from 0
+    uint64_t    fileSize;       // preallocated size
+    uint64_t    dataOffset;     // first record
+    uint64_t    dataEnd;        // end of the last record, 0 until the segment is closed
+    uint32_t    indexCapacity;
+    uint32_t    indexCount;
+};
+
+struct JournalIndexEntry {
+    uint32_t    sequenceNumber; // first sequence number of the record at offset
+    uint32_t    reserved;
+    uint64_t    offset;
+};
+
+struct JournalRecord {
+    uint64_t    tsNs;           // kernel receive time (CLOCK_REALTIME nanoseconds)
+    uint32_t    sequenceNumber; // sequence number of the first message in the payload
+    uint16_t    len;            // payload bytes that follow, 0 = end of data
+    uint16_t    reserved;
+};
+
+constexpr size_t journalRecordSize(size_t len) {
+    return (sizeof(JournalRecord) + len + 7) & ~(size_t) 7;
+}
+
+struct JournalStats {
+    uint64_t    payloads = 0;
+    uint64_t    bytes = 0;
+    uint64_t    dropped = 0;    // payloads not recorded because the next segment wasn't ready
+    uint64_t    segments = 0;   // segments started
+    uint64_t    segmentFailures = 0;    // attempts by the writer to prepare the next segment that failed
+};
+
+// One mapped segment file
+struct JournalSegment {
+    int                 fd = -1;
+    char                *base = nullptr;
+    size_t              size = 0;
+    size_t              used = 0;       // end of the data, set by the hot path when it hands the segment back
+    JournalFileHeader   *header = nullptr;
+    JournalIndexEntry   *index = nullptr;
+    std::string         path;
+};
+
+class Journal {
+public:
+    ~Journal() { close(); }
+
+    // Create the first segment and start the writer thread pinned to cpu (-1 = not pinned), returns false (after
+    // printing why) on failure
+    bool open(const std::string &prefix, size_t segmentSize = JOURNAL_DEFAULT_SIZE, int cpu = -1) {
+        m_prefix = prefix;
+        m_segmentSize = std::max(segmentSize, (size_t) 16 * JOURNAL_PAGE_SIZE);
+        m_current = createSegment(0);
+        if (!m_current) return false;
+        startSegment(m_current);
+        m_nextNumber = 1;
+        m_running.store(true, std::memory_order_release);
+        m_writer = std::thread([this, cpu] {
+            if (cpu >= 0) pinToCpu(cpu);
+            writerLoop();
+        });
+        return true;
+    }
+
+    bool enabled() const { return m_current != nullptr; }
+
+    // Hot path. Append a payload received at tsNs, false if it had to be dropped. An empty one is skipped, its
+    // record would read as the end of the data
+    bool append(const char *payload, uint16_t len, uint64_t tsNs, uint32_t sequenceNumber) {
+        if (len == 0) [[unlikely]] return true;
+        size_t total = journalRecordSize(len);
+        if (m_pos + total > m_current->size) [[unlikely]] {
+            if (!rotate() || m_pos + total > m_current->size) {
+                m_stats.dropped++;
+                return false;
+            }
+        }
+        char *rec = m_current->base + m_pos;
+        std::memcpy(rec + sizeof(JournalRecord), payload, len);
+        // The length goes in last: a reader that finds it set finds the whole payload
+        JournalRecord h{tsNs, sequenceNumber, len, 0};
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(rec, &h, sizeof(h));
+
+        JournalFileHeader *hdr = m_current->header;
+        if (hdr->indexCount < hdr->indexCapacity &&
+            (hdr->indexCount == 0 || (m_pos - m_lastIndexed >= JOURNAL_INDEX_INTERVAL && sequenceNumber > m_lastIndexedSeq))) {
+            m_current->index[hdr->indexCount] = JournalIndexEntry{sequenceNumber, 0, m_pos};
+            hdr->indexCount++;
+            m_lastIndexed = m_pos;
+            m_lastIndexedSeq = sequenceNumber;
+        }
+        m_pos += total;
+        m_published.store(m_pos, std::memory_order_release);
+        m_stats.payloads++;
+        m_stats.bytes += len;
+        return true;
+    }
+
+    // Stop the writer and close every segment, trimmed to its data
+    void close() {
+        if (!m_current) return;
+        m_running.store(false, std::memory_order_release);
+        if (m_writer.joinable()) m_writer.join();
+        if (JournalSegment *s = m_retired.exchange(nullptr)) finishSegment(s);
+        // A prepared segment that never got a record is removed again
+        if (JournalSegment *s = m_next.exchange(nullptr)) {
+            unlink(s->path.c_str());
+            s->used = s->header->dataOffset;
+            finishSegment(s);
+        }
+        m_current->used = m_pos;
+        finishSegment(m_current);
+        m_current = nullptr;
+    }
+
+    JournalStats stats() const {
+        JournalStats s = m_stats;
+        s.segmentFailures = m_segmentFailures.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::string     m_prefix;
+    size_t          m_segmentSize = JOURNAL_DEFAULT_SIZE;
+    // Hot path state, only touched by the receive thread
+    JournalSegment  *m_current = nullptr;
+    size_t          m_pos = 0;
+    size_t          m_lastIndexed = 0;
+    uint32_t        m_lastIndexedSeq = 0;
+    JournalStats    m_stats;
+    // Hand-off between the receive thread and the writer
+    std::atomic<JournalSegment*>    m_next{nullptr};        // prepared by the writer, taken on rotation
+    std::atomic<JournalSegment*>    m_retired{nullptr};     // full segment handed back to the writer
+    std::atomic<JournalSegment*>    m_active{nullptr};      // segment m_published refers to
+    std::atomic<uint64_t>           m_published{0};         // write position in the active segment
+    std::atomic<bool>               m_running{false};
+    std::atomic<uint64_t>           m_segmentFailures{0};   // the writer's, read by stats()
+    std::thread     m_writer;
+    uint32_t        m_nextNumber = 0;
+
+    void startSegment(JournalSegment *s) {
+        m_pos = s->header->dataOffset;
+        m_lastIndexed = 0;
+        m_lastIndexedSeq = 0;
+        m_published.store(m_pos, std::memory_order_relaxed);
+        m_active.store(s, std::memory_order_release);
+        m_stats.segments++;
+    }
+
+    // Swap in the segment the writer prepared. The new segment is made active before the full one is handed
+    // back (the writer unmaps it), and handed back before the slot of the next is cleared, so the writer (which
+    // only prepares a segment while both slots are empty) never sees both empty mid swap
+    bool rotate() {
+        JournalSegment *next = m_next.load(std::memory_order_acquire);
+        if (!next) return false;
+        JournalSegment *full = m_current;
+        full->used = m_pos;
+        m_current = next;
+        startSegment(next);
+        m_retired.store(full, std::memory_order_release);
+        m_next.store(nullptr, std::memory_order_release);
+        return true;
+    }
+
+    // Says why on failure if report is set
+    JournalSegment *createSegment(uint32_t number, bool report = true) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%04u", number);
+        auto *s = new JournalSegment;
+        s->path = m_prefix + suffix;
+        s->size = m_segmentSize;
+        s->fd = ::open(s->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (s->fd < 0) {
+            if (report) perror("Failed to create journal segment");
+            delete s;
+            return nullptr;
+        }
+        // Allocate the blocks up front so appends never extend the file, fall back to a sparse file
+        if (posix_fallocate(s->fd, 0, s->size) != 0 && ftruncate(s->fd, s->size) != 0) {
+            if (report) perror("Failed to size journal segment");
+            ::close(s->fd);
+            delete s;
+            return nullptr;
+        }
+        void *p = mmap(nullptr, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+        if (p == MAP_FAILED) {
+            if (report) perror("Failed to mmap journal segment");
+            ::close(s->fd);
+            delete s;
+            return nullptr;
+        }
+        s->base = static_cast<char*>(p);
+        s->header = reinterpret_cast<JournalFileHeader*>(s->base);
+        s->index = reinterpret_cast<JournalIndexEntry*>(s->base + sizeof(JournalFileHeader));
+        uint32_t capacity = s->size / JOURNAL_INDEX_INTERVAL + 1;
+        size_t dataOffset = (sizeof(JournalFileHeader) + capacity * sizeof(JournalIndexEntry) + JOURNAL_PAGE_SIZE - 1) & ~(JOURNAL_PAGE_SIZE - 1);
+        *s->header = JournalFileHeader{JOURNAL_MAGIC, JOURNAL_VERSION, number, s->size, dataOffset, 0, capacity, 0};
+        prefault(s, 0, dataOffset + JOURNAL_PREFAULT_AHEAD);
+        return s;
+    }
+
+    // Map [from, to) writable now rather than on the hot path's first write to each page
+    static void prefault(JournalSegment *s, size_t from, size_t to) {
+        from &= ~(JOURNAL_PAGE_SIZE - 1);
+        to = std::min(to, s->size);
+        if (from >= to) return;
+        if (madvise(s->base + from, to - from, MADV_POPULATE_WRITE) != 0) {
+            // Kernels before 5.14: a read at least brings the page cache pages in
+            for (size_t off = from; off < to; off += JOURNAL_PAGE_SIZE) (void) *(volatile char *) (s->base + off);
+        }
+    }
+
+    // Record where the data ends, trim the preallocation to it and close the file
+    static void finishSegment(JournalSegment *s) {
+        s->header->dataEnd = s->used;
+        munmap(s->base, s->size);
+        if (ftruncate(s->fd, s->used) != 0) perror("Failed to trim journal segment");
+        ::close(s->fd);
+        delete s;
+    }
+
+    void writerLoop() {
+        JournalSegment *active = nullptr;
+        size_t prefaulted = 0, writtenBack = 0;
+        // Backoff while the next segment keeps failing: only the first failure is reported
+        uint64_t failures = 0;
+        uint32_t retryIn = 0, backoff = 1;
+        while (m_running.load(std::memory_order_acquire)) {
+            if (JournalSegment *s = m_retired.exchange(nullptr, std::memory_order_acquire)) finishSegment(s);
+            if (!m_next.load(std::memory_order_acquire) && !m_retired.load(std::memory_order_acquire) && (retryIn == 0 || --retryIn == 0)) {
+                if (JournalSegment *s = createSegment(m_nextNumber, failures == 0)) {
+                    if (failures) fprintf(stderr, "Journal segment %s created after %lu failed attempts\n", s->path.c_str(), failures);
+                    failures = 0;
+                    retryIn = 0;
+                    backoff = 1;
+                    m_nextNumber++;
+                    m_next.store(s, std::memory_order_release);
+                } else {
+                    failures++;
+                    m_segmentFailures.fetch_add(1, std::memory_order_relaxed);
+                    retryIn = backoff;
+                    backoff = std::min(backoff * 2, JOURNAL_RETRY_MAX_SLEEPS);
+                }
+            }
+
+            JournalSegment *s = m_active.load(std::memory_order_acquire);
+            size_t pos = m_published.load(std::memory_order_acquire);
+            if (s != active) {
+                active = s;
+                prefaulted = writtenBack = s->header->dataOffset;
+            }
+            // A position read across a rotation may belong to the previous segment, only ever move forward
+            if (pos > prefaulted - std::min(prefaulted, JOURNAL_PREFAULT_AHEAD / 2)) {
+                size_t to = std::min(pos + JOURNAL_PREFAULT_AHEAD, s->size);
+                prefault(s, prefaulted, to);
+                prefaulted = std::max(prefaulted, to);
+            }
+            size_t flushTo = std::min(pos, s->size) & ~(JOURNAL_PAGE_SIZE - 1);
+            if (flushTo >= writtenBack + JOURNAL_WRITEBACK_CHUNK) {
+                sync_file_range(s->fd, writtenBack, flushTo - writtenBack, SYNC_FILE_RANGE_WRITE);
+                writtenBack = flushTo;
+            }
+
+            timespec idle{0, JOURNAL_WRITER_SLEEP_NS};
+            nanosleep(&idle, nullptr);
+        }
+    }
+};
+
+// The capture journal of the receive loop, enabled with --journal
+inline Journal feedJournal;
+
+// Read back one journal segment: seek by sequence number through the sparse index, then read records in order
+class JournalReader {
+public:
+    explicit JournalReader(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            perror("Failed to open journal segment");
+            return;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(JournalFileHeader)) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                m_base = static_cast<const char*>(p);
+                m_size = st.st_size;
+            }
+        }
+        ::close(fd);
+        if (!m_base) return;
+        if (header().magic != JOURNAL_MAGIC || header().version != JOURNAL_VERSION || header().dataOffset > m_size) {
+            fprintf(stderr, "Not a journal segment: %s\n", path);
+            munmap((void *) m_base, m_size);
+            m_base = nullptr;
+            return;
+        }
+        m_end = header().dataEnd ? std::min<size_t>(header().dataEnd, m_size) : m_size;
+        m_pos = header().dataOffset;
+    }
+    ~JournalReader() { if (m_base) munmap((void *) m_base, m_size); }
+
+    JournalReader(const JournalReader &) = delete;
+    JournalReader& operator=(const JournalReader &) = delete;
+
+    bool ok() const { return m_base != nullptr; }
+    const JournalFileHeader &header() const { return *reinterpret_cast<const JournalFileHeader*>(m_base); }
+
+    // Position at the record holding sequenceNumber: the last record starting at or before it. Binary search
+    // of the index, then at most one index interval of records. False if the segment starts after it
+    bool seek(uint32_t sequenceNumber) {
+        const JournalIndexEntry *index = reinterpret_cast<const JournalIndexEntry*>(m_base + sizeof(JournalFileHeader));
+        const JournalIndexEntry *end = index + header().indexCount;
+        const JournalIndexEntry *it = std::upper_bound(index, end, sequenceNumber,
+            [](uint32_t seq, const JournalIndexEntry &e) { return seq < e.sequenceNumber; });
+        if (it == index) return false;
+        size_t pos = (it - 1)->offset, found = pos;
+        for (const JournalRecord *r; (r = recordAt(pos)) && r->sequenceNumber <= sequenceNumber; pos += journalRecordSize(r->len)) {
+            found = pos;
+        }
+        m_pos = found;
+        return true;
+    }
+
+    // The record at the read position, nullptr at the end of the data; advances past it
+    const JournalRecord *next(const char *&payload) {
+        const JournalRecord *r = recordAt(m_pos);
+        if (!r) return nullptr;
+        payload = reinterpret_cast<const char*>(r) + sizeof(JournalRecord);
+        m_pos += journalRecordSize(r->len);
+        return r;
+    }
+
+private:
+    const char  *m_base = nullptr;
+    size_t      m_size = 0;
+    size_t      m_end = 0;
+    size_t      m_pos = 0;
+
+    const JournalRecord *recordAt(size_t pos) const {
+        if (pos + sizeof(JournalRecord) > m_end) return nullptr;
+        const JournalRecord *r = reinterpret_cast<const JournalRecord*>(m_base + pos);
+        if (r->len == 0 || pos + journalRecordSize(r->len) > m_end) return nullptr;
+        return r;
+    }
+};
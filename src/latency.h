@@ -0,0 +1,256 @@
+// Per stage latency of the receive path, from the kernel's receive timestamp to the book update. The receive
+// loop stamps each packet with its kernel receive time (tpacket3_hdr) and the TSC when it takes the packet off
+// the ring, and the handler stamps each message of it with the TSC once it is decoded, once the sequencer has
+// decided on it and once the books, top of book and shared memory feed are done with it. Every stage goes
+// into a histogram of its own, and so does the exchange's timestamp against the kernel receive time.
+//
+// Timing costs three rdtsc per message, so only 1 in LatencyRecorder::sampling() packets is timed (the exchange
+// to receive histogram is only a subtraction and covers every message). The TSC is mapped to CLOCK_REALTIME, the
+// clock the kernel stamps packets with, through an anchor refreshed every LATENCY_REANCHOR_NS so TSC rate error
+// and NTP slew never add up to more than a few nanoseconds.
+//
+// Histograms are log-linear (HDR style): exact below 64 ns, then 32 buckets for every power of two, so any value
+// is within 1/32 of the one reported, and everything up to 2^40 ns fits in 9 KB. Counts are single writer
+// relaxed atomics (like the pipeline stats), so another thread can summarize them while the loop keeps running.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <time.h>
+#include <x86intrin.h>
+#include "clock.h"
+
+constexpr uint32_t LATENCY_SUB_BITS = 5;                                  // 32 buckets per power of two
+constexpr uint64_t LATENCY_LINEAR = 2ULL << LATENCY_SUB_BITS;             // values below are counted exactly
+constexpr uint32_t LATENCY_MAX_BITS = 40;                                 // ~18 minutes, larger values are clamped
+constexpr size_t LATENCY_BUCKETS = LATENCY_LINEAR + (LATENCY_MAX_BITS - LATENCY_SUB_BITS - 1) * (1ULL << LATENCY_SUB_BITS);
+constexpr uint64_t LATENCY_REANCHOR_NS = 100'000;
+constexpr uint32_t LATENCY_DEFAULT_SAMPLING = 64;
+constexpr uint64_t NS_PER_DAY = 86'400'000'000'000ULL;
+
+// Percentiles of a histogram, each the highest value of the bucket it falls in
+struct LatencySummary {
+    uint64_t    count = 0;
+    uint64_t    negative = 0;   // samples below zero (clock skew), counted as 0
+    double      mean = 0;
+    uint64_t    p50 = 0, p90 = 0, p99 = 0, p999 = 0, p9999 = 0, max = 0;
+};
+
+class LatencyHistogram {
+public:
+    static size_t bucketOf(uint64_t ns) {
+        if (ns < LATENCY_LINEAR) return ns;
+        if (ns >> LATENCY_MAX_BITS) ns = (1ULL << LATENCY_MAX_BITS) - 1;
+        uint32_t shift = std::bit_width(ns) - (LATENCY_SUB_BITS + 1);
+        return LATENCY_LINEAR + (shift - 1) * (1ULL << LATENCY_SUB_BITS) + ((ns >> shift) - (1ULL << LATENCY_SUB_BITS));
+    }
+
+    // Lowest and highest value counted in a bucket
+    static uint64_t bucketLow(size_t bucket) {
+        if (bucket < LATENCY_LINEAR) return bucket;
+        size_t k = bucket - LATENCY_LINEAR;
+        uint32_t shift = k / (1ULL << LATENCY_SUB_BITS) + 1;
+        return (k % (1ULL << LATENCY_SUB_BITS) + (1ULL << LATENCY_SUB_BITS)) << shift;
+    }
+
+    static uint64_t bucketHigh(size_t bucket) {
+        return bucket + 1 < LATENCY_BUCKETS ? bucketLow(bucket + 1) - 1 : (1ULL << LATENCY_MAX_BITS) - 1;
+    }
+
+    // Writer side, one thread only
+    void record(uint64_t ns) {
+        add(m_counts[bucketOf(ns)], 1);
+        add(m_sum, ns);
+        if (ns > m_max.load(std::memory_order_relaxed)) m_max.store(ns, std::memory_order_relaxed);
+    }
+
+    // A difference of two clocks, which skew can put below zero
+    void recordSigned(int64_t ns) {
+        if (ns < 0) {
+            add(m_negative, 1);
+            ns = 0;
+        }
+        record(ns);
+    }
+
+    // Any thread. The buckets are read one at a time while the writer carries on, so the result is consistent
+    // to within the samples recorded during the call
+    LatencySummary summary() const {
+        LatencySummary s;
+        static thread_local uint64_t counts[LATENCY_BUCKETS];
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+            counts[b] = m_counts[b].load(std::memory_order_relaxed);
+            s.count += counts[b];
+        }
+        if (s.count == 0) return s;
+        s.negative = m_negative.load(std::memory_order_relaxed);
+        s.mean = (double) m_sum.load(std::memory_order_relaxed) / s.count;
+        s.max = m_max.load(std::memory_order_relaxed);
+        const double quantiles[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+        uint64_t *values[] = {&s.p50, &s.p90, &s.p99, &s.p999, &s.p9999};
+        uint64_t seen = 0;
+        size_t q = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS && q < 5; b++) {
+            seen += counts[b];
+            while (q < 5 && seen >= quantiles[q] * s.count && seen) *values[q++] = std::min(bucketHigh(b), s.max);
+        }
+        return s;
+    }
+
+    // Not safe against a concurrent writer, between runs only
+    void reset() {
+        for (auto &c : m_counts) c.store(0, std::memory_order_relaxed);
+        m_sum.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+        m_negative.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t>   m_counts[LATENCY_BUCKETS]{};
+    std::atomic<uint64_t>   m_sum{0};
+    std::atomic<uint64_t>   m_max{0};
+    std::atomic<uint64_t>   m_negative{0};
+
+    // Single writer increment, a plain load and store
+    static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+enum LatencyStage: uint32_t {
+    LAT_RX_TO_DEQUEUE,      // kernel receive to the loop taking the packet off the ring (or the hand-off ring)
+    LAT_PARSE,              // dequeue, or the end of the previous message of the packet, to the message decoded
+    LAT_SEQUENCE,           // the sequencer's decision (near zero with MoldUDP64, sequenced a packet at a time)
+    LAT_CALLBACK,           // books, top of book and shared memory feed
+    LAT_RX_TO_HANDLED,      // kernel receive to the message fully handled
+    LAT_EXCHANGE_TO_RX,     // exchange timestamp to kernel receive, every message
+    LATENCY_STAGES
+};
+
+inline constexpr const char *LATENCY_STAGE_NAMES[LATENCY_STAGES] = {
+    "kernel rx -> dequeue", "dequeue -> parsed", "sequence", "callback", "kernel rx -> handled", "exchange -> kernel rx"
+};
+
+class LatencyRecorder {
+public:
+    LatencyRecorder() { reanchor(); }
+
+    // Time 1 in every n packets, n a power of 2, 0 turns timing off (the exchange histogram too)
+    void setSampling(uint32_t n) {
+        m_sampling = n;
+        m_mask = n ? n - 1 : 0;
+        m_packets = 0;
+    }
+
+    uint32_t sampling() const { return m_sampling; }
+
+    // Receive loop, a packet was taken off the ring. kernelNs is its receive time from tpacket3_hdr, 0 when
+    // there is none (files, whose timestamps aren't this host's clock)
+    void beginPacket(uint64_t kernelNs) {
+        m_kernelNs = m_sampling ? kernelNs : 0;
+        m_timing = m_sampling && (m_packets++ & m_mask) == 0;
+        if (!m_timing) return;
+        m_last = __rdtsc();
+        if (m_kernelNs) m_stages[LAT_RX_TO_DEQUEUE].recordSigned(realtimeNs(m_last) - (int64_t) m_kernelNs);
+    }
+
+    // Handler, the message is decoded
+    void parsed() { if (m_timing) lap(LAT_PARSE); }
+    // Handler, the sequencer has accepted or dropped it
+    void sequenced() { if (m_timing) lap(LAT_SEQUENCE); }
+
+    // Handler, everything is done with the message. exchangeNs is its timestamp, nanoseconds since midnight
+    void handled(uint64_t exchangeNs) {
+        if (m_kernelNs) {
+            // Since midnight UTC, like the replay server's timestamps. Around midnight the two can be a day apart
+            int64_t delta = (int64_t) (m_kernelNs % NS_PER_DAY) - (int64_t) exchangeNs;
+            if (delta < -(int64_t) NS_PER_DAY / 2) delta += NS_PER_DAY;
+            m_stages[LAT_EXCHANGE_TO_RX].recordSigned(delta);
+        }
+        if (!m_timing) return;
+        lap(LAT_CALLBACK);
+        if (m_kernelNs) m_stages[LAT_RX_TO_HANDLED].recordSigned(realtimeNs(m_last) - (int64_t) m_kernelNs);
+    }
+
+    const LatencyHistogram &stage(LatencyStage s) const { return m_stages[s]; }
+    uint64_t packets() const { return m_packets; }
+
+    void reset() {
+        for (LatencyHistogram &h : m_stages) h.reset();
+        m_packets = 0;
+    }
+
+    // CLOCK_REALTIME at a TSC reading, from the anchor (refreshed when it is LATENCY_REANCHOR_NS old)
+    int64_t realtimeNs(uint64_t tsc) {
+        int64_t ticks = (int64_t) (tsc - m_anchorTsc);
+        if (ticks > m_reanchorTicks) {
+            reanchor();
+            ticks = (int64_t) (tsc - m_anchorTsc);
+        }
+        int64_t ns = (int64_t) tscClock.ticksToNs(ticks < 0 ? -ticks : ticks);
+        return m_anchorNs + (ticks < 0 ? -ns : ns);
+    }
+
+private:
+    LatencyHistogram    m_stages[LATENCY_STAGES];
+    uint32_t            m_sampling = LATENCY_DEFAULT_SAMPLING;
+    uint32_t            m_mask = 0;
+    uint64_t            m_packets = 0;
+    bool                m_timing = false;
+    uint64_t            m_kernelNs = 0;
+    uint64_t            m_last = 0;         // TSC at the end of the last stage
+    uint64_t            m_anchorTsc = 0;
+    int64_t             m_anchorNs = 0;
+    int64_t             m_reanchorTicks = 0;
+
+    void lap(LatencyStage s) {
+        uint64_t now = __rdtsc();
+        m_stages[s].record(tscClock.ticksToNs(now - m_last));
+        m_last = now;
+    }
+
+    // Pair the TSC with CLOCK_REALTIME, the TSC taken halfway through the clock_gettime call
+    void reanchor() {
+        timespec ts;
+        uint64_t before = __rdtsc();
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t after = __rdtsc();
+        m_anchorTsc = before + (after - before) / 2;
+        m_anchorNs = (int64_t) ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+        if (!m_reanchorTicks) {
+            // ticksToNs is linear, scale it up from a large count of ticks to keep the precision
+            constexpr uint64_t PROBE = 1ULL << 32;
+            m_reanchorTicks = (int64_t) ((unsigned __int128) LATENCY_REANCHOR_NS * PROBE / tscClock.ticksToNs(PROBE));
+        }
+    }
+};
+
+// Every stage with samples, one line each
+inline void printLatencyStats(const LatencyRecorder &rec) {
+    for (uint32_t s = 0; s < LATENCY_STAGES; s++) {
+        LatencySummary l = rec.stage((LatencyStage) s).summary();
+        if (!l.count) continue;
+        printf("[latency] %-22s n=%lu mean=%.0f p50=%lu p90=%lu p99=%lu p99.9=%lu p99.99=%lu max=%lu ns", LATENCY_STAGE_NAMES[s],
+               l.count, l.mean, l.p50, l.p90, l.p99, l.p999, l.p9999, l.max);
+        if (l.negative) printf(" (%lu below zero)", l.negative);
+        printf("\n");
+    }
+}
+
+// Print the histograms every `seconds` from a thread of its own (--latency-report), the loop never stops for it
+inline void startLatencyReporter(const LatencyRecorder &rec, uint32_t seconds) {
+    std::thread([&rec, seconds] {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::seconds(seconds));
+            printLatencyStats(rec);
+            fflush(stdout);
+        }
+    }).detach();
+}
+
+// Process wide recorder, written by the thread running the sequencer
+inline LatencyRecorder latency;
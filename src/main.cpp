@@ -14,214 +14,260 @@
 #include <poll.h>
 #include "parse.h"
 #include "sequencer.h"
+#include "orderbook.h"
+#include "demux.h"
+#include "file_ingest.h"
+#include "options.h"
+#include "ring.h"
+#include "pipeline.h"
+#include "fanout.h"
+#include "arbitration.h"
+#include "moldudp64.h"
+#include "clock.h"
+#include "journal.h"
+#include "shm_feed.h"
+#include "top_of_book.h"
+#include "symbols.h"
+#include "latency.h"
+#include "stats_page.h"
+#include "residency.h"
+#include "channels.h"
+#include "rx_loop.h"
 #define MULTICAST_IP "239.1.1.1"
 #define PORT 30001
+#define MULTICAST_IP_B "239.1.1.2"
+#define PORT_B 30002
+#define RETRANSMIT_PORT 30003
 #define LOG(x) std::cout << x << std::endl
 #define LOGREAD(x) std::cout << "READ " << x << " BYTES\n"
 
-// PACKET_MMAP RING BUFFER CONSTS
-constexpr unsigned int BLOCK_SIZE = 524288;
-constexpr unsigned int FRAME_SIZE = 2048;
-constexpr unsigned int BLOCK_NR = 64;
-constexpr unsigned int FRAME_NR = (BLOCK_NR * BLOCK_SIZE) / FRAME_SIZE;
-
-int main() {
-    // 0. Pin to quiet core
-    pinToCpu(3);
-    // 1. Get the interface name used for the multicast IP
-    std::string nic = "enxc8a362d92729";
-    if (nic.empty()) {
-        std::cerr << "Failed to determine interface for muticast IP: " << MULTICAST_IP << std::endl;
+// Offline mode: replay a pcap or raw ITCH file from memory through the same demux/parse path as the ring loop
+int runOffline(const Options &opts) {
+    MappedFile file(opts.pcapPath ? opts.pcapPath : opts.rawPath);
+    if (!file.ok()) return 1;
+    if (opts.pcapPath && !file.isPcap()) {
+        std::cerr << "Not a pcap file: " << opts.pcapPath << std::endl;
         return 1;
     }
 
-    std::cout << "Found interface: " << nic << std::endl;
+    pinToCpu(opts.rxCpu);
+    // The file is read far faster than real time, so the gap timeout runs on a virtual clock driven by the
+    // file's own timestamps (capture times for a pcap, ITCH timestamps for raw files). Gaps then expire
+    // exactly as they would have at the original pace, however fast the replay runs.
+    VirtualClock clock;
+    // Raw files are packed into bare runs of messages, whatever the live feed framing is
+    if (opts.rawPath) feedFraming = Framing::Raw;
+    auto onPayload = [&clock](char *payload, ssize_t payload_length, uint64_t tsNs) {
+        capturePayload(payload, payload_length, tsNs);
+        // File timestamps aren't this host's receive times, only the stages from dequeue on are measured
+        latency.beginPacket(0);
+        parsePayload(payload, payload_length);
+        clock.advanceTo(tsNs);
+        checkGapTimeout(clock.nowNs());
+        statsPage.publishSequencer();
+    };
+    // The file has no blocks, steady state is from the first payload
+    FaultWatch faults;
+    if (opts.resident) faults.arm();
+    IngestStats stats;
+    bool ok = opts.pcapPath
+        ? ingestPcap(file, inet_addr(MULTICAST_IP), htons(PORT), stats, onPayload)
+        : ingestRaw(file, stats, onPayload);
 
-    // 2. Get the interface index
-    uint32_t index = if_nametoindex(nic.c_str());
-    if (index == 0) {
-        std::cerr << "Failed to find index for interface: " << nic << std::endl;
-        return 1;
-    }
+    faults.update();
+    // Any gap still open at the end of the file is counted as lost
+    GlobalState::sequencer.flushGaps();
+    // Write out the rest of the log before the results
+    FeedLogger::stop();
+    JournalStats journalStats = feedJournal.stats();
+    feedJournal.close();
+    ShmConsumerStatus consumers[SHM_FEED_MAX_CONSUMERS];
+    size_t consumerCount = feedPublisher.consumers(consumers);
 
-    // 3. Create a UDP socket for receiving a byte stream (raw frames at L2)
-    // We will process this ourselves and completely bypass kernel network stack
-    // to avoid the rt_offload_failed issue
-    int sockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
-    if (sockfd < 0) {
-        perror("Failed to initialize a socket.\n");
-        return 1;
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Frames read: %lu\n", stats.frames);
+    printf("Payloads parsed: %lu (%lu bytes)\n", stats.payloads, stats.bytes);
+    printf("Messages parsed: %u\n", GlobalState::sequencer.stats.parsedMessages);
+    printf("Messages lost: %u\n", GlobalState::sequencer.stats.lostMessages);
+    printf("Messages received out of order: %u\n", GlobalState::sequencer.stats.outOfOrderMessages);
+    printf("Messages recieved as duplicates: %u\n", GlobalState::sequencer.stats.duplicates);
+    printf("Gap timeouts: %lu\n", GlobalState::gapDeadline.expirations);
+    printf("Time taken: %lld\n", stats.nanos);
+    if (GlobalState::sequencer.stats.parsedMessages) printf("Time taken per message: %lld\n", stats.nanos / GlobalState::sequencer.stats.parsedMessages);
+    printf("Throughput: %f messages/sec\n", GlobalState::sequencer.stats.parsedMessages / (stats.nanos / 1e9));
+    if (opts.journal) {
+        printf("Journal payloads recorded: %lu (%lu bytes), dropped: %lu, segments: %lu, failed segment attempts: %lu\n",
+               journalStats.payloads, journalStats.bytes, journalStats.dropped, journalStats.segments, journalStats.segmentFailures);
     }
-
-    // 4. PACKET_MMAP RING BUFFER SETUP (TPACKET_V3)
-    // First enable TPACKET_V3 by setting the version as a socket option at the SOL_PACKET layer
-    int v = TPACKET_V3;
-    setsockopt(sockfd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v));
-
-    // 5. Create a socket option to tell the kernel to write the frames from the bound NIC
-    // (happens below) to the new PACKET_RX_RING (similar to TPACKET_V1 except we need to set some block parameters)
-    tpacket_req3 req{};
-    req.tp_frame_size = FRAME_SIZE;
-    req.tp_frame_nr = FRAME_NR;
-    req.tp_block_size = BLOCK_SIZE;
-    req.tp_block_nr = BLOCK_NR;
-    req.tp_retire_blk_tov = 0;
-    req.tp_sizeof_priv = 0;
-    if (setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
-        perror("Failed to create RX ring buffer on socket\n");
-        return 1;
+    if (opts.publish) {
+        printf("Events published: %lu, consumers: %zu\n", feedPublisher.published(), consumerCount);
+        for (size_t i = 0; i < consumerCount; i++) {
+            printf("  consumer %d: behind by %lu events%s, lapped %lu times, %lu events missed\n", consumers[i].pid,
+                   consumers[i].lag, consumers[i].lapped ? " (lapped)" : "", consumers[i].laps, consumers[i].missed);
+        }
     }
+    feedPublisher.close();
+    if (opts.topOfBook) printf("Top of book changes: %lu\n", topOfBook.changes());
+    if (opts.subscribe) printf("Order messages for unsubscribed symbols: %lu\n", orderBooks.unsubscribed);
+    if (opts.resident) printf("Page faults while parsing: %lu minor, %lu major\n", faults.minorFaults(), faults.majorFaults());
+    topOfBook.close();
+    statsPage.close();
+    printLatencyStats(latency);
+    if (FeedLogger::enabled) printf("Log records written: %lu, dropped: %lu\n", asyncLog.written(), asyncLog.dropped());
+    return ok ? 0 : 1;
+}
 
-    // 6. Memory map the shared buffer into the MDFH process address space
-     unsigned int mmap_len = BLOCK_SIZE * BLOCK_NR;
-    void *ringPtr = mmap(
-        nullptr,                    // Let the kernel choose any suitable VA in MDFH address space
-        mmap_len,                   // Length of memory to map (exact size of the buffer)
-        PROT_READ | PROT_WRITE,     // MDFH will read and write (altering the frames tp_status to TP_STATUS_KERNEL from TP_STATUS_USER)
-        MAP_SHARED,                 // Indicates memory is shared between kernel and user space
-        sockfd,                     // Pass in the shared buffer via the socket descriptor for the raw socket
-        0                           // Use offset = 0 because we want to start from the beginning of the buffer
-    );
-
-    if (ringPtr == MAP_FAILED) {
-        perror("Failed (mmap()) to create shared ring buffer between user space and kernel\n");
-        return 1;
+// Pipelined mode: RX and parsing on separate cores with an SPSC hand-off, the main thread only reports stats
+void runPipelined(RxRing &ring, const Options &opts, uint32_t mcast_ip, uint16_t dest_port) {
+    Pipeline *pipeline = new Pipeline{};
+    pipeline->ringStats.attach(statsPage.ring(0), ring);
+    std::thread rxThread([&] {
+        pinToCpu(opts.rxCpu);
+        raisePriority();
+        rxLoop(ring, *pipeline, mcast_ip, dest_port);
+    });
+    std::thread parseThread([&] {
+        pinToCpu(opts.parseCpu);
+        raisePriority();
+        parseLoop(ring, *pipeline, opts.gapClock);
+    });
+
+    // Sample the per stage counters once a second without touching the hot threads. Neither loop returns, this
+    // runs until the process is killed (the kernel releases the ring with it)
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        printPipelineStats(*pipeline, ring.blockNr);
+        if (gapRecovery.enabled()) printRecoveryStats(gapRecovery);
     }
+}
 
-    // 7. Because we are working at L2, bind refers to the interface on which
-    // we want to receive the L2 frames. This requires the use a of sockaddr_ll structure
-    // as opposed to sockaddr_in used at L4
-    sockaddr_ll socket_link_layer{};
-    socket_link_layer.sll_family = AF_PACKET; // AF_PACKET tells the OS to use this socket for Ethernet frames, similar to AF_INET being for IPv4
-    socket_link_layer.sll_protocol = htons(ETH_P_IP); // Filtering is applied to deliver only IPv4 encapsulated ethernet frames
-    socket_link_layer.sll_ifindex = index; // Set the previously found interface index
-    
-    if (bind(sockfd, (sockaddr *)&socket_link_layer, sizeof(socket_link_layer)) < 0) {
-        perror("Failed to bind socket to found NIC\n");
-        return 1;
+// Fanout mode: N rings in a PACKET_FANOUT group, one pinned RX worker per ring, merged by sequence number
+// on the parse core. The main thread only reports stats.
+int runFanout(const Options &opts, uint32_t mcast_ip, uint16_t dest_port) {
+    Fanout fanout;
+    if (!openFanout(opts.nic, opts.fanout, fanout, opts.ring)) return 1;
+    std::cout << "LISTENING FOR FRAMES ON " << opts.nic << " WITH " << opts.fanout << " FANOUT RINGS" << std::endl;
+
+    startFanoutWorkers(fanout, opts.fanoutCpu, mcast_ip, dest_port);
+    std::thread mergeThread([&] {
+        pinToCpu(opts.parseCpu);
+        raisePriority();
+        mergeLoop(fanout, [] { return true; }, opts.gapClock);
+    });
+
+    // Runs until the process is killed, like the workers and the merge (the kernel releases the rings with it)
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        printFanoutStats(fanout);
+        if (gapRecovery.enabled()) printRecoveryStats(gapRecovery);
     }
+}
 
+// A/B mode: both lines of the feed, on one ring or a ring per line, arbitrated through the shared sequencer
+int runArbitrated(const Options &opts, uint32_t mcast_ip, uint16_t dest_port) {
+    FeedLine lines[AB_LINES] = {{mcast_ip, dest_port}, {inet_addr(MULTICAST_IP_B), htons(PORT_B)}};
+    RxRing rings[AB_LINES];
+    uint32_t ringCount = opts.nicB.empty() ? 1 : 2;
+    int rc = 0;
+    if (!openRxRing(opts.nic, rings[0], opts.ring) || (ringCount > 1 && !openRxRing(opts.nicB, rings[1], opts.ring))) {
+        rc = 1;
+    } else {
+        std::cout << "LISTENING FOR LINES A AND B ON " << opts.nic;
+        if (ringCount > 1) std::cout << " AND " << opts.nicB;
+        std::cout << std::endl;
+        arbitrationLoop(rings, ringCount, lines, opts.gapClock);
+    }
+    for (RxRing &ring : rings) closeRxRing(ring);
+    return rc;
+}
 
-    std::cout << "LISTENING FOR FRAMES ON " << nic << std::endl;
+int main(int argc, char **argv) {
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) return 1;
+    feedFraming = opts.framing;
+    if (opts.subscribe) {
+        if (!feedSubscriptions.subscribeAll(opts.subscribe)) return 1;
+        orderBooks.subscribedOnly = true;
+        printf("Subscribed to %zu symbols\n", feedSubscriptions.count());
+    }
+    // Hot state on hugepages, prefaulted and locked before anything is received
+    if (opts.resident) residency.enable();
+    // Parsed messages are formatted and written by a thread of their own, off the receive cores
+    FeedLogger::start(STDOUT_FILENO, opts.logCpu);
+    if (opts.journal && !feedJournal.open(opts.journal, (size_t) opts.journalSizeMb << 20, opts.journalCpu)) return 1;
+    // Strategy processes on this host read the decoded feed from shared memory (ShmFeedReader in shm_feed.h)
+    if (opts.publish && !feedPublisher.open(opts.publish, opts.publishEvents)) return 1;
+    // and the latest top of book of every symbol from another (TopOfBookReader in top_of_book.h)
+    if (opts.topOfBook && !topOfBook.open(opts.topOfBook)) return 1;
+    // Counters of every stage and ring for mdfh-stat to sample live (StatsPageReader in stats_page.h)
+    if (opts.stats && !statsPage.open(opts.stats, opts.ringCount())) return 1;
+    latency.setSampling(opts.latencySample);
+    if (opts.offline()) return runOffline(opts);
+    // Histograms are summarized from a thread of their own while the receive loop runs on
+    if (opts.latencyReport) startLatencyReporter(latency, opts.latencyReport);
 
-    // 7. Start timer thread for packet sequencer (for detecting losses when gaps opened in stream
-    // due to out-of-order messages)
-    GlobalState::timerIsRunning.store(true, std::memory_order_relaxed);
-    std::thread gapTimerThread(gapTimer);
+    // 0. Pin to quiet core
+    pinToCpu(opts.rxCpu);
+    // 1. Get the interface name used for the multicast IP
+    std::string nic = opts.nic;
+    if (nic.empty()) {
+        std::cerr << "Failed to determine interface for muticast IP: " << MULTICAST_IP << std::endl;
+        return 1;
+    }
 
-    // 8. Loop over the shared ring buffer in modulo pattern so we continuously iterate
-     // Ensure the frame index is always within the frame count of the shared ring buffer
+    std::cout << "Found interface: " << nic << std::endl;
     uint32_t mcast_ip = inet_addr(MULTICAST_IP);
     uint16_t dest_port = htons(PORT);
 
-    // Create poll object so process doesnt busy wait, let kernel wake process when block ready
-    pollfd pfd{};
-    pfd.fd = sockfd;
-    pfd.events = POLLIN;
-    for(uint32_t block_idx = 0; ;block_idx = (block_idx + 1) % BLOCK_NR)
-    {
-        // Get the TPACKET_V3 block pointer 
-        tpacket_block_desc *block_ptr = (tpacket_block_desc *)((uint8_t *)ringPtr + (block_idx * BLOCK_SIZE));
-        // If the kernel has not yet readied this block, simply check the next block by continuing the loop
-        if (!(block_ptr->hdr.bh1.block_status & TP_STATUS_USER)) {
-            poll(&pfd, 1, -1);
-             if (!(block_ptr->hdr.bh1.block_status & TP_STATUS_USER)) continue;
-        }
-        
-        // Use the block metadata to get a pointer to the first TPACKET_V3 packet in the block
-        uint32_t num_pkts = block_ptr->hdr.bh1.num_pkts;
-        uint32_t offset_to_first_pkt = block_ptr->hdr.bh1.offset_to_first_pkt;
-
-        // Using simple pointer arithmetic, add the offset of the first packet to the block pointer to obtains
-        // the pointer to the first packet
-        tpacket3_hdr* current_packet = (tpacket3_hdr *)((uint8_t *)block_ptr + offset_to_first_pkt);
-
-        for(uint32_t block_idx = 0; ;block_idx = (block_idx + 1) % BLOCK_NR)
-    {
-        // Get the TPACKET_V3 block pointer 
-        tpacket_block_desc *block_ptr = (tpacket_block_desc *)((uint8_t *)ringPtr + (block_idx * BLOCK_SIZE));
-        // If the kernel has not yet readied this block, simply check the next block by continuing the loop
-        if (!(block_ptr->hdr.bh1.block_status & TP_STATUS_USER)) {
-            continue;
-        }
-        
-        // Use the block metadata to get a pointer to the first TPACKET_V3 packet in the block
-        uint32_t num_pkts = block_ptr->hdr.bh1.num_pkts;
-        uint32_t offset_to_first_pkt = block_ptr->hdr.bh1.offset_to_first_pkt;
-
-        // Using simple pointer arithmetic, add the offset of the first packet to the block pointer to obtains
-        // the pointer to the first packet
-        tpacket3_hdr* current_packet = (tpacket3_hdr *)((uint8_t *)block_ptr + offset_to_first_pkt);
-
-        // Iterate through every packet in the block
-        for (uint32_t i = 0; i < num_pkts; i++) {
-            // The tpacket3_hdr struct has extended fields compared to V1, one of which is the next tp_next_offset,
-            // which gives the offset of the next packet. We can use this to prefetch the next packet and load it into 
-            // the L1 cache so it is ready for processing immediately after this one, so no cycles are wasted. 
-            __builtin_prefetch((uint8_t*) current_packet + current_packet->tp_next_offset);
-
-            // ---------------------------------------------------------------------------------
-            // NOW WE PROCESS THE PACKET JUST AS WITH TPACKETV1
-            // ON A FAIL CONDITION, WE MOVE TO THE NEXT PACKET AND INCREMENT THE COUNTER
-            // ---------------------------------------------------------------------------------
-             // Get the ethernet frame from the TPACKET frame
-            // Add the offset of the ethernet header to the frame_header to get a pointer to the ethernet header
-            char *buf = (char *)current_packet + current_packet->tp_mac;
-
-            // Now buf contains the read ethernet frame, we must decode it and obtain the UDP payload
-            // We dont need to parse the dest MAC because its already encoded in the dest IP (01:00:5e:01:01:01 => 239.1.1.1)
-            // So we can skip the ethernet header (14 bytes) and go directly to the ip header
-            iphdr* ip_header = (iphdr*)(buf + 14);
-
-            // Now we can filter by the dest IP addr (should be 239.1.1.1)
-            // Compare the binary network byte order of the dest addr in the IP packet and the known multicast IP
-            uint32_t dest_ip_addr = ip_header->daddr;
-            if (dest_ip_addr != mcast_ip) {
-                current_packet = (tpacket3_hdr *)((uint8_t*) current_packet + current_packet->tp_next_offset);
-                continue; 
-            }
-            // We need the IP header length to determine the offset of the UDP header (IP header length is variable from 20-60 bytes)
-            // we cannot just conclude that there are no options and use 20 bytes, so we must find it through the header fields.
-            // The header length is determined by the internet header length (IHL) field (4 bit) which gives us its length in 32 bit words (4 bytes)
-            // so multiply this by 4 to get the length in bytes (using IPv6 would be much simpler here, as the header is a static 20 bytes)
-            int ip_header_length = ip_header->ihl * 4;
-
-            // Filter by protocol (must be UDP i.e. 17)
-            if (ip_header->protocol != 17) {
-                current_packet = (tpacket3_hdr *)((uint8_t*) current_packet + current_packet->tp_next_offset);
-                continue;
-            }
-
-            // Now get the UDP header and filter by the 30001 port
-            udphdr* udp_header = (udphdr*)(buf + 14 + ip_header_length);
-            int udp_port = udp_header->dest;
-            if (udp_port != dest_port) {
-                current_packet = (tpacket3_hdr *)((uint8_t*) current_packet + current_packet->tp_next_offset); 
-                continue; 
-            }
-
-            // FINALLY get a pointer to the UDP payload using basic pointer arithmetoc
-            char *payload = buf + 14 + ip_header_length + 8;
-
-            // And determine the size using the IP header. The IP payload size is equal to the total length field (16 bit) - IHL (4 bit) * 4, which we already have.
-            // Then we can get the UDP payload size by taking away the UDP header from that value
-            ssize_t payload_length = ntohs(ip_header->tot_len) - ip_header_length - 8;
-            parseMessage(payload, payload_length);
-
-            // Check if timeout occured
-            if (GlobalState::gapTimeout.exchange(false, std::memory_order_acq_rel)) {
-                handleGapTimeout();
-            }
-            current_packet = (tpacket3_hdr *)((uint8_t*) current_packet + current_packet->tp_next_offset);
-        }
+    // 2. Gaps opened in the stream by out-of-order messages are timed out inline by the thread running the
+    // sequencer (serviceGaps at block boundaries), so no core is spent on a timer thread. With a retransmit
+    // server, missing messages are requested from it before the deadline gives up on them
+    if (opts.retransmit) {
+        std::string addr = opts.retransmit;
+        size_t colon = addr.find(':');
+        uint16_t port = colon == std::string::npos ? RETRANSMIT_PORT : atoi(addr.c_str() + colon + 1);
+        if (!gapRecovery.open(inet_addr(addr.substr(0, colon).c_str()), htons(port))) return 1;
+        std::cout << "Recovering gaps from " << addr.substr(0, colon) << ":" << port << std::endl;
+    }
 
-        // Release the block after processing
-        release_block(block_ptr);
+    // The channels the single ring loop demuxes to: the feed's group and port, unless --channels lists them
+    if (opts.channels ? !feedChannels.addAll(opts.channels) : !feedChannels.add(mcast_ip, dest_port)) return 1;
+
+    // 3. Create the TPACKET_V3 ring(s) bound to the interface
+    RxRing ring;
+    int rc = 0;
+    if (opts.ab) {
+        rc = runArbitrated(opts, mcast_ip, dest_port);
+    } else if (opts.fanout > 0) {
+        rc = runFanout(opts, mcast_ip, dest_port);
+    } else if (!openRxRing(nic, ring, opts.ring)) {
+        rc = 1;
+    } else if (opts.pipelined) {
+        std::cout << "LISTENING FOR FRAMES ON " << nic << std::endl;
+        runPipelined(ring, opts, mcast_ip, dest_port);
+    } else {
+        std::cout << "LISTENING FOR FRAMES ON " << nic << std::endl;
+        if (feedChannels.count() > 1) {
+            printf("Receiving %u channels\n", feedChannels.count());
+            startChannelReporter(feedChannels, CHANNEL_REPORT_SECONDS);
+        }
+        // 4. Walk the ring block by block (singleRingLoop in rx_loop.h)
+        // With --resident, count the page faults the loop takes from its second block on
+        FaultWatch faults;
+        singleRingLoop(ring, opts.gapClock, [&] {
+            if (opts.resident && !faults.armed()) faults.arm();
+            faults.poll();
+            return true;
+        });
     }
 
-    // 8. Stop the timer thread
-    GlobalState::timerIsRunning.store(false, std::memory_order_relaxed);
-    gapTimerThread.join();
-    munmap(ringPtr, mmap_len); // Unmap the shared memory to release it
-    close(sockfd);
-}
\ No newline at end of file
+    // 5. Release the ring
+    closeRxRing(ring);
+    feedJournal.close();
+    feedPublisher.close();
+    topOfBook.close();
+    statsPage.close();
+    gapRecovery.close();
+    return rc;
+}
@@ -0,0 +1,123 @@
+// mdfh-stat: sample the stats page of a running mdfh (--stats <name>) and print it every interval, with rates
+// over the interval next to the totals. Only maps the page read only, mdfh never knows it is being watched.
+// Build: g++ -std=c++20 -O2 mdfh_stat.cpp -o mdfh-stat
+// Run: ./mdfh-stat <name> [interval ms, default 1000] [--once]
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include "stats_layout.h"
+
+// Plain copy of the counters, so a sample is taken once and printed from
+struct Sample {
+    uint64_t    takenNs;
+    uint64_t    parsed, lost, outOfOrder, duplicates, gapTimeouts, nextExpected, highest, gapOpen, unknown, truncated;
+    uint64_t    gapSizes[STATS_GAP_BUCKETS], gapLosses[STATS_GAP_BUCKETS];
+    struct Ring {
+        uint64_t    blocks, packets, losingBlocks, kernelPackets, kernelDrops, kernelFreezes, maxOccupancy, blockNr;
+        uint64_t    occupancy[RING_OCCUPANCY_BUCKETS];
+    } rings[STATS_MAX_RINGS];
+};
+
+static uint64_t get(const std::atomic<uint64_t> &v) { return v.load(std::memory_order_relaxed); }
+
+static void take(const StatsPageLayout &page, Sample &s) {
+    const SequencerStatsLines &q = page.sequencer;
+    s.takenNs = realtimeNs();
+    s.parsed = get(q.parsed);
+    s.lost = get(q.lost);
+    s.outOfOrder = get(q.outOfOrder);
+    s.duplicates = get(q.duplicates);
+    s.gapTimeouts = get(q.gapTimeouts);
+    s.nextExpected = get(q.nextExpected);
+    s.highest = get(q.highest);
+    s.gapOpen = get(q.gapOpen);
+    s.unknown = get(q.unknownMessages);
+    s.truncated = get(q.truncatedMessages);
+    for (size_t b = 0; b < STATS_GAP_BUCKETS; b++) {
+        s.gapSizes[b] = get(q.gapSizes[b]);
+        s.gapLosses[b] = get(q.gapLosses[b]);
+    }
+    for (uint32_t r = 0; r < page.ringCount; r++) {
+        const RingStatsLines &l = page.rings[r];
+        Sample::Ring &o = s.rings[r];
+        o.blocks = get(l.blocks);
+        o.packets = get(l.packets);
+        o.losingBlocks = get(l.losingBlocks);
+        o.kernelPackets = get(l.kernelPackets);
+        o.kernelDrops = get(l.kernelDrops);
+        o.kernelFreezes = get(l.kernelFreezes);
+        o.maxOccupancy = get(l.maxOccupancy);
+        o.blockNr = get(l.blockNr);
+        for (size_t b = 0; b < RING_OCCUPANCY_BUCKETS; b++) o.occupancy[b] = get(l.occupancy[b]);
+    }
+}
+
+// Non empty buckets of a bit_width histogram as "<2^i:count", bucket 0 as "0:count"
+static void printHistogram(const char *label, const uint64_t *buckets, size_t n) {
+    printf("  %s", label);
+    bool any = false;
+    for (size_t b = 0; b < n; b++) {
+        if (!buckets[b]) continue;
+        if (b == 0) printf(" 0:%lu", buckets[b]);
+        else printf(" <2^%zu:%lu", b, buckets[b]);
+        any = true;
+    }
+    printf(any ? "\n" : " -\n");
+}
+
+static void print(const StatsPageLayout &page, const Sample &s, const Sample &prev) {
+    double secs = (s.takenNs - prev.takenNs) / 1e9;
+    auto rate = [secs](uint64_t now, uint64_t before) { return secs > 0 ? (now - before) / secs : 0.0; };
+    printf("[sequencer] parsed=%lu (%.0f/s) lost=%lu (%.0f/s) out_of_order=%lu duplicates=%lu gap_timeouts=%lu "
+           "next=%lu highest=%lu gap_open=%lu unknown=%lu truncated=%lu\n", s.parsed, rate(s.parsed, prev.parsed), s.lost,
+           rate(s.lost, prev.lost), s.outOfOrder, s.duplicates, s.gapTimeouts, s.nextExpected, s.highest, s.gapOpen,
+           s.unknown, s.truncated);
+    printHistogram("gap sizes (missing when opened):", s.gapSizes, STATS_GAP_BUCKETS);
+    printHistogram("gap losses (lost per flush):    ", s.gapLosses, STATS_GAP_BUCKETS);
+    for (uint32_t r = 0; r < page.ringCount; r++) {
+        const Sample::Ring &o = s.rings[r], &p = prev.rings[r];
+        printf("[ring %u] blocks=%lu (%.0f/s) packets=%lu (%.0f/s) losing_blocks=%lu kernel_packets=%lu kernel_drops=%lu "
+               "(%.0f/s) freezes=%lu max_waiting=%lu/%lu\n", r, o.blocks, rate(o.blocks, p.blocks), o.packets,
+               rate(o.packets, p.packets), o.losingBlocks, o.kernelPackets, o.kernelDrops, rate(o.kernelDrops, p.kernelDrops),
+               o.kernelFreezes, o.maxOccupancy, o.blockNr);
+        printHistogram("blocks waiting behind each block taken:", o.occupancy, RING_OCCUPANCY_BUCKETS);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || !strcmp(argv[1], "--help")) {
+        printf("Usage: %s <name> [interval ms, default 1000] [--once]\n", argv[0]);
+        return argc < 2;
+    }
+    const char *name = argv[1];
+    uint32_t intervalMs = 1000;
+    bool once = false;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--once")) once = true;
+        else intervalMs = atoi(argv[i]);
+    }
+    if (intervalMs == 0) intervalMs = 1000;
+
+    StatsPageReader reader;
+    if (!reader.open(name)) return 1;
+    const StatsPageLayout &page = reader.page();
+    printf("mdfh pid %d, %u ring(s)\n", page.pid, page.ringCount);
+
+    // The first line's rates are since mdfh started
+    static Sample prev{}, now{};
+    prev.takenNs = page.startedNs;
+    for (;;) {
+        take(page, now);
+        print(page, now, prev);
+        fflush(stdout);
+        if (once) break;
+        if (reader.writerGone()) {
+            printf("mdfh has stopped\n");
+            break;
+        }
+        prev = now;
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+}
@@ -0,0 +1,124 @@
+// Zero-copy message views: a view is a pointer to a message where it already is (in the TPACKET_V3 block, the
+// recv buffer or the mapped file) and decodes a field only when it is read, at the offset the layout tables in
+// itch.h give it. A consumer that only needs the sequence number and symbol never decodes anything else.
+//
+// Lifetime: a view is only valid while the memory under it is. For the packet ring that is until the block
+// holding the packet is handed back with release_block() (after that the kernel can overwrite it at any time),
+// for a recv buffer until the next recv into it, and for an offline file until it is unmapped. A view must
+// never be stored past that: copy the fields out (or decode into a message struct) instead.
+// Building with -DMDFH_CHECK_VIEWS makes every view remember the release count of its thread when it was made
+// and abort on a read after any block has been released since, which catches views kept across a release.
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "itch.h"
+
+#ifdef MDFH_CHECK_VIEWS
+// Blocks released by this thread, bumped by release_block()
+inline thread_local uint64_t viewEpoch = 0;
+#endif
+
+// Any message: the header fields, and every other field through its layout
+class MessageView {
+public:
+    explicit MessageView(const char *msg): m_msg(msg) {}
+
+    char            messageType() const { return load<uint8_t>(0); }
+    uint64_t        timestamp() const { return (uint64_t) load<uint16_t>(1) << 32 | load<uint32_t>(3); }
+    uint32_t        sequenceNumber() const { return load<uint32_t>(7); }
+    const char      *data() const { check(); return m_msg; }
+    size_t          size() const { return messageSize(messageType()); }
+    // nullptr for an unknown type
+    const MessageLayout *layout() const { return layoutOf(messageType()); }
+    // Integer, price or timestamp field of the layout
+    uint64_t        field(const FieldLayout &f) const { check(); return readField(m_msg, f); }
+    // 8 byte stock field of any type that has one, as sent; nullptr for the others
+    const char      *stockField() const {
+        uint8_t offset = STOCK_OFFSETS[(uint8_t) messageType()];
+        return offset ? alpha8(offset) : nullptr;
+    }
+
+protected:
+    const char  *m_msg;
+#ifdef MDFH_CHECK_VIEWS
+    uint64_t    m_epoch = viewEpoch;
+#endif
+
+    void check() const {
+#ifdef MDFH_CHECK_VIEWS
+        if (m_epoch != viewEpoch) {
+            fprintf(stderr, "Message view read after its block was released\n");
+            abort();
+        }
+#endif
+    }
+
+    // Big endian unsigned integer of sizeof(T) bytes at offset
+    template<typename T>
+    T load(size_t offset) const {
+        check();
+        T v;
+        std::memcpy(&v, m_msg + offset, sizeof(T));
+        if constexpr (sizeof(T) == 8) return __builtin_bswap64(v);
+        else if constexpr (sizeof(T) == 4) return __builtin_bswap32(v);
+        else if constexpr (sizeof(T) == 2) return __builtin_bswap16(v);
+        else return v;
+    }
+
+    // 8 byte stock field, as sent (null or space padded)
+    const char *alpha8(size_t offset) const {
+        check();
+        return m_msg + offset;
+    }
+};
+
+// 'A' (add order) and 'P' (trade)
+struct TradeView: MessageView {
+    using MessageView::MessageView;
+    static constexpr size_t ORDER_REF_NUMBER = fieldOffset('A', "orderRefNumber");
+    static constexpr size_t BUY_SELL_INDICATOR = fieldOffset('A', "buySellIndicator");
+    static constexpr size_t SHARES = fieldOffset('A', "shares");
+    static constexpr size_t STOCK = fieldOffset('A', "stock");
+    static constexpr size_t PRICE = fieldOffset('A', "price");
+    uint64_t    orderRefNumber() const { return load<uint64_t>(ORDER_REF_NUMBER); }
+    char        buySellIndicator() const { return load<uint8_t>(BUY_SELL_INDICATOR); }
+    uint32_t    shares() const { return load<uint32_t>(SHARES); }
+    const char  *stock() const { return alpha8(STOCK); }
+    uint32_t    price() const { return load<uint32_t>(PRICE); }
+};
+
+struct OrderExecutedView: MessageView {
+    using MessageView::MessageView;
+    static constexpr size_t ORDER_REF_NUMBER = fieldOffset('E', "orderRefNumber");
+    static constexpr size_t EXECUTED_SHARES = fieldOffset('E', "executedShares");
+    uint64_t    orderRefNumber() const { return load<uint64_t>(ORDER_REF_NUMBER); }
+    uint32_t    executedShares() const { return load<uint32_t>(EXECUTED_SHARES); }
+};
+
+struct OrderExecutedWithPriceView: MessageView {
+    using MessageView::MessageView;
+    static constexpr size_t ORDER_REF_NUMBER = fieldOffset('X', "orderRefNumber");
+    static constexpr size_t EXECUTED_SHARES = fieldOffset('X', "executedShares");
+    static constexpr size_t PRINTABLE = fieldOffset('X', "printable");
+    static constexpr size_t EXECUTED_PRICE = fieldOffset('X', "executedPrice");
+    uint64_t    orderRefNumber() const { return load<uint64_t>(ORDER_REF_NUMBER); }
+    uint32_t    executedShares() const { return load<uint32_t>(EXECUTED_SHARES); }
+    char        printable() const { return load<uint8_t>(PRINTABLE); }
+    uint32_t    executedPrice() const { return load<uint32_t>(EXECUTED_PRICE); }
+};
+
+struct SystemEventView: MessageView {
+    using MessageView::MessageView;
+    static constexpr size_t EVENT_CODE = fieldOffset('S', "eventCode");
+    char        eventCode() const { return load<uint8_t>(EVENT_CODE); }
+};
+
+struct OrderCancelView: MessageView {
+    using MessageView::MessageView;
+    static constexpr size_t ORDER_REF_NUMBER = fieldOffset('C', "orderRefNumber");
+    static constexpr size_t CANCELLED_SHARES = fieldOffset('C', "cancelledShares");
+    uint64_t    orderRefNumber() const { return load<uint64_t>(ORDER_REF_NUMBER); }
+    uint32_t    cancelledShares() const { return load<uint32_t>(CANCELLED_SHARES); }
+};
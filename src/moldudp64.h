@@ -0,0 +1,95 @@
+// MoldUDP64 framing: a 20 byte header (10 byte session, 8 byte sequence number of the first message,
+// 2 byte message count) followed by message blocks, each a 2 byte length and the message itself. All integers
+// are big endian. A request packet is a bare header asking for messageCount messages from sequenceNumber.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include "helper.h"
+#include "parse.h"
+
+constexpr size_t MOLD_SESSION_LEN = 10;
+constexpr size_t MOLD_HEADER_LEN = 20;
+constexpr size_t MOLD_LENGTH_LEN = 2;
+
+// Message count of the packet marking the end of a session
+constexpr uint16_t MOLD_END_OF_SESSION = 0xFFFF;
+
+// Session the replay server publishes, requests for any other session are ignored
+constexpr char MOLD_SESSION[MOLD_SESSION_LEN + 1] = "MDFHITCH01";
+
+struct MoldHeader {
+    char        session[MOLD_SESSION_LEN];
+    uint64_t    sequenceNumber;
+    uint16_t    messageCount;
+};
+
+// Returns false if buf is too short to hold a header
+inline bool readMoldHeader(const char *buf, size_t len, MoldHeader &h) {
+    if (len < MOLD_HEADER_LEN) return false;
+    std::memcpy(h.session, buf, MOLD_SESSION_LEN);
+    size_t offset = MOLD_SESSION_LEN;
+    h.sequenceNumber = read8Bytes(buf, offset);
+    uint16_t count;
+    std::memcpy(&count, buf + offset, sizeof(count));
+    h.messageCount = ntohs(count);
+    return true;
+}
+
+// Write a header (or a whole request packet) to buf, returns the number of bytes written
+inline size_t writeMoldHeader(char *buf, const char *session, uint64_t seq, uint16_t count) {
+    std::memcpy(buf, session, MOLD_SESSION_LEN);
+    uint32_t hi = htonl(seq >> 32), lo = htonl(seq & 0xffffffff);
+    std::memcpy(buf + MOLD_SESSION_LEN, &hi, 4);
+    std::memcpy(buf + MOLD_SESSION_LEN + 4, &lo, 4);
+    uint16_t n = htons(count);
+    std::memcpy(buf + MOLD_SESSION_LEN + 8, &n, 2);
+    return MOLD_HEADER_LEN;
+}
+
+// Call onMessage(msg, len) for every message block after the header, returns false if the packet is truncated
+template<typename MessageHandler>
+inline bool forEachMoldMessage(const char *buf, size_t len, uint16_t count, MessageHandler &&onMessage) {
+    size_t pos = MOLD_HEADER_LEN;
+    for (uint16_t i = 0; i < count; i++) {
+        if (pos + MOLD_LENGTH_LEN > len) return false;
+        uint16_t msgLen;
+        std::memcpy(&msgLen, buf + pos, sizeof(msgLen));
+        msgLen = ntohs(msgLen);
+        pos += MOLD_LENGTH_LEN;
+        if (pos + msgLen > len) return false;
+        onMessage(buf + pos, msgLen);
+        pos += msgLen;
+    }
+    return true;
+}
+
+// How the feed packs messages into UDP payloads
+enum class Framing {
+    Raw,        // a bare run of messages, each sequenced on its own
+    MoldUDP64   // MoldUDP64 packets, sequenced a whole packet at a time
+};
+
+// Framing of the live feed, set once at startup
+inline Framing feedFraming = Framing::Raw;
+
+// Parse a feed payload in the configured framing
+inline void parsePayload(const char *buf, ssize_t len) {
+    if (feedFraming == Framing::MoldUDP64) parseMoldPacket(buf, len);
+    else parseMessage(buf, len);
+}
+
+// Whether a feed payload of len bytes is long enough for peekPayloadSequence
+inline bool hasPayloadSequence(ssize_t len) {
+    return len >= (ssize_t) (feedFraming == Framing::MoldUDP64 ? MOLD_HEADER_LEN : MESSAGE_HEADER_LEN);
+}
+
+// Sequence number of the first message in a feed payload, without parsing it (check hasPayloadSequence first)
+inline uint32_t peekPayloadSequence(const char *buf) {
+    if (feedFraming == Framing::MoldUDP64) {
+        size_t offset = MOLD_SESSION_LEN;
+        return read8Bytes(buf, offset);
+    }
+    return peekSequenceNumber(buf);
+}
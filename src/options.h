@@ -0,0 +1,171 @@
+// Command line options for mdfh
+#pragma once
+#include <bit>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include "clock.h"
+#include "moldudp64.h"
+#include "latency.h"
+#include "ring.h"
+
+constexpr uint32_t MAX_FANOUT_RINGS = 8;
+
+struct Options {
+    std::string nic = "enxc8a362d92729";    // interface the AF_PACKET ring is bound to
+    const char *pcapPath = nullptr;         // offline mode: Ethernet pcap capture
+    const char *rawPath = nullptr;          // offline mode: raw ITCH messages (itch_data.bin format)
+    bool pipelined = false;                 // RX and parsing on separate cores
+    int rxCpu = 3;                          // core for the RX loop (the only loop when not pipelined)
+    int parseCpu = 2;                       // core for the parser thread in pipelined mode (merge thread in fanout mode)
+    uint32_t fanout = 0;                    // number of PACKET_FANOUT rings, 0 = single ring
+    int fanoutCpu = 4;                      // core of the first fanout worker, the rest follow consecutively
+    bool ab = false;                        // receive and arbitrate between the A and B lines
+    std::string nicB;                       // A/B mode: interface for a separate line B ring, empty = both lines on one ring
+    const char *retransmit = nullptr;       // live modes: retransmit server (ip[:port]) to recover gaps from
+    Framing framing = Framing::Raw;         // how the feed packs messages into payloads
+    GapClock gapClock = GapClock::Tsc;      // time source for the gap timeout (offline mode always uses the file's timestamps)
+    const char *journal = nullptr;          // single ring and offline modes: record every payload to <journal>.NNNN segments
+    uint32_t journalSizeMb = 1024;          // preallocated size of each journal segment
+    int journalCpu = 0;                     // core for the journal writer thread
+    const char *publish = nullptr;          // publish accepted messages as normalized events to /dev/shm/<publish>
+    uint32_t publishEvents = 1 << 16;       // events the shared memory feed holds before readers are lapped
+    const char *topOfBook = nullptr;        // keep the top of every book in the shared memory table /dev/shm/<topOfBook>
+    const char *subscribe = nullptr;        // only handle these symbols: a comma separated list, or @file with one per line
+    const char *channels = nullptr;         // single ring mode: receive these group:port channels (list or @file), each sequenced on its own
+    const char *stats = nullptr;            // keep the receive path's counters in the shared memory stats page /dev/shm/<stats>
+    uint32_t latencySample = LATENCY_DEFAULT_SAMPLING; // time 1 in n packets stage by stage, 0 = off
+    uint32_t latencyReport = 0;             // live modes: print the latency histograms every n seconds, 0 = never
+    int logCpu = 0;                         // core for the log formatter thread (builds with MDFH_LOG_LEVEL only)
+    bool resident = false;                  // hot tables on hugepages, all memory prefaulted and locked before the first message
+    RingGeometry ring;                      // geometry of every receive ring (benchmark_ring_sweep recommends one)
+
+    bool offline() const { return pcapPath || rawPath; }
+
+    // Packet rings the receive mode opens
+    uint32_t ringCount() const {
+        if (offline()) return 0;
+        if (ab) return nicB.empty() ? 1 : 2;
+        return fanout ? fanout : 1;
+    }
+};
+
+inline void printUsage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  --nic <name>     interface to receive the multicast feed on (default enxc8a362d92729)\n"
+           "  --pcap <file>    read frames from an Ethernet pcap instead of the NIC\n"
+           "  --raw <file>     read raw ITCH messages (itch_data.bin format) instead of the NIC\n"
+           "  --pipelined      receive and parse on separate cores with an SPSC hand-off\n"
+           "  --rx-cpu <n>     core to pin the receive loop to (default 3)\n"
+           "  --parse-cpu <n>  core to pin the parser thread to in pipelined mode (default 2)\n"
+           "  --fanout <n>     receive on n (1-8) PACKET_FANOUT rings, one worker each, merged by sequence number\n"
+           "  --fanout-cpu <n> core of the first fanout worker, the others use the following cores (default 4)\n"
+           "  --ab             receive both the A and B lines and arbitrate between them\n"
+           "  --nic-b <name>   A/B mode with line B on its own ring on this interface (implies --ab)\n"
+           "  --retransmit <a> request missing messages from the retransmit server at ip[:port] (default port 30003)\n"
+           "  --framing <f>    feed payload framing: raw (bare messages, default) or mold (MoldUDP64 packets)\n"
+           "  --gap-clock <c>  measure the gap timeout in tsc (local time, default) or packet (kernel receive timestamps)\n"
+           "  --journal <p>    record every accepted payload to the journal segments <p>.0000, <p>.0001, ...\n"
+           "  --journal-size <mb> size each journal segment is preallocated to (default 1024)\n"
+           "  --journal-cpu <n> core for the journal writer thread (default 0, -1 = unpinned)\n"
+           "  --publish <name> publish every accepted message as a normalized event to the shared memory feed /dev/shm/<name>\n"
+           "  --publish-events <n> events the shared memory feed holds, rounded up to a power of 2 (default 65536)\n"
+           "  --top-of-book <name> keep the best bid/ask and last trade of every symbol in the shared memory table /dev/shm/<name>\n"
+           "  --subscribe <s>  only book and publish these symbols: SYM1,SYM2,... or @file with one symbol per line\n"
+           "  --channels <c>   receive the channels group:port,group:port,... (or @file, one per line), each with its own\n"
+           "                   sequencer, on the one ring (default 239.1.1.1:30001 only)\n"
+           "  --stats <name>   keep sequencer, gap and ring counters (with the kernel's drops) in /dev/shm/<name> for mdfh-stat\n"
+           "  --latency-sample <n> time 1 in n packets (a power of 2) from kernel receive to book update, 0 = off (default %u)\n"
+           "  --latency-report <s> print the latency histograms every s seconds in the live modes\n"
+           "  --resident       put the order tables on 2 MB pages, prefault and mlock all memory at startup, warn on page faults\n"
+           "  --block-size <kb> size of each ring block, a multiple of the page size (default %u)\n"
+           "  --block-nr <n>   blocks in each ring (default %u)\n"
+           "  --frame-size <b> ring frame size, a multiple of 16 (default %u)\n"
+           "  --retire-tov <ms> retire a part filled block after this long, 0 = the kernel's choice from the link speed (default %u)\n"
+           "  --log-cpu <n>    core for the log formatter thread when built with logging (default 0, -1 = unpinned)\n"
+           "  --help           show this message\n", prog, LATENCY_DEFAULT_SAMPLING, BLOCK_SIZE / 1024, BLOCK_NR,
+           FRAME_SIZE, RETIRE_TOV_MS);
+}
+
+// Returns false (after printing the usage) if the arguments are invalid
+inline bool parseOptions(int argc, char **argv, Options &opts) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--nic") && hasValue) opts.nic = argv[++i];
+        else if (!strcmp(arg, "--pcap") && hasValue) opts.pcapPath = argv[++i];
+        else if (!strcmp(arg, "--raw") && hasValue) opts.rawPath = argv[++i];
+        else if (!strcmp(arg, "--pipelined")) opts.pipelined = true;
+        else if (!strcmp(arg, "--rx-cpu") && hasValue) opts.rxCpu = atoi(argv[++i]);
+        else if (!strcmp(arg, "--parse-cpu") && hasValue) opts.parseCpu = atoi(argv[++i]);
+        else if (!strcmp(arg, "--fanout") && hasValue) opts.fanout = atoi(argv[++i]);
+        else if (!strcmp(arg, "--fanout-cpu") && hasValue) opts.fanoutCpu = atoi(argv[++i]);
+        else if (!strcmp(arg, "--journal") && hasValue) opts.journal = argv[++i];
+        else if (!strcmp(arg, "--journal-size") && hasValue) opts.journalSizeMb = atoi(argv[++i]);
+        else if (!strcmp(arg, "--journal-cpu") && hasValue) opts.journalCpu = atoi(argv[++i]);
+        else if (!strcmp(arg, "--publish") && hasValue) opts.publish = argv[++i];
+        else if (!strcmp(arg, "--publish-events") && hasValue) opts.publishEvents = atoi(argv[++i]);
+        else if (!strcmp(arg, "--top-of-book") && hasValue) opts.topOfBook = argv[++i];
+        else if (!strcmp(arg, "--subscribe") && hasValue) opts.subscribe = argv[++i];
+        else if (!strcmp(arg, "--channels") && hasValue) opts.channels = argv[++i];
+        else if (!strcmp(arg, "--stats") && hasValue) opts.stats = argv[++i];
+        else if (!strcmp(arg, "--latency-sample") && hasValue) opts.latencySample = atoi(argv[++i]);
+        else if (!strcmp(arg, "--latency-report") && hasValue) opts.latencyReport = atoi(argv[++i]);
+        else if (!strcmp(arg, "--resident")) opts.resident = true;
+        else if (!strcmp(arg, "--block-size") && hasValue) opts.ring.blockSize = atoi(argv[++i]) * 1024;
+        else if (!strcmp(arg, "--block-nr") && hasValue) opts.ring.blockNr = atoi(argv[++i]);
+        else if (!strcmp(arg, "--frame-size") && hasValue) opts.ring.frameSize = atoi(argv[++i]);
+        else if (!strcmp(arg, "--retire-tov") && hasValue) opts.ring.retireTovMs = atoi(argv[++i]);
+        else if (!strcmp(arg, "--log-cpu") && hasValue) opts.logCpu = atoi(argv[++i]);
+        else if (!strcmp(arg, "--retransmit") && hasValue) opts.retransmit = argv[++i];
+        else if (!strcmp(arg, "--ab")) opts.ab = true;
+        else if (!strcmp(arg, "--nic-b") && hasValue) opts.nicB = argv[++i], opts.ab = true;
+        else if (!strcmp(arg, "--framing") && hasValue && !strcmp(argv[i + 1], "raw")) opts.framing = Framing::Raw, i++;
+        else if (!strcmp(arg, "--framing") && hasValue && !strcmp(argv[i + 1], "mold")) opts.framing = Framing::MoldUDP64, i++;
+        else if (!strcmp(arg, "--gap-clock") && hasValue && !strcmp(argv[i + 1], "tsc")) opts.gapClock = GapClock::Tsc, i++;
+        else if (!strcmp(arg, "--gap-clock") && hasValue && !strcmp(argv[i + 1], "packet")) opts.gapClock = GapClock::Packet, i++;
+        else {
+            if (strcmp(arg, "--help")) fprintf(stderr, "Unknown or incomplete option: %s\n", arg);
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (opts.pcapPath && opts.rawPath) {
+        fprintf(stderr, "--pcap and --raw are mutually exclusive\n");
+        return false;
+    }
+    if (opts.ab && (opts.pipelined || opts.fanout)) {
+        fprintf(stderr, "--ab can't be combined with --pipelined or --fanout\n");
+        return false;
+    }
+    if (opts.journal && (opts.ab || opts.pipelined || opts.fanout)) {
+        fprintf(stderr, "--journal is only supported with a single ring or offline\n");
+        return false;
+    }
+    if (opts.channels && (opts.offline() || opts.ab || opts.pipelined || opts.fanout || opts.journal)) {
+        fprintf(stderr, "--channels is only supported with a single ring, without --journal\n");
+        return false;
+    }
+    if (opts.journal && opts.journalSizeMb == 0) {
+        fprintf(stderr, "--journal-size must be at least 1\n");
+        return false;
+    }
+    if (opts.publish && (opts.publishEvents == 0 || opts.publishEvents > (1u << 30))) {
+        fprintf(stderr, "--publish-events must be between 1 and %u\n", 1u << 30);
+        return false;
+    }
+    if (!std::has_single_bit(opts.latencySample) && opts.latencySample != 0) {
+        fprintf(stderr, "--latency-sample must be a power of 2, or 0\n");
+        return false;
+    }
+    if (const char *why = opts.ring.invalid()) {
+        fprintf(stderr, "Invalid ring geometry: %s\n", why);
+        return false;
+    }
+    if (opts.fanout > MAX_FANOUT_RINGS) {
+        fprintf(stderr, "--fanout supports at most %u rings\n", MAX_FANOUT_RINGS);
+        return false;
+    }
+    return true;
+}
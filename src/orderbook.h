@@ -0,0 +1,315 @@
+// In-process limit order book (market-by-order), built inline from the parsed ITCH messages
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include "parse.h"
+#include "hugepage.h"
+#include "symbols.h"
+
+// Maximum number of distinct stocks (one book each) and live orders tracked at once.
+// The order table is open addressed so its capacity must be a power of 2.
+constexpr size_t MAX_BOOKS = 8192;         // about every listed US equity
+constexpr size_t MAX_ORDERS = 1 << 20;
+// Number of price levels reserved up front per book side, so the level arrays do not
+// reallocate while the book is building up during the day
+constexpr size_t LEVEL_RESERVE = 256;
+
+// A single aggregated price level (16 bytes, so 4 levels share a cache line)
+struct PriceLevel {
+    uint32_t    price;
+    uint32_t    orderCount;
+    uint64_t    shares;
+};
+
+// One side of a book. Levels are kept in a contiguous sorted array instead of a node based
+// std::map, with the BEST price at the back. Almost all activity happens at or near the top of
+// the book, so inserts/erases there only shift a handful of levels and the hot levels stay in
+// the same few cache lines. Bids are sorted ascending, asks descending (templated so the
+// comparison is resolved at compile time rather than branching on the side for every update).
+template<bool IsBid>
+class BookSide {
+public:
+    BookSide() { m_levels.reserve(LEVEL_RESERVE); }
+
+    // Add shares at a price, creating the level if it does not exist yet
+    void add(uint32_t price, uint32_t shares) {
+        auto it = lowerBound(price);
+        if (it == m_levels.end() || it->price != price) {
+            it = m_levels.insert(it, PriceLevel{price, 0, 0});
+        }
+        it->orderCount++;
+        it->shares += shares;
+    }
+
+    // Remove shares from a price level. orderGone is set when the order has been fully
+    // executed/cancelled, in which case the order count of the level drops as well.
+    void remove(uint32_t price, uint32_t shares, bool orderGone) {
+        auto it = lowerBound(price);
+        if (it == m_levels.end() || it->price != price) return;
+        it->shares -= std::min<uint64_t>(shares, it->shares);
+        if (orderGone) it->orderCount--;
+        if (it->orderCount == 0) m_levels.erase(it);
+    }
+
+    // Best level (highest bid/lowest ask), nullptr if this side is empty
+    const PriceLevel* best() const { return m_levels.empty() ? nullptr : &m_levels.back(); }
+
+    // Level n away from the top of book (0 = best), nullptr if the book is not that deep
+    const PriceLevel* level(size_t n) const {
+        return n < m_levels.size() ? &m_levels[m_levels.size() - 1 - n] : nullptr;
+    }
+
+    size_t depth() const { return m_levels.size(); }
+
+private:
+    std::vector<PriceLevel> m_levels;
+
+    std::vector<PriceLevel>::iterator lowerBound(uint32_t price) {
+        if constexpr (IsBid) {
+            return std::lower_bound(m_levels.begin(), m_levels.end(), price,
+                [](const PriceLevel &l, uint32_t p) { return l.price < p; });
+        } else {
+            return std::lower_bound(m_levels.begin(), m_levels.end(), price,
+                [](const PriceLevel &l, uint32_t p) { return l.price > p; });
+        }
+    }
+};
+
+struct OrderBook {
+    char            stock[8];       // as on the wire, space padded
+    BookSide<true>  bids;
+    BookSide<false> asks;
+    // Last execution against the book or non-displayed trade ('E', 'X', 'P'), 0 until there is one
+    uint32_t        lastPrice = 0;
+    uint32_t        lastShares = 0;
+};
+
+// A resting order. An empty slot in the order table is one with 0 shares, because an order
+// that reaches 0 shares is removed from the book anyway.
+struct Order {
+    uint64_t    orderRefNumber;
+    uint32_t    price;
+    uint32_t    shares;
+    uint16_t    book;
+    char        side;
+};
+
+// Owns one OrderBook per stock plus the order reference table used to resolve the
+// E/X/C messages (which only carry an order reference number) back to a book, side and price.
+// A book's id is its symbol's id in the directory (symbols.h), the one the subscription filter and the
+// top of book table (top_of_book.h) go by too.
+class BookManager {
+public:
+    explicit BookManager(SymbolDirectory &symbols = symbolDirectory): m_symbols(symbols), m_orders(MAX_ORDERS) {
+        m_books.reserve(MAX_BOOKS);
+    }
+
+    // delete move/copy constructor/assignment operators, the tables are large and referenced by index
+    BookManager(const BookManager &) = delete;
+    BookManager& operator=(const BookManager &) = delete;
+    BookManager(BookManager &&) = delete;
+    BookManager& operator=(BookManager &&) = delete;
+
+    // Allocate the tables again now that hugePages is enabled (--resident), so they are on 2 MB pages and
+    // already faulted in. Only before the first message, whatever is in them is dropped
+    void makeResident() {
+        m_orders = OrderTable(MAX_ORDERS);
+        m_books = BookTable();
+        m_books.reserve(MAX_BOOKS);
+        m_liveOrders = 0;
+    }
+
+    static constexpr uint16_t NO_BOOK = UINT16_MAX;
+
+    // 'A' adds a resting order, 'P' is a trade against a non-displayed order so only the last trade changes
+    void apply(const TradeMessage &t) {
+        if (t.messageType == 'P') m_changed = recordTrade(t.stock, t.price, t.shares);
+        else m_changed = t.shares == 0 ? NO_BOOK : addOrder(t.orderRefNumber, t.buySellIndicator, t.shares, t.price, t.stock);
+    }
+
+    void apply(const OrderExecutedMessage &t) { m_changed = reduceOrder(t.orderRefNumber, t.executedShares, true); }
+    void apply(const OrderExecutedWithPriceMessage &t) {
+        m_changed = reduceOrder(t.orderRefNumber, t.executedShares, true, t.executedPrice);
+    }
+    void apply(const OrderCancelMessage &t) { m_changed = reduceOrder(t.orderRefNumber, t.cancelledShares, false); }
+
+    // The same straight from the payload
+    void apply(const TradeView &v) {
+        if (v.messageType() == 'P') {
+            m_changed = recordTrade(v.stock(), v.price(), v.shares());
+            return;
+        }
+        uint32_t shares = v.shares();
+        m_changed = shares == 0 ? NO_BOOK : addOrder(v.orderRefNumber(), v.buySellIndicator(), shares, v.price(), v.stock());
+    }
+
+    void apply(const OrderExecutedView &v) { m_changed = reduceOrder(v.orderRefNumber(), v.executedShares(), true); }
+    void apply(const OrderExecutedWithPriceView &v) {
+        m_changed = reduceOrder(v.orderRefNumber(), v.executedShares(), true, v.executedPrice());
+    }
+    void apply(const OrderCancelView &v) { m_changed = reduceOrder(v.orderRefNumber(), v.cancelledShares(), false); }
+
+    // Book changed by the last apply(), NO_BOOK if it changed none
+    uint16_t lastChanged() const { return m_changed; }
+    const OrderBook& bookAt(uint16_t id) const { return m_books[id]; }
+
+    // Look up the book for a stock (8 byte field, space or null padded), nullptr if it has none yet
+    const OrderBook* book(const char *stock) const {
+        uint16_t id = m_symbols.find(stock);
+        return id < m_books.size() ? &m_books[id] : nullptr;
+    }
+
+    const Order* order(uint64_t orderRefNumber) const {
+        return const_cast<BookManager*>(this)->findOrder(orderRefNumber);
+    }
+
+    size_t bookCount() const { return m_books.size(); }
+    size_t liveOrders() const { return m_liveOrders; }
+
+    // Number of messages that changed a book
+    uint64_t updates = 0;
+    // Messages dropped because the order/symbol tables were full or the order was unknown
+    uint64_t rejected = 0;
+    // Only the orders of subscribed symbols are added (a subscription filter runs in front of the books), so
+    // an E/X/C for an order that isn't here is most likely for another symbol: counted below, not as rejected
+    bool subscribedOnly = false;
+    uint64_t unsubscribed = 0;
+
+private:
+    using OrderTable = std::vector<Order, HugePageAllocator<Order>>;
+    using BookTable = std::vector<OrderBook, HugePageAllocator<OrderBook>>;
+
+    SymbolDirectory &m_symbols;
+    OrderTable m_orders;
+    BookTable m_books;
+    size_t m_liveOrders = 0;
+    uint16_t m_changed = NO_BOOK;
+
+    // Fibonacci hashing, spreads the (mostly sequential) order reference numbers over the table
+    static size_t hashOrder(uint64_t ref) { return (ref * 0x9E3779B97F4A7C15ULL) >> (64 - std::countr_zero(MAX_ORDERS)); }
+
+    // Book of a stock, by its symbol id. Ids are handed out densely, so the books up to a new one are created
+    // along with it (the symbols subscribed to, interned at startup, or none)
+    uint16_t bookFor(const char *stock) {
+        uint16_t id = m_symbols.intern(stock);
+        if (id < m_books.size()) return id;
+        if (id == NO_SYMBOL || id >= MAX_BOOKS) {
+            rejected++;
+            return NO_BOOK;
+        }
+        while (m_books.size() <= id) {
+            m_books.emplace_back();
+            std::memcpy(m_books.back().stock, m_symbols.ticker(m_books.size() - 1), 8);
+        }
+        return id;
+    }
+
+    Order* findOrder(uint64_t ref) {
+        for (size_t i = hashOrder(ref);; i = (i + 1) & (MAX_ORDERS - 1)) {
+            Order &o = m_orders[i];
+            if (o.shares == 0) return nullptr;
+            if (o.orderRefNumber == ref) return &o;
+        }
+    }
+
+    Order* insertOrder(uint64_t ref) {
+        // Keep the load factor below 1/2 so probe sequences stay short
+        if (m_liveOrders >= MAX_ORDERS / 2) {
+            rejected++;
+            return nullptr;
+        }
+        size_t i = hashOrder(ref);
+        while (m_orders[i].shares != 0) i = (i + 1) & (MAX_ORDERS - 1);
+        m_orders[i].orderRefNumber = ref;
+        m_liveOrders++;
+        return &m_orders[i];
+    }
+
+    // Linear probing with backward shift deletion, avoids tombstones building up in the table
+    // as orders are added and removed all day
+    void eraseOrder(Order *o) {
+        size_t hole = o - m_orders.data();
+        size_t i = hole;
+        for (;;) {
+            i = (i + 1) & (MAX_ORDERS - 1);
+            if (m_orders[i].shares == 0) break;
+            size_t home = hashOrder(m_orders[i].orderRefNumber);
+            // Move the entry into the hole if its home slot is not cyclically within (hole, i]
+            if (((i - home) & (MAX_ORDERS - 1)) >= ((i - hole) & (MAX_ORDERS - 1))) {
+                m_orders[hole] = m_orders[i];
+                hole = i;
+            }
+        }
+        m_orders[hole].shares = 0;
+        m_liveOrders--;
+    }
+
+    // Take shares off the book for an order, removing the order once it has none left
+    void removeShares(Order &o, uint32_t shares) {
+        shares = std::min(shares, o.shares);
+        bool orderGone = shares == o.shares;
+        OrderBook &b = m_books[o.book];
+        if (o.side == 'B') b.bids.remove(o.price, shares, orderGone);
+        else b.asks.remove(o.price, shares, orderGone);
+        if (orderGone) eraseOrder(&o);
+        else o.shares -= shares;
+    }
+
+    // Each of these returns the book it changed, NO_BOOK if none
+    uint16_t addOrder(uint64_t ref, char side, uint32_t shares, uint32_t price, const char *stock) {
+        uint16_t bookId = bookFor(stock);
+        if (bookId == NO_BOOK) return NO_BOOK;
+
+        // An order reference being re-added replaces the previous order with the same reference
+        Order *o = findOrder(ref);
+        if (o) removeShares(*o, o->shares);
+
+        o = insertOrder(ref);
+        if (!o) return NO_BOOK;
+        o->price = price;
+        o->shares = shares;
+        o->book = bookId;
+        o->side = side;
+        OrderBook &b = m_books[bookId];
+        if (o->side == 'B') b.bids.add(o->price, o->shares);
+        else b.asks.add(o->price, o->shares);
+        updates++;
+        return bookId;
+    }
+
+    // An execution is also the book's last trade, at the order's price unless the message carries another
+    uint16_t reduceOrder(uint64_t ref, uint32_t shares, bool executed, uint32_t price = 0) {
+        Order *o = findOrder(ref);
+        if (!o) {
+            if (subscribedOnly) unsubscribed++;
+            else rejected++;
+            return NO_BOOK;
+        }
+        uint16_t bookId = o->book;
+        if (executed) {
+            OrderBook &b = m_books[bookId];
+            b.lastPrice = price ? price : o->price;
+            b.lastShares = shares;
+        }
+        removeShares(*o, shares);
+        updates++;
+        return bookId;
+    }
+
+    uint16_t recordTrade(const char *stock, uint32_t price, uint32_t shares) {
+        uint16_t bookId = bookFor(stock);
+        if (bookId == NO_BOOK) return NO_BOOK;
+        OrderBook &b = m_books[bookId];
+        b.lastPrice = price;
+        b.lastShares = shares;
+        updates++;
+        return bookId;
+    }
+};
+
+// Process wide books, updated by the parse functions after each message is sequenced
+inline BookManager orderBooks;
@@ -2,44 +2,195 @@
 #include "parse.h"
 #include "helper.h"
 #include "sequencer.h"
+#include "orderbook.h"
+#include "moldudp64.h"
+#include "handler.h"
+#include "shm_feed.h"
+#include "top_of_book.h"
+#include "symbols.h"
+#include "latency.h"
 #include <bit>
-#include <chrono>
+#include <charconv>
+#include <concepts>
+#include <type_traits>
+
+// The handler behind parseMessage and parseMoldPacket: sequences every message and applies it to the book straight
+// from the payload, the sequencer only decodes the sequence number and the book only the fields it needs.
+// With logging compiled in, every message is also copied to the async log, and with --publish every message the
+// sequencer accepts is published to the shared memory feed. With --top-of-book, the top of every book a message
+// changes is refreshed in the shared memory table. With --subscribe, messages for other symbols go no further
+// than the sequencer. Every message of a packet the latency recorder is timing is stamped after decoding,
+// sequencing and handling
+class BookHandler: public FeedHandler<BookHandler> {
+public:
+    // The sequencer has already accepted the current datagram whole (MoldUDP64 framing)
+    bool presequenced = false;
+
+    void onAddOrder(const TradeView &v) { handle(v); }
+    void onTrade(const TradeView &v) { handle(v); }
+    void onExecute(const OrderExecutedView &v) { handle(v); }
+    void onExecuteWithPrice(const OrderExecutedWithPriceView &v) { handle(v); }
+    void onCancel(const OrderCancelView &v) { handle(v); }
+    void onSystemEvent(const SystemEventView &v) { handle(v); }
+    void onOtherMessage(const MessageView &v) { handle(v); }
+    void onUnknownMessage(const char *, size_t) { parseStats.unknownMessages++; }
+    void onTruncatedMessage(const char *, size_t) { parseStats.truncatedMessages++; }
+
+    // One message a parse* function decoded for its caller, handled like a message of a payload
+    template<typename View>
+    void handleDecoded(const View &v, bool sequenced) {
+        bool payloadSequenced = presequenced;
+        presequenced = sequenced;
+        handle(v);
+        presequenced = payloadSequenced;
+    }
+
+private:
+    template<typename View>
+    void handle(const View &v) {
+        latency.parsed();
+        FeedLogger::log(v.data());
+        bool accepted = presequenced || checkAndSetGlobalState(v.sequenceNumber());
+        latency.sequenced();
+        if (accepted) consume(v);
+        latency.handled(v.timestamp());
+    }
+
+    // A message the sequencer accepted
+    template<typename View>
+    void consume(const View &v) {
+        if constexpr (std::is_same_v<View, TradeView>) {
+            // Only the symbol is read until it is known to be subscribed
+            if (!feedSubscriptions.subscribed(v.stock())) return;
+        } else if constexpr (std::is_same_v<View, MessageView>) {
+            // The other types that carry a stock (R, H, Y, L, F, Q, I ...) are filtered on it the same way
+            const char *stock = v.stockField();
+            if (stock && !feedSubscriptions.subscribed(stock)) return;
+        }
+        if constexpr (requires { orderBooks.apply(v); }) {
+            orderBooks.apply(v);
+            uint16_t changed = orderBooks.lastChanged();
+            // E/X/C carry no symbol, their order is only on the books if its symbol is subscribed
+            if constexpr (!std::is_same_v<View, TradeView>) {
+                if (changed == BookManager::NO_BOOK && feedSubscriptions.active()) return;
+            }
+            if (topOfBook.enabled() && changed != BookManager::NO_BOOK) updateTopOfBook(changed, v.timestamp());
+        }
+        if (feedPublisher.enabled()) {
+            FeedEvent *e = feedPublisher.claim();
+            normalize(v, *e);
+            feedPublisher.publish();
+        }
+    }
+
+    static_assert(MAX_BOOKS <= TOP_OF_BOOK_SYMBOLS, "the top of book table needs an entry per book");
+
+    static void updateTopOfBook(uint16_t bookId, uint64_t timestamp) {
+        const OrderBook &book = orderBooks.bookAt(bookId);
+        const PriceLevel *bid = book.bids.best(), *ask = book.asks.best();
+        TopOfBook t;
+        std::memcpy(t.stock, book.stock, sizeof(t.stock));
+        t.bidPrice = bid ? bid->price : 0;
+        t.bidOrders = bid ? bid->orderCount : 0;
+        t.bidShares = bid ? bid->shares : 0;
+        t.askPrice = ask ? ask->price : 0;
+        t.askOrders = ask ? ask->orderCount : 0;
+        t.askShares = ask ? ask->shares : 0;
+        t.lastPrice = book.lastPrice;
+        t.lastShares = book.lastShares;
+        t.timestamp = timestamp;
+        topOfBook.update(bookId, t);
+    }
 
-// Logger for printing parsed messages
-static const Logger logger = LogLevel::OFF;
+    // Fill every field of the event, the slot still holds whatever was published in it a lap ago
+    static void normalize(const MessageView &v, FeedEvent &e) {
+        e.timestamp = v.timestamp();
+        e.orderRefNumber = 0;
+        e.sequenceNumber = v.sequenceNumber();
+        e.shares = 0;
+        e.price = 0;
+        e.messageType = v.messageType();
+        e.side = 0;
+        e.code = 0;
+        e.reserved = 0;
+        std::memset(e.stock, 0, sizeof(e.stock));
+    }
+
+    static void normalize(const TradeView &v, FeedEvent &e) {
+        normalize((const MessageView &) v, e);
+        e.orderRefNumber = v.orderRefNumber();
+        e.shares = v.shares();
+        e.price = v.price();
+        e.side = v.buySellIndicator();
+        std::memcpy(e.stock, v.stock(), sizeof(e.stock));
+    }
+
+    static void normalize(const OrderExecutedView &v, FeedEvent &e) {
+        normalize((const MessageView &) v, e);
+        e.orderRefNumber = v.orderRefNumber();
+        e.shares = v.executedShares();
+    }
+
+    static void normalize(const OrderExecutedWithPriceView &v, FeedEvent &e) {
+        normalize((const MessageView &) v, e);
+        e.orderRefNumber = v.orderRefNumber();
+        e.shares = v.executedShares();
+        e.price = v.executedPrice();
+        e.code = v.printable();
+    }
+
+    static void normalize(const OrderCancelView &v, FeedEvent &e) {
+        normalize((const MessageView &) v, e);
+        e.orderRefNumber = v.orderRefNumber();
+        e.shares = v.cancelledShares();
+    }
+
+    static void normalize(const SystemEventView &v, FeedEvent &e) {
+        normalize((const MessageView &) v, e);
+        e.code = v.eventCode();
+    }
+};
+
+static BookHandler bookHandler;
 
 // Parsing loop, run for each syscall to obtain data from socket receive buffer
  void parseMessage(const char* buf, const ssize_t &len) {
-    ssize_t pos = 0;
-    char type;
-
     // The "len" value is the length of bytes read by recv. This should be at most
     // 1472 bytes, so we must go through the buffer and parse each
     // ITCH message based on the first byte (messageType) which also tells us the message
-    // size (this is static, determined by the ITCH protocol specification)
-    while(pos < len) {
-        type = buf[pos];
-        switch(type) {
-            case 'A': pos += parseTrade(buf + pos, tradeMsg); break;
-            case 'P': pos += parseTrade(buf + pos, tradeMsg); break;
-            case 'E': pos += parseOrderExecuted(buf + pos, orderExecutedMsg); break;
-            case 'X': pos += parseOrderWithPrice(buf + pos, orderExecutedWithPriceMsg); break;
-            case 'S': pos += parseSystemEvent(buf + pos, sysMsg); break;
-            case 'C': pos += parseOrderCancelled(buf + pos, orderCancelMsg); break;
-        }
-        //std::cout << std::endl;
-    }
+    // size (this is static, determined by the layout tables in itch.h)
+    bookHandler.presequenced = false;
+    bookHandler.decode(buf, len);
+}
+
+// Parse a MoldUDP64 packet: the whole packet is sequenced with one range check, and only when that can't
+// decide (a gap is open, or it overlaps messages already seen) is each message checked on its own.
+// UDP delivers datagrams whole, so a packet whose blocks run past its end is from a broken publisher, the
+// messages before that point are still applied.
+void parseMoldPacket(const char* buf, const ssize_t &len) {
+    MoldHeader h;
+    if (!readMoldHeader(buf, len, h)) return;
+    // Heartbeats and the end of session marker carry no messages
+    if (h.messageCount == 0 || h.messageCount == MOLD_END_OF_SESSION) return;
+
+    RangeCheck range = GlobalState::current->checkRange(h.sequenceNumber, h.messageCount);
+    if (range == RangeCheck::Duplicate) return;
+    bookHandler.presequenced = range == RangeCheck::InOrder;
+    forEachMoldMessage(buf, len, h.messageCount, [](const char *msg, uint16_t msgLen) {
+        // The length prefix says where the next message starts, so unknown and short messages are skipped
+        // over without losing the rest of the packet
+        bookHandler.decodeOne(msg, msgLen);
+    });
 }
 
-ssize_t parseTrade(const char *buf, TradeMessage &t) {
-    using namespace std::chrono;
+// Decoding of each message type into its struct, shared by the parse* functions and the log formatter
+static void decode(const char *buf, TradeMessage &t) {
     size_t offset = 0;
     // 1. Message Type (1 byte)
     t.messageType = buf[offset++];
 
     // 2. Timestamp (6 bytes)
     t.timestamp = readTimestamp(buf, offset);
-    // show latency
 
     // 3. Sequence number
     t.sequenceNumber = read4Bytes(buf, offset);
@@ -55,21 +206,14 @@ ssize_t parseTrade(const char *buf, TradeMessage &t) {
     
     // 7. Stock name
     std::memcpy(&t.stock, buf + offset, 8);
-    t.stock[7] = '\0';
+    t.stock[8] = '\0';
     offset += 8;
     
     // 8. Price
     t.price = read4Bytes(buf, offset);
-
-    logger.log(t);
-    // Get latency
-    //getDelta(t.timestamp);
-    // Set last sequence number
-    checkAndSetGlobalState(t.sequenceNumber);
-    return MessageSize::Trade;
 }
 
-ssize_t parseOrderExecuted(const char *buf, OrderExecutedMessage &t) {
+static void decode(const char *buf, OrderExecutedMessage &t) {
     size_t offset = 0;
     // 1. Message Type (1 byte)
     t.messageType = buf[offset++];
@@ -85,16 +229,9 @@ ssize_t parseOrderExecuted(const char *buf, OrderExecutedMessage &t) {
 
     // 4. Executed shares
     t.executedShares = read4Bytes(buf, offset);
-
-    logger.log(t);
-    // Get latency
-    //getDelta(t.timestamp);
-    // Check and set last sequence number
-    checkAndSetGlobalState(t.sequenceNumber);
-    return MessageSize::OrderExecuted;
 }
 
-ssize_t parseOrderWithPrice(const char *buf, OrderExecutedWithPriceMessage &t) {
+static void decode(const char *buf, OrderExecutedWithPriceMessage &t) {
     size_t offset = 0;
     // 1. Message Type (1 byte)
     t.messageType = buf[offset++];
@@ -116,16 +253,9 @@ ssize_t parseOrderWithPrice(const char *buf, OrderExecutedWithPriceMessage &t) {
     
     // 7. Executed price
     t.executedPrice = read4Bytes(buf, offset);
-
-    logger.log(t);
-    // Get latency
-    //getDelta(t.timestamp);
-    // Set last sequence number
-    checkAndSetGlobalState(t.sequenceNumber);
-    return MessageSize::OrderExecutedWithPrice;
 }
 
-ssize_t parseSystemEvent(const char *buf, SystemEventMessage &t) {
+static void decode(const char *buf, SystemEventMessage &t) {
     size_t offset = 0;
     // 1. Message Type (1 byte)
     t.messageType = buf[offset++];
@@ -138,16 +268,9 @@ ssize_t parseSystemEvent(const char *buf, SystemEventMessage &t) {
 
     // 4. Executed shares
     t.eventCode = buf[offset++];
-
-    logger.log(t);
-    // Get latency
-    //getDelta(t.timestamp);
-    // Set last sequence number
-    checkAndSetGlobalState(t.sequenceNumber);
-    return MessageSize::SystemEvent;
 }
 
-ssize_t parseOrderCancelled(const char *buf, OrderCancelMessage &t) {
+static void decode(const char *buf, OrderCancelMessage &t) {
     size_t offset = 0;
     // 1. Message Type (1 byte)
     t.messageType = buf[offset++];
@@ -163,43 +286,139 @@ ssize_t parseOrderCancelled(const char *buf, OrderCancelMessage &t) {
 
     // 5. Executed shares
     t.cancelledShares = read4Bytes(buf, offset);
+}
 
-    logger.log(t);
-    // Get latency
-    //getDelta(t.timestamp);
-    // Set last sequence number
-    checkAndSetGlobalState(t.sequenceNumber);
-    return MessageSize::OrderCancelled;
+static void decode(const char *buf, TableMessage &t) {
+    size_t offset = 0;
+    // 1. Message Type (1 byte), which picks the layout of the rest
+    t.messageType = buf[offset++];
+    t.layout = layoutOf(t.messageType);
+    t.raw = buf;
+
+    // 2. Timestamp (6 bytes)
+    t.timestamp = readTimestamp(buf, offset);
+
+    // 3. Sequence Number (4 bytes)
+    t.sequenceNumber = read4Bytes(buf, offset);
+}
+
+ssize_t parseTrade(const char *buf, TradeMessage &t, bool presequenced) {
+    decode(buf, t);
+    bookHandler.handleDecoded(TradeView(buf), presequenced);
+    return messageSize('A');
+}
+
+ssize_t parseOrderExecuted(const char *buf, OrderExecutedMessage &t, bool presequenced) {
+    decode(buf, t);
+    bookHandler.handleDecoded(OrderExecutedView(buf), presequenced);
+    return messageSize('E');
+}
+
+ssize_t parseOrderWithPrice(const char *buf, OrderExecutedWithPriceMessage &t, bool presequenced) {
+    decode(buf, t);
+    bookHandler.handleDecoded(OrderExecutedWithPriceView(buf), presequenced);
+    return messageSize('X');
+}
+
+ssize_t parseSystemEvent(const char *buf, SystemEventMessage &t, bool presequenced) {
+    decode(buf, t);
+    bookHandler.handleDecoded(SystemEventView(buf), presequenced);
+    return messageSize('S');
+}
+
+ssize_t parseOrderCancelled(const char *buf, OrderCancelMessage &t, bool presequenced) {
+    decode(buf, t);
+    bookHandler.handleDecoded(OrderCancelView(buf), presequenced);
+    return messageSize('C');
+}
+
+ssize_t parseTableMessage(const char *buf, TableMessage &t, bool presequenced) {
+    decode(buf, t);
+    bookHandler.handleDecoded(MessageView(buf), presequenced);
+    return t.layout->size;
+}
+
+// Appends text to a caller's buffer (at least MAX_LOG_LINE bytes for one line), with the subset of the
+// ostream interface the message formatters use, so the same formatters print to a stream and fill the
+// async log's batches
+class LineWriter {
+public:
+    explicit LineWriter(char *out): m_start(out), m_pos(out) {}
+
+    LineWriter &operator<<(char c) { *m_pos++ = c; return *this; }
+    LineWriter &operator<<(const char *s) { return write(s, strlen(s)); }
+    template<std::integral T>
+    LineWriter &operator<<(T v) {
+        m_pos = std::to_chars(m_pos, m_pos + 20, v).ptr;
+        return *this;
+    }
+    LineWriter &write(const char *s, size_t n) {
+        std::memcpy(m_pos, s, n);
+        m_pos += n;
+        return *this;
+    }
+    size_t size() const { return m_pos - m_start; }
+
+private:
+    char    *m_start;
+    char    *m_pos;
+};
+
+// RAW format: every field of the struct as name=value
+template<typename Stream>
+static void writeRaw(Stream &s, const TradeMessage &t) {
+    s << "[" << t.messageType << "] " << "timestamp=" << t.timestamp \
+    << " sequenceNumber=" << t.sequenceNumber << " orderRefNumber=" << t.orderRefNumber << " shares=" << t.shares << " stock=" \
+    << t.stock << " buysell=" << t.buySellIndicator << " price=" << t.price;
 }
 
-void TradeMessage::getRawLogImpl() const {
-    std::cout << "[" << messageType << "] " << "timestamp=" << timestamp \
-    << " sequenceNumber=" << sequenceNumber << " orderRefNumber=" << orderRefNumber << " shares=" << shares << " stock=" \
-    << stock << " buysell=" << buySellIndicator << " price=" << price;
+template<typename Stream>
+static void writeRaw(Stream &s, const OrderExecutedMessage &t) {
+    s << "[" << t.messageType << "] " << "timestamp=" << t.timestamp \
+    << " sequenceNumber=" << t.sequenceNumber << " orderRefNumber=" << t.orderRefNumber << " executedShares=" << t.executedShares;
 }
 
-void OrderExecutedMessage::getRawLogImpl() const {
-    std::cout << "[" << messageType << "] " << "timestamp=" << timestamp \
-    << " sequenceNumber=" << sequenceNumber << " orderRefNumber=" << orderRefNumber << " executedShares=" << executedShares;
+template<typename Stream>
+static void writeRaw(Stream &s, const OrderExecutedWithPriceMessage &t) {
+    s << "[" << t.messageType << "] " << "timestamp=" << t.timestamp \
+    << " sequenceNumber=" << t.sequenceNumber << " orderRefNumber=" << t.orderRefNumber << " executedShares=" << t.executedShares \
+    << " executedPrice=" << t.executedPrice << " printable=" << t.printable;
 }
 
-void OrderExecutedWithPriceMessage::getRawLogImpl() const {
-    std::cout << "[" << messageType << "] " << "timestamp=" << timestamp \
-    << " sequenceNumber=" << sequenceNumber << " orderRefNumber=" << orderRefNumber << " executedShares=" << executedShares \
-    << " executedPrice=" << executedPrice << " printable=" << printable;
+template<typename Stream>
+static void writeRaw(Stream &s, const SystemEventMessage &t) {
+    s << "[" << t.messageType << "] " << "timestamp=" << t.timestamp \
+    << " sequenceNumber=" << t.sequenceNumber << " eventCode=[" << t.eventCode << "]";
 }
 
-void SystemEventMessage::getRawLogImpl() const {
-    std::cout << "[" << messageType << "] " << "timestamp=" << timestamp \
-    << " sequenceNumber=" << sequenceNumber << " eventCode=[" << eventCode << "]";
+template<typename Stream>
+static void writeRaw(Stream &s, const OrderCancelMessage &t) {
+    s << "[" << t.messageType << "] " << "timestamp=" << t.timestamp \
+    << " sequenceNumber=" << t.sequenceNumber << " orderRefNumber=" << t.orderRefNumber << " cancelledShares=" << t.cancelledShares;
 }
 
-void OrderCancelMessage::getRawLogImpl() const {
-    std::cout << "[" << messageType << "] " << "timestamp=" << timestamp \
-    << " sequenceNumber=" << sequenceNumber << " orderRefNumber=" << orderRefNumber << " cancelledShares=" << cancelledShares;
+template<typename Stream>
+static void writeRaw(Stream &s, const TableMessage &t) {
+    s << "[" << t.messageType << "] " << "timestamp=" << t.timestamp << " sequenceNumber=" << t.sequenceNumber;
+    // Body fields straight from the layout, alpha fields as they are (space padded)
+    for (uint8_t i = 3; i < t.layout->fieldCount; i++) {
+        const FieldLayout &f = t.layout->fields[i];
+        s << " " << f.name << "=";
+        if (f.type == FieldType::Alpha) s.write(t.raw + f.offset, f.width);
+        else s << readField(t.raw, f);
+    }
 }
 
-std::ostream &operator<<(std::ostream &s, const TradeMessage &t) {
+void TradeMessage::getRawLogImpl() const { writeRaw(std::cout, *this); }
+void OrderExecutedMessage::getRawLogImpl() const { writeRaw(std::cout, *this); }
+void OrderExecutedWithPriceMessage::getRawLogImpl() const { writeRaw(std::cout, *this); }
+void SystemEventMessage::getRawLogImpl() const { writeRaw(std::cout, *this); }
+void OrderCancelMessage::getRawLogImpl() const { writeRaw(std::cout, *this); }
+void TableMessage::getRawLogImpl() const { writeRaw(std::cout, *this); }
+
+// VERBOSE format: one human readable line per message
+template<typename Stream>
+static void writeVerbose(Stream &s, const TradeMessage &t) {
     // Get timestamp in human readable form
     char out[20];
     nsToTimeStr(t.timestamp, out);
@@ -208,45 +427,97 @@ std::ostream &operator<<(std::ostream &s, const TradeMessage &t) {
         << (t.messageType == 'A' ? "Order Added: " : "Trade: ") \
         << "[" << t.orderRefNumber << "]: " << t.shares << " of $" \
         << t.stock << " to " << (t.buySellIndicator == 'B' ? "Buy " : "Sell ") \
-        << "@ " << t.price <<  std::endl;
-    return s;
+        << "@ " << t.price << '\n';
 }
 
-std::ostream &operator<<(std::ostream &s, const OrderExecutedMessage &t) {
+template<typename Stream>
+static void writeVerbose(Stream &s, const OrderExecutedMessage &t) {
     // Get timestamp in human readable form
     char out[20];
     nsToTimeStr(t.timestamp, out);
 
     s << "[" << out << "]" << " | " << "Order executed: " "[" << t.orderRefNumber << "]: " << \
-    t.executedShares << " shares" << std::endl;
-    return s;
+    t.executedShares << " shares" << '\n';
 }
 
-std::ostream &operator<<(std::ostream &s, const OrderExecutedWithPriceMessage &t) {
+template<typename Stream>
+static void writeVerbose(Stream &s, const OrderExecutedWithPriceMessage &t) {
     // Get timestamp in human readable form
     char out[20];
     nsToTimeStr(t.timestamp, out);
 
     s << "[" << out << "]" << " | " << "Order executed with price Order ID: [" \
-    << t.orderRefNumber << "]: " << t.executedShares << " @ " << t.executedPrice << std::endl;
-    return s;
+    << t.orderRefNumber << "]: " << t.executedShares << " @ " << t.executedPrice << '\n';
 }
 
-std::ostream &operator<<(std::ostream &s, const SystemEventMessage &t) {
+template<typename Stream>
+static void writeVerbose(Stream &s, const SystemEventMessage &t) {
     // Get timestamp in human readable form
     char out[20];
     nsToTimeStr(t.timestamp, out);
 
     s << "[" << out << "]" << " | " << (t.eventCode == 'O' ? "*MARKET OPEN" : "*MARKET CLOSE") \
     << "*\n";
-    return s;
 }
 
-std::ostream &operator<<(std::ostream &s, const OrderCancelMessage &t) {
+template<typename Stream>
+static void writeVerbose(Stream &s, const OrderCancelMessage &t) {
+    // Get timestamp in human readable form
+    char out[20];
+    nsToTimeStr(t.timestamp, out);
+
+    s << "[" << out << "]" << " | " << "Order cancelled Order ID: [" << t.orderRefNumber << "] cancelled." << '\n';
+}
+
+template<typename Stream>
+static void writeVerbose(Stream &s, const TableMessage &t) {
     // Get timestamp in human readable form
     char out[20];
     nsToTimeStr(t.timestamp, out);
 
-    s << "[" << out << "]" << " | " << "Order cancelled Order ID: [" << t.orderRefNumber << "] cancelled." << std::endl;
-    return s;
-}
\ No newline at end of file
+    s << "[" << out << "]" << " | " << t.layout->name << ":";
+    for (uint8_t i = 3; i < t.layout->fieldCount; i++) {
+        const FieldLayout &f = t.layout->fields[i];
+        s << " " << f.name << "=";
+        if (f.type == FieldType::Alpha) s.write(t.raw + f.offset, f.width);
+        else s << readField(t.raw, f);
+    }
+    s << '\n';
+}
+
+std::ostream &operator<<(std::ostream &s, const TradeMessage &t) { writeVerbose(s, t); return s; }
+std::ostream &operator<<(std::ostream &s, const OrderExecutedMessage &t) { writeVerbose(s, t); return s; }
+std::ostream &operator<<(std::ostream &s, const OrderExecutedWithPriceMessage &t) { writeVerbose(s, t); return s; }
+std::ostream &operator<<(std::ostream &s, const SystemEventMessage &t) { writeVerbose(s, t); return s; }
+std::ostream &operator<<(std::ostream &s, const OrderCancelMessage &t) { writeVerbose(s, t); return s; }
+std::ostream &operator<<(std::ostream &s, const TableMessage &t) { writeVerbose(s, t); return s; }
+
+// Decode a logged message into its struct and format it, on the async log's formatter thread
+template<LogLevel Level, typename MessageType>
+static void formatMessage(const char *msg, LineWriter &w) {
+    MessageType m;
+    decode(msg, m);
+    if constexpr (Level == LogLevel::RAW) {
+        writeRaw(w, m);
+        w << '\n';
+    } else {
+        writeVerbose(w, m);
+    }
+}
+
+template<LogLevel Level>
+size_t formatLogRecord(const char *msg, char *out) {
+    LineWriter w(out);
+    switch (msg[0]) {
+        case 'A': case 'P': formatMessage<Level, TradeMessage>(msg, w); break;
+        case 'E': formatMessage<Level, OrderExecutedMessage>(msg, w); break;
+        case 'X': formatMessage<Level, OrderExecutedWithPriceMessage>(msg, w); break;
+        case 'S': formatMessage<Level, SystemEventMessage>(msg, w); break;
+        case 'C': formatMessage<Level, OrderCancelMessage>(msg, w); break;
+        default: formatMessage<Level, TableMessage>(msg, w); break;
+    }
+    return w.size();
+}
+
+template size_t formatLogRecord<LogLevel::VERBOSE>(const char *msg, char *out);
+template size_t formatLogRecord<LogLevel::RAW>(const char *msg, char *out);
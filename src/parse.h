@@ -4,6 +4,9 @@
 #include <atomic>
 #include <bitset>
 #include "helper.h"
+#include "itch.h"
+#include "message_view.h"
+#include "async_log.h"
 
 enum LogLevel {
     VERBOSE = 1, RAW, OFF
@@ -13,52 +16,58 @@ enum LogLevel {
 // out of order, as duplicates or lost
 constexpr size_t WINDOW_SIZE = 65536; //8MB window size
 
-enum MessageSize {
-    Trade = 36,
-    OrderExecuted = 23,
-    OrderExecutedWithPrice = 28,
-    SystemEvent = 12,
-    OrderCancelled = 23
-};
-
-// Logger class to print parsed messages
+// Get size of each ITCH message from its type byte, 0 if the type is unknown
+inline size_t getMessageSize(const char &msgType) {
+    return messageSize(msgType);
+}
+
+// Read the sequence number of the message at buf without parsing it (it follows the type and timestamp)
+inline uint32_t peekSequenceNumber(const char *buf) {
+    size_t offset = 7;
+    return read4Bytes(buf, offset);
+}
+
+// Read the timestamp (nanoseconds since midnight) of the message at buf without parsing it
+inline uint64_t peekTimestamp(const char *buf) {
+    size_t offset = 1;
+    return readTimestamp(buf, offset);
+}
+
+// Level the parser logs at, fixed at compile time: build with -DMDFH_LOG_LEVEL=VERBOSE or -DMDFH_LOG_LEVEL=RAW to
+// log every parsed message. The default OFF build has no logging code in the parse path at all
+#ifndef MDFH_LOG_LEVEL
+#define MDFH_LOG_LEVEL OFF
+#endif
+constexpr LogLevel LOG_LEVEL = LogLevel::MDFH_LOG_LEVEL;
+
+// Formats a logged message at the given level (VERBOSE or RAW), a LogFormatter for the async log
+template<LogLevel Level>
+size_t formatLogRecord(const char *msg, char *out);
+
+// Logger of parsed messages, the level is a template parameter so a disabled logger compiles away. Logging only
+// copies the message into the async log (async_log.h), the formatting and writing happen on the formatter thread
+template<LogLevel Level>
 class Logger {
 public:
-    Logger(LogLevel l = LogLevel::VERBOSE): m_logLevel(l) {}
-    void setLogLevel(LogLevel l) { m_logLevel = l; }
-
-    // delete move/copy constructor/assignment operators for safety
-    Logger(const Logger &) = delete;
-    Logger& operator=(const Logger &) = delete;
-    Logger(Logger &&) = delete;
-    Logger& operator=(Logger &&) = delete;
-
-    //  Templated logging function that logs based on the level
-    template <typename MessageType>
-    void log(const MessageType &m) const {
-        switch (m_logLevel) {
-            case LogLevel::VERBOSE:
-                verbose(m);
-                break;
-            case LogLevel::RAW:
-                raw(m);
-                break;
-            default:
-                break;
-        }
-    }
-
-private:
-    LogLevel m_logLevel;
+    static constexpr bool enabled = Level != LogLevel::OFF;
 
-    // Nested templated logging function that logs based on input MessageType
-    template <typename MessageType>
-    void verbose(const MessageType &parsedMsg) const { std::cout << parsedMsg; }
+    // Start the formatter thread writing to fd on the given core, and stop it once everything is written
+    static void start(int fd, int cpu) {
+        if constexpr (enabled) asyncLog.start(fd, formatLogRecord<Level>, cpu);
+    }
+    static void stop() {
+        if constexpr (enabled) asyncLog.stop();
+    }
 
-    template <typename MessageType>
-    void raw(const MessageType &parsedMsg) const { parsedMsg.getRawLog(); }
+    // Log a message of a known type
+    static void log(const char *msg) {
+        if constexpr (enabled) asyncLog.push(msg);
+    }
 };
 
+// Logger of the parse path
+using FeedLogger = Logger<LOG_LEVEL>;
+
 
 // Parsing structs (Updated to feature CRTP for static polymorphism, avoiding virtual function overhead)
 template<typename DerivedMessage>
@@ -80,7 +89,7 @@ struct TradeMessage: OrderMessage<TradeMessage> {
     char        buySellIndicator;
     uint32_t    shares;
     uint32_t    price;
-    char        stock[8];
+    char        stock[9];       // the 8 byte field as sent, null terminated for printing
     void getRawLogImpl() const;
 };
 
@@ -106,24 +115,44 @@ struct OrderCancelMessage: OrderMessage<OrderCancelMessage> {
     void getRawLogImpl() const;
 };
 
-// Parsing functions
+// Any other message type, decoded from its layout table. Only the header is copied out, the body is read
+// from the payload through the layout, so raw must not outlive the payload
+struct TableMessage: Message<TableMessage> {
+    const MessageLayout *layout;
+    const char          *raw;
+    void getRawLogImpl() const;
+};
+
+// Messages that could not be parsed. An unknown type in a bare run of messages also loses the rest of its
+// payload, since the next message boundary can't be found without the size
+struct ParseStats {
+    uint64_t    unknownMessages = 0;
+    uint64_t    truncatedMessages = 0;
+};
+
+inline ParseStats parseStats;
+
+// Parsing functions. parseMessage and parseMoldPacket sequence and book every message straight from the
+// payload through message views (message_view.h), decoding only the fields that are read (their decode loop is
+// the one of handler.h, for consumers of their own). The parse* functions
+// decode one message into a struct the caller owns (the copy that outlives the payload), then hand it to the
+// same handler step (subscriptions, book, top of book, publishing, latency stamps). No receive path calls them,
+// the async log copies the raw message: they are the copy-out decoders of the benchmarks and tools.
+// presequenced = the sequencer has already accepted the message as part of a whole datagram (MoldUDP64
+// framing), so it is applied without a check of its own
 void parseMessage(const char* buf, const ssize_t &len); 
-ssize_t parseTrade(const char* buf, TradeMessage &t);
-ssize_t parseOrderExecuted(const char* buf, OrderExecutedMessage &t);
-ssize_t parseOrderWithPrice(const char* buf, OrderExecutedWithPriceMessage &t);
-ssize_t parseSystemEvent(const char* buf, SystemEventMessage &t);
-ssize_t parseOrderCancelled(const char* buf, OrderCancelMessage &t);
-
-// Static parsing structs (fixed memory address means they will be cache hot, faster writes)
-static TradeMessage tradeMsg{};
-static OrderExecutedMessage orderExecutedMsg{};
-static OrderExecutedWithPriceMessage orderExecutedWithPriceMsg{};
-static SystemEventMessage sysMsg{};
-static OrderCancelMessage orderCancelMsg{};
-
-// Operator overloads for logging
-std::ostream &operator<<(std::ostream &s, TradeMessage &t);
-std::ostream &operator<<(std::ostream &s, OrderExecutedMessage &t);
-std::ostream &operator<<(std::ostream &s, OrderExecutedWithPriceMessage &t);
-std::ostream &operator<<(std::ostream &s, SystemEventMessage &t);
-std::ostream &operator<<(std::ostream &s, OrderCancelMessage &t);
\ No newline at end of file
+void parseMoldPacket(const char* buf, const ssize_t &len);
+ssize_t parseTrade(const char* buf, TradeMessage &t, bool presequenced = false);
+ssize_t parseOrderExecuted(const char* buf, OrderExecutedMessage &t, bool presequenced = false);
+ssize_t parseOrderWithPrice(const char* buf, OrderExecutedWithPriceMessage &t, bool presequenced = false);
+ssize_t parseSystemEvent(const char* buf, SystemEventMessage &t, bool presequenced = false);
+ssize_t parseOrderCancelled(const char* buf, OrderCancelMessage &t, bool presequenced = false);
+ssize_t parseTableMessage(const char* buf, TableMessage &t, bool presequenced = false);
+
+// Operator overloads for printing the message structs, the same text the async log writes at VERBOSE
+std::ostream &operator<<(std::ostream &s, const TradeMessage &t);
+std::ostream &operator<<(std::ostream &s, const OrderExecutedMessage &t);
+std::ostream &operator<<(std::ostream &s, const OrderExecutedWithPriceMessage &t);
+std::ostream &operator<<(std::ostream &s, const SystemEventMessage &t);
+std::ostream &operator<<(std::ostream &s, const OrderCancelMessage &t);
+std::ostream &operator<<(std::ostream &s, const TableMessage &t);
\ No newline at end of file
@@ -0,0 +1,157 @@
+// Pipelined receive mode: an RX thread walks the TPACKET_V3 ring and only finds UDP payloads, publishing
+// descriptors into an SPSC ring. A parser thread on another core consumes them, runs parsePayload and the
+// sequencer, and hands blocks back to the kernel in order once every payload in them has been parsed.
+// The RX side never waits on parsing unless the hand-off ring itself is full, so bursts are absorbed by
+// PIPELINE_DEPTH payloads of slack on top of the kernel ring.
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <poll.h>
+#include <immintrin.h>
+#include "ring.h"
+#include "spsc.h"
+#include "demux.h"
+#include "parse.h"
+#include "sequencer.h"
+#include "recovery.h"
+#include "moldudp64.h"
+#include "latency.h"
+#include "stats_page.h"
+
+constexpr size_t PIPELINE_DEPTH = 8192;
+
+// A UDP payload found by the RX thread. len == 0 marks the end of `block`: every payload in it has been
+// published, so the parser can release the block once it reaches this marker.
+struct PayloadDesc {
+    const char  *payload;
+    uint32_t    len;
+    uint32_t    block;
+    uint64_t    tsNs;       // kernel receive time, for the latency recorder
+};
+
+using PayloadRing = SpscRing<PayloadDesc, PIPELINE_DEPTH>;
+
+// Hand-off ring occupancy histogram, bucket i counts publishes that found bit_width(depth) == i
+constexpr size_t OCCUPANCY_BUCKETS = std::bit_width(PIPELINE_DEPTH) + 1;
+
+// Single writer counters, each stage on its own cache line(s) so the RX and parser threads never write the
+// same line. Updated with a relaxed load + store (plain movs on x86, no locked instructions) and sampled
+// live by the main thread.
+struct alignas(CACHE_LINE_SIZE) RxStageStats {
+    std::atomic<uint64_t>   packets{0};         // packets walked in the ring
+    std::atomic<uint64_t>   payloads{0};        // payloads published to the parser
+    std::atomic<uint64_t>   blocks{0};          // blocks fully published
+    std::atomic<uint64_t>   ringFullSpins{0};   // spins waiting for the parser to free a hand-off slot
+    std::atomic<uint64_t>   blockWaitSpins{0};  // spins waiting for the parser to release a block
+    std::atomic<uint64_t>   maxOccupancy{0};    // high water mark of the hand-off ring
+    std::atomic<uint64_t>   occupancy[OCCUPANCY_BUCKETS]{};
+};
+
+struct alignas(CACHE_LINE_SIZE) ParseStageStats {
+    std::atomic<uint64_t>   payloads{0};        // payloads parsed
+    std::atomic<uint64_t>   emptyPolls{0};      // polls that found the hand-off ring empty (parser idle)
+    std::atomic<uint64_t>   blocksReleased{0};  // blocks handed back to the kernel, also RX flow control
+};
+
+struct Pipeline {
+    PayloadRing     queue;
+    RxStageStats    rx;
+    ParseStageStats parse;
+    RingStatsWriter ringStats;  // the ring's lines of the stats page, kept by the RX thread
+};
+
+// Single writer increment, see RxStageStats
+inline void bump(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// RX stage: find the UDP payloads in each block and publish them, followed by an end of block marker
+inline void rxLoop(RxRing &ring, Pipeline &p, uint32_t mcast_ip, uint16_t dest_port) {
+    pollfd pfd{};
+    pfd.fd = ring.sockfd;
+    pfd.events = POLLIN;
+
+    auto publish = [&p](const PayloadDesc &d) {
+        while (!p.queue.tryPush(d)) {
+            bump(p.rx.ringFullSpins);
+            _mm_pause();
+        }
+        uint64_t depth = p.queue.size();
+        bump(p.rx.occupancy[std::bit_width(depth)]);
+        if (depth > p.rx.maxOccupancy.load(std::memory_order_relaxed)) p.rx.maxOccupancy.store(depth, std::memory_order_relaxed);
+    };
+
+    uint64_t published = 0;
+    for (uint32_t block_idx = 0; ; block_idx = (block_idx + 1) % ring.blockNr) {
+        // The parser releases blocks, so before touching this block again make sure it has handed back our
+        // previous lap's use of it, otherwise we would see the TP_STATUS_USER left over from that lap
+        while (published - p.parse.blocksReleased.load(std::memory_order_acquire) >= ring.blockNr) {
+            bump(p.rx.blockWaitSpins);
+            _mm_pause();
+        }
+
+        // Blocks are retired by the kernel in ring order, so wait on this block rather than skipping ahead
+        tpacket_block_desc *block_ptr = ring.block(block_idx);
+        while (!RxRing::ready(block_ptr)) poll(&pfd, 1, -1);
+
+        forEachPacket(block_ptr, [&](tpacket3_hdr *pkt) {
+            bump(p.rx.packets);
+            ssize_t payload_length;
+            char *payload = extractUdpPayload((char *)pkt + pkt->tp_mac, pkt->tp_snaplen, mcast_ip, dest_port, payload_length);
+            if (!payload || payload_length == 0) return;
+            publish(PayloadDesc{payload, (uint32_t) payload_length, block_idx, RxRing::packetNs(pkt)});
+            bump(p.rx.payloads);
+        });
+
+        p.ringStats.onBlock(ring, block_idx);
+        publish(PayloadDesc{nullptr, 0, block_idx, 0});
+        bump(p.rx.blocks);
+        published++;
+    }
+}
+
+// Parse stage: parse and sequence every payload, releasing blocks as their end markers come through.
+// The hand-off ring is FIFO and RX publishes blocks in ring order, so blocks are released in order.
+// The parser owns the sequencer, so it also polls the gap deadline: at every block boundary, and while idle
+// with a gap open (TSC clock only, packet time stands still without packets).
+inline void parseLoop(RxRing &ring, Pipeline &p, GapClock clock = GapClock::Tsc) {
+    PayloadDesc d;
+    for (;;) {
+        if (!p.queue.tryPop(d)) {
+            bump(p.parse.emptyPolls);
+            if (clock == GapClock::Tsc && GlobalState::sequencer.gapExists()) serviceGaps(tscClock.nowNs());
+            _mm_pause();
+            continue;
+        }
+        if (d.len == 0) {
+            tpacket_block_desc *block_ptr = ring.block(d.block);
+            uint64_t nowNs = blockTimeNs(clock, block_ptr);
+            release_block(block_ptr);
+            p.parse.blocksReleased.store(p.parse.blocksReleased.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            serviceGaps(nowNs);
+            continue;
+        }
+        latency.beginPacket(d.tsNs);
+        parsePayload(d.payload, d.len);
+        bump(p.parse.payloads);
+    }
+}
+
+// One line snapshot of both stages, printed periodically by the main thread
+inline void printPipelineStats(const Pipeline &p, uint32_t blockNr) {
+    uint64_t blocks = p.rx.blocks.load(std::memory_order_relaxed);
+    uint64_t released = p.parse.blocksReleased.load(std::memory_order_relaxed);
+    printf("[rx] pkts=%lu payloads=%lu blocks=%lu full_spins=%lu block_wait_spins=%lu | "
+           "[queue] depth=%zu max=%lu/%zu | [parse] payloads=%lu idle_polls=%lu released=%lu | blocks_in_flight=%lu/%u\n",
+           p.rx.packets.load(std::memory_order_relaxed), p.rx.payloads.load(std::memory_order_relaxed), blocks,
+           p.rx.ringFullSpins.load(std::memory_order_relaxed), p.rx.blockWaitSpins.load(std::memory_order_relaxed),
+           p.queue.size(), p.rx.maxOccupancy.load(std::memory_order_relaxed), PayloadRing::capacity(),
+           p.parse.payloads.load(std::memory_order_relaxed), p.parse.emptyPolls.load(std::memory_order_relaxed),
+           released, blocks - released, blockNr);
+    printf("[queue occupancy] ");
+    for (size_t i = 0; i < OCCUPANCY_BUCKETS; i++) {
+        printf("<%zu:%lu ", (size_t) 1 << i, p.rx.occupancy[i].load(std::memory_order_relaxed));
+    }
+    printf("\n");
+}
@@ -0,0 +1,182 @@
+// Gap recovery: instead of letting every gap run into the deadline and be counted as lost, missing ranges are
+// requested from a retransmit server over unicast UDP (MoldUDP64 request packets, one per missing range, all
+// of a poll's ranges sent with a single sendmmsg). Responses are MoldUDP64 packets that go through
+// parseMoldPacket, so they are merged by the sequencer like any late copy: filling the window and draining it.
+//
+// Nothing here blocks. The socket is non-blocking, requests are fire and forget (re-sent every RECOVERY_RETRY
+// while the gap is still open) and responses are drained by serviceGaps() at the same points the gap deadline
+// is polled. The deadline still applies, so whatever hasn't been recovered by GAP_TIMEOUT is counted as lost.
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "parse.h"
+#include "sequencer.h"
+#include "moldudp64.h"
+#include "stats_page.h"
+
+// Gaps younger than this are usually just reordering, give them a chance to close on their own first
+constexpr uint64_t RECOVERY_DELAY_NS = std::chrono::nanoseconds(std::chrono::microseconds(100)).count();
+// Re-request everything still missing this often
+constexpr uint64_t RECOVERY_RETRY_NS = std::chrono::nanoseconds(std::chrono::milliseconds(1)).count();
+// Ranges requested per poll (one request packet each)
+constexpr uint32_t MAX_RECOVERY_RANGES = 16;
+constexpr size_t RECOVERY_RECV_SIZE = 2048;
+
+struct RecoveryStats {
+    uint64_t    requests = 0;           // request packets sent
+    uint64_t    requestedMessages = 0;  // sequence numbers asked for (re-requests included)
+    uint64_t    responses = 0;          // response packets received
+    uint64_t    messages = 0;           // messages received in responses (late ones are dropped as duplicates)
+    uint64_t    gapsRecovered = 0;      // gaps closed after a request without losing anything
+    uint64_t    recoveryNsTotal = 0;    // first request to gap closed, over the recovered gaps
+    uint64_t    recoveryNsMax = 0;
+};
+
+class GapRecovery {
+public:
+    RecoveryStats stats;
+
+    // Open the non-blocking request socket, serverIp and port in network byte order
+    bool open(uint32_t serverIp, uint16_t port) {
+        m_sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+        if (m_sockfd < 0) {
+            perror("Failed to create retransmission request socket");
+            return false;
+        }
+        m_server = sockaddr_in{};
+        m_server.sin_family = AF_INET;
+        m_server.sin_addr.s_addr = serverIp;
+        m_server.sin_port = port;
+        // Connected, so responses from anyone else are filtered by the kernel and send needs no address
+        if (connect(m_sockfd, (sockaddr *)&m_server, sizeof(m_server)) < 0) {
+            perror("Failed to connect retransmission request socket");
+            ::close(m_sockfd);
+            m_sockfd = -1;
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (m_sockfd >= 0) ::close(m_sockfd);
+        m_sockfd = -1;
+    }
+
+    bool enabled() const { return m_sockfd >= 0; }
+
+    // Drain responses and (re-)request the missing ranges of the global sequencer. Called by the thread that
+    // owns the sequencer, before polling the gap deadline.
+    void poll(uint64_t nowNs) {
+        if (m_awaiting) drain();
+
+        Sequencer &seq = GlobalState::sequencer;
+        if (!seq.gapExists()) {
+            if (m_requested && seq.stats.lostMessages == m_lostAtRequest) {
+                uint64_t ns = nowNs - m_firstRequest;
+                stats.gapsRecovered++;
+                stats.recoveryNsTotal += ns;
+                if (ns > stats.recoveryNsMax) stats.recoveryNsMax = ns;
+            }
+            m_gapSeen = false;
+            m_requested = false;
+            return;
+        }
+        if (!m_gapSeen) {
+            m_gapSeen = true;
+            m_gapSince = nowNs;
+            return;
+        }
+        if (nowNs - m_gapSince < RECOVERY_DELAY_NS) return;
+        if (m_requested && nowNs - m_lastRequest < RECOVERY_RETRY_NS) return;
+
+        request(seq);
+        m_lastRequest = nowNs;
+        if (!m_requested) {
+            m_requested = true;
+            m_firstRequest = nowNs;
+            m_lostAtRequest = seq.stats.lostMessages;
+        }
+    }
+
+private:
+    int             m_sockfd = -1;
+    sockaddr_in     m_server{};
+    bool            m_gapSeen = false;
+    bool            m_requested = false;
+    bool            m_awaiting = false;     // responses may still be on the way
+    uint64_t        m_gapSince = 0;
+    uint64_t        m_firstRequest = 0;
+    uint64_t        m_lastRequest = 0;
+    uint32_t        m_lostAtRequest = 0;
+    char            m_requests[MAX_RECOVERY_RANGES][MOLD_HEADER_LEN];
+
+    // One MoldUDP64 request per missing range, sent together
+    void request(const Sequencer &seq) {
+        mmsghdr msgs[MAX_RECOVERY_RANGES]{};
+        iovec iov[MAX_RECOVERY_RANGES];
+        uint32_t n = 0;
+        seq.forEachGap([&](uint32_t first, uint32_t count) {
+            // Ranges longer than a request can describe are asked for again on the next retry
+            while (count > 0 && n < MAX_RECOVERY_RANGES) {
+                uint16_t c = count > UINT16_MAX ? UINT16_MAX : count;
+                writeMoldHeader(m_requests[n], MOLD_SESSION, first, c);
+                iov[n] = iovec{m_requests[n], MOLD_HEADER_LEN};
+                msgs[n].msg_hdr.msg_iov = &iov[n];
+                msgs[n].msg_hdr.msg_iovlen = 1;
+                stats.requestedMessages += c;
+                first += c;
+                count -= c;
+                n++;
+            }
+        });
+        if (n == 0) return;
+        int sent = sendmmsg(m_sockfd, msgs, n, MSG_DONTWAIT);
+        if (sent > 0) stats.requests += sent;
+        m_awaiting = true;
+    }
+
+    // Read every response that has arrived, without blocking
+    void drain() {
+        char buf[RECOVERY_RECV_SIZE];
+        for (;;) {
+            ssize_t len = recv(m_sockfd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (len < 0) {
+                // Nothing more for now, stop checking once there is no gap left to fill
+                if (!GlobalState::sequencer.gapExists()) m_awaiting = false;
+                return;
+            }
+            MoldHeader h;
+            if (!readMoldHeader(buf, len, h) || std::memcmp(h.session, MOLD_SESSION, MOLD_SESSION_LEN)) continue;
+            stats.responses++;
+            stats.messages += h.messageCount;
+            // Responses fill the global sequencer's gaps, whichever channel (channels.h) the last datagram selected
+            GlobalState::current = &GlobalState::sequencer;
+            parseMoldPacket(buf, len);
+        }
+    }
+};
+
+// Recovery for the live feed, enabled by opening it
+inline GapRecovery gapRecovery;
+
+// Everything the thread that owns the sequencer does about gaps at a block boundary or idle poll: recover
+// what it can, then give up on whatever is past the deadline. Returns true if the window was flushed.
+inline bool serviceGaps(uint64_t nowNs) {
+    if (gapRecovery.enabled()) gapRecovery.poll(nowNs);
+    bool flushed = checkGapTimeout(nowNs);
+    statsPage.publishSequencer();
+    return flushed;
+}
+
+inline void printRecoveryStats(const GapRecovery &r) {
+    const RecoveryStats &s = r.stats;
+    printf("[recovery] requests=%lu requested=%lu responses=%lu messages=%lu gaps_recovered=%lu mean_recovery=%luns max_recovery=%luns\n",
+           s.requests, s.requestedMessages, s.responses, s.messages, s.gapsRecovered,
+           s.gapsRecovered ? s.recoveryNsTotal / s.gapsRecovered : 0, s.recoveryNsMax);
+}
@@ -0,0 +1,134 @@
+// Memory residency (--resident): everything the receive path touches is in memory and mapped before the first
+// message, and stays that way. Without it the first messages fault in the order table, the sequencer window,
+// the heap the book levels come from and the stack page by page (each a trip into the kernel), and a quiet
+// process can have its pages reclaimed or swapped. Once at startup, before the first message:
+//   - the big hot tables (orderbook.h) are allocated again on 2 MB pages, prefaulted (hugepage.h)
+//   - the sequencer window is written through
+//   - the heap is grown by RESIDENCY_HEAP_BYTES and kept (no trimming, no mmap for big blocks), so book
+//     levels and anything else allocated later comes from memory that is already there, and the stack by
+//     RESIDENCY_STACK_BYTES
+//   - all of it is locked: mlockall(MCL_CURRENT | MCL_FUTURE) faults in and locks everything mapped so far
+//     and everything mapped later as it is mapped. That includes whole thread stacks and journal segments
+//     (--journal-size), which is what the host needs the memory for. MCL_ONFAULT would avoid that but also
+//     turns MAP_POPULATE off for every later mapping, the shared memory feeds included
+// The packet rings need nothing: the kernel inserts all of a ring's pages when it is mapped, and can't reclaim
+// them. FaultWatch then checks it worked, counting the page faults a loop takes once it is in steady state.
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <malloc.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "parse.h"
+#include "hugepage.h"
+#include "orderbook.h"
+#include "sequencer.h"
+#include "clock.h"
+
+constexpr size_t RESIDENCY_HEAP_BYTES = 64 * 1024 * 1024;
+constexpr size_t RESIDENCY_STACK_BYTES = 256 * 1024;
+constexpr uint64_t FAULT_POLL_NS = 100'000'000;
+
+// Page faults taken by the calling thread so far
+inline void threadFaults(uint64_t &minor, uint64_t &major) {
+    rusage ru{};
+    getrusage(RUSAGE_THREAD, &ru);
+    minor = ru.ru_minflt;
+    major = ru.ru_majflt;
+}
+
+class Residency {
+public:
+    // Once, from the thread that will run the sequencer, before the first message. Prints what it did.
+    // Returns false if the memory could not be locked (everything else is still done)
+    bool enable() {
+        timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        hugePages.enable();
+        orderBooks.makeResident();
+        GlobalState::sequencer.touchWindow();
+        mallopt(M_MMAP_MAX, 0);
+        mallopt(M_TRIM_THRESHOLD, -1);
+        if (void *heap = malloc(RESIDENCY_HEAP_BYTES)) {
+            prefault(heap, RESIDENCY_HEAP_BYTES);
+            free(heap);
+        }
+        growStack();
+        m_locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        if (!m_locked) perror("mlockall() (raise ulimit -l or grant CAP_IPC_LOCK)");
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        m_startupNs = (end.tv_sec - start.tv_sec) * 1'000'000'000ULL + end.tv_nsec - start.tv_nsec;
+        m_enabled = true;
+
+        printf("[residency] %s in %.1f ms:", m_locked ? "resident and locked" : "resident, NOT locked", m_startupNs / 1e6);
+        for (size_t b = PAGE_BACKINGS; b-- > 0;) {
+            if (hugePages.bytes((PageBacking) b)) printf(" %zu MB on %s", hugePages.bytes((PageBacking) b) >> 20, PAGE_BACKING_NAMES[b]);
+        }
+        printf("\n");
+        return m_locked;
+    }
+
+    bool enabled() const { return m_enabled; }
+    bool locked() const { return m_locked; }
+    uint64_t startupNs() const { return m_startupNs; }
+
+private:
+    bool        m_enabled = false;
+    bool        m_locked = false;
+    uint64_t    m_startupNs = 0;
+
+    [[gnu::noinline]] static void growStack() {
+        volatile char stack[RESIDENCY_STACK_BYTES];
+        for (size_t i = 0; i < RESIDENCY_STACK_BYTES; i += SMALL_PAGE_SIZE) stack[i] = 0;
+        // Keeps the touched frame from being optimized away
+        asm volatile("" :: "r"(stack) : "memory");
+    }
+};
+
+// Page faults a loop takes in steady state, kept by the thread running it. Armed once the loop is past its
+// first block, then polled at block boundaries: a fault there means something the loop touches wasn't
+// resident, which is reported the first time it happens. Does nothing until armed
+class FaultWatch {
+public:
+    void arm() {
+        threadFaults(m_baseMinor, m_baseMajor);
+        m_armed = true;
+    }
+
+    bool armed() const { return m_armed; }
+
+    void poll() {
+        if (!m_armed) return;
+        uint64_t now = tscClock.nowNs();
+        if (now < m_nextPoll) return;
+        m_nextPoll = now + FAULT_POLL_NS;
+        update();
+    }
+
+    // Read the counts now, whatever the poll interval
+    void update() {
+        if (!m_armed) return;
+        uint64_t minor, major;
+        threadFaults(minor, major);
+        m_minor = minor - m_baseMinor;
+        m_major = major - m_baseMajor;
+        if ((m_minor || m_major) && !m_reported) {
+            fprintf(stderr, "[residency] the receive loop took %lu minor and %lu major page faults in steady state\n", m_minor, m_major);
+            m_reported = true;
+        }
+    }
+
+    uint64_t minorFaults() const { return m_minor; }
+    uint64_t majorFaults() const { return m_major; }
+
+private:
+    bool        m_armed = false;
+    bool        m_reported = false;
+    uint64_t    m_baseMinor = 0, m_baseMajor = 0;
+    uint64_t    m_minor = 0, m_major = 0;
+    uint64_t    m_nextPoll = 0;
+};
+
+// Process wide (--resident)
+inline Residency residency;
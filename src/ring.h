@@ -0,0 +1,205 @@
+// PACKET_MMAP (TPACKET_V3) receive ring setup and block walking, shared by every receive mode
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include "helper.h"
+#include "clock.h"
+
+// PACKET_MMAP RING BUFFER CONSTS, the default geometry (--block-size, --block-nr, --frame-size, --retire-tov)
+constexpr unsigned int BLOCK_SIZE = 524288;
+constexpr unsigned int FRAME_SIZE = 2048;
+constexpr unsigned int BLOCK_NR = 64;
+constexpr unsigned int FRAME_NR = (BLOCK_NR * BLOCK_SIZE) / FRAME_SIZE;
+constexpr unsigned int RETIRE_TOV_MS = 0;
+
+// Shape of a TPACKET_V3 ring. The kernel hands blocks to user space whole, once full or once the retire timeout
+// expires, so the block size trades wakeups and block releases against how long a packet can sit in a part
+// filled block on a quiet feed, and the block count is how much of a burst the ring absorbs while the loop is
+// behind. With TPACKET_V3 the frame size is only a sanity bound on what fits in a block.
+struct RingGeometry {
+    uint32_t    blockSize = BLOCK_SIZE;
+    uint32_t    blockNr = BLOCK_NR;
+    uint32_t    frameSize = FRAME_SIZE;
+    uint32_t    retireTovMs = RETIRE_TOV_MS;   // 0 = the kernel picks it from the link speed
+
+    size_t bytes() const { return (size_t) blockSize * blockNr; }
+
+    // Why PACKET_RX_RING would refuse it, nullptr if it won't
+    const char *invalid() const {
+        if (blockSize == 0 || blockSize % getpagesize()) return "the block size must be a multiple of the page size";
+        if (frameSize < TPACKET3_HDRLEN || frameSize % TPACKET_ALIGNMENT) return "the frame size must be a multiple of 16, at least TPACKET3_HDRLEN";
+        if (frameSize > blockSize) return "the frame size can't be larger than a block";
+        if (blockNr == 0) return "the ring needs at least one block";
+        if ((uint64_t) (blockSize / frameSize) * blockNr > UINT32_MAX) return "the ring holds too many frames";
+        return nullptr;
+    }
+};
+
+// A TPACKET_V3 receive ring mapped into the process
+struct RxRing {
+    int         sockfd = -1;
+    uint8_t     *ptr = nullptr;
+    size_t      len = 0;
+    uint32_t    blockSize = BLOCK_SIZE;
+    uint32_t    blockNr = BLOCK_NR;
+
+    tpacket_block_desc* block(uint32_t idx) const {
+        return (tpacket_block_desc *)(ptr + (size_t) idx * blockSize);
+    }
+
+    // A block belongs to user space once the kernel has retired it (filled it or timed it out)
+    static bool ready(const tpacket_block_desc *block_ptr) {
+        return block_ptr->hdr.bh1.block_status & TP_STATUS_USER;
+    }
+
+    // Kernel receive time of the last packet in a retired block (CLOCK_REALTIME nanoseconds), read it
+    // before the block is released
+    static uint64_t lastPacketNs(const tpacket_block_desc *block_ptr) {
+        const tpacket_bd_ts &ts = block_ptr->hdr.bh1.ts_last_pkt;
+        return (uint64_t) ts.ts_sec * 1'000'000'000ULL + ts.ts_nsec;
+    }
+
+    // Kernel receive time of a packet (CLOCK_REALTIME nanoseconds)
+    static uint64_t packetNs(const tpacket3_hdr *pkt) {
+        return (uint64_t) pkt->tp_sec * 1'000'000'000ULL + pkt->tp_nsec;
+    }
+};
+
+// Time to poll the gap deadline with at the end of a retired block
+inline uint64_t blockTimeNs(GapClock clock, const tpacket_block_desc *block_ptr) {
+    return clock == GapClock::Packet ? RxRing::lastPacketNs(block_ptr) : tscClock.nowNs();
+}
+
+// Create an AF_PACKET socket with a TPACKET_V3 PACKET_RX_RING of the given geometry, map the ring and bind it to
+// the NIC. Returns false (after printing why) if any step fails.
+inline bool openRxRing(const std::string &nic, RxRing &ring, const RingGeometry &geometry = RingGeometry{}) {
+    if (const char *why = geometry.invalid()) {
+        std::cerr << "Invalid ring geometry: " << why << std::endl;
+        return false;
+    }
+    ring.blockSize = geometry.blockSize;
+    ring.blockNr = geometry.blockNr;
+
+    // 1. Get the interface index
+    uint32_t index = if_nametoindex(nic.c_str());
+    if (index == 0) {
+        std::cerr << "Failed to find index for interface: " << nic << std::endl;
+        return false;
+    }
+
+    // 2. Create a UDP socket for receiving a byte stream (raw frames at L2)
+    // We will process this ourselves and completely bypass kernel network stack
+    // to avoid the rt_offload_failed issue
+    int sockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+    if (sockfd < 0) {
+        perror("Failed to initialize a socket.\n");
+        return false;
+    }
+
+    // 3. PACKET_MMAP RING BUFFER SETUP (TPACKET_V3)
+    // First enable TPACKET_V3 by setting the version as a socket option at the SOL_PACKET layer
+    int v = TPACKET_V3;
+    setsockopt(sockfd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v));
+
+    // 4. Create a socket option to tell the kernel to write the frames from the bound NIC
+    // (happens below) to the new PACKET_RX_RING (similar to TPACKET_V1 except we need to set some block parameters)
+    tpacket_req3 req{};
+    req.tp_frame_size = geometry.frameSize;
+    req.tp_frame_nr = geometry.blockSize / geometry.frameSize * geometry.blockNr;
+    req.tp_block_size = ring.blockSize;
+    req.tp_block_nr = ring.blockNr;
+    req.tp_retire_blk_tov = geometry.retireTovMs;
+    req.tp_sizeof_priv = 0;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        perror("Failed to create RX ring buffer on socket\n");
+        close(sockfd);
+        return false;
+    }
+
+    // 5. Memory map the shared buffer into the MDFH process address space
+    size_t mmap_len = (size_t) ring.blockSize * ring.blockNr;
+    void *ringPtr = mmap(
+        nullptr,                    // Let the kernel choose any suitable VA in MDFH address space
+        mmap_len,                   // Length of memory to map (exact size of the buffer)
+        PROT_READ | PROT_WRITE,     // MDFH will read and write (altering the frames tp_status to TP_STATUS_KERNEL from TP_STATUS_USER)
+        MAP_SHARED,                 // Indicates memory is shared between kernel and user space
+        sockfd,                     // Pass in the shared buffer via the socket descriptor for the raw socket
+        0                           // Use offset = 0 because we want to start from the beginning of the buffer
+    );
+
+    if (ringPtr == MAP_FAILED) {
+        perror("Failed (mmap()) to create shared ring buffer between user space and kernel\n");
+        close(sockfd);
+        return false;
+    }
+
+    // 6. Because we are working at L2, bind refers to the interface on which
+    // we want to receive the L2 frames. This requires the use a of sockaddr_ll structure
+    // as opposed to sockaddr_in used at L4
+    sockaddr_ll socket_link_layer{};
+    socket_link_layer.sll_family = AF_PACKET; // AF_PACKET tells the OS to use this socket for Ethernet frames, similar to AF_INET being for IPv4
+    socket_link_layer.sll_protocol = htons(ETH_P_IP); // Filtering is applied to deliver only IPv4 encapsulated ethernet frames
+    socket_link_layer.sll_ifindex = index; // Set the previously found interface index
+
+    if (bind(sockfd, (sockaddr *)&socket_link_layer, sizeof(socket_link_layer)) < 0) {
+        perror("Failed to bind socket to found NIC\n");
+        munmap(ringPtr, mmap_len);
+        close(sockfd);
+        return false;
+    }
+
+    ring.sockfd = sockfd;
+    ring.ptr = (uint8_t *) ringPtr;
+    ring.len = mmap_len;
+    return true;
+}
+
+// Add a bound ring's socket to a PACKET_FANOUT group, the kernel then spreads the interface's frames over
+// every socket in the group. mode is one of the PACKET_FANOUT_* policies. Note PACKET_FANOUT_HASH keeps
+// a flow on one socket, and the whole feed is a single flow, so load balancing needs PACKET_FANOUT_LB/CPU.
+inline bool joinFanoutGroup(RxRing &ring, uint16_t groupId, uint16_t mode) {
+    int arg = groupId | (mode << 16);
+    if (setsockopt(ring.sockfd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) {
+        perror("Failed to join PACKET_FANOUT group\n");
+        return false;
+    }
+    return true;
+}
+
+inline void closeRxRing(RxRing &ring) {
+    if (ring.ptr) munmap(ring.ptr, ring.len); // Unmap the shared memory to release it
+    if (ring.sockfd >= 0) close(ring.sockfd);
+    ring.ptr = nullptr;
+    ring.sockfd = -1;
+}
+
+// Call onPacket(tpacket3_hdr*) for every packet in a block the kernel has handed to user space
+template<typename PacketHandler>
+inline void forEachPacket(tpacket_block_desc *block_ptr, PacketHandler &&onPacket) {
+    // Use the block metadata to get a pointer to the first TPACKET_V3 packet in the block
+    uint32_t num_pkts = block_ptr->hdr.bh1.num_pkts;
+    uint32_t offset_to_first_pkt = block_ptr->hdr.bh1.offset_to_first_pkt;
+
+    // Using simple pointer arithmetic, add the offset of the first packet to the block pointer to obtains
+    // the pointer to the first packet
+    tpacket3_hdr* current_packet = (tpacket3_hdr *)((uint8_t *)block_ptr + offset_to_first_pkt);
+
+    // Iterate through every packet in the block
+    for (uint32_t i = 0; i < num_pkts; i++) {
+        // The tpacket3_hdr struct has extended fields compared to V1, one of which is the next tp_next_offset,
+        // which gives the offset of the next packet. We can use this to prefetch the next packet and load it into
+        // the L1 cache so it is ready for processing immediately after this one, so no cycles are wasted.
+        __builtin_prefetch((uint8_t*) current_packet + current_packet->tp_next_offset);
+        onPacket(current_packet);
+        current_packet = (tpacket3_hdr *)((uint8_t*) current_packet + current_packet->tp_next_offset);
+    }
+}
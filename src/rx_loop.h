@@ -0,0 +1,69 @@
+// The single ring receive loop: wait for each block in ring order, demux every packet in it to its channel,
+// journal and parse the payloads, then hand the block back to the kernel and check the gap deadlines. main.cpp
+// runs it over the NIC's ring, the synthetic ring benchmark over blocks built in memory (synthetic_ring.h), so
+// what is measured there is exactly what receives the feed.
+#pragma once
+#include <cstdint>
+#include <poll.h>
+#include "parse.h"
+#include "ring.h"
+#include "sequencer.h"
+#include "moldudp64.h"
+#include "journal.h"
+#include "latency.h"
+#include "stats_page.h"
+#include "channels.h"
+
+// Capture stage: record an accepted payload, received at tsNs, in the journal (--journal)
+inline void capturePayload(const char *payload, ssize_t len, uint64_t tsNs) {
+    if (!feedJournal.enabled()) return;
+    uint32_t seq = hasPayloadSequence(len) ? peekPayloadSequence(payload) : 0;
+    feedJournal.append(payload, len, tsNs, seq);
+}
+
+// Runs over feedChannels until keepRunning() returns false, checked after every block
+template<typename KeepRunning>
+inline void singleRingLoop(RxRing &ring, GapClock gapClock, KeepRunning &&keepRunning) {
+    // Loop over the shared ring buffer in modulo pattern so we continuously iterate
+    // Create poll object so process doesnt busy wait, let kernel wake process when block ready
+    pollfd pfd{};
+    pfd.fd = ring.sockfd;
+    pfd.events = POLLIN;
+    RingStatsWriter ringStats;
+    ringStats.attach(statsPage.ring(0), ring);
+    for(uint32_t block_idx = 0; ;block_idx = (block_idx + 1) % ring.blockNr)
+    {
+        // Get the TPACKET_V3 block pointer
+        tpacket_block_desc *block_ptr = ring.block(block_idx);
+        // Blocks are retired by the kernel in ring order, so wait for this one. While a gap is open, wake
+        // up every GAP_POLL_MS so its deadline still expires if the feed goes quiet
+        while (!RxRing::ready(block_ptr)) {
+            bool gapOpen = feedChannels.gapExists();
+            poll(&pfd, 1, gapOpen ? GAP_POLL_MS : -1);
+            if (gapOpen && gapClock == GapClock::Tsc) feedChannels.serviceGaps(tscClock.nowNs());
+        }
+
+        forEachPacket(block_ptr, [&](tpacket3_hdr *current_packet) {
+            // Get the ethernet frame from the TPACKET frame
+            // Add the offset of the ethernet header to the frame_header to get a pointer to the ethernet header
+            char *buf = (char *)current_packet + current_packet->tp_mac;
+
+            // Now buf contains the read ethernet frame, decode it and obtain the UDP payload (nullptr if it is
+            // not for one of our channels, otherwise its channel's sequencer is the one messages are checked on)
+            ssize_t payload_length;
+            char *payload = feedChannels.demux(buf, current_packet->tp_snaplen, payload_length);
+            if (!payload) return;
+            uint64_t tsNs = RxRing::packetNs(current_packet);
+            capturePayload(payload, payload_length, tsNs);
+            latency.beginPacket(tsNs);
+            parsePayload(payload, payload_length);
+        });
+
+        // Release the block after processing, then check the gap deadline
+        ringStats.onBlock(ring, block_idx);
+        uint64_t nowNs = blockTimeNs(gapClock, block_ptr);
+        release_block(block_ptr);
+        feedChannels.serviceGaps(nowNs);
+        if (!keepRunning()) return;
+    }
+}
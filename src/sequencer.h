@@ -1,126 +1,405 @@
 // Check for out of order, duplicates and lost packets
 #pragma once
-#include <thread>
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <bit>
+#include <cstring>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "parse.h"
-#include "cpu.h"
 constexpr auto GAP_TIMEOUT = std::chrono::milliseconds(5);
+constexpr uint64_t GAP_TIMEOUT_NS = std::chrono::nanoseconds(GAP_TIMEOUT).count();
+// poll() timeout of the receive loops while a gap is open, so its deadline is still checked on a quiet feed
+constexpr int GAP_POLL_MS = 1;
 
-// Global state struct, used for tracking parsing program metrics (aligned to cache block size)
-struct alignas(64) GlobalState {
-    // Metrics
-    inline static uint32_t parsedMessages = 0;
-    inline static uint32_t outOfOrderMessages = 0;
-    inline static uint32_t lostMessages = 0;
-    inline static uint32_t duplicates = 0;
-
-    // Sequencer
-    inline static std::atomic<uint32_t> nextSeq = UINT32_MAX; // sentinel, will be initialized on first packet
-    inline static std::atomic<uint32_t> highestSeq = 0;
-    inline static std::atomic<bool> gapExists = false;
-
-    // ring buffer (indexed using modulus operator) for tracking 
-    // most recently seen sequence numbers. Crucial for detecting duplicates, out of order packets
-    // and lost packets. The window begins with 
-    inline static std::atomic<uint32_t> seen[WINDOW_SIZE];
+// Gap size histograms, bucket i counts gaps of n messages with bit_width(n) == i
+constexpr size_t GAP_SIZE_BUCKETS = 33;
 
-    // Timer
-    inline static std::atomic<bool> gapTimeout = false; // flag set by timer thread, main thread reads this and flushes bitset
-    inline static std::atomic<bool> timerIsRunning = false; // bool for determining if timer is running
+// Sequencer metrics, kept by every sequencer engine
+struct SequencerStats {
+    uint32_t parsedMessages = 0;
+    uint32_t outOfOrderMessages = 0;
+    uint32_t lostMessages = 0;
+    uint32_t duplicates = 0;
+    uint32_t gapSizes[GAP_SIZE_BUCKETS] = {};   // messages missing when a gap opened
+    uint32_t gapLosses[GAP_SIZE_BUCKETS] = {};  // messages given up on by each flush that lost any
 };
 
-inline void checkAndSetGlobalState(const uint32_t &seq) {
-    // *** Refer to Sequencer state diagram for more information ***
-    // Initialize nextSeq if this is the very first packet received (nextSeq is set to UIN32_MAX on init)
-    // Branch prediction penalties amortized with extending runtime
-    uint32_t expected = UINT32_MAX;
-    GlobalState::nextSeq.compare_exchange_strong(expected, seq);
-
-    // Update highest sequence number seen
-    uint32_t oldHigh = GlobalState::highestSeq.load(std::memory_order_acquire);
-    while (seq > oldHigh && GlobalState::highestSeq.compare_exchange_weak(oldHigh, seq, std::memory_order_release)) {};
-
-    // 1. seq < nextSeq (duplicate)
-    if (seq < GlobalState::nextSeq.load(std::memory_order_acquire)) {
-        // DUPLICATE
-        GlobalState::duplicates++;
-        return;
-    }
+// Result of sequencing a whole datagram at once (MoldUDP64 framing)
+enum class RangeCheck {
+    InOrder,    // every message is the next expected one, all accepted, they need no check of their own
+    Duplicate,  // every message has been seen before, drop the datagram
+    Mixed       // overlaps what was seen, is ahead of nextSeq, or a gap is open: check each message
+};
+
+// Original sequencer engine. Every piece of state is an atomic so the gap timer thread can watch it, and the
+// sliding window stores the full sequence number of the last message seen in each slot (256 KB).
+// Kept as a variant (build with -DMDFH_ATOMIC_SEQUENCER) so the engines can be compared.
+class AtomicSequencer {
+public:
+    SequencerStats stats;
+
+    // Returns false if the message is a duplicate and should not be applied downstream
+    bool check(uint32_t seq) {
+        // *** Refer to Sequencer state diagram for more information ***
+        // Initialize nextSeq if this is the very first packet received (nextSeq is set to UIN32_MAX on init)
+        // Branch prediction penalties amortized with extending runtime
+        uint32_t expected = UINT32_MAX;
+        nextSeq.compare_exchange_strong(expected, seq);
+
+        // Update highest sequence number seen
+        uint32_t oldHigh = highestSeq.load(std::memory_order_acquire);
+        while (seq > oldHigh && highestSeq.compare_exchange_weak(oldHigh, seq, std::memory_order_release)) {};
+
+        // 1. seq < nextSeq (duplicate)
+        if (seq < nextSeq.load(std::memory_order_acquire)) {
+            // DUPLICATE
+            stats.duplicates++;
+            return false;
+        }
 
-    // 2. seq == nextSeq (in-order)
-    if (seq == GlobalState::nextSeq.load(std::memory_order_acquire)) {
-        // Set the sliding window bitset
-        GlobalState::seen[seq % WINDOW_SIZE].store(seq, std::memory_order_relaxed);
-        GlobalState::parsedMessages++;
-        GlobalState::nextSeq.fetch_add(1, std::memory_order_release);
-
-        // if we are in GAP_OPEN state
-        if (GlobalState::gapExists.load(std::memory_order_acquire)) {
-            // ADVANCE_DRAIN
-            while (GlobalState::seen[GlobalState::nextSeq.load(std::memory_order_acquire) % WINDOW_SIZE]
-                   .load(std::memory_order_acquire) == GlobalState::nextSeq.load(std::memory_order_acquire)) {
-                GlobalState::nextSeq.fetch_add(1, std::memory_order_release);
-                GlobalState::parsedMessages++;
+        // 2. seq == nextSeq (in-order)
+        if (seq == nextSeq.load(std::memory_order_acquire)) {
+            // Set the sliding window bitset
+            seen[seq % WINDOW_SIZE].store(seq, std::memory_order_relaxed);
+            stats.parsedMessages++;
+            nextSeq.fetch_add(1, std::memory_order_release);
+
+            // if we are in GAP_OPEN state
+            if (gapOpen.load(std::memory_order_acquire)) {
+                // ADVANCE_DRAIN
+                while (seen[nextSeq.load(std::memory_order_acquire) % WINDOW_SIZE]
+                       .load(std::memory_order_acquire) == nextSeq.load(std::memory_order_acquire)) {
+                    nextSeq.fetch_add(1, std::memory_order_release);
+                    stats.parsedMessages++;
+                }
+
+                // Does the gap still exist?
+                if (nextSeq.load(std::memory_order_acquire) > highestSeq.load(std::memory_order_acquire)) {
+                    gapOpen.store(false, std::memory_order_release);
+                }
             }
 
-            // Does the gap still exist?
-            if (GlobalState::nextSeq.load(std::memory_order_acquire) > GlobalState::highestSeq.load(std::memory_order_acquire)) {
-                GlobalState::gapExists.store(false, std::memory_order_release);
+            // otherwise NO_GAP state, normal processing
+            return true;
+        }
+
+        // 3. seq > nextSeq (out-of-order)
+        // enter GAP_OPEN (can already be in this state, that just means more gaps, but the timer does not reset
+        // it runs on a separate thread and begins only if there is no gap currently open)
+        if (!gapOpen.load(std::memory_order_acquire)) {
+            gapOpen.store(true, std::memory_order_release);
+            stats.gapSizes[std::bit_width(seq - nextSeq.load(std::memory_order_acquire))]++;
+        }
+        stats.outOfOrderMessages++;
+        seen[seq % WINDOW_SIZE].store(seq, std::memory_order_release);
+        return true;
+    }
+
+    // GAP_TIMEOUT: iterate over the window and for every sequence number not seen in between the
+    // low (nextSeq) and the high (highestSeq) increment the lostMessages counter
+    void flushGaps() {
+        uint32_t lost = 0;
+        for (uint32_t seq = nextSeq.load(std::memory_order_acquire);
+         seq <= highestSeq.load(std::memory_order_acquire); ++seq) {
+            if (seen[seq % WINDOW_SIZE].load(std::memory_order_acquire) != seq) lost++;
+        }
+        stats.lostMessages += lost;
+        if (lost) stats.gapLosses[std::bit_width(lost)]++;
+
+        // Reset the gap state
+        gapOpen.store(false, std::memory_order_release);
+
+        // Set the next expected sequence number to the highest + 1 (everything before
+        // is now either parsed or lost)
+        nextSeq.store(highestSeq.load(std::memory_order_acquire) + 1, std::memory_order_release);
+    }
+
+    // No range fast path, every message is checked on its own
+    RangeCheck checkRange(uint32_t, uint32_t) { return RangeCheck::Mixed; }
+
+    // Call onGap(firstSeq, count) for every run of missing sequence numbers in [nextSeq, highestSeq]
+    template<typename GapHandler>
+    void forEachGap(GapHandler &&onGap) const {
+        uint32_t low = nextExpected(), high = highest();
+        if (low == UINT32_MAX) return;
+        uint32_t runStart = 0, runLength = 0;
+        for (uint32_t seq = low; seq <= high; ++seq) {
+            if (seen[seq % WINDOW_SIZE].load(std::memory_order_acquire) != seq) {
+                if (runLength++ == 0) runStart = seq;
+            } else if (runLength) {
+                onGap(runStart, runLength);
+                runLength = 0;
             }
         }
+        if (runLength) onGap(runStart, runLength);
+    }
+
+    bool gapExists() const { return gapOpen.load(std::memory_order_acquire); }
+    uint32_t nextExpected() const { return nextSeq.load(std::memory_order_acquire); }
+    uint32_t highest() const { return highestSeq.load(std::memory_order_acquire); }
 
-        // otherwise NO_GAP state, normal processing
-        return;
+    // Write every window slot so its pages are mapped and in the TLB before the first message
+    void touchWindow() {
+        for (size_t i = 0; i < WINDOW_SIZE; i++) seen[i].store(0, std::memory_order_relaxed);
     }
 
-    // 3. seq > nextSeq (out-of-order)
-    if (seq > GlobalState::nextSeq.load(std::memory_order_acquire)) {
-        // enter GAP_OPEN (can already be in this state, that just means more gaps, but the timer does not reset
-        // it runs on a separate thread and begins only if there is no gap currently open)
-        if (!GlobalState::gapExists.load(std::memory_order_acquire)) {
-            GlobalState::gapExists.store(true, std::memory_order_release);
+private:
+    std::atomic<uint32_t> nextSeq = UINT32_MAX; // sentinel, will be initialized on first packet
+    std::atomic<uint32_t> highestSeq = 0;
+    std::atomic<bool> gapOpen = false;
+
+    // ring buffer (indexed using modulus operator) for tracking
+    // most recently seen sequence numbers. Crucial for detecting duplicates, out of order packets
+    // and lost packets.
+    std::atomic<uint32_t> seen[WINDOW_SIZE];
+};
+
+// Single writer sequencer engine. Only the thread running the parse loop ever writes sequencer state, so
+// none of it needs to be atomic, and the window only needs to know WHETHER a sequence number ahead of
+// nextSeq has arrived: one bit per slot, 8 KB for the whole window, which mostly stays in L1.
+//
+// Invariant: bits are only ever set for sequence numbers in (nextSeq, nextSeq + WINDOW_SIZE), and are
+// cleared as nextSeq moves past them. The in-order, no gap path therefore never touches the window at all.
+// Gaps are found 64 slots at a time with countr_zero/countr_one (and skipped 256 slots at a time with
+// AVX2 where available), instead of one load per sequence number.
+class BitsetSequencer {
+public:
+    SequencerStats stats;
+
+    // Returns false if the message is a duplicate and should not be applied downstream
+    bool check(uint32_t seq) {
+        // Initialize nextSeq on the very first packet
+        if (nextSeq == UINT32_MAX) [[unlikely]] nextSeq = seq;
+        if (seq > highestSeq) highestSeq = seq;
+
+        // 1. seq == nextSeq (in-order), the hot path
+        if (seq == nextSeq) [[likely]] {
+            stats.parsedMessages++;
+            nextSeq++;
+            if (gapOpen) drain();
+            return true;
+        }
+
+        // 2. seq < nextSeq (duplicate)
+        if (seq < nextSeq) {
+            stats.duplicates++;
+            return false;
+        }
+
+        // 3. seq > nextSeq (out-of-order). If it is so far ahead that it doesn't fit in the window, the
+        // oldest part of the gap is given up on straight away to make room for it (after which seq may even
+        // be the next expected one, so it is checked again).
+        if (seq - nextSeq >= WINDOW_SIZE) {
+            retire(seq - WINDOW_SIZE + 1);
+            return check(seq);
+        }
+        uint64_t &word = window[(seq % WINDOW_SIZE) / 64];
+        uint64_t bit = 1ULL << (seq % 64);
+        if (word & bit) {
+            // Already buffered, a duplicate of an out-of-order message
+            stats.duplicates++;
+            return false;
         }
-        GlobalState::outOfOrderMessages++;
-        GlobalState::seen[seq % WINDOW_SIZE].store(seq, std::memory_order_release);
+        word |= bit;
+        stats.outOfOrderMessages++;
+        if (!gapOpen) stats.gapSizes[std::bit_width(seq - nextSeq)]++;
+        gapOpen = true;
+        return true;
     }
-}
 
-// Handle the gap timeout after it expires (entering GAP_TIMEOUT state)
-inline void handleGapTimeout() {
-    // If the flag is not set, just return
-    if (!GlobalState::gapTimeout.load(std::memory_order_acquire)) return;
-
-    // Otherwise, flush the bitset. Iterate over the bitset and for every 
-    // 0 found in between the low (nextSeq) and the high (highestSeq) increment
-    // the lostMessages counter
-    for (uint32_t seq = GlobalState::nextSeq.load(std::memory_order_acquire);
-     seq <= GlobalState::highestSeq.load(std::memory_order_acquire); ++seq) {
-        if (GlobalState::seen[seq % WINDOW_SIZE].load(std::memory_order_acquire) != seq) GlobalState::lostMessages++;
+    // Sequence count messages starting at first with a single comparison. With no gap open, nothing ahead of
+    // nextSeq is buffered, so a datagram starting at nextSeq can only hold new messages, and one ending at or
+    // before it only old ones. Anything else falls back to checking each message.
+    RangeCheck checkRange(uint32_t first, uint32_t count) {
+        if (nextSeq == UINT32_MAX) [[unlikely]] nextSeq = first;
+        uint32_t end = first + count;
+        if (first == nextSeq && !gapOpen) [[likely]] {
+            nextSeq = end;
+            highestSeq = end - 1;
+            stats.parsedMessages += count;
+            return RangeCheck::InOrder;
+        }
+        if (end <= nextSeq) {
+            stats.duplicates += count;
+            return RangeCheck::Duplicate;
+        }
+        return RangeCheck::Mixed;
     }
 
-    // Reset the timer and gap states
-    GlobalState::gapExists.store(false, std::memory_order_release);
-    GlobalState::gapTimeout.store(false, std::memory_order_release);
+    // GAP_TIMEOUT: every sequence number up to highestSeq that has not arrived is lost, everything that did
+    // arrive out of order is delivered
+    void flushGaps() {
+        if (nextSeq == UINT32_MAX) return;
+        retire(highestSeq + 1);
+    }
 
-    // Set the next expected sequence number to the highest + 1 (everything before
-    // is now either parsed or lost)
-    GlobalState::nextSeq.store(GlobalState::highestSeq.load(std::memory_order_acquire) + 1, std::memory_order_release);
-}
+    // Call onGap(firstSeq, count) for every run of missing sequence numbers in [nextSeq, highestSeq]
+    template<typename GapHandler>
+    void forEachGap(GapHandler &&onGap) const {
+        if (nextSeq == UINT32_MAX || nextSeq > highestSeq) return;
+        uint32_t seq = nextSeq;
+        while (seq <= highestSeq) {
+            // Skip over slots that have arrived
+            seq = findNext(seq, highestSeq + 1, true);
+            if (seq > highestSeq) break;
+            uint32_t end = findNext(seq, highestSeq + 1, false);
+            onGap(seq, end - seq);
+            seq = end;
+        }
+    }
+
+    bool gapExists() const { return gapOpen; }
+    uint32_t nextExpected() const { return nextSeq; }
+    uint32_t highest() const { return highestSeq; }
+
+    // Write every window word so its pages are mapped and in the TLB before the first message
+    void touchWindow() { std::memset(window, 0, sizeof(window)); }
+
+private:
+    static constexpr size_t WORDS = WINDOW_SIZE / 64;
+    static_assert(WINDOW_SIZE % 256 == 0, "window must be a whole number of AVX2 registers");
+
+    uint32_t nextSeq = UINT32_MAX; // sentinel, will be initialized on first packet
+    uint32_t highestSeq = 0;
+    bool gapOpen = false;
+    alignas(64) uint64_t window[WORDS] = {};
+
+    // Deliver the run of buffered messages starting at nextSeq, up to 64 per step
+    void drain() {
+        for (;;) {
+            uint64_t &word = window[(nextSeq % WINDOW_SIZE) / 64];
+            uint32_t shift = nextSeq % 64;
+            // The shift fills the top with zeros, so the run never extends past this word
+            uint32_t run = std::countr_one(word >> shift);
+            if (run == 0) break;
+            word &= ~(run == 64 ? ~0ULL : ((1ULL << run) - 1) << shift);
+            nextSeq += run;
+            stats.parsedMessages += run;
+            if (shift + run < 64) break;
+        }
+        if (nextSeq > highestSeq) gapOpen = false;
+    }
+
+    // Move nextSeq forward to end, counting every slot in between as delivered (bit set) or lost (bit clear)
+    // and clearing the bits, then drain whatever is buffered from the new nextSeq
+    void retire(uint32_t end) {
+        uint32_t lost = 0;
+        while (nextSeq < end) {
+            uint64_t &word = window[(nextSeq % WINDOW_SIZE) / 64];
+            uint32_t shift = nextSeq % 64;
+            uint32_t n = std::min<uint32_t>(64 - shift, end - nextSeq);
+            uint64_t mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << shift;
+            uint32_t arrived = std::popcount(word & mask);
+            stats.parsedMessages += arrived;
+            lost += n - arrived;
+            word &= ~mask;
+            nextSeq += n;
+        }
+        stats.lostMessages += lost;
+        if (lost) stats.gapLosses[std::bit_width(lost)]++;
+        gapOpen = false;
+        if (nextSeq <= highestSeq) {
+            drain();
+            if (nextSeq <= highestSeq) gapOpen = true;
+        }
+    }
+
+    // First sequence number in [from, end) whose bit is clear (wantClear) or set (!wantClear), end if none
+    uint32_t findNext(uint32_t from, uint32_t end, bool wantClear) const {
+        uint32_t seq = from;
+        while (seq < end) {
+            size_t idx = (seq % WINDOW_SIZE) / 64;
+            uint32_t shift = seq % 64;
+#ifdef __AVX2__
+            // Whole registers of arrived (or missing) slots are skipped 256 at a time
+            if (shift == 0 && idx % 4 == 0 && end - seq >= 256) {
+                __m256i v = _mm256_load_si256((const __m256i *)&window[idx]);
+                bool allSkipped = wantClear ? _mm256_testc_si256(v, _mm256_set1_epi64x(-1)) : _mm256_testz_si256(v, v);
+                if (allSkipped) {
+                    seq += 256;
+                    continue;
+                }
+            }
+#endif
+            uint64_t word = wantClear ? ~window[idx] : window[idx];
+            word >>= shift;
+            if (word) {
+                uint32_t found = seq + std::countr_zero(word);
+                return found < end ? found : end;
+            }
+            seq += 64 - shift;
+        }
+        return end;
+    }
+};
+
+#ifdef MDFH_ATOMIC_SEQUENCER
+using Sequencer = AtomicSequencer;
+#else
+using Sequencer = BitsetSequencer;
+#endif
 
-// Function run for the timer thread, sets gapTimerExpired flag in GlobalState
-// once timer expires. Main thread, which runs handleGapTimeout() for every message parsed,
-// checks this flag to flush the seen bitset.
-inline void gapTimer() {
-    // Pin this thread to an isolated CPU so it can spin wait to its hearts content
-    pinToCpu(3);
-    raisePriority();
-    while (GlobalState::timerIsRunning.load(std::memory_order_acquire)) {
-        // spin wait
-        if (GlobalState::gapExists.load(std::memory_order_acquire)) {
-            // Once the gap exists, start the timer
-            std::this_thread::sleep_for(GAP_TIMEOUT);
-            GlobalState::gapTimeout.store(true, std::memory_order_release);
+// GAP_TIMEOUT as a deadline, polled inline by the thread that owns the sequencer instead of a timer thread
+// spinning on another core. The deadline is armed the first time a poll finds a gap open and the gap is
+// flushed by the first poll at or after it, so a gap lives for GAP_TIMEOUT plus at most one poll interval
+// (the loops poll at block boundaries and while idle). Times are plain nanoseconds from whichever clock the
+// caller owns (TSC, kernel packet timestamps or a VirtualClock), only differences between them matter.
+class GapDeadline {
+public:
+    uint64_t expirations = 0; // gaps given up on
+
+    GapDeadline() = default;
+    explicit GapDeadline(uint64_t timeoutNs) : m_timeoutNs(timeoutNs) {}
+
+    // Returns true if the deadline expired and the sequencer's open gaps were flushed
+    template<typename Engine>
+    bool poll(Engine &seq, uint64_t nowNs) {
+        if (!seq.gapExists()) {
+            m_armed = false;
+            return false;
+        }
+        if (!m_armed) {
+            m_armed = true;
+            m_deadline = nowNs + m_timeoutNs;
+            return false;
         }
+        if (nowNs < m_deadline) return false;
+        seq.flushGaps();
+        m_armed = false;
+        expirations++;
+        return true;
     }
+
+    bool armed() const { return m_armed; }
+    uint64_t timeoutNs() const { return m_timeoutNs; }
+
+private:
+    uint64_t m_timeoutNs = GAP_TIMEOUT_NS;
+    uint64_t m_deadline = 0;
+    bool m_armed = false;
+};
+
+// Global state struct, used for tracking parsing program metrics (aligned to cache block size)
+struct alignas(64) GlobalState {
+    // Sequencer for the feed, holds the sliding window and the metrics
+    inline static Sequencer sequencer;
+
+    // Gap timeout for the sequencer, only touched by the thread that runs it
+    inline static GapDeadline gapDeadline;
+
+    // The sequencer the parse functions check messages against: sequencer, unless the feed has several
+    // channels (channels.h), each with a sequencer of its own, when it is the current packet's channel's
+    inline static Sequencer *current = &sequencer;
+};
+
+// Returns false if the message is a duplicate and should not be applied downstream
+inline bool checkAndSetGlobalState(const uint32_t &seq) {
+    return GlobalState::current->check(seq);
+}
+
+// Poll the gap deadline (entering GAP_TIMEOUT state once it expires), returns true if the window was flushed
+inline bool checkGapTimeout(uint64_t nowNs) {
+    return GlobalState::gapDeadline.poll(GlobalState::sequencer, nowNs);
 }
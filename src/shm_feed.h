@@ -0,0 +1,284 @@
+// Shared memory publication of the decoded feed: every message the sequencer accepts is normalized into a fixed
+// size FeedEvent and published into a single producer, multi consumer ring in /dev/shm, so any number of
+// strategy processes on the host can read the feed without each running its own packet ring and parser.
+//
+// The producer never waits for anyone. Each slot carries the position of the event in it, written last, so a
+// reader knows from the slot alone whether the event it wants is there yet, is being written, or has already
+// been overwritten by the producer coming round again (the reader was lapped). A lapped reader is told so,
+// skips to the newest event and counts what it missed, and a read the producer overwrote halfway through is
+// detected by checking the slot's position again after the copy (a seqlock per slot).
+// Each reader registers a cursor in the header, which is only for monitoring: the producer (or any tool that
+// maps the segment) can see how far behind every consumer is and which ones have been lapped.
+//
+// Layout of /dev/shm/<name>: a ShmFeedHeader, then capacity ShmFeedSlots of one cache line each.
+// Only one thread may publish, which holds for every receive mode since the sequencer has a single owner too.
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <x86intrin.h>
+#include "spsc.h"
+#include "shm_segment.h"
+
+constexpr uint64_t SHM_FEED_MAGIC = 0x444545464846444d; // "MDFHFEED"
+constexpr uint32_t SHM_FEED_VERSION = 1;
+constexpr uint32_t SHM_FEED_MAX_CONSUMERS = 16;
+constexpr uint64_t SHM_FEED_DEFAULT_EVENTS = 1 << 16;   // 4MB of slots
+constexpr uint64_t SHM_SLOT_WRITING = 1ULL << 63;       // set in a slot's position while the producer fills it
+
+// One accepted message, normalized. Fields a message type doesn't carry are 0
+struct FeedEvent {
+    uint64_t    publishTsc;     // TSC when the producer published it
+    uint64_t    timestamp;      // ITCH timestamp, nanoseconds since midnight
+    uint64_t    orderRefNumber;
+    uint32_t    sequenceNumber;
+    uint32_t    shares;         // added, traded, executed or cancelled shares
+    uint32_t    price;          // order or trade price, executed price for 'X'
+    char        messageType;    // as on the wire
+    char        side;           // buy/sell indicator of 'A' and 'P'
+    char        code;           // event code of 'S', printable of 'X'
+    char        reserved;
+    char        stock[8];       // as sent, space padded, 'A' and 'P' only
+};
+
+// A ring slot: the event and the position it was published at plus 1 (0 = never written)
+struct alignas(CACHE_LINE_SIZE) ShmFeedSlot {
+    std::atomic<uint64_t>   position;
+    FeedEvent               event;
+};
+
+static_assert(sizeof(ShmFeedSlot) == CACHE_LINE_SIZE, "a feed event slot should fill one cache line");
+
+// A registered reader, on a line of its own so readers never share one
+struct alignas(CACHE_LINE_SIZE) ShmFeedConsumer {
+    std::atomic<int32_t>    pid;        // 0 = free
+    std::atomic<uint64_t>   cursor;     // next position the reader will read
+    std::atomic<uint64_t>   laps;       // times it was lapped
+    std::atomic<uint64_t>   missed;     // events it skipped because of that
+};
+
+struct ShmFeedHeader {
+    std::atomic<uint64_t>   magic;      // stamped last (shm_segment.h)
+    uint32_t                version;
+    uint32_t                slotSize;
+    uint64_t                capacity;   // slots, a power of 2
+    int32_t                 producerPid;
+    std::atomic<uint32_t>   closed;     // the producer has stopped publishing
+    // Producer line
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head; // events published
+    ShmFeedConsumer         consumers[SHM_FEED_MAX_CONSUMERS];
+};
+
+inline size_t shmFeedSize(uint64_t capacity) {
+    return sizeof(ShmFeedHeader) + capacity * sizeof(ShmFeedSlot);
+}
+
+// How a consumer is doing, as seen from the header
+struct ShmConsumerStatus {
+    int32_t     pid;
+    uint64_t    lag;        // events published that it hasn't read yet
+    uint64_t    laps;
+    uint64_t    missed;
+    bool        lapped;     // behind by more than the ring holds, it will lose events on its next read
+};
+
+// Producer side
+class ShmFeedPublisher {
+public:
+    ~ShmFeedPublisher() { close(); }
+
+    // Create /dev/shm/<name> holding capacity events (rounded up to a power of 2), replacing any left over
+    // segment. Returns false (after printing why) on failure
+    bool open(const char *name, uint64_t capacity = SHM_FEED_DEFAULT_EVENTS) {
+        uint64_t slots = 1;
+        while (slots < capacity) slots <<= 1;
+        size_t size = shmFeedSize(slots);
+        void *base = createShmSegment(name, size);
+        if (!base) return false;
+        m_header = (ShmFeedHeader *) base;
+        m_slots = (ShmFeedSlot *) ((char *) base + sizeof(ShmFeedHeader));
+        m_size = size;
+        m_mask = slots - 1;
+        m_head = 0;
+        snprintf(m_name, sizeof(m_name), "%s", name);
+        m_header->version = SHM_FEED_VERSION;
+        m_header->slotSize = sizeof(ShmFeedSlot);
+        m_header->capacity = slots;
+        m_header->producerPid = getpid();
+        stampShmSegment(m_header->magic, SHM_FEED_MAGIC);
+        return true;
+    }
+
+    bool enabled() const { return m_header != nullptr; }
+
+    // Hot path. The slot of the next event to fill in place: marked as being written, so a reader that gets to
+    // it meanwhile waits (or, if it was lapped, knows) instead of reading half an event
+    FeedEvent* claim() {
+        ShmFeedSlot &slot = m_slots[m_head & m_mask];
+        slot.position.store((m_head + 1) | SHM_SLOT_WRITING, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return &slot.event;
+    }
+
+    // Hot path. Make the claimed event visible to every reader
+    void publish() {
+        ShmFeedSlot &slot = m_slots[m_head & m_mask];
+        slot.event.publishTsc = __rdtsc();
+        m_head++;
+        slot.position.store(m_head, std::memory_order_release);
+        m_header->head.store(m_head, std::memory_order_release);
+    }
+
+    uint64_t published() const { return m_head; }
+
+    // Registered consumers into out (at most SHM_FEED_MAX_CONSUMERS), returns how many
+    size_t consumers(ShmConsumerStatus *out) const {
+        if (!m_header) return 0;
+        return scanConsumers(m_header, out);
+    }
+
+    // Mark the feed closed for the readers and remove the segment
+    void close() {
+        if (!m_header) return;
+        m_header->closed.store(1, std::memory_order_release);
+        removeShmSegment(m_header, m_size, m_name);
+        m_header = nullptr;
+    }
+
+    // Consumer table of any mapped segment, also used by the readers
+    static size_t scanConsumers(const ShmFeedHeader *header, ShmConsumerStatus *out) {
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        size_t n = 0;
+        for (const ShmFeedConsumer &c : header->consumers) {
+            int32_t pid = c.pid.load(std::memory_order_acquire);
+            if (!pid) continue;
+            uint64_t cursor = c.cursor.load(std::memory_order_relaxed);
+            uint64_t lag = head > cursor ? head - cursor : 0;
+            out[n++] = ShmConsumerStatus{pid, lag, c.laps.load(std::memory_order_relaxed),
+                                         c.missed.load(std::memory_order_relaxed), lag > header->capacity};
+        }
+        return n;
+    }
+
+private:
+    ShmFeedHeader   *m_header = nullptr;
+    ShmFeedSlot     *m_slots = nullptr;
+    size_t          m_size = 0;
+    uint64_t        m_mask = 0;
+    uint64_t        m_head = 0;     // the producer's own copy, never read back from shared memory
+    char            m_name[256] = {};
+};
+
+// The feed published by the parse path (--publish)
+inline ShmFeedPublisher feedPublisher;
+
+enum class ShmPoll {
+    Event,      // an event was read
+    Empty,      // nothing new yet
+    Lapped      // the producer overwrote events before they were read, the reader skipped to the newest
+};
+
+// Reader library: attach to a feed published by mdfh, poll events out of it. One reader per thread
+class ShmFeedReader {
+public:
+    ~ShmFeedReader() { close(); }
+
+    // Map /dev/shm/<name> and register as a consumer, reading from the next event published. Returns false
+    // (after printing why) if there is no such feed or every consumer slot is taken
+    bool open(const char *name) {
+        void *base = mapShmSegment(name, true, m_size);
+        if (!base) return false;
+        m_header = (ShmFeedHeader *) base;
+        if (m_size < sizeof(ShmFeedHeader) || !shmSegmentIs(m_header->magic, m_header->version, SHM_FEED_MAGIC, SHM_FEED_VERSION) ||
+            m_header->slotSize != sizeof(ShmFeedSlot) || shmFeedSize(m_header->capacity) > m_size) {
+            fprintf(stderr, "%s is not a feed of this version\n", name);
+            close();
+            return false;
+        }
+        m_slots = (ShmFeedSlot *) ((char *) base + sizeof(ShmFeedHeader));
+        m_mask = m_header->capacity - 1;
+        m_cursor = m_header->head.load(std::memory_order_acquire);
+        if (!registerConsumer()) {
+            fprintf(stderr, "%s already has %u consumers\n", name, SHM_FEED_MAX_CONSUMERS);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Copy the next event out into e. Never blocks, on Empty poll again (or do something else meanwhile)
+    ShmPoll poll(FeedEvent &e) {
+        const ShmFeedSlot &slot = m_slots[m_cursor & m_mask];
+        uint64_t position = slot.position.load(std::memory_order_acquire);
+        if (position == m_cursor + 1) {
+            std::memcpy(&e, &slot.event, sizeof(e));
+            // The producer may have come round and started overwriting the slot during the copy
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.position.load(std::memory_order_relaxed) == position) {
+                m_cursor++;
+                m_consumer->cursor.store(m_cursor, std::memory_order_relaxed);
+                return ShmPoll::Event;
+            }
+            return lapped();
+        }
+        // Not written yet, or still being written, for this lap
+        if ((position & ~SHM_SLOT_WRITING) <= m_cursor + 1) return ShmPoll::Empty;
+        return lapped();
+    }
+
+    // The producer has stopped, nothing more will be published after what is in the ring
+    bool producerClosed() const { return m_header->closed.load(std::memory_order_acquire) != 0; }
+
+    // Events skipped over because this reader was lapped, and how many times that happened
+    uint64_t missed() const { return m_missed; }
+    uint64_t laps() const { return m_laps; }
+    uint64_t capacity() const { return m_header->capacity; }
+
+    // Every registered consumer of the feed, into out (at most SHM_FEED_MAX_CONSUMERS), returns how many
+    size_t consumers(ShmConsumerStatus *out) const { return ShmFeedPublisher::scanConsumers(m_header, out); }
+
+    void close() {
+        if (!m_header) return;
+        if (m_consumer) m_consumer->pid.store(0, std::memory_order_release);
+        munmap(m_header, m_size);
+        m_header = nullptr;
+        m_consumer = nullptr;
+    }
+
+private:
+    ShmFeedHeader   *m_header = nullptr;
+    ShmFeedSlot     *m_slots = nullptr;
+    ShmFeedConsumer *m_consumer = nullptr;
+    size_t          m_size = 0;
+    uint64_t        m_mask = 0;
+    uint64_t        m_cursor = 0;
+    uint64_t        m_missed = 0;
+    uint64_t        m_laps = 0;
+
+    // Rejoin at the newest event: the events in between are already being overwritten, and a reader that
+    // can't keep up gains nothing from starting at the oldest one only to be lapped again
+    ShmPoll lapped() {
+        uint64_t head = m_header->head.load(std::memory_order_acquire);
+        m_missed += head - m_cursor;
+        m_laps++;
+        m_cursor = head;
+        m_consumer->cursor.store(m_cursor, std::memory_order_relaxed);
+        m_consumer->missed.store(m_missed, std::memory_order_relaxed);
+        m_consumer->laps.store(m_laps, std::memory_order_relaxed);
+        return ShmPoll::Lapped;
+    }
+
+    bool registerConsumer() {
+        for (ShmFeedConsumer &c : m_header->consumers) {
+            if (claimShmSlot(c.pid)) {
+                c.cursor.store(m_cursor, std::memory_order_relaxed);
+                c.laps.store(0, std::memory_order_relaxed);
+                c.missed.store(0, std::memory_order_relaxed);
+                m_consumer = &c;
+                return true;
+            }
+        }
+        return false;
+    }
+};
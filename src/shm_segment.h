@@ -0,0 +1,98 @@
+// The /dev/shm segments mdfh shares with other processes: the feed (shm_feed.h), the top of book table
+// (top_of_book.h) and the stats page (stats_page.h). Each has one writer, which creates the segment, fills in
+// its header and stamps the magic last (release), and any number of readers, which map it and only trust it
+// once they see the magic (acquire) of the version they were built for. Readers that register in the segment
+// claim a slot by writing their pid into it, and a slot whose pid is no longer alive is free again, so a reader
+// that dies without closing doesn't hold its slot for good.
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Writer: create /dev/shm/<name> of size bytes, replacing any left over segment (readers still attached to it
+// keep their mapping, they see it closed). Populated up front so the writer never faults on it. Returns the
+// mapping, nullptr (after printing why) on failure
+inline void *createShmSegment(const char *name, size_t size) {
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) {
+        perror("shm_open()");
+        return nullptr;
+    }
+    if (ftruncate(fd, size) < 0) {
+        perror("ftruncate()");
+        close(fd);
+        shm_unlink(name);
+        return nullptr;
+    }
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap()");
+        shm_unlink(name);
+        return nullptr;
+    }
+    return base;
+}
+
+// Writer: make the segment visible to readers, after everything else in its header is written
+inline void stampShmSegment(std::atomic<uint64_t> &magic, uint64_t value) {
+    magic.store(value, std::memory_order_release);
+}
+
+// Writer: unmap the segment and remove it
+inline void removeShmSegment(void *base, size_t size, const char *name) {
+    munmap(base, size);
+    shm_unlink(name);
+}
+
+// Reader: map an existing /dev/shm/<name> whole, its size into size. Writable for readers that register in it
+// (populated then, they poll it), read only otherwise. Returns the mapping, nullptr (after printing why) if
+// there is no such segment
+inline void *mapShmSegment(const char *name, bool writable, size_t &size) {
+    int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) {
+        perror("shm_open()");
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "%s is empty\n", name);
+        close(fd);
+        return nullptr;
+    }
+    size = st.st_size;
+    void *base = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      writable ? MAP_SHARED | MAP_POPULATE : MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap()");
+        return nullptr;
+    }
+    return base;
+}
+
+// Reader: whether the writer has stamped the segment, and with the version this reader was built for
+inline bool shmSegmentIs(const std::atomic<uint64_t> &magic, uint32_t version, uint64_t expectedMagic, uint32_t expectedVersion) {
+    return magic.load(std::memory_order_acquire) == expectedMagic && version == expectedVersion;
+}
+
+// Reader: take a registration slot that is free (pid 0) or whose reader died without closing. False if another
+// live reader holds it
+inline bool claimShmSlot(std::atomic<int32_t> &slotPid) {
+    int32_t self = getpid();
+    int32_t pid = slotPid.load(std::memory_order_acquire);
+    bool dead = pid != 0 && pid != self && kill(pid, 0) < 0 && errno == ESRCH;
+    return (pid == 0 || dead) && slotPid.compare_exchange_strong(pid, self, std::memory_order_acq_rel);
+}
+
+// Reader: the process that wrote pid has exited
+inline bool shmWriterDead(int32_t pid) {
+    return kill(pid, 0) < 0 && errno == ESRCH;
+}
@@ -0,0 +1,82 @@
+// Lock-free single producer/single consumer ring used to hand work between pinned threads
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Bounded SPSC queue. The producer and consumer indices live on separate cache lines (and the slots
+// after both) so the two cores only share a line when one actually has to look at the other's index.
+// Each side also keeps a cached copy of the other side's index and only reloads it (an acquire load
+// of a line owned by the other core) when the cached value says the ring is full/empty.
+template<typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of 2");
+
+public:
+    // Producer side. Returns false if the ring is full.
+    bool tryPush(const T &item) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cachedTail == Capacity) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail == Capacity) return false;
+        }
+        m_slots[head & (Capacity - 1)] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side, zero copy: the next free slot to fill in place, nullptr if the ring is full. The item
+    // becomes visible to the consumer on publish().
+    T* claim() {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cachedTail == Capacity) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cachedTail == Capacity) return nullptr;
+        }
+        return &m_slots[head & (Capacity - 1)];
+    }
+
+    void publish() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer side. Returns false if the ring is empty.
+    bool tryPop(T &item) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_cachedHead) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail == m_cachedHead) return false;
+        }
+        item = m_slots[tail & (Capacity - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Look at the next item without consuming it, nullptr if the ring is empty.
+    const T* peek() {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_cachedHead) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail == m_cachedHead) return nullptr;
+        }
+        return &m_slots[tail & (Capacity - 1)];
+    }
+
+    // Approximate number of items in the ring, safe to call from any thread (used for occupancy stats)
+    size_t size() const {
+        return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    // Producer line
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_head{0};
+    uint64_t m_cachedTail = 0;
+    // Consumer line
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_tail{0};
+    uint64_t m_cachedHead = 0;
+    alignas(CACHE_LINE_SIZE) T m_slots[Capacity];
+};
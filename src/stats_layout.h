@@ -0,0 +1,104 @@
+// Layout of the stats page (stats_page.h) and its read only mapping: all a reader such as mdfh-stat needs, without
+// the receive path's headers. The writer's side is in stats_page.h.
+//
+// Layout of /dev/shm/<name>: one StatsPageLayout.
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <time.h>
+#include <sys/mman.h>
+#include "spsc.h"
+#include "shm_segment.h"
+
+constexpr uint64_t STATS_PAGE_MAGIC = 0x544154534846444d; // "MDFHSTAT"
+constexpr uint32_t STATS_PAGE_VERSION = 1;
+constexpr uint32_t STATS_MAX_RINGS = 8;
+// Ring occupancy histogram, bucket i counts blocks taken with bit_width(blocks already waiting behind it) == i
+constexpr size_t RING_OCCUPANCY_BUCKETS = 17;
+// Gap size histogram buckets, GAP_SIZE_BUCKETS of the sequencer (sequencer.h)
+constexpr size_t STATS_GAP_BUCKETS = 33;
+
+// Written by the thread that owns the sequencer
+struct alignas(CACHE_LINE_SIZE) SequencerStatsLines {
+    std::atomic<uint64_t>   updatedNs;          // CLOCK_REALTIME of the last copy
+    std::atomic<uint64_t>   parsed;
+    std::atomic<uint64_t>   lost;
+    std::atomic<uint64_t>   outOfOrder;
+    std::atomic<uint64_t>   duplicates;
+    std::atomic<uint64_t>   gapTimeouts;
+    std::atomic<uint64_t>   nextExpected;
+    std::atomic<uint64_t>   highest;
+    std::atomic<uint64_t>   gapOpen;
+    std::atomic<uint64_t>   unknownMessages;
+    std::atomic<uint64_t>   truncatedMessages;
+    std::atomic<uint64_t>   gapSizes[STATS_GAP_BUCKETS];
+    std::atomic<uint64_t>   gapLosses[STATS_GAP_BUCKETS];
+};
+
+// Written by the thread walking the ring
+struct alignas(CACHE_LINE_SIZE) RingStatsLines {
+    std::atomic<uint64_t>   blocks;             // blocks taken from the kernel
+    std::atomic<uint64_t>   packets;
+    std::atomic<uint64_t>   losingBlocks;       // blocks the kernel marked TP_STATUS_LOSING (it dropped while filling them)
+    std::atomic<uint64_t>   kernelPackets;      // PACKET_STATISTICS totals, tp_packets includes the drops
+    std::atomic<uint64_t>   kernelDrops;
+    std::atomic<uint64_t>   kernelFreezes;      // tp_freeze_q_cnt, times the ring was full and the queue frozen
+    std::atomic<uint64_t>   maxOccupancy;
+    std::atomic<uint64_t>   blockNr;
+    std::atomic<uint64_t>   occupancy[RING_OCCUPANCY_BUCKETS];
+};
+
+struct StatsPageLayout {
+    std::atomic<uint64_t>   magic;              // stamped last (shm_segment.h)
+    uint32_t                version;
+    uint32_t                ringCount;
+    int32_t                 pid;
+    std::atomic<uint32_t>   closed;             // the process has stopped
+    uint64_t                startedNs;          // CLOCK_REALTIME when the page was created
+    SequencerStatsLines     sequencer;
+    RingStatsLines          rings[STATS_MAX_RINGS];
+};
+
+inline uint64_t realtimeNs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1'000'000'000ULL + ts.tv_nsec;
+}
+
+
+// Read only mapping of a page, for mdfh-stat
+class StatsPageReader {
+public:
+    ~StatsPageReader() { close(); }
+
+    // Returns false (after printing why) if there is no such page or it isn't of this version
+    bool open(const char *name) {
+        void *base = mapShmSegment(name, false, m_size);
+        if (!base) return false;
+        m_page = (const StatsPageLayout *) base;
+        if (m_size != sizeof(StatsPageLayout) || !shmSegmentIs(m_page->magic, m_page->version, STATS_PAGE_MAGIC, STATS_PAGE_VERSION)) {
+            fprintf(stderr, "%s is not a stats page of this version\n", name);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    const StatsPageLayout &page() const { return *m_page; }
+
+    // The writer closed the page, or died without closing it
+    bool writerGone() const {
+        return m_page->closed.load(std::memory_order_acquire) || shmWriterDead(m_page->pid);
+    }
+
+    void close() {
+        if (!m_page) return;
+        munmap((void *) m_page, m_size);
+        m_page = nullptr;
+    }
+
+private:
+    const StatsPageLayout *m_page = nullptr;
+    size_t                m_size = 0;
+};
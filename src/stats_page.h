@@ -0,0 +1,151 @@
+// Out of band stats page: the counters of the receive path in /dev/shm/<name> (--stats), for mdfh-stat
+// (mdfh_stat.cpp) or any other tool to sample live, without the process printing anything or being asked.
+// Every writer thread has cache lines of its own: the thread that owns the sequencer copies the sequencer's
+// counters and gap histograms in at every block boundary (serviceGaps), and the thread walking each ring keeps
+// that ring's block counts, occupancy histogram and the kernel's PACKET_STATISTICS, read every
+// STATS_KERNEL_POLL_NS and straight away when a block comes back marked TP_STATUS_LOSING.
+// Fields are relaxed atomics stored by their only writer (plain movs on x86, no locked instructions), and
+// nothing on the hot path ever reads the page, so a reader costs the writers at most a line moving on the next
+// store. The layout and the reader's side are in stats_layout.h.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include "parse.h"
+#include "stats_layout.h"
+#include "ring.h"
+#include "sequencer.h"
+#include "clock.h"
+
+constexpr uint64_t STATS_KERNEL_POLL_NS = 100'000'000;
+
+static_assert(STATS_GAP_BUCKETS == GAP_SIZE_BUCKETS, "the stats page holds every bucket of the gap histograms");
+
+// Single writer store, see the comment at the top
+inline void statsStore(std::atomic<uint64_t> &field, uint64_t v) { field.store(v, std::memory_order_relaxed); }
+inline void statsAdd(std::atomic<uint64_t> &field, uint64_t n = 1) { statsStore(field, field.load(std::memory_order_relaxed) + n); }
+
+class StatsPage {
+public:
+    // Create /dev/shm/<name> for ringCount rings, replacing any left over page. Returns false (after printing why)
+    // on failure
+    bool open(const char *name, uint32_t ringCount) {
+        if (ringCount > STATS_MAX_RINGS) {
+            fprintf(stderr, "The stats page holds at most %u rings\n", STATS_MAX_RINGS);
+            return false;
+        }
+        void *base = createShmSegment(name, sizeof(StatsPageLayout));
+        if (!base) return false;
+        m_page = (StatsPageLayout *) base;
+        snprintf(m_name, sizeof(m_name), "%s", name);
+        m_page->version = STATS_PAGE_VERSION;
+        m_page->ringCount = ringCount;
+        m_page->pid = getpid();
+        m_page->startedNs = realtimeNs();
+        stampShmSegment(m_page->magic, STATS_PAGE_MAGIC);
+        return true;
+    }
+
+    bool enabled() const { return m_page != nullptr; }
+
+    // Lines of ring i for its RingStatsWriter, nullptr when the page is off
+    RingStatsLines *ring(uint32_t i) const { return m_page && i < m_page->ringCount ? &m_page->rings[i] : nullptr; }
+
+    // Sequencer owner, at block boundaries: copy the sequencer's state in. The histograms only change along with
+    // the out of order and lost counts, so they are only copied when those moved
+    void publishSequencer() {
+        if (!m_page) return;
+        const SequencerStats &st = GlobalState::sequencer.stats;
+        SequencerStatsLines &s = m_page->sequencer;
+        statsStore(s.parsed, st.parsedMessages);
+        statsStore(s.duplicates, st.duplicates);
+        statsStore(s.gapTimeouts, GlobalState::gapDeadline.expirations);
+        statsStore(s.nextExpected, GlobalState::sequencer.nextExpected());
+        statsStore(s.highest, GlobalState::sequencer.highest());
+        statsStore(s.gapOpen, GlobalState::sequencer.gapExists());
+        statsStore(s.unknownMessages, parseStats.unknownMessages);
+        statsStore(s.truncatedMessages, parseStats.truncatedMessages);
+        if (st.outOfOrderMessages != m_outOfOrder || st.lostMessages != m_lost) {
+            m_outOfOrder = st.outOfOrderMessages;
+            m_lost = st.lostMessages;
+            statsStore(s.outOfOrder, m_outOfOrder);
+            statsStore(s.lost, m_lost);
+            for (size_t b = 0; b < GAP_SIZE_BUCKETS; b++) {
+                statsStore(s.gapSizes[b], st.gapSizes[b]);
+                statsStore(s.gapLosses[b], st.gapLosses[b]);
+            }
+        }
+        statsStore(s.updatedNs, realtimeNs());
+    }
+
+    // Mark the page closed for the readers and remove it
+    void close() {
+        if (!m_page) return;
+        publishSequencer();
+        m_page->closed.store(1, std::memory_order_release);
+        removeShmSegment(m_page, sizeof(StatsPageLayout), m_name);
+        m_page = nullptr;
+    }
+
+private:
+    StatsPageLayout *m_page = nullptr;
+    uint32_t        m_outOfOrder = 0;
+    uint32_t        m_lost = 0;
+    char            m_name[256] = {};
+};
+
+// Per ring writer, kept by the thread that walks the ring. Does nothing until attached to a page
+class RingStatsWriter {
+public:
+    void attach(RingStatsLines *lines, const RxRing &ring) {
+        m_lines = lines;
+        m_sockfd = ring.sockfd;
+        if (m_lines) statsStore(m_lines->blockNr, ring.blockNr);
+    }
+
+    // At every block the loop takes from the kernel, before it is released
+    void onBlock(const RxRing &ring, uint32_t blockIdx) {
+        if (!m_lines) return;
+        const tpacket_block_desc *block_ptr = ring.block(blockIdx);
+        statsAdd(m_lines->blocks);
+        statsAdd(m_lines->packets, block_ptr->hdr.bh1.num_pkts);
+        // Blocks the kernel has already retired behind this one, how far the loop is behind
+        uint32_t waiting = 0;
+        while (waiting + 1 < ring.blockNr && RxRing::ready(ring.block((blockIdx + waiting + 1) % ring.blockNr))) waiting++;
+        statsAdd(m_lines->occupancy[std::min<size_t>(std::bit_width(waiting), RING_OCCUPANCY_BUCKETS - 1)]);
+        if (waiting > m_lines->maxOccupancy.load(std::memory_order_relaxed)) statsStore(m_lines->maxOccupancy, waiting);
+
+        bool losing = block_ptr->hdr.bh1.block_status & TP_STATUS_LOSING;
+        if (losing) statsAdd(m_lines->losingBlocks);
+        uint64_t now = tscClock.nowNs();
+        if (losing || now >= m_nextPoll) {
+            pollKernel();
+            m_nextPoll = now + STATS_KERNEL_POLL_NS;
+        }
+    }
+
+    // Add the kernel's counters since the last call (reading them resets them)
+    void pollKernel() {
+        if (!m_lines || m_sockfd < 0) return;
+        tpacket_stats_v3 st{};
+        socklen_t len = sizeof(st);
+        if (getsockopt(m_sockfd, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0) return;
+        statsAdd(m_lines->kernelPackets, st.tp_packets);
+        statsAdd(m_lines->kernelDrops, st.tp_drops);
+        statsAdd(m_lines->kernelFreezes, st.tp_freeze_q_cnt);
+    }
+
+private:
+    RingStatsLines  *m_lines = nullptr;
+    int             m_sockfd = -1;
+    uint64_t        m_nextPoll = 0;
+};
+
+// Process wide page (--stats)
+inline StatsPage statsPage;
@@ -0,0 +1,198 @@
+// Symbol directory and subscription filter. The directory interns the 8 byte stock field of the messages, used
+// as it is on the wire (a 64-bit key, no copy, no null termination), to a dense 16-bit id that tables can be
+// indexed by. The filter is a bit per id: with a subscription set, messages for any other symbol are dropped
+// right after sequencing, before anything but their symbol is read.
+//
+// Lookups are what the hot path does (interning happens at startup and when a new symbol is first seen), so the
+// table is laid out for them: buckets of 8 keys that fill one cache line, compared against the key all at once
+// (two AVX2 compares when built for it), with linear probing between buckets. It is kept at most half full,
+// so nearly every lookup, hit or miss, is one bucket. Nothing is ever removed, so the first bucket with a free
+// slot ends a search.
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+constexpr size_t MAX_SYMBOLS = 16384;
+constexpr uint16_t NO_SYMBOL = UINT16_MAX;
+constexpr size_t SYMBOL_BUCKET_KEYS = 8;
+constexpr size_t SYMBOL_BUCKETS = MAX_SYMBOLS * 2 / SYMBOL_BUCKET_KEYS;
+
+// The 8 byte stock field as a key: space padded as on the wire. A null padded copy of a shorter ticker gives
+// the same key, its zero bytes are turned into spaces without a branch. All 8 bytes count, a copy cut short
+// by a terminator in the 8th byte would be another symbol
+inline uint64_t tickerKey(const char *stock) {
+    constexpr uint64_t LOW7 = 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t key;
+    std::memcpy(&key, stock, 8);
+    // 0x80 in every byte that is zero, then shifted down to 0x20
+    uint64_t zero = ~(((key & LOW7) + LOW7) | key | LOW7);
+    return key | (zero >> 2);
+}
+
+class SymbolDirectory {
+public:
+    SymbolDirectory(): m_buckets(SYMBOL_BUCKETS), m_ids(SYMBOL_BUCKETS) {
+        m_tickers.reserve(MAX_SYMBOLS);
+    }
+
+    // Id of a symbol, NO_SYMBOL if it was never interned
+    uint16_t find(const char *stock) const { return findKey(tickerKey(stock)); }
+
+    uint16_t findKey(uint64_t key) const {
+        for (size_t b = hashKey(key);; b = (b + 1) & (SYMBOL_BUCKETS - 1)) {
+            const Bucket &bucket = m_buckets[b];
+            uint32_t hit = match(bucket, key);
+            if (hit) return m_ids[b][std::countr_zero(hit)];
+            if (match(bucket, 0)) return NO_SYMBOL;
+        }
+    }
+
+    // Id of a symbol, given the next free one if it is new. NO_SYMBOL once MAX_SYMBOLS are interned
+    uint16_t intern(const char *stock) {
+        uint64_t key = tickerKey(stock);
+        for (size_t b = hashKey(key);; b = (b + 1) & (SYMBOL_BUCKETS - 1)) {
+            Bucket &bucket = m_buckets[b];
+            uint32_t hit = match(bucket, key);
+            if (hit) return m_ids[b][std::countr_zero(hit)];
+            uint32_t free = match(bucket, 0);
+            if (!free) continue;
+            if (m_tickers.size() == MAX_SYMBOLS) return NO_SYMBOL;
+            uint16_t id = m_tickers.size();
+            size_t slot = std::countr_zero(free);
+            bucket.keys[slot] = key;
+            m_ids[b][slot] = id;
+            m_tickers.push_back(key);
+            return id;
+        }
+    }
+
+    // The 8 byte, space padded stock field of an id
+    const char *ticker(uint16_t id) const { return (const char *) &m_tickers[id]; }
+    size_t size() const { return m_tickers.size(); }
+
+private:
+    struct alignas(64) Bucket {
+        uint64_t    keys[SYMBOL_BUCKET_KEYS];   // 0 = free
+    };
+
+    std::vector<Bucket> m_buckets;
+    std::vector<std::array<uint16_t, SYMBOL_BUCKET_KEYS>> m_ids;
+    std::vector<uint64_t> m_tickers;            // key of every id
+
+    static size_t hashKey(uint64_t key) {
+        return (key * 0x9E3779B97F4A7C15ULL) >> (64 - std::countr_zero(SYMBOL_BUCKETS));
+    }
+
+    // A bit per slot of the bucket holding key
+    static uint32_t match(const Bucket &bucket, uint64_t key) {
+#ifdef __AVX2__
+        __m256i k = _mm256_set1_epi64x(key);
+        __m256i lo = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *) bucket.keys), k);
+        __m256i hi = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *) (bucket.keys + 4)), k);
+        return _mm256_movemask_pd(_mm256_castsi256_pd(lo)) | _mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4;
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < SYMBOL_BUCKET_KEYS; i++) bits |= (uint32_t) (bucket.keys[i] == key) << i;
+        return bits;
+#endif
+    }
+};
+
+// The symbols to handle, a bit per id of the directory. Inactive (never subscribed to anything) lets every
+// symbol through. A symbol the directory doesn't know is not subscribed, so the feed's other symbols never
+// need to be interned
+class SubscriptionFilter {
+public:
+    explicit SubscriptionFilter(SymbolDirectory &directory): m_directory(directory), m_bits(MAX_SYMBOLS / 64) {}
+
+    bool active() const { return m_active; }
+
+    // Hot path. Whether messages for a symbol are handled
+    bool subscribed(const char *stock) const {
+        if (!m_active) return true;
+        uint16_t id = m_directory.find(stock);
+        return id != NO_SYMBOL && (m_bits[id / 64] >> (id % 64) & 1);
+    }
+
+    // Add a symbol (up to 8 characters) to the subscription, false if the directory is full
+    bool subscribe(const std::string &ticker) {
+        uint16_t id = m_directory.intern(padTicker(ticker).data());
+        if (id == NO_SYMBOL) return false;
+        if (!(m_bits[id / 64] >> (id % 64) & 1)) m_count++;
+        m_bits[id / 64] |= 1ULL << (id % 64);
+        m_active = true;
+        return true;
+    }
+
+    // Stop handling a symbol. The filter stays active, even with nothing left subscribed
+    void unsubscribe(const std::string &ticker) {
+        uint16_t id = m_directory.find(padTicker(ticker).data());
+        if (id == NO_SYMBOL || !(m_bits[id / 64] >> (id % 64) & 1)) return;
+        m_bits[id / 64] &= ~(1ULL << (id % 64));
+        m_count--;
+    }
+
+    // Subscribe to a comma separated list of symbols, or the symbols of a file (one per line) given as @path.
+    // Returns false (after printing why) if the file can't be read or holds no symbols
+    bool subscribeAll(const char *spec) {
+        std::vector<std::string> tickers;
+        if (spec[0] == '@') {
+            std::ifstream f(spec + 1);
+            if (!f) {
+                fprintf(stderr, "Failed to open subscription file %s\n", spec + 1);
+                return false;
+            }
+            for (std::string line; std::getline(f, line);) tickers.push_back(line);
+        } else {
+            std::string list = spec;
+            for (size_t start = 0, comma;; start = comma + 1) {
+                comma = list.find(',', start);
+                tickers.push_back(list.substr(start, comma - start));
+                if (comma == std::string::npos) break;
+            }
+        }
+        size_t added = 0;
+        for (std::string &t : tickers) {
+            // Surrounding whitespace (and the \r of a file from Windows) isn't part of the symbol
+            size_t first = t.find_first_not_of(" \t\r"), last = t.find_last_not_of(" \t\r");
+            if (first == std::string::npos) continue;
+            if (!subscribe(t.substr(first, last - first + 1))) {
+                fprintf(stderr, "Too many symbols subscribed, at most %zu\n", MAX_SYMBOLS);
+                return false;
+            }
+            added++;
+        }
+        if (!added) fprintf(stderr, "No symbols to subscribe to in %s\n", spec);
+        return added != 0;
+    }
+
+    // Symbols subscribed to
+    size_t count() const { return m_count; }
+
+private:
+    SymbolDirectory         &m_directory;
+    std::vector<uint64_t>   m_bits;
+    size_t                  m_count = 0;
+    bool                    m_active = false;
+
+    static std::array<char, 8> padTicker(const std::string &ticker) {
+        std::array<char, 8> stock;
+        stock.fill(' ');
+        std::memcpy(stock.data(), ticker.data(), std::min(ticker.size(), stock.size()));
+        return stock;
+    }
+};
+
+// Process wide directory, and the subscription of the parse path (--subscribe)
+inline SymbolDirectory symbolDirectory;
+inline SubscriptionFilter feedSubscriptions(symbolDirectory);
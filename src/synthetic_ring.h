@@ -0,0 +1,118 @@
+// A TPACKET_V3 ring built in memory: Ethernet frames laid out in blocks exactly where the kernel puts them in a
+// PACKET_RX_RING (block descriptor, then per packet a tpacket3_hdr with the frame at tp_mac, 8 byte aligned and
+// linked by tp_next_offset), every block retired to user space. The receive loops run over it as they do over a
+// NIC's ring, so they can be tested and benchmarked without root, an interface or a sender. syntheticFrame
+// builds the frames to put in it.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <linux/if_packet.h>
+#include "ring.h"
+#include "demux.h"
+
+// Offsets the kernel uses for a packet with an Ethernet header and no tp_reserve (tpacket_rcv in af_packet.c)
+constexpr uint32_t SYNTHETIC_BLOCK_HEADER = (sizeof(tpacket_block_desc) + 7) & ~7u;
+constexpr uint32_t SYNTHETIC_NET_OFFSET = TPACKET_ALIGN(TPACKET3_HDRLEN + 16);
+constexpr uint32_t SYNTHETIC_MAC_OFFSET = SYNTHETIC_NET_OFFSET - ETH_HLEN;
+// Headers in front of the payload of a frame built by syntheticFrame
+constexpr size_t SYNTHETIC_FRAME_HEADERS = ETH_HEADER_LEN + sizeof(iphdr) + UDP_HEADER_LEN;
+
+// Build into frame an Ethernet/IPv4/UDP frame to group:port (network byte order, like ChannelTable::add) with
+// a copy of len payload bytes, only the fields extractUdpDatagram (demux.h) reads set. Returns the frame's length
+inline size_t syntheticFrame(char *frame, uint32_t group, uint16_t port, const char *payload, size_t len) {
+    std::memset(frame, 0, SYNTHETIC_FRAME_HEADERS);
+    ((ethhdr *) frame)->h_proto = htons(ETH_P_IP);
+    iphdr *ip = (iphdr *) (frame + ETH_HEADER_LEN);
+    ip->ihl = 5;
+    ip->protocol = IPPROTO_UDP;
+    ip->daddr = group;
+    ip->tot_len = htons(sizeof(iphdr) + UDP_HEADER_LEN + len);
+    ((udphdr *) (frame + ETH_HEADER_LEN + sizeof(iphdr)))->dest = port;
+    std::memcpy(frame + SYNTHETIC_FRAME_HEADERS, payload, len);
+    return SYNTHETIC_FRAME_HEADERS + len;
+}
+
+class SyntheticRing {
+public:
+    explicit SyntheticRing(uint32_t blockSize = BLOCK_SIZE) : m_blockSize(blockSize) {}
+
+    // Append a frame received at tsNs (CLOCK_REALTIME nanoseconds), in a new block if it doesn't fit in the
+    // current one. False if it doesn't fit in a block at all
+    bool add(const char *frame, uint32_t len, uint64_t tsNs) {
+        uint32_t packetLen = (SYNTHETIC_MAC_OFFSET + len + 7) & ~7u;
+        if (SYNTHETIC_BLOCK_HEADER + packetLen > m_blockSize) return false;
+        if (m_blocks == 0 || m_used + packetLen > m_blockSize) openBlock();
+        size_t blockStart = (size_t) (m_blocks - 1) * m_blockSize;
+        tpacket_block_desc *block = (tpacket_block_desc *) (m_data.data() + blockStart);
+        tpacket_hdr_v1 &bh = block->hdr.bh1;
+        if (bh.num_pkts) ((tpacket3_hdr *) (m_data.data() + blockStart + m_last))->tp_next_offset = m_used - m_last;
+        else bh.ts_first_pkt = blockTs(tsNs);
+
+        tpacket3_hdr *pkt = (tpacket3_hdr *) (m_data.data() + blockStart + m_used);
+        pkt->tp_next_offset = 0;
+        pkt->tp_sec = tsNs / 1'000'000'000;
+        pkt->tp_nsec = tsNs % 1'000'000'000;
+        pkt->tp_snaplen = len;
+        pkt->tp_len = len;
+        pkt->tp_status = TP_STATUS_USER;
+        pkt->tp_mac = SYNTHETIC_MAC_OFFSET;
+        pkt->tp_net = SYNTHETIC_NET_OFFSET;
+        std::memcpy((char *) pkt + SYNTHETIC_MAC_OFFSET, frame, len);
+
+        bh.num_pkts++;
+        bh.ts_last_pkt = blockTs(tsNs);
+        m_last = m_used;
+        m_used += packetLen;
+        bh.blk_len = m_used;
+        return true;
+    }
+
+    // The blocks as a ring, every one of them retired to user space
+    RxRing ring() {
+        rearm();
+        RxRing r;
+        r.ptr = m_data.data();
+        r.len = m_data.size();
+        r.blockSize = m_blockSize;
+        r.blockNr = m_blocks;
+        return r;
+    }
+
+    // Hand every block to user space again, after a loop has released them
+    void rearm() {
+        for (uint32_t b = 0; b < m_blocks; b++) {
+            ((tpacket_block_desc *) (m_data.data() + (size_t) b * m_blockSize))->hdr.bh1.block_status = TP_STATUS_USER;
+        }
+    }
+
+    uint32_t blocks() const { return m_blocks; }
+    size_t bytes() const { return m_data.size(); }
+
+private:
+    // Only offsets into it are kept while it grows, a block a time
+    std::vector<uint8_t>    m_data;
+    uint32_t                m_blockSize;
+    uint32_t                m_blocks = 0;
+    uint32_t                m_used = 0;     // bytes of the current block in use
+    uint32_t                m_last = 0;     // offset of its last packet
+
+    void openBlock() {
+        m_data.resize((size_t) (m_blocks + 1) * m_blockSize);
+        tpacket_block_desc *block = (tpacket_block_desc *) (m_data.data() + (size_t) m_blocks * m_blockSize);
+        block->version = TPACKET_V3;
+        block->offset_to_priv = sizeof(tpacket_block_desc);
+        block->hdr.bh1.seq_num = m_blocks;
+        block->hdr.bh1.offset_to_first_pkt = SYNTHETIC_BLOCK_HEADER;
+        m_blocks++;
+        m_used = SYNTHETIC_BLOCK_HEADER;
+        m_last = 0;
+    }
+
+    static tpacket_bd_ts blockTs(uint64_t tsNs) {
+        tpacket_bd_ts ts{};
+        ts.ts_sec = tsNs / 1'000'000'000;
+        ts.ts_nsec = tsNs % 1'000'000'000;
+        return ts;
+    }
+};
@@ -0,0 +1,278 @@
+// Conflated top of book in shared memory: for every symbol the best bid and ask (price, shares, orders) and the
+// last trade, kept up to date from the books as the A/E/X/C/P messages are applied, in /dev/shm for consumers
+// that only want the latest state of a symbol rather than every event (those read the feed, shm_feed.h).
+//
+// Each symbol has one cache line, indexed by its book number, guarded by a seqlock: the writer makes the
+// version odd, updates the entry and makes it even again, and a reader retries a copy whose version was odd or
+// changed under it. Readers never write to an entry, so they can't slow the writer down beyond the cache misses
+// of sharing the line, and the writer never waits for them.
+// The writer only touches an entry when the top of the book or the last trade actually changed, and then sets
+// the symbol's bit in the dirty bitmap of every registered reader, so a reader polls only the symbols that
+// changed since it last looked (and takes a burst of changes to one symbol as a single one).
+//
+// Layout of /dev/shm/<name>: a TopOfBookHeader (with the readers' bitmaps), then TOP_OF_BOOK_SYMBOLS entries.
+// Only one thread may write, the one applying messages to the books.
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <bit>
+#include <x86intrin.h>
+#include "spsc.h"
+#include "shm_segment.h"
+
+constexpr uint64_t TOP_OF_BOOK_MAGIC = 0x4b4f4f424846444d; // "MDFHBOOK"
+constexpr uint32_t TOP_OF_BOOK_VERSION = 1;
+constexpr size_t TOP_OF_BOOK_SYMBOLS = 8192;            // one per book, at least MAX_BOOKS (orderbook.h)
+constexpr size_t TOP_OF_BOOK_WORDS = TOP_OF_BOOK_SYMBOLS / 64;
+constexpr uint32_t TOP_OF_BOOK_MAX_READERS = 16;
+
+// What a reader gets for a symbol. Prices and shares are 0 for an empty side or no trade yet
+struct TopOfBook {
+    char        stock[8];
+    uint32_t    bidPrice;
+    uint32_t    bidOrders;
+    uint64_t    bidShares;
+    uint32_t    askPrice;
+    uint32_t    askOrders;
+    uint64_t    askShares;
+    uint32_t    lastPrice;
+    uint32_t    lastShares;
+    uint64_t    timestamp;  // ITCH timestamp of the message that last changed it
+};
+
+// One symbol's line: the seqlock version (odd while the writer is in the middle of an update), then the data
+struct alignas(CACHE_LINE_SIZE) TopOfBookEntry {
+    std::atomic<uint32_t>   version;
+    uint32_t                reserved;
+    TopOfBook               top;
+};
+
+static_assert(sizeof(TopOfBookEntry) == CACHE_LINE_SIZE, "a top of book entry should fill one cache line");
+
+// A registered reader's dirty bitmap, a bit per symbol. Set by the writer, taken (cleared) by the reader
+struct alignas(CACHE_LINE_SIZE) TopOfBookReaderSlot {
+    std::atomic<int32_t>    pid;        // 0 = free
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> dirty[TOP_OF_BOOK_WORDS];
+};
+
+struct TopOfBookHeader {
+    std::atomic<uint64_t>   magic;      // stamped last (shm_segment.h)
+    uint32_t                version;
+    uint32_t                symbolCapacity;
+    std::atomic<uint32_t>   symbols;    // entries in use, from index 0
+    std::atomic<uint32_t>   closed;     // the writer has stopped
+    // Registered readers, a bit per slot, read by the writer on every update
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> readerMask;
+    TopOfBookReaderSlot     readers[TOP_OF_BOOK_MAX_READERS];
+};
+
+// Writer side
+class TopOfBookTable {
+public:
+    ~TopOfBookTable() { close(); }
+
+    // Create /dev/shm/<name>, replacing any left over table. Returns false (after printing why) on failure
+    bool open(const char *name) {
+        void *base = createShmSegment(name, SIZE);
+        if (!base) return false;
+        m_header = (TopOfBookHeader *) base;
+        m_entries = (TopOfBookEntry *) ((char *) base + sizeof(TopOfBookHeader));
+        std::memset(m_last, 0, sizeof(m_last));
+        snprintf(m_name, sizeof(m_name), "%s", name);
+        m_header->version = TOP_OF_BOOK_VERSION;
+        m_header->symbolCapacity = TOP_OF_BOOK_SYMBOLS;
+        stampShmSegment(m_header->magic, TOP_OF_BOOK_MAGIC);
+        return true;
+    }
+
+    bool enabled() const { return m_header != nullptr; }
+
+    // Hot path. Refresh the entry of a book after a message changed it, a no-op when neither its top nor its last
+    // trade moved (a change deeper in the book, or an update that left the best level's totals the same). The
+    // timestamp of next only counts when something else changed
+    void update(uint16_t bookId, TopOfBook next) {
+        if (bookId >= TOP_OF_BOOK_SYMBOLS) return;
+        // Compared against the writer's own copy, the shared line is only written (and pulled away from the
+        // readers' caches) when something changed
+        uint64_t timestamp = next.timestamp;
+        next.timestamp = m_last[bookId].timestamp;
+        if (!std::memcmp(&next, &m_last[bookId], sizeof(next))) return;
+        next.timestamp = timestamp;
+        m_last[bookId] = next;
+
+        TopOfBookEntry &e = m_entries[bookId];
+        uint32_t v = e.version.load(std::memory_order_relaxed);
+        e.version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        e.top = next;
+        e.version.store(v + 2, std::memory_order_release);
+        if (bookId >= m_symbols) {
+            m_symbols = bookId + 1;
+            m_header->symbols.store(m_symbols, std::memory_order_release);
+        }
+        markDirty(bookId);
+        m_changes++;
+    }
+
+    // Entries written
+    uint64_t changes() const { return m_changes; }
+
+    // Mark the table closed for the readers and remove it
+    void close() {
+        if (!m_header) return;
+        m_header->closed.store(1, std::memory_order_release);
+        removeShmSegment(m_header, SIZE, m_name);
+        m_header = nullptr;
+    }
+
+    static constexpr size_t SIZE = sizeof(TopOfBookHeader) + TOP_OF_BOOK_SYMBOLS * sizeof(TopOfBookEntry);
+
+private:
+    TopOfBookHeader *m_header = nullptr;
+    TopOfBookEntry  *m_entries = nullptr;
+    uint32_t        m_symbols = 0;
+    uint64_t        m_changes = 0;
+    TopOfBook       m_last[TOP_OF_BOOK_SYMBOLS];    // what each entry holds, never read back from shared memory
+    char            m_name[256] = {};
+
+    // The bit is only set (a locked instruction) if the reader has taken it since, a symbol changing again
+    // before its reader got to it costs a load of the bitmap word
+    void markDirty(uint16_t bookId) {
+        uint32_t readers = m_header->readerMask.load(std::memory_order_acquire);
+        uint64_t bit = 1ULL << (bookId % 64);
+        while (readers) {
+            std::atomic<uint64_t> &word = m_header->readers[std::countr_zero(readers)].dirty[bookId / 64];
+            if (!(word.load(std::memory_order_relaxed) & bit)) word.fetch_or(bit, std::memory_order_release);
+            readers &= readers - 1;
+        }
+    }
+};
+
+// The table kept by the parse path (--top-of-book)
+inline TopOfBookTable topOfBook;
+
+// Reader library: attach to the table published by mdfh, read symbols by index or take the ones that changed.
+// One reader per thread
+class TopOfBookReader {
+public:
+    ~TopOfBookReader() { close(); }
+
+    // Map /dev/shm/<name> and register for change notifications. Returns false (after printing why) if there is
+    // no such table or every reader slot is taken
+    bool open(const char *name) {
+        void *base = mapShmSegment(name, true, m_size);
+        if (!base) return false;
+        m_header = (TopOfBookHeader *) base;
+        m_entries = (const TopOfBookEntry *) ((char *) base + sizeof(TopOfBookHeader));
+        if (m_size != TopOfBookTable::SIZE || !shmSegmentIs(m_header->magic, m_header->version, TOP_OF_BOOK_MAGIC, TOP_OF_BOOK_VERSION)) {
+            fprintf(stderr, "%s is not a top of book table of this version\n", name);
+            close();
+            return false;
+        }
+        if (!registerReader()) {
+            fprintf(stderr, "%s already has %u readers\n", name, TOP_OF_BOOK_MAX_READERS);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Consistent copy of a symbol's entry, retrying while the writer is in the middle of updating it.
+    // False if the symbol index has never been written
+    bool read(size_t index, TopOfBook &out) {
+        if (index >= TOP_OF_BOOK_SYMBOLS) return false;
+        const TopOfBookEntry &e = m_entries[index];
+        for (;;) {
+            uint32_t v = e.version.load(std::memory_order_acquire);
+            if (v == 0) return false;
+            if (!(v & 1)) {
+                std::memcpy(&out, &e.top, sizeof(out));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (e.version.load(std::memory_order_relaxed) == v) return true;
+            }
+            m_retries++;
+            _mm_pause();
+        }
+    }
+
+    // Index of a symbol (8 byte stock field, space or null padded, all 8 characters count), -1 if it hasn't been
+    // seen. A scan of the table, look the index up once and keep it
+    int find(const char *stock) {
+        uint32_t n = symbols();
+        TopOfBook t;
+        for (uint32_t i = 0; i < n; i++) {
+            if (read(i, t) && sameStock(t.stock, stock)) return i;
+        }
+        return -1;
+    }
+
+    // Call f(index, const TopOfBook &) for every symbol that changed since the last call, returns how many
+    template<typename F>
+    size_t pollChanged(F &&f) {
+        size_t n = 0;
+        TopOfBook t;
+        size_t words = (symbols() + 63) / 64;
+        for (size_t w = 0; w < words; w++) {
+            std::atomic<uint64_t> &word = m_slot->dirty[w];
+            if (!word.load(std::memory_order_relaxed)) continue;
+            // Taken before the entries are read, so a change made meanwhile sets the bit again
+            uint64_t bits = word.exchange(0, std::memory_order_acquire);
+            while (bits) {
+                size_t index = w * 64 + std::countr_zero(bits);
+                bits &= bits - 1;
+                if (read(index, t)) {
+                    f(index, t);
+                    n++;
+                }
+            }
+        }
+        return n;
+    }
+
+    // Symbols the writer has written so far (indices 0 .. symbols() - 1)
+    uint32_t symbols() const { return m_header->symbols.load(std::memory_order_acquire); }
+    bool writerClosed() const { return m_header->closed.load(std::memory_order_acquire) != 0; }
+    // Copies thrown away because the writer was updating the entry
+    uint64_t retries() const { return m_retries; }
+
+    void close() {
+        if (!m_header) return;
+        if (m_slot) {
+            m_header->readerMask.fetch_and(~(1u << (m_slot - m_header->readers)), std::memory_order_acq_rel);
+            m_slot->pid.store(0, std::memory_order_release);
+        }
+        munmap(m_header, m_size);
+        m_header = nullptr;
+        m_slot = nullptr;
+    }
+
+private:
+    TopOfBookHeader         *m_header = nullptr;
+    const TopOfBookEntry    *m_entries = nullptr;
+    TopOfBookReaderSlot     *m_slot = nullptr;
+    size_t                  m_size = 0;
+    uint64_t                m_retries = 0;
+
+    static bool sameStock(const char *a, const char *b) {
+        for (size_t i = 0; i < sizeof(TopOfBook::stock); i++) {
+            if ((a[i] ? a[i] : ' ') != (b[i] ? b[i] : ' ')) return false;
+        }
+        return true;
+    }
+
+    // Every symbol starts out dirty, so the first pollChanged() returns the whole table
+    bool registerReader() {
+        for (uint32_t i = 0; i < TOP_OF_BOOK_MAX_READERS; i++) {
+            TopOfBookReaderSlot &s = m_header->readers[i];
+            if (claimShmSlot(s.pid)) {
+                for (std::atomic<uint64_t> &word : s.dirty) word.store(~0ULL, std::memory_order_relaxed);
+                m_header->readerMask.fetch_or(1u << i, std::memory_order_acq_rel);
+                m_slot = &s;
+                return true;
+            }
+        }
+        return false;
+    }
+};
@@ -0,0 +1,94 @@
+// Hot path cost of a log call with logging on: the synchronous logger this replaced (copy-out parse, then the
+// formatted line written to a stream and flushed, as the old std::endl did) against a push into the async log
+// (src/async_log.h), whose formatter thread writes to /dev/null meanwhile. On itch_data.bin packed into payloads
+// like the replay server does. After the first pass every message is a duplicate, so the copy-out parsers only
+// add the sequence check.
+// The benchmark pushes far faster than any formatter keeps up with, so the drop counter shows what is shed
+// under overload; the formatter's own rate is reported too. Pin it with the formatter core as argument 2.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_async_log.cpp ../../../src/parse.cpp -o benchmark_async_log
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <fcntl.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int PASSES = 20;
+
+using Payloads = std::vector<std::pair<size_t, size_t>>;
+
+// Every message of every payload, PASSES times
+template<typename Log>
+static double nsPerMessage(const std::vector<char> &fileBuf, const Payloads &payloads, size_t msgCount, Log &&log) {
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (auto &[off, len] : payloads) {
+            const char *buf = fileBuf.data() + off;
+            for (size_t pos = 0; pos < len; pos += getMessageSize(buf[pos])) log(buf + pos);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (msgCount * PASSES);
+}
+
+// Copy-out parse of one message, then print it to the stream (if any) the way the old Logger did
+static void parseAndPrint(const char *msg, std::ostream *out) {
+    switch (msg[0]) {
+        case 'A': case 'P': { TradeMessage m; parseTrade(msg, m); if (out) *out << m << std::flush; break; }
+        case 'E': { OrderExecutedMessage m; parseOrderExecuted(msg, m); if (out) *out << m << std::flush; break; }
+        case 'X': { OrderExecutedWithPriceMessage m; parseOrderWithPrice(msg, m); if (out) *out << m << std::flush; break; }
+        case 'S': { SystemEventMessage m; parseSystemEvent(msg, m); if (out) *out << m << std::flush; break; }
+        case 'C': { OrderCancelMessage m; parseOrderCancelled(msg, m); if (out) *out << m << std::flush; break; }
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    int formatterCpu = argc > 2 ? atoi(argv[2]) : -1;
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // 1. Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    Payloads payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+
+    // 2. First pass sequences and books every message
+    for (auto &[off, len] : payloads) parseMessage(fileBuf.data() + off, len);
+
+    // 3. Synchronous logging: the copy-out parse alone, then with every line formatted and flushed
+    std::ofstream devNull("/dev/null");
+    double parseOnly = nsPerMessage(fileBuf, payloads, msgCount, [](const char *msg) { parseAndPrint(msg, nullptr); });
+    double syncLog = nsPerMessage(fileBuf, payloads, msgCount, [&](const char *msg) { parseAndPrint(msg, &devNull); });
+
+    // 4. Async logging: only the push on this thread, formatted and written by the formatter thread
+    int fd = open("/dev/null", O_WRONLY);
+    asyncLog.start(fd, formatLogRecord<LogLevel::VERBOSE>, formatterCpu);
+    uint64_t accepted = 0;
+    auto start = std::chrono::steady_clock::now();
+    double asyncPush = nsPerMessage(fileBuf, payloads, msgCount, [&](const char *msg) { accepted += asyncLog.push(msg); });
+    asyncLog.stop();
+    auto end = std::chrono::steady_clock::now();
+    double formatterSecs = std::chrono::duration<double>(end - start).count();
+    close(fd);
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Payloads: %zu, messages: %zu, passes: %d\n", payloads.size(), msgCount, PASSES);
+    printf("Copy-out parse time per message: %.2f ns\n", parseOnly);
+    printf("Copy-out parse + synchronous log (format + flush) time per message: %.2f ns (%.2f ns per log call)\n",
+           syncLog, syncLog - parseOnly);
+    printf("Async log call (push) time per message: %.2f ns\n", asyncPush);
+    printf("Async log records pushed: %lu, written: %lu, dropped: %lu (%.1f%%)\n", accepted, asyncLog.written(),
+           asyncLog.dropped(), 100.0 * asyncLog.dropped() / (msgCount * PASSES));
+    printf("Formatter throughput: %.0f records/sec\n", asyncLog.written() / formatterSecs);
+}
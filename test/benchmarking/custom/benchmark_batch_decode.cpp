@@ -0,0 +1,120 @@
+// Batch decoding into columns (src/batch_decode.h) against the per-message parser, on itch_data.bin packed
+// into payloads like the replay server does, from memory. Every instruction set the CPU supports is timed,
+// and its columns are checked against the scalar decoder and the typed parsers first.
+// The per-message parser also sequences every message; after the first pass they are all duplicates, so
+// it is timed on the cheapest sequencer path.
+// Build: g++ -std=c++20 -O3 benchmark_batch_decode.cpp ../../../src/parse.cpp -o benchmark_batch_decode
+// (no -march: the decoder picks its instruction set at runtime)
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/batch_decode.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int PASSES = 200;
+constexpr int ROUNDS = 5;
+
+using Payloads = std::vector<std::pair<size_t, size_t>>;
+
+template<typename Parse>
+static double nsPerMessage(const Payloads &payloads, size_t msgCount, Parse &&parse) {
+    double best = 1e9;
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < PASSES; pass++) {
+            for (auto &[off, len] : payloads) parse(off, len);
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (msgCount * PASSES));
+    }
+    return best;
+}
+
+// Columns of one decoded batch equal to the scalar decoder's and, for the book types, the typed parsers'
+static bool matches(const char *payload, const MessageBatch &b, const MessageBatch &ref) {
+    if (b.count != ref.count) return false;
+    for (uint32_t i = 0; i < b.count; i++) {
+        if (b.type[i] != ref.type[i] || b.timestamp[i] != ref.timestamp[i] || b.seq[i] != ref.seq[i] ||
+            b.orderRef[i] != ref.orderRef[i] || b.shares[i] != ref.shares[i] || b.price[i] != ref.price[i] ||
+            std::memcmp(b.symbol[i], ref.symbol[i], 8)) return false;
+        // Typed parsers run after the first pass, so every message is a duplicate and nothing is booked again
+        const char *msg = payload + b.offset[i];
+        switch (b.type[i]) {
+            case 'A': case 'P': {
+                TradeMessage t;
+                parseTrade(msg, t);
+                if (t.orderRefNumber != b.orderRef[i] || t.shares != b.shares[i] || t.price != b.price[i] ||
+                    std::memcmp(t.stock, b.symbol[i], 8)) return false;
+                break;
+            }
+            case 'X': {
+                OrderExecutedWithPriceMessage x;
+                parseOrderWithPrice(msg, x);
+                if (x.orderRefNumber != b.orderRef[i] || x.executedShares != b.shares[i] || x.executedPrice != b.price[i]) return false;
+                break;
+            }
+            case 'C': {
+                OrderCancelMessage c;
+                parseOrderCancelled(msg, c);
+                if (c.orderRefNumber != b.orderRef[i] || c.cancelledShares != b.shares[i]) return false;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // 1. Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    Payloads payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+    const char *data = fileBuf.data();
+
+    // 2. Per-message parser, after a first pass that sequences and books everything
+    for (auto &[off, len] : payloads) parseMessage(data + off, len);
+    double perMessage = nsPerMessage(payloads, msgCount, [&](size_t off, size_t len) { parseMessage(data + off, len); });
+
+    // 3. Every supported instruction set, checked against the scalar decoder and the typed parsers first
+    auto batch = std::make_unique<MessageBatch>();
+    auto ref = std::make_unique<MessageBatch>();
+    uint64_t sink = 0;
+    std::cout << "=== RESULTS ===\n";
+    printf("Payloads: %zu, messages: %zu, selected instruction set: %s\n", payloads.size(), msgCount, batchIsaName(batchIsa));
+    printf("Per-message parser time per message: %.2f ns\n", perMessage);
+    for (BatchIsa isa : {BatchIsa::Scalar, BatchIsa::Sse41, BatchIsa::Avx2, BatchIsa::Avx512}) {
+        if (!batchIsaSupported(isa)) {
+            printf("Batch decode (%s): not supported\n", batchIsaName(isa));
+            continue;
+        }
+        BatchDecoder decode = batchDecoderFor(isa);
+        bool ok = true;
+        for (auto &[off, len] : payloads) {
+            ok &= decode(data + off, len, *batch) == len;
+            batch_detail::decodeBatchScalar(data + off, len, *ref);
+            ok &= matches(data + off, *batch, *ref);
+        }
+        double ns = nsPerMessage(payloads, msgCount, [&](size_t off, size_t len) {
+            decode(data + off, len, *batch);
+            sink += batch->seq[batch->count - 1];
+        });
+        printf("Batch decode (%s) time per message: %.2f ns, %.2fx the per-message parser, columns %s\n",
+               batchIsaName(isa), ns, perMessage / ns, ok ? "match" : "DIFFER");
+    }
+    if (sink == 42) printf("\n");
+}
@@ -0,0 +1,134 @@
+// Demux and sequencing cost of multi-channel feeds (src/channels.h) for 1 to 64 channels: LAPS of
+// itch_data.bin packed into payloads like the replay server does, dealt round robin over the channels as
+// Ethernet/IPv4/UDP frames in memory, with the messages of each channel renumbered so it is a gapless stream
+// of its own. Every frame goes through ChannelTable::demux and every message of it through the selected
+// channel's sequencer, which is all the channels add to the receive path (the books are the same whatever the
+// channel). The single group/port compare of extractUdpPayload into the one global sequencer is the baseline.
+// Every run is a forked child so the sequencers start empty, the best of RUNS is reported.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_channels.cpp ../../../src/parse.cpp -o benchmark_channels
+// Run: ./benchmark_channels [itch file, default ../replay_server/itch_data.bin]
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/channels.h"
+#include "../../../src/synthetic_ring.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int LAPS = 20;
+constexpr int RUNS = 5;
+
+struct Frame {
+    uint32_t    len;
+    char        bytes[SYNTHETIC_FRAME_HEADERS + MAX_UDP_PAYLOAD];
+};
+
+// Written by each child into memory shared with the parent
+struct RunResult {
+    double      nsPerFrame;
+    double      nsPerMessage;
+    uint64_t    accepted;
+};
+
+static uint32_t channelGroup(uint32_t c) { return inet_addr(("239.2.0." + std::to_string(c + 1)).c_str()); }
+
+// Sequence every message of a payload on the current sequencer, returns the number of messages
+static uint32_t sequencePayload(const char *payload, ssize_t len) {
+    uint32_t n = 0;
+    for (ssize_t pos = 0; pos < len; pos += getMessageSize(payload[pos]), n++) {
+        uint32_t seq;
+        std::memcpy(&seq, payload + pos + 7, 4);
+        checkAndSetGlobalState(ntohl(seq));
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    std::vector<std::pair<size_t, size_t>> payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+    size_t frameCount = payloads.size() * LAPS;
+    std::vector<Frame> frames(frameCount);
+
+    RunResult *result = (RunResult *) mmap(nullptr, sizeof(RunResult), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED) {
+        perror("mmap()");
+        return 1;
+    }
+
+    // 0 channels is the baseline, a single group and port compared directly
+    const uint32_t channelCounts[] = {0, 1, 2, 4, 8, 16, 32, 64};
+    RunResult best[std::size(channelCounts)];
+    for (size_t k = 0; k < std::size(channelCounts); k++) {
+        uint32_t channels = std::max(channelCounts[k], 1u);
+        // Deal the payloads round robin, numbering each channel's messages from 1
+        std::vector<uint32_t> nextSeq(channels, 1);
+        msgCount = 0;
+        for (size_t i = 0; i < frameCount; i++) {
+            auto [off, len] = payloads[i % payloads.size()];
+            uint32_t c = i % channels;
+            Frame &fr = frames[i];
+            fr.len = syntheticFrame(fr.bytes, channelGroup(c), htons(30001), fileBuf.data() + off, len);
+            char *payload = fr.bytes + SYNTHETIC_FRAME_HEADERS;
+            for (size_t pos = 0; pos < len; pos += getMessageSize(payload[pos]), msgCount++) {
+                uint32_t seq = htonl(nextSeq[c]++);
+                std::memcpy(payload + pos + 7, &seq, 4);
+            }
+        }
+
+        best[k].nsPerFrame = 1e18;
+        for (int run = 0; run < RUNS; run++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                for (uint32_t c = 0; c < channelCounts[k]; c++) feedChannels.add(channelGroup(c), htons(30001));
+                uint32_t group = channelGroup(0);
+                uint16_t port = htons(30001);
+                uint64_t messages = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (Frame &fr : frames) {
+                    ssize_t len;
+                    char *payload = channelCounts[k] ? feedChannels.demux(fr.bytes, fr.len, len)
+                                                     : extractUdpPayload(fr.bytes, fr.len, group, port, len);
+                    if (payload) messages += sequencePayload(payload, len);
+                }
+                auto end = std::chrono::steady_clock::now();
+                double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+                result->nsPerFrame = ns / frames.size();
+                result->nsPerMessage = ns / messages;
+                result->accepted = GlobalState::sequencer.stats.parsedMessages;
+                for (uint32_t c = 1; c < feedChannels.count(); c++) result->accepted += feedChannels.at(c).sequencer->stats.parsedMessages;
+                _exit(0);
+            }
+            waitpid(pid, nullptr, 0);
+            if (result->nsPerFrame < best[k].nsPerFrame) best[k] = *result;
+        }
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Frames: %zu, messages: %zu, best of %d runs\n", frameCount, msgCount, RUNS);
+    for (size_t k = 0; k < std::size(channelCounts); k++) {
+        if (channelCounts[k] == 0) printf("Single group/port compare: ");
+        else printf("%2u channel(s):             ", channelCounts[k]);
+        printf("%.2f ns per frame, %.2f ns per message (%+.2f ns per frame), %lu accepted\n", best[k].nsPerFrame,
+               best[k].nsPerMessage, best[k].nsPerFrame - best[0].nsPerFrame, best[k].accepted);
+    }
+}
@@ -0,0 +1,105 @@
+// Message dispatch cost: parseMessage's jump table (generated from the layout tables in itch.h, handing out
+// message views) against the switch over the copy-out parsers it replaced, on itch_data.bin packed into
+// payloads like the replay server does.
+// After the first pass every message is a duplicate, so later passes time parse + sequence check only.
+// Also times the types decoded from their layout alone, on a synthetic payload of every such type.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_dispatch.cpp ../../../src/parse.cpp -o benchmark_dispatch
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int PASSES = 200;
+constexpr int ROUNDS = 5;
+
+// The dispatch parseMessage used before the jump table, into the copy-out structs it used
+static TradeMessage tradeMsg{};
+static OrderExecutedMessage orderExecutedMsg{};
+static OrderExecutedWithPriceMessage orderExecutedWithPriceMsg{};
+static SystemEventMessage sysMsg{};
+static OrderCancelMessage orderCancelMsg{};
+
+static void parseSwitch(const char* buf, ssize_t len) {
+    ssize_t pos = 0;
+    while (pos < len) {
+        switch (buf[pos]) {
+            case 'A': pos += parseTrade(buf + pos, tradeMsg); break;
+            case 'P': pos += parseTrade(buf + pos, tradeMsg); break;
+            case 'E': pos += parseOrderExecuted(buf + pos, orderExecutedMsg); break;
+            case 'X': pos += parseOrderWithPrice(buf + pos, orderExecutedWithPriceMsg); break;
+            case 'S': pos += parseSystemEvent(buf + pos, sysMsg); break;
+            case 'C': pos += parseOrderCancelled(buf + pos, orderCancelMsg); break;
+            default: return;
+        }
+    }
+}
+
+template<typename Parse>
+static double nsPerMessage(const std::vector<char> &fileBuf, const std::vector<std::pair<size_t, size_t>> &payloads,
+                           size_t msgCount, Parse &&parse) {
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (auto &[off, len] : payloads) parse(fileBuf.data() + off, len);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (msgCount * PASSES);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // 1. Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    std::vector<std::pair<size_t, size_t>> payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+
+    // 2. First pass sequences and books every message, the rest are duplicates for both dispatchers
+    for (auto &[off, len] : payloads) parseMessage(fileBuf.data() + off, len);
+
+    // 3. Alternate the two so neither gets a warmer machine, keep the best round of each
+    double bestSwitch = 1e9, bestTable = 1e9;
+    for (int round = 0; round < ROUNDS; round++) {
+        bestSwitch = std::min(bestSwitch, nsPerMessage(fileBuf, payloads, msgCount, parseSwitch));
+        bestTable = std::min(bestTable, nsPerMessage(fileBuf, payloads, msgCount, parseMessage));
+    }
+
+    // 4. One of every type only the layout tables know about, sequence numbers continuing after the file
+    std::vector<char> tableBuf;
+    std::vector<std::pair<size_t, size_t>> tablePayloads;
+    uint32_t seq = GlobalState::sequencer.nextExpected();
+    size_t tableCount = 0;
+    for (int copy = 0; copy < 64; copy++) {
+        for (const MessageLayout &l : MESSAGE_LAYOUTS) {
+            if (l.type == 'A' || l.type == 'P' || l.type == 'E' || l.type == 'X' || l.type == 'S' || l.type == 'C') continue;
+            size_t pos = tableBuf.size();
+            tableBuf.resize(pos + l.size, ' ');
+            tableBuf[pos] = l.type;
+            uint32_t s = htonl(seq++);
+            std::memcpy(&tableBuf[pos + fieldOffset('A', "sequenceNumber")], &s, 4);
+            tableCount++;
+        }
+    }
+    tablePayloads.emplace_back(0, tableBuf.size());
+    for (auto &[off, len] : tablePayloads) parseMessage(tableBuf.data() + off, len);
+    double tableOnly = nsPerMessage(tableBuf, tablePayloads, tableCount, parseMessage);
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Payloads: %zu, messages: %zu, message types: %zu\n", payloads.size(), msgCount, std::size(MESSAGE_LAYOUTS));
+    printf("Switch dispatch time per message: %.2f ns\n", bestSwitch);
+    printf("Jump table dispatch time per message: %.2f ns\n", bestTable);
+    printf("Layout decoded types time per message: %.2f ns\n", tableOnly);
+    printf("Unknown messages: %lu, truncated messages: %lu\n", parseStats.unknownMessages, parseStats.truncatedMessages);
+}
@@ -0,0 +1,66 @@
+// Throughput scaling of the PACKET_FANOUT receive mode with 1, 2, 4 and 8 rings (run the replay server on the sender).
+// Each ring count runs in a forked child so every run starts with fresh sequencer state.
+// Build: g++ -std=c++20 -O3 -march=native -pthread benchmark_fanout.cpp ../../../src/parse.cpp -o benchmark_fanout
+// Usage: sudo ./benchmark_fanout [nic] [ring counts...]
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <sys/wait.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/fanout.h"
+#define MULTICAST_IP "239.1.1.1"
+#define PORT 30001
+
+constexpr uint32_t NUM_MESSAGES = 10000000;
+constexpr int MERGE_CPU = 2;
+constexpr int FIRST_WORKER_CPU = 4;
+
+int runOnce(const std::string &nic, uint32_t rings) {
+    Fanout fanout;
+    if (!openFanout(nic, rings, fanout)) return 1;
+
+    startFanoutWorkers(fanout, FIRST_WORKER_CPU, inet_addr(MULTICAST_IP), htons(PORT));
+
+    pinToCpu(MERGE_CPU);
+    // Start the clock on the first message so the time waiting for the sender is not counted
+    while (GlobalState::sequencer.stats.parsedMessages == 0) mergeLoop(fanout, [] { return GlobalState::sequencer.stats.parsedMessages == 0; });
+    auto now = std::chrono::steady_clock::now();
+    mergeLoop(fanout, [] { return GlobalState::sequencer.stats.parsedMessages < NUM_MESSAGES; });
+    auto end = std::chrono::steady_clock::now();
+    long long time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
+    std::chrono::duration<double> time_taken_sec = end - now;
+
+    // RESULTS
+    printf("=== RESULTS: %u RING(S) ===\n", rings);
+    printFanoutStats(fanout);
+    printf("Messages parsed: %u\n", GlobalState::sequencer.stats.parsedMessages);
+    printf("Messages lost: %u\n", GlobalState::sequencer.stats.lostMessages);
+    printf("Messages received out of order: %u\n", GlobalState::sequencer.stats.outOfOrderMessages);
+    printf("Messages recieved as duplicates: %u\n", GlobalState::sequencer.stats.duplicates);
+    printf("Time taken: %lld\n", time_taken);
+    printf("Time taken per message: %lld\n", time_taken / NUM_MESSAGES);
+    printf("Throughput: %f messages/sec\n", NUM_MESSAGES / time_taken_sec.count());
+    fflush(stdout);
+
+    // The RX workers spin forever, leave without joining them (the process is a throwaway child)
+    _exit(0);
+}
+
+int main(int argc, char **argv) {
+    std::string nic = argc > 1 ? argv[1] : "enxc8a362d92729";
+    std::vector<uint32_t> ringCounts;
+    for (int i = 2; i < argc; i++) ringCounts.push_back(atoi(argv[i]));
+    if (ringCounts.empty()) ringCounts = {1, 2, 4, 8};
+
+    for (uint32_t rings : ringCounts) {
+        pid_t pid = fork();
+        if (pid == 0) return runOnce(nic, rings);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Run with %u ring(s) failed\n", rings);
+        }
+    }
+}
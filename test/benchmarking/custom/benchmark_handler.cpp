@@ -0,0 +1,124 @@
+// Cost of the handler API (src/handler.h): the decode loop instantiated against an empty handler, and against one
+// that reads a field from every message, next to the sink it replaced: the copy-out parsers feeding a Logger
+// whose level is switched on at runtime (set to OFF, as the feed handler ran), and parseMessage's own handler
+// (sequencer + book, logging compiled out). On itch_data.bin packed into payloads like the replay server does.
+// After the first pass every message is a duplicate, so later passes time parse + sequence check only.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_handler.cpp ../../../src/parse.cpp -o benchmark_handler
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/handler.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int PASSES = 200;
+constexpr int ROUNDS = 5;
+
+// The Logger before the level became a template parameter: a switch on the level for every message
+class RuntimeLogger {
+public:
+    constexpr RuntimeLogger(LogLevel l): m_logLevel(l) {}
+    template <typename MessageType>
+    void log(const MessageType &m) const {
+        switch (m_logLevel) {
+            case LogLevel::VERBOSE: std::cout << m; break;
+            case LogLevel::RAW: m.getRawLog(); break;
+            default: break;
+        }
+    }
+private:
+    LogLevel m_logLevel;
+};
+
+// volatile so the level isn't folded, it was read from the logger object every message
+static volatile LogLevel runtimeLevel = LogLevel::OFF;
+static TradeMessage tradeMsg{};
+static OrderExecutedMessage orderExecutedMsg{};
+static OrderExecutedWithPriceMessage orderExecutedWithPriceMsg{};
+static SystemEventMessage sysMsg{};
+static OrderCancelMessage orderCancelMsg{};
+
+static void parseRuntimeLogger(const char* buf, ssize_t len) {
+    const RuntimeLogger logger(runtimeLevel);
+    ssize_t pos = 0;
+    while (pos < len) {
+        switch (buf[pos]) {
+            case 'A': case 'P': pos += parseTrade(buf + pos, tradeMsg); logger.log(tradeMsg); break;
+            case 'E': pos += parseOrderExecuted(buf + pos, orderExecutedMsg); logger.log(orderExecutedMsg); break;
+            case 'X': pos += parseOrderWithPrice(buf + pos, orderExecutedWithPriceMsg); logger.log(orderExecutedWithPriceMsg); break;
+            case 'S': pos += parseSystemEvent(buf + pos, sysMsg); logger.log(sysMsg); break;
+            case 'C': pos += parseOrderCancelled(buf + pos, orderCancelMsg); logger.log(orderCancelMsg); break;
+            default: return;
+        }
+    }
+}
+
+struct EmptyHandler: FeedHandler<EmptyHandler> {};
+
+// Reads one field of every book message, the least a real consumer does
+struct SumHandler: FeedHandler<SumHandler> {
+    uint64_t sum = 0;
+    void onAddOrder(const TradeView &v) { sum += v.price(); }
+    void onTrade(const TradeView &v) { sum += v.price(); }
+    void onExecute(const OrderExecutedView &v) { sum += v.executedShares(); }
+    void onExecuteWithPrice(const OrderExecutedWithPriceView &v) { sum += v.executedPrice(); }
+    void onCancel(const OrderCancelView &v) { sum += v.cancelledShares(); }
+    void onSystemEvent(const SystemEventView &v) { sum += v.eventCode(); }
+};
+
+template<typename Parse>
+static double nsPerMessage(const std::vector<char> &fileBuf, const std::vector<std::pair<size_t, size_t>> &payloads,
+                           size_t msgCount, Parse &&parse) {
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (auto &[off, len] : payloads) parse(fileBuf.data() + off, len);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (msgCount * PASSES);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // 1. Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    std::vector<std::pair<size_t, size_t>> payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+
+    // 2. First pass sequences and books every message, the rest are duplicates for the sequencing paths
+    for (auto &[off, len] : payloads) parseMessage(fileBuf.data() + off, len);
+
+    // 3. Alternate them so none gets a warmer machine, keep the best round of each
+    EmptyHandler empty;
+    SumHandler summer;
+    size_t emptyBytes = 0; // what the empty handler decoded, so the loop isn't optimised out
+    double bestLogger = 1e9, bestBook = 1e9, bestEmpty = 1e9, bestSum = 1e9;
+    for (int round = 0; round < ROUNDS; round++) {
+        bestLogger = std::min(bestLogger, nsPerMessage(fileBuf, payloads, msgCount, parseRuntimeLogger));
+        bestBook = std::min(bestBook, nsPerMessage(fileBuf, payloads, msgCount, parseMessage));
+        bestEmpty = std::min(bestEmpty, nsPerMessage(fileBuf, payloads, msgCount,
+                                                     [&](const char *buf, size_t len) { emptyBytes += empty.decode(buf, len); }));
+        bestSum = std::min(bestSum, nsPerMessage(fileBuf, payloads, msgCount,
+                                                 [&](const char *buf, size_t len) { summer.decode(buf, len); }));
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Payloads: %zu, messages: %zu, compiled log level: %s\n", payloads.size(), msgCount,
+           FeedLogger::enabled ? "on" : "OFF");
+    printf("Copy-out parsers + runtime Logger (OFF) time per message: %.2f ns\n", bestLogger);
+    printf("parseMessage (BookHandler) time per message: %.2f ns\n", bestBook);
+    printf("Empty handler time per message: %.2f ns (%zu bytes decoded)\n", bestEmpty, emptyBytes);
+    printf("Field reading handler time per message: %.2f ns (checksum %lu)\n", bestSum, summer.sum);
+}
@@ -0,0 +1,135 @@
+// Overhead of the capture journal (src/journal.h): itch_data.bin packed into payloads like the replay server
+// does, parsed from memory with and without every payload appended to the journal first. Each pass parses the
+// file with fresh sequence numbers (continuing from the last pass), so every message is sequenced and booked
+// like a live feed rather than dropped as a duplicate.
+// Times are the receive thread's own CPU time, so the journal writer and the kernel's writeback don't count
+// against it when they share its core (on a tuned host they run on other cores); wall time is shown as well.
+// The overhead is given both against parsing from memory (no network at all, the worst case) and against the
+// replay server's full rate, one payload every REPLAY_INTERVAL_NS at most.
+// Also times seeks by sequence number through the sparse index of the segment written.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_journal.cpp ../../../src/parse.cpp -o benchmark_journal
+// Run: ./benchmark_journal [itch_data.bin] [journal prefix, default /tmp/benchmark_journal]
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <arpa/inet.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/journal.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int PASSES = 20;
+constexpr int ROUNDS = 5;
+constexpr int SEEKS = 100000;
+// The replay server sleeps 10us between payloads
+constexpr double REPLAY_INTERVAL_NS = 10'000;
+
+// CPU time of the calling thread
+static long long threadNs() {
+    timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return (long long) t.tv_sec * 1'000'000'000LL + t.tv_nsec;
+}
+
+struct Timing {
+    double cpuNs = 1e9;     // thread CPU time per payload
+    double wallNs = 1e9;    // wall time per payload
+};
+
+using Payloads = std::vector<std::pair<size_t, size_t>>;
+
+// Shift every sequence number in the file by delta so the next pass continues where the last one stopped
+static void renumber(std::vector<char> &fileBuf, const Payloads &payloads, uint32_t delta) {
+    for (auto &[off, len] : payloads) {
+        for (size_t pos = off; pos < off + len; pos += getMessageSize(fileBuf[pos])) {
+            uint32_t seq = htonl(peekSequenceNumber(&fileBuf[pos]) + delta);
+            std::memcpy(&fileBuf[pos + 7], &seq, 4);
+        }
+    }
+}
+
+// One round of PASSES passes over the file, time per payload spent parsing (and capturing, with a journal),
+// keeping the best round so far in best
+static void timeRound(std::vector<char> &fileBuf, const Payloads &payloads, size_t msgCount, Journal *journal, Timing &best) {
+    long long cpu = 0, wall = 0;
+    for (int pass = 0; pass < PASSES; pass++) {
+        auto start = std::chrono::steady_clock::now();
+        long long cpuStart = threadNs();
+        for (auto &[off, len] : payloads) {
+            const char *payload = fileBuf.data() + off;
+            if (journal) journal->append(payload, len, pass, peekSequenceNumber(payload));
+            parseMessage(payload, len);
+        }
+        cpu += threadNs() - cpuStart;
+        wall += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        renumber(fileBuf, payloads, msgCount);
+    }
+    best.cpuNs = std::min(best.cpuNs, (double) cpu / (payloads.size() * PASSES));
+    best.wallNs = std::min(best.wallNs, (double) wall / (payloads.size() * PASSES));
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    std::string prefix = argc > 2 ? argv[2] : "/tmp/benchmark_journal";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // 1. Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    Payloads payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+
+    // 2. Alternate rounds with and without the journal, keep the best of each
+    Journal journal;
+    if (!journal.open(prefix)) return 1;
+    Timing plain, captured;
+    for (int round = 0; round < ROUNDS; round++) {
+        timeRound(fileBuf, payloads, msgCount, nullptr, plain);
+        timeRound(fileBuf, payloads, msgCount, &journal, captured);
+    }
+    JournalStats stats = journal.stats();
+    journal.close();
+
+    // 3. Seeks to the first sequence number of random records of the first segment
+    JournalReader reader((prefix + ".0000").c_str());
+    if (!reader.ok()) return 1;
+    std::vector<uint32_t> recorded;
+    const char *data;
+    while (const JournalRecord *r = reader.next(data)) recorded.push_back(r->sequenceNumber);
+    std::mt19937 rng(42);
+    uint64_t found = 0;
+    long long seekStart = threadNs();
+    for (int i = 0; i < SEEKS; i++) {
+        uint32_t seq = recorded[rng() % recorded.size()];
+        const JournalRecord *r;
+        if (reader.seek(seq) && (r = reader.next(data)) && r->sequenceNumber == seq) found++;
+    }
+    double seekNs = (double) (threadNs() - seekStart) / SEEKS;
+    for (uint32_t s = 0; s < stats.segments; s++) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%04u", s);
+        unlink((prefix + suffix).c_str());
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Payloads: %zu, messages: %zu, passes per round: %d\n", payloads.size(), msgCount, PASSES);
+    double captureNs = captured.cpuNs - plain.cpuNs;
+    printf("Parse time per payload: %.1f ns CPU (%.1f ns wall)\n", plain.cpuNs, plain.wallNs);
+    printf("Capture + parse time per payload: %.1f ns CPU (%.1f ns wall)\n", captured.cpuNs, captured.wallNs);
+    printf("Capture overhead against parsing from memory: %.2f%%\n", 100.0 * captureNs / plain.cpuNs);
+    printf("Capture overhead at full replay rate (a payload every %.0f ns): %.2f%%\n", REPLAY_INTERVAL_NS,
+           100.0 * captureNs / REPLAY_INTERVAL_NS);
+    printf("Journal payloads recorded: %lu (%lu bytes), dropped: %lu, segments: %lu, index entries (first segment): %u\n",
+           stats.payloads, stats.bytes, stats.dropped, stats.segments, reader.header().indexCount);
+    printf("Seek time: %.1f ns (%lu/%d found)\n", seekNs, found, SEEKS);
+}
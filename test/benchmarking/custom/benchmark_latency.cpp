@@ -0,0 +1,92 @@
+// Cost of the per stage latency instrumentation (src/latency.h) on the parse path: itch_data.bin packed into
+// payloads like the replay server does and run through parsePayload (sequencer + books) with 1 in n packets
+// timed, for n = 1, 8, 64 (the default) and 512, against timing off. Also prints what the stages measured when
+// every packet is timed, which includes the rdtsc calls themselves (a few ns each on bare metal, more in a VM).
+// There is no kernel timestamp in a file, so the receive and exchange histograms stay empty.
+// Every run is a forked child, so the books and the sequencer start empty and every message is accepted, the
+// best of RUNS is reported.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_latency.cpp ../../../src/parse.cpp -o benchmark_latency
+// Run: ./benchmark_latency [itch file, default ../replay_server/itch_data.bin]
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/moldudp64.h"
+#include "../../../src/latency.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int RUNS = 7;
+
+// Written by each child into memory shared with the parent
+struct RunResult {
+    double          nsPerMessage;
+    LatencySummary  stages[LATENCY_STAGES];
+};
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    std::vector<std::pair<size_t, size_t>> payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+
+    RunResult *result = (RunResult *) mmap(nullptr, sizeof(RunResult), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED) {
+        perror("mmap()");
+        return 1;
+    }
+
+    const uint32_t samplings[] = {0, 1, 8, 64, 512};
+    RunResult best[std::size(samplings)];
+    for (RunResult &b : best) b.nsPerMessage = 1e18;
+    // Alternate the configurations so none gets a warmer machine
+    for (int run = 0; run < RUNS; run++) {
+        for (size_t i = 0; i < std::size(samplings); i++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                latency.setSampling(samplings[i]);
+                auto start = std::chrono::steady_clock::now();
+                for (auto &[off, len] : payloads) {
+                    latency.beginPacket(0);
+                    parsePayload(fileBuf.data() + off, len);
+                }
+                auto end = std::chrono::steady_clock::now();
+                result->nsPerMessage = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / msgCount;
+                for (uint32_t s = 0; s < LATENCY_STAGES; s++) result->stages[s] = latency.stage((LatencyStage) s).summary();
+                _exit(0);
+            }
+            waitpid(pid, nullptr, 0);
+            if (result->nsPerMessage < best[i].nsPerMessage) best[i] = *result;
+        }
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Payloads: %zu, messages: %zu, best of %d runs\n", payloads.size(), msgCount, RUNS);
+    for (size_t i = 0; i < std::size(samplings); i++) {
+        if (samplings[i] == 0) printf("Timing off: %.2f ns per message\n", best[i].nsPerMessage);
+        else printf("1 in %u packets timed: %.2f ns per message (%+.2f ns)\n", samplings[i], best[i].nsPerMessage,
+                    best[i].nsPerMessage - best[0].nsPerMessage);
+    }
+    printf("Stages with every packet timed:\n");
+    for (uint32_t s = 0; s < LATENCY_STAGES; s++) {
+        const LatencySummary &l = best[1].stages[s];
+        if (!l.count) continue;
+        printf("  %-20s n=%lu mean=%.1f p50=%lu p99=%lu p99.9=%lu max=%lu ns\n", LATENCY_STAGE_NAMES[s], l.count,
+               l.mean, l.p50, l.p99, l.p999, l.max);
+    }
+}
@@ -0,0 +1,84 @@
+// Replays itch_data.bin from memory through the order book and reports the cost per book update.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_order_book.cpp ../../../src/parse.cpp -o benchmark_order_book
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/orderbook.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int PASSES = 50;
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // 1. Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    std::vector<std::pair<size_t, size_t>> payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+    size_t packedEnd = payloads.empty() ? 0 : payloads.back().first + payloads.back().second;
+
+    // 2. End to end: parse + sequence + book for a single pass over the file (sequence numbers
+    // only increase once, so replaying it again would just be counted as duplicates)
+    auto now = std::chrono::steady_clock::now();
+    for (auto &[off, len] : payloads) parseMessage(fileBuf.data() + off, len);
+    auto end = std::chrono::steady_clock::now();
+    long long parseTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
+
+    // 3. Decode every book event once so the book can be timed on its own
+    std::vector<char> types;
+    std::vector<TradeMessage> adds;
+    std::vector<OrderExecutedMessage> execs;
+    std::vector<OrderExecutedWithPriceMessage> execsWithPrice;
+    std::vector<OrderCancelMessage> cancels;
+    for (size_t pos = 0; pos < packedEnd;) {
+        char type = fileBuf[pos];
+        const char *msg = fileBuf.data() + pos;
+        switch (type) {
+            case 'A': adds.emplace_back(); parseTrade(msg, adds.back()); types.push_back(type); break;
+            case 'E': execs.emplace_back(); parseOrderExecuted(msg, execs.back()); types.push_back(type); break;
+            case 'X': execsWithPrice.emplace_back(); parseOrderWithPrice(msg, execsWithPrice.back()); types.push_back(type); break;
+            case 'C': cancels.emplace_back(); parseOrderCancelled(msg, cancels.back()); types.push_back(type); break;
+        }
+        pos += getMessageSize(type);
+    }
+
+    auto books = std::make_unique<BookManager>();
+    now = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < PASSES; pass++) {
+        size_t a = 0, e = 0, x = 0, c = 0;
+        for (char type : types) {
+            switch (type) {
+                case 'A': books->apply(adds[a++]); break;
+                case 'E': books->apply(execs[e++]); break;
+                case 'X': books->apply(execsWithPrice[x++]); break;
+                case 'C': books->apply(cancels[c++]); break;
+            }
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    long long bookTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
+    uint64_t bookEvents = (uint64_t) types.size() * PASSES;
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Payloads: %zu, messages: %zu\n", payloads.size(), msgCount);
+    printf("Parse + sequence + book time per message: %lld ns\n", parseTime / (long long) msgCount);
+    printf("Parse throughput: %f messages/sec\n", msgCount / (parseTime / 1e9));
+    printf("Books: %zu, live orders: %zu\n", orderBooks.bookCount(), orderBooks.liveOrders());
+    printf("Book events applied: %lu (updates %lu, rejected %lu)\n", bookEvents, books->updates, books->rejected);
+    printf("Time per book update: %f ns\n", (double) bookTime / bookEvents);
+    printf("Book throughput: %f updates/sec\n", bookEvents / (bookTime / 1e9));
+}
@@ -13,6 +13,7 @@
 #include <sys/mman.h>
 #include "../../src/parse.h"
 #include "../../src/sequencer.h"
+#include "../../src/clock.h"
 #define MULTICAST_IP "239.1.1.1"
 #define PORT 30001
 #define LOG(x) std::cout << x << std::endl
@@ -91,10 +92,8 @@ int main() {
 
     std::cout << "LISTENING FOR FRAMES ON " << nic << std::endl;
 
-    // 7. Start timer thread for packet sequencer (for detecting losses when gaps opened in stream
-    // due to out-of-order messages)
-    GlobalState::timerIsRunning.store(true, std::memory_order_relaxed);
-    std::thread gapTimerThread(gapTimer);
+    // 7. Gaps opened in the stream by out-of-order messages are timed out inline by checkGapTimeout,
+    // no timer thread needed
     uint32_t NUM_MESSAGES = 10000000;
     auto now = std::chrono::steady_clock::now();
     // 8. Loop over the shared ring buffer in modulo pattern so we continuously iterate
@@ -154,14 +153,12 @@ int main() {
         // Then we can get the UDP payload size by taking away the UDP header from that value
         ssize_t payload_length = ntohs(ip_header->tot_len) - ip_header_length - 8;
         parseMessage(payload, payload_length);
-        handleGapTimeout();
+        checkGapTimeout(tscClock.nowNs());
 
         releaseFrame(frame_header);
-        if (GlobalState::parsedMessages > NUM_MESSAGES) break;
+        if (GlobalState::sequencer.stats.parsedMessages > NUM_MESSAGES) break;
     }
 
-    GlobalState::timerIsRunning.store(false, std::memory_order_relaxed);
-    gapTimerThread.join();
     auto end = std::chrono::steady_clock::now();
     long long time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
     std::chrono::duration<double> time_taken_sec = end - now;
@@ -170,9 +167,9 @@ int main() {
     // RESULTS
     std::cout << "=== RESULTS ===\n";
     printf("Messages parsed: %d\n", NUM_MESSAGES);
-    printf("Messages lost: %u\n", GlobalState::lostMessages);
-    printf("Messages received out of order: %u\n", GlobalState::outOfOrderMessages);
-    printf("Messages recieved as duplicates: %u\n", GlobalState::duplicates);
+    printf("Messages lost: %u\n", GlobalState::sequencer.stats.lostMessages);
+    printf("Messages received out of order: %u\n", GlobalState::sequencer.stats.outOfOrderMessages);
+    printf("Messages recieved as duplicates: %u\n", GlobalState::sequencer.stats.duplicates);
     printf("Time taken: %lld\n", time_taken);
     printf("Time taken per message: %lld\n", time_taken/NUM_MESSAGES);
     printf("Throughput: %f messages/sec\n", NUM_MESSAGES / time_taken_sec.count());
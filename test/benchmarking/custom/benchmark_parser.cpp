@@ -6,6 +6,7 @@
 #include <chrono>
 #include "../../src/parse.h"
 #include "../../src/sequencer.h"
+#include "../../src/clock.h"
 #include <thread>
 
 #define MULTICAST_IP "239.1.1.1"
@@ -13,8 +14,7 @@
 #define LOG(x) std::cout << x << std::endl
 #define LOGREAD(x) std::cout << "READ " << x << " BYTES\n"
 
-// TURN OFF LOGGING
-static const Logger logger = LogLevel::OFF;
+// Logging is off unless built with -DMDFH_LOG_LEVEL
 
 int main() {
     int sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -64,12 +64,10 @@ int main() {
     
     std::cout << "LISTENING FOR MULTICAST TRAFFIC ON " << MULTICAST_IP << std::endl;
 
-    GlobalState::timerIsRunning.store(true, std::memory_order_relaxed);
-    std::thread gapTimerThread(gapTimer);
     alignas(64) char buf[2048];
     uint32_t NUM_MESSAGES = 1000000;
     auto now = std::chrono::steady_clock::now();
-    while (GlobalState::parsedMessages < NUM_MESSAGES) {
+    while (GlobalState::sequencer.stats.parsedMessages < NUM_MESSAGES) {
         ssize_t nbytes = recv(sockfd, buf, sizeof(buf) - 1, 0);
         if (nbytes < 0) {
             perror("Error receiving data, terminating.");
@@ -78,11 +76,9 @@ int main() {
         parseMessage(buf, nbytes);
 
         fflush(stdout);
-        // Check if the timer expired and if GlobalState::gapTimeout = true
-        handleGapTimeout();
+        // Check if the gap deadline expired
+        checkGapTimeout(tscClock.nowNs());
     }
-    GlobalState::timerIsRunning.store(false, std::memory_order_relaxed);
-    gapTimerThread.join();
     auto end = std::chrono::steady_clock::now();
     long long time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
     std::chrono::duration<double> time_taken_sec = end - now;
@@ -90,9 +86,9 @@ int main() {
     close(sockfd);
     std::cout << "=== RESULTS ===\n";
     printf("Messages parsed: %d\n", NUM_MESSAGES);
-    printf("Messages lost: %u\n", GlobalState::lostMessages);
-    printf("Messages received out of order: %u\n", GlobalState::outOfOrderMessages);
-    printf("Messages recieved as duplicates: %u\n", GlobalState::duplicates);
+    printf("Messages lost: %u\n", GlobalState::sequencer.stats.lostMessages);
+    printf("Messages received out of order: %u\n", GlobalState::sequencer.stats.outOfOrderMessages);
+    printf("Messages recieved as duplicates: %u\n", GlobalState::sequencer.stats.duplicates);
     printf("Time taken: %lld\n", time_taken);
     printf("Time taken per message: %lld\n", time_taken/NUM_MESSAGES);
     printf("Throughput: %f messages/sec\n", NUM_MESSAGES / time_taken_sec.count());
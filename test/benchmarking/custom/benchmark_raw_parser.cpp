@@ -13,6 +13,7 @@
 #include <chrono>
 #include "../../src/parse.h"
 #include "../../src/sequencer.h"
+#include "../../src/clock.h"
 #define MULTICAST_IP "239.1.1.1"
 #define PORT 30001
 #define LOG(x) std::cout << x << std::endl
@@ -67,13 +68,11 @@ int main() {
 
     std::cout << "LISTENING FOR FRAMES ON " << nic << std::endl;
 
-    GlobalState::timerIsRunning.store(true, std::memory_order_relaxed);
-    std::thread gapTimerThread(gapTimer);
 
     uint32_t NUM_MESSAGES = 10000000;
     alignas(64) char buf[2048];
     auto now = std::chrono::steady_clock::now();
-    while (GlobalState::parsedMessages < NUM_MESSAGES) {
+    while (GlobalState::sequencer.stats.parsedMessages < NUM_MESSAGES) {
         ssize_t nbytes = recv(sockfd, buf, sizeof(buf) - 1, 0);
         if (nbytes < 0) {
             perror("Error receiving data, terminating.");
@@ -105,11 +104,9 @@ int main() {
         // Then we can get the UDP payload size by taking away the UDP header from that value
         ssize_t payload_length = ntohs(ip_header->tot_len) - ip_header_length - 8;
         parseMessage(payload, payload_length);
-        handleGapTimeout();
+        checkGapTimeout(tscClock.nowNs());
         fflush(stdout);
     }
-    GlobalState::timerIsRunning.store(false, std::memory_order_relaxed);
-    gapTimerThread.join();
     auto end = std::chrono::steady_clock::now();
     long long time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
     std::chrono::duration<double> time_taken_sec = end - now;
@@ -118,9 +115,9 @@ int main() {
     // RESULTS
     std::cout << "=== RESULTS ===\n";
     printf("Messages parsed: %d\n", NUM_MESSAGES);
-    printf("Messages lost: %u\n", GlobalState::lostMessages);
-    printf("Messages received out of order: %u\n", GlobalState::outOfOrderMessages);
-    printf("Messages recieved as duplicates: %u\n", GlobalState::duplicates);
+    printf("Messages lost: %u\n", GlobalState::sequencer.stats.lostMessages);
+    printf("Messages received out of order: %u\n", GlobalState::sequencer.stats.outOfOrderMessages);
+    printf("Messages recieved as duplicates: %u\n", GlobalState::sequencer.stats.duplicates);
     printf("Time taken: %lld\n", time_taken);
     printf("Time taken per message: %lld\n", time_taken/NUM_MESSAGES);
     printf("Throughput: %f messages/sec\n", NUM_MESSAGES / time_taken_sec.count());
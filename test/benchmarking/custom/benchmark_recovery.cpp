@@ -0,0 +1,60 @@
+// Gap recovery latency and throughput against the replay server's retransmit server
+// (run ./replay --retransmit in test/benchmarking/replay_server first, on this host or the one given).
+// Each round opens a gap of N messages in the sequencer and polls recovery until it has closed.
+// Build: g++ -std=c++20 -O3 -march=native -pthread benchmark_recovery.cpp ../../../src/parse.cpp -o benchmark_recovery
+// Usage: ./benchmark_recovery [server ip]
+#include <stdio.h>
+#include <iostream>
+#include <chrono>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/recovery.h"
+#include "../../../src/clock.h"
+#define RETRANSMIT_PORT 30003
+
+constexpr uint32_t GAP_SIZES[] = {1, 10, 100, 1000, 10000};
+constexpr uint32_t MAX_ROUNDS = 50;
+// Messages spent per gap size, so every size fits in the 99976 messages of itch_data.bin
+constexpr uint32_t MESSAGES_PER_SIZE = 20000;
+constexpr uint64_t ROUND_TIMEOUT_NS = 1'000'000'000ULL;
+
+int main(int argc, char **argv) {
+    const char *server = argc > 1 ? argv[1] : "127.0.0.1";
+    if (!gapRecovery.open(inet_addr(server), htons(RETRANSMIT_PORT))) return 1;
+
+    std::cout << "=== RESULTS ===\n";
+    uint32_t base = 1;
+    for (uint32_t n : GAP_SIZES) {
+        uint32_t rounds = std::min(MAX_ROUNDS, MESSAGES_PER_SIZE / n);
+        RecoveryStats before = gapRecovery.stats;
+        uint32_t lostBefore = GlobalState::sequencer.stats.lostMessages;
+        uint64_t wallNs = 0;
+        for (uint32_t r = 0; r < rounds; r++) {
+            // base arrives in order, base + n + 1 opens a gap of [base + 1, base + n]
+            GlobalState::sequencer.check(base);
+            GlobalState::sequencer.check(base + n + 1);
+            uint64_t start = tscClock.nowNs(), now = start;
+            while (GlobalState::sequencer.gapExists() && now - start < ROUND_TIMEOUT_NS) {
+                gapRecovery.poll(now);
+                now = tscClock.nowNs();
+            }
+            // One more poll records the recovered gap
+            gapRecovery.poll(now);
+            wallNs += now - start;
+            if (GlobalState::sequencer.gapExists()) {
+                fprintf(stderr, "Gap of %u at %u not recovered, is the retransmit server running?\n", n, base + 1);
+                GlobalState::sequencer.flushGaps();
+            }
+            base += n + 2;
+        }
+        const RecoveryStats &s = gapRecovery.stats;
+        uint64_t recovered = s.gapsRecovered - before.gapsRecovered;
+        uint64_t messages = s.messages - before.messages;
+        printf("gap=%-6u rounds=%-3u recovered=%-3lu lost=%-6u requests=%-5lu responses=%-5lu mean_recovery=%8luns "
+               "gap_to_recovered=%8luns throughput=%.0f messages/sec\n",
+               n, rounds, recovered, GlobalState::sequencer.stats.lostMessages - lostBefore, s.requests - before.requests,
+               s.responses - before.responses, recovered ? (s.recoveryNsTotal - before.recoveryNsTotal) / recovered : 0,
+               wallNs / rounds, wallNs ? messages / (wallNs / 1e9) : 0.0);
+    }
+    gapRecovery.close();
+}
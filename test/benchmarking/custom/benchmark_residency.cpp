@@ -0,0 +1,149 @@
+// Startup and first message cost with and without --resident (src/residency.h): every run is a fresh process
+// (this program again, exec'd, so nothing is inherited already faulted in from the parent) that gets ready to
+// receive, then runs itch_data.bin packed into payloads like the replay server does through parsePayload. Reports
+// the time from the fork to ready (exec, static initialization and, resident, the hugepage tables, prefaulting
+// and mlockall), the first payload, the first 64 payloads, the rest per message and the page faults taken in
+// each, the median of RUNS. Resident runs need the memory lock limit raised (root, or ulimit -l unlimited).
+// Build: g++ -std=c++20 -O3 -march=native benchmark_residency.cpp ../../../src/parse.cpp -o benchmark_residency
+// Run: ./benchmark_residency [itch file, default ../replay_server/itch_data.bin]
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/moldudp64.h"
+#include "../../../src/residency.h"
+#include "../../../src/file_ingest.h"
+
+constexpr int RUNS = 9;
+constexpr size_t WARMUP_PAYLOADS = 64;
+
+// Sent back by each child over a pipe
+struct RunResult {
+    uint64_t    readyNs;            // fork to ready to receive
+    uint64_t    firstNs;            // first payload
+    uint64_t    warmupNs;           // first WARMUP_PAYLOADS payloads
+    double      steadyNsPerMessage; // the rest
+    uint64_t    firstFaults, warmupFaults, steadyFaults;
+    bool        locked;
+};
+
+static uint64_t monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t minorFaults() {
+    uint64_t minor, major;
+    threadFaults(minor, major);
+    return minor + major;
+}
+
+// Child: argv = self --child <resident 0/1> <fork time ns> <result fd> <file>
+static int runChild(bool resident, uint64_t forkNs, int fd, const char *path) {
+    RunResult r{};
+    if (resident) r.locked = residency.enable();
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+    // Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    std::vector<std::pair<size_t, size_t>> payloads = packRawPayloads(fileBuf.data(), nbytes, msgCount);
+    r.readyNs = monotonicNs() - forkNs;
+
+    uint64_t faults = minorFaults();
+    uint64_t start = monotonicNs();
+    size_t i = 0;
+    for (; i < payloads.size(); i++) {
+        parsePayload(fileBuf.data() + payloads[i].first, payloads[i].second);
+        if (i == 0) {
+            r.firstNs = monotonicNs() - start;
+            r.firstFaults = minorFaults() - faults;
+        }
+        if (i + 1 == WARMUP_PAYLOADS) break;
+    }
+    r.warmupNs = monotonicNs() - start;
+    r.warmupFaults = minorFaults() - faults;
+    uint32_t warmupMessages = GlobalState::sequencer.stats.parsedMessages;
+
+    faults = minorFaults();
+    start = monotonicNs();
+    for (i++; i < payloads.size(); i++) parsePayload(fileBuf.data() + payloads[i].first, payloads[i].second);
+    r.steadyNsPerMessage = (double) (monotonicNs() - start) / (GlobalState::sequencer.stats.parsedMessages - warmupMessages);
+    r.steadyFaults = minorFaults() - faults;
+    return write(fd, &r, sizeof(r)) == sizeof(r) ? 0 : 1;
+}
+
+static bool runOnce(const char *self, bool resident, const char *path, RunResult &r) {
+    int fds[2];
+    if (pipe(fds) < 0) return false;
+    uint64_t forkNs = monotonicNs();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        // What the residency setup prints isn't wanted here
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        std::string forkArg = std::to_string(forkNs), fdArg = std::to_string(fds[1]);
+        execl(self, self, "--child", resident ? "1" : "0", forkArg.c_str(), fdArg.c_str(), path, (char *) nullptr);
+        _exit(127);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], &r, sizeof(r)) == sizeof(r);
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+    return ok;
+}
+
+template<typename T>
+static T median(std::vector<RunResult> &runs, T RunResult::*field) {
+    std::sort(runs.begin(), runs.end(), [field](const RunResult &a, const RunResult &b) { return a.*field < b.*field; });
+    return runs[runs.size() / 2].*field;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 6 && !strcmp(argv[1], "--child")) {
+        return runChild(argv[2][0] == '1', strtoull(argv[3], nullptr, 10), atoi(argv[4]), argv[5]);
+    }
+    const char *path = argc > 1 ? argv[1] : "../replay_server/itch_data.bin";
+    if (!std::ifstream(path)) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+
+    std::vector<RunResult> runs[2];
+    // Alternate the configurations so none gets a warmer machine
+    for (int run = 0; run < RUNS; run++) {
+        for (int resident = 0; resident < 2; resident++) {
+            RunResult r;
+            if (!runOnce("/proc/self/exe", resident, path, r)) {
+                std::cerr << "A run failed" << std::endl;
+                return 1;
+            }
+            runs[resident].push_back(r);
+        }
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Median of %d runs each\n", RUNS);
+    for (int resident = 0; resident < 2; resident++) {
+        std::vector<RunResult> &v = runs[resident];
+        printf("%s%s:\n", resident ? "--resident" : "Default", resident && !v[0].locked ? " (mlockall failed, not locked)" : "");
+        printf("  Ready to receive: %.2f ms after fork\n", median(v, &RunResult::readyNs) / 1e6);
+        printf("  First payload: %.1f us, %lu page faults\n", median(v, &RunResult::firstNs) / 1e3, median(v, &RunResult::firstFaults));
+        printf("  First %zu payloads: %.1f us, %lu page faults\n", WARMUP_PAYLOADS, median(v, &RunResult::warmupNs) / 1e3,
+               median(v, &RunResult::warmupFaults));
+        printf("  Then: %.2f ns per message, %lu page faults\n", median(v, &RunResult::steadyNsPerMessage),
+               median(v, &RunResult::steadyFaults));
+    }
+}
@@ -0,0 +1,223 @@
+// Sweep of the TPACKET_V3 ring geometry (src/ring.h RingGeometry, the --block-size/--block-nr/--retire-tov
+// options): for every block size x block count x retire timeout in the grid a forked child opens the ring on the
+// interface, replays itch_data.bin to 239.1.1.1:30001 through it from a sender thread (laps of the file in bursts
+// of n payloads with a pause between, out of the interface with the given address) and walks the ring like mdfh's
+// single ring loop, with every packet timed. Reports the receive throughput, the kernel receive -> dequeue
+// latency (how long packets sat in the ring, part filled blocks waiting on the retire timeout included) and the
+// kernel's drops and queue freezes, then recommends the geometry for this host: no drops, then the lowest p99,
+// then the least memory. Laps after the first are duplicates to the sequencer, which still decodes every message.
+// Needs root (AF_PACKET). The defaults run over loopback, where the sender and the loop share the machine; use a
+// real interface with the replay server on another host for numbers that mean something for production.
+// Build: g++ -std=c++20 -O3 -march=native -pthread benchmark_ring_sweep.cpp ../../../src/parse.cpp -o benchmark_ring_sweep
+// Run: sudo ./benchmark_ring_sweep [nic, default lo] [if address, default 127.0.0.1] [laps, default 20]
+//          [burst, default 64] [pause us, default 200] [itch file, default ../replay_server/itch_data.bin]
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/ring.h"
+#include "../../../src/demux.h"
+#include "../../../src/moldudp64.h"
+#include "../../../src/latency.h"
+#include "../../../src/file_ingest.h"
+#define MULTICAST_IP "239.1.1.1"
+#define PORT 30001
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+constexpr uint32_t BLOCK_SIZES_KB[] = {16, 64, 256, 1024};
+constexpr uint32_t BLOCK_NRS[] = {8, 32, 128};
+constexpr uint32_t RETIRE_TOVS_MS[] = {0, 1, 4};
+// Once the sender is done, the ring is drained when no block retires for this long (longer than any timeout)
+constexpr int DRAIN_MS = 200;
+
+// Written by each child into memory shared with the parent
+struct SweepResult {
+    bool            ok;
+    RingGeometry    geometry;
+    uint64_t        sent, received, messages;
+    uint64_t        kernelDrops, kernelFreezes;
+    double          seconds;
+    LatencySummary  rxToDequeue;
+};
+
+struct Workload {
+    const char                              *nic;
+    const char                              *ifaceIp;
+    uint32_t                                laps, burst, pauseUs;
+    std::vector<char>                       fileBuf;
+    std::vector<std::pair<size_t, size_t>>  payloads; // (offset, length)
+};
+
+// Send every payload laps times in bursts, returns the number sent
+static uint64_t sendWorkload(const Workload &w) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    in_addr iface{};
+    inet_pton(AF_INET, w.ifaceIp, &iface);
+    if (sock < 0 || setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0) {
+        perror("Sender socket");
+        return 0;
+    }
+    sockaddr_in dest{};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(PORT);
+    dest.sin_addr.s_addr = inet_addr(MULTICAST_IP);
+    uint64_t sent = 0;
+    for (uint32_t lap = 0; lap < w.laps; lap++) {
+        for (auto &[off, len] : w.payloads) {
+            if (sendto(sock, w.fileBuf.data() + off, len, 0, (sockaddr *) &dest, sizeof(dest)) == (ssize_t) len) sent++;
+            if (w.pauseUs && sent % w.burst == 0) std::this_thread::sleep_for(std::chrono::microseconds(w.pauseUs));
+        }
+    }
+    close(sock);
+    return sent;
+}
+
+static void runOnce(const Workload &w, const RingGeometry &geometry, SweepResult &result) {
+    result = SweepResult{};
+    result.geometry = geometry;
+    RxRing ring;
+    if (!openRxRing(w.nic, ring, geometry)) return;
+    // On loopback the socket would see every datagram twice, leaving and arriving
+    int one = 1;
+    setsockopt(ring.sockfd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+    latency.setSampling(1);
+    uint32_t mcast_ip = inet_addr(MULTICAST_IP);
+    uint16_t dest_port = htons(PORT);
+
+    std::atomic<bool> senderDone{false};
+    std::thread sender([&] {
+        result.sent = sendWorkload(w);
+        senderDone.store(true, std::memory_order_release);
+    });
+
+    pollfd pfd{};
+    pfd.fd = ring.sockfd;
+    pfd.events = POLLIN;
+    std::chrono::steady_clock::time_point first{}, last{};
+    for (uint32_t block_idx = 0; ; block_idx = (block_idx + 1) % ring.blockNr) {
+        tpacket_block_desc *block_ptr = ring.block(block_idx);
+        bool drained = false;
+        while (!RxRing::ready(block_ptr)) {
+            bool done = senderDone.load(std::memory_order_acquire);
+            if (poll(&pfd, 1, done ? DRAIN_MS : 10) == 0 && done) {
+                drained = !RxRing::ready(block_ptr);
+                break;
+            }
+        }
+        if (drained) break;
+        forEachPacket(block_ptr, [&](tpacket3_hdr *current_packet) {
+            char *buf = (char *)current_packet + current_packet->tp_mac;
+            ssize_t payload_length;
+            char *payload = extractUdpPayload(buf, current_packet->tp_snaplen, mcast_ip, dest_port, payload_length);
+            if (!payload) return;
+            if (!result.received++) first = std::chrono::steady_clock::now();
+            latency.beginPacket(RxRing::packetNs(current_packet));
+            parsePayload(payload, payload_length);
+        });
+        last = std::chrono::steady_clock::now();
+        release_block(block_ptr);
+    }
+    sender.join();
+
+    tpacket_stats_v3 st{};
+    socklen_t len = sizeof(st);
+    getsockopt(ring.sockfd, SOL_PACKET, PACKET_STATISTICS, &st, &len);
+    closeRxRing(ring);
+    result.kernelDrops = st.tp_drops;
+    result.kernelFreezes = st.tp_freeze_q_cnt;
+    result.messages = GlobalState::sequencer.stats.parsedMessages + GlobalState::sequencer.stats.duplicates;
+    result.seconds = std::chrono::duration<double>(last - first).count();
+    result.rxToDequeue = latency.stage(LAT_RX_TO_DEQUEUE).summary();
+    result.ok = true;
+}
+
+// Better for the host: nothing lost, then the lower p99 (within 5%), then the smaller ring
+static bool better(const SweepResult &a, const SweepResult &b) {
+    uint64_t lostA = a.kernelDrops + (a.sent - std::min(a.sent, a.received));
+    uint64_t lostB = b.kernelDrops + (b.sent - std::min(b.sent, b.received));
+    if (lostA != lostB) return lostA < lostB;
+    if (a.rxToDequeue.p99 * 20 < b.rxToDequeue.p99 * 19) return true;
+    if (b.rxToDequeue.p99 * 20 < a.rxToDequeue.p99 * 19) return false;
+    return a.geometry.bytes() < b.geometry.bytes();
+}
+
+int main(int argc, char **argv) {
+    Workload w;
+    w.nic = argc > 1 ? argv[1] : "lo";
+    w.ifaceIp = argc > 2 ? argv[2] : "127.0.0.1";
+    w.laps = argc > 3 ? atoi(argv[3]) : 20;
+    w.burst = argc > 4 ? std::max(atoi(argv[4]), 1) : 64;
+    w.pauseUs = argc > 5 ? atoi(argv[5]) : 200;
+    const char *path = argc > 6 ? argv[6] : "../replay_server/itch_data.bin";
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    w.fileBuf.resize(nbytes);
+    f.seekg(0);
+    f.read(w.fileBuf.data(), nbytes);
+
+    // Pack the file into payloads exactly like the replay server does
+    size_t msgCount = 0;
+    w.payloads = packRawPayloads(w.fileBuf.data(), nbytes, msgCount);
+
+    SweepResult *result = (SweepResult *) mmap(nullptr, sizeof(SweepResult), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED) {
+        perror("mmap()");
+        return 1;
+    }
+
+    // Every run is a forked child, so the books and the sequencer start empty
+    std::vector<SweepResult> results;
+    for (uint32_t blockKb : BLOCK_SIZES_KB) {
+        for (uint32_t blockNr : BLOCK_NRS) {
+            for (uint32_t tov : RETIRE_TOVS_MS) {
+                RingGeometry geometry;
+                geometry.blockSize = blockKb * 1024;
+                geometry.blockNr = blockNr;
+                geometry.retireTovMs = tov;
+                pid_t pid = fork();
+                if (pid == 0) {
+                    runOnce(w, geometry, *result);
+                    _exit(0);
+                }
+                waitpid(pid, nullptr, 0);
+                if (result->ok) results.push_back(*result);
+            }
+        }
+    }
+    if (results.empty()) {
+        std::cerr << "No geometry could be opened on " << w.nic << " (needs root)" << std::endl;
+        return 1;
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("%s, %u laps of %zu payloads, bursts of %u with %u us pauses\n", w.nic, w.laps, w.payloads.size(), w.burst, w.pauseUs);
+    printf("%9s %6s %7s %8s %10s %10s %7s %7s %10s %10s %10s\n", "block KB", "blocks", "tov ms", "ring MB", "sent",
+           "received", "drops", "freezes", "msgs/s", "p50 ns", "p99 ns");
+    const SweepResult *best = &results[0];
+    for (const SweepResult &r : results) {
+        printf("%9u %6u %7u %8.1f %10lu %10lu %7lu %7lu %10.0f %10lu %10lu\n", r.geometry.blockSize / 1024,
+               r.geometry.blockNr, r.geometry.retireTovMs, r.geometry.bytes() / 1048576.0, r.sent, r.received,
+               r.kernelDrops, r.kernelFreezes, r.seconds > 0 ? r.messages / r.seconds : 0.0, r.rxToDequeue.p50,
+               r.rxToDequeue.p99);
+        if (better(r, *best)) best = &r;
+    }
+    printf("Recommended: --block-size %u --block-nr %u --retire-tov %u (%.1f MB, %lu drops, p99 %lu ns)\n",
+           best->geometry.blockSize / 1024, best->geometry.blockNr, best->geometry.retireTovMs,
+           best->geometry.bytes() / 1048576.0, best->kernelDrops, best->rxToDequeue.p99);
+}
@@ -0,0 +1,140 @@
+// Producer to consumer latency of the shared memory feed (src/shm_feed.h) with 1 to 8 reader processes: the
+// producer publishes events at a fixed interval and every reader, a forked process attached by name through
+// ShmFeedReader, spins on the feed and records how long after publication it read each event (TSC at read
+// minus the TSC the producer stamped at publish). Also reports the producer's cost per published event, which
+// stays flat however many readers there are since it never looks at them.
+// Readers that can't keep up are lapped rather than waited for, the events they missed are reported. The
+// readers spin, so each needs a core of its own for the numbers to mean anything: with fewer cores than
+// readers + 1 the latencies are the scheduler's time slices. Pin the readers to consecutive cores from the
+// third argument.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_shm_feed.cpp -o benchmark_shm_feed
+// Run: ./benchmark_shm_feed [interval ns, default 1000] [events, default 200000] [first reader core, default unpinned]
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <sys/wait.h>
+#include "../../../src/shm_feed.h"
+#include "../../../src/clock.h"
+#include "../../../src/cpu.h"
+
+constexpr int MAX_READERS = 8;
+constexpr uint64_t FEED_EVENTS = 1 << 16;
+
+// Written by each reader process into memory shared with the parent
+struct ReaderResult {
+    uint64_t    received;
+    uint64_t    missed;
+    uint64_t    laps;
+    double      p50, p99, p999, max;
+};
+
+static double percentile(const std::vector<uint32_t> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+}
+
+// Reader process: read until the producer closes the feed, then hand the latencies back through result
+static void runReader(const char *name, uint64_t events, int cpu, ReaderResult &result) {
+    if (cpu >= 0) pinToCpu(cpu);
+    std::vector<uint32_t> latencies;
+    latencies.reserve(events);
+    ShmFeedReader reader;
+    if (!reader.open(name)) _exit(1);
+    FeedEvent e;
+    for (;;) {
+        // Closed is set after the last publish, so once it is seen an empty feed stays empty
+        bool closed = reader.producerClosed();
+        ShmPoll r = reader.poll(e);
+        if (r == ShmPoll::Event) {
+            latencies.push_back(tscClock.nowNs() - tscClock.toNs(e.publishTsc));
+        } else if (r == ShmPoll::Empty) {
+            if (closed) break;
+            _mm_pause();
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    result = ReaderResult{latencies.size(), reader.missed(), reader.laps(), percentile(latencies, 0.5),
+                          percentile(latencies, 0.99), percentile(latencies, 0.999),
+                          latencies.empty() ? 0.0 : (double) latencies.back()};
+    reader.close();
+}
+
+int main(int argc, char **argv) {
+    uint64_t intervalNs = argc > 1 ? atoll(argv[1]) : 1000;
+    uint64_t events = argc > 2 ? atoll(argv[2]) : 200000;
+    int firstCpu = argc > 3 ? atoi(argv[3]) : -1;
+    std::string name = "/benchmark_shm_feed_" + std::to_string(getpid());
+    ReaderResult *results = (ReaderResult *) mmap(nullptr, sizeof(ReaderResult) * MAX_READERS, PROT_READ | PROT_WRITE,
+                                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap()");
+        return 1;
+    }
+
+    struct Run {
+        int             readers;
+        double          publishNs;  // producer time per event, claim to publish
+        ReaderResult    r[MAX_READERS];
+    };
+    std::vector<Run> runs;
+    for (int readers = 1; readers <= MAX_READERS; readers *= 2) {
+        ShmFeedPublisher publisher;
+        if (!publisher.open(name.c_str(), FEED_EVENTS)) return 1;
+        std::vector<pid_t> children;
+        for (int i = 0; i < readers; i++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                runReader(name.c_str(), events, firstCpu >= 0 ? firstCpu + i : -1, results[i]);
+                _exit(0); // the parent's publisher must not be closed (and unlinked) by a child
+            }
+            children.push_back(pid);
+        }
+        // Publish only once every reader is attached
+        ShmConsumerStatus status[SHM_FEED_MAX_CONSUMERS];
+        while (publisher.consumers(status) < (size_t) readers) usleep(1000);
+
+        uint64_t publishTicks = 0;
+        uint64_t next = tscClock.nowNs();
+        for (uint64_t i = 0; i < events; i++) {
+            while (tscClock.nowNs() < next) _mm_pause();
+            next += intervalNs;
+            uint64_t start = __rdtsc();
+            FeedEvent *e = publisher.claim();
+            std::memset(e, 0, sizeof(*e));
+            e->messageType = 'A';
+            e->sequenceNumber = i + 1;
+            publisher.publish();
+            publishTicks += __rdtsc() - start;
+        }
+        publisher.close();
+        for (pid_t pid : children) waitpid(pid, nullptr, 0);
+        Run run{readers, (double) tscClock.ticksToNs(publishTicks) / events, {}};
+        std::copy(results, results + readers, run.r);
+        runs.push_back(run);
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Events per run: %lu, one every %lu ns, feed holds %lu events\n", events, intervalNs, FEED_EVENTS);
+    for (const Run &run : runs) {
+        // Worst reader of the run for every figure
+        ReaderResult worst{};
+        uint64_t received = 0;
+        for (int i = 0; i < run.readers; i++) {
+            const ReaderResult &r = run.r[i];
+            received += r.received;
+            worst.missed = std::max(worst.missed, r.missed);
+            worst.laps = std::max(worst.laps, r.laps);
+            worst.p50 = std::max(worst.p50, r.p50);
+            worst.p99 = std::max(worst.p99, r.p99);
+            worst.p999 = std::max(worst.p999, r.p999);
+            worst.max = std::max(worst.max, r.max);
+        }
+        printf("%d reader(s): latency p50 %.0f ns, p99 %.0f ns, p99.9 %.0f ns, max %.0f ns (worst reader); "
+               "events read %lu/%lu, most missed by one reader %lu (%lu laps); publish %.1f ns per event\n",
+               run.readers, worst.p50, worst.p99, worst.p999, worst.max, received, events * run.readers,
+               worst.missed, worst.laps, run.publishNs);
+    }
+}
@@ -0,0 +1,173 @@
+// Throughput of the parse path with a subscription filter (src/symbols.h) in front of the books, with 1%, 10%
+// and 100% of the symbols subscribed and with no filter at all. itch_data.bin only has a dozen symbols, so the
+// feed is synthetic: 8000 symbols (about a US equities universe), adds spread evenly over them, and the
+// executions, cancels and trades that follow them in roughly the proportions of a real feed. E/X/C carry no
+// symbol, the filter drops them when their order isn't on the books.
+// Each configuration runs in a forked child so every one starts with empty books and a fresh sequencer. Each
+// round parses the whole feed with fresh sequence numbers (continuing from the last round), the best round is
+// reported.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_subscription.cpp ../../../src/parse.cpp -o benchmark_subscription
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <endian.h>
+#include <sys/wait.h>
+#include "../../../src/parse.h"
+#include "../../../src/sequencer.h"
+#include "../../../src/orderbook.h"
+#include "../../../src/symbols.h"
+
+constexpr uint32_t SYMBOLS = 8000;
+constexpr uint32_t MESSAGES = 1'000'000;
+constexpr size_t SEND_BUFFER_SIZE = 1472;
+constexpr int ROUNDS = 5;
+
+using Payloads = std::vector<std::pair<size_t, size_t>>;
+
+struct Feed {
+    std::vector<char> buf;
+    Payloads payloads;
+    std::vector<std::string> symbols;
+};
+
+// Message builder, fields written big endian at the offsets of the layout tables
+class Writer {
+public:
+    Writer(Feed &feed): m_feed(feed) {}
+
+    char *begin(char type) {
+        size_t size = getMessageSize(type);
+        if (m_feed.buf.size() - m_payloadStart + size > SEND_BUFFER_SIZE) endPayload();
+        m_msg = m_feed.buf.size();
+        m_feed.buf.resize(m_msg + size);
+        char *msg = &m_feed.buf[m_msg];
+        msg[0] = type;
+        put16(msg + 1, 0);
+        put32(msg + 3, m_seq);
+        put32(msg + 7, m_seq++);
+        return msg;
+    }
+
+    void endPayload() {
+        if (m_feed.buf.size() > m_payloadStart) m_feed.payloads.emplace_back(m_payloadStart, m_feed.buf.size() - m_payloadStart);
+        m_payloadStart = m_feed.buf.size();
+    }
+
+    static void put16(char *p, uint16_t v) { v = htobe16(v); std::memcpy(p, &v, 2); }
+    static void put32(char *p, uint32_t v) { v = htobe32(v); std::memcpy(p, &v, 4); }
+    static void put64(char *p, uint64_t v) { v = htobe64(v); std::memcpy(p, &v, 8); }
+
+private:
+    Feed &m_feed;
+    size_t m_payloadStart = 0, m_msg = 0;
+    uint32_t m_seq = 1;
+};
+
+static Feed makeFeed() {
+    Feed feed;
+    for (uint32_t s = 0; s < SYMBOLS; s++) feed.symbols.push_back("S" + std::to_string(s));
+    Writer w(feed);
+    std::mt19937 rng(42);
+    struct Live { uint64_t ref; };
+    std::vector<Live> live;
+    uint64_t nextRef = 1;
+    for (uint32_t i = 0; i < MESSAGES; i++) {
+        uint32_t r = rng() % 100;
+        if (r < 45 || live.empty()) {
+            // Add
+            char *m = w.begin('A');
+            uint32_t s = rng() % SYMBOLS;
+            char stock[8];
+            std::memset(stock, ' ', 8);
+            std::memcpy(stock, feed.symbols[s].data(), feed.symbols[s].size());
+            Writer::put64(m + TradeView::ORDER_REF_NUMBER, nextRef);
+            m[TradeView::BUY_SELL_INDICATOR] = rng() % 2 ? 'B' : 'S';
+            Writer::put32(m + TradeView::SHARES, 100 + rng() % 400);
+            std::memcpy(m + TradeView::STOCK, stock, 8);
+            Writer::put32(m + TradeView::PRICE, 10000 + rng() % 1000);
+            live.push_back({nextRef++});
+        } else if (r < 90) {
+            // Cancel (whole order), execute or execute with price (part of it) a random live order
+            size_t k = rng() % live.size();
+            char type = r < 70 ? 'C' : r < 85 ? 'E' : 'X';
+            char *m = w.begin(type);
+            Writer::put64(m + OrderCancelView::ORDER_REF_NUMBER, live[k].ref);
+            if (type == 'C') {
+                Writer::put32(m + OrderCancelView::CANCELLED_SHARES, 1000);
+                live[k] = live.back();
+                live.pop_back();
+            } else if (type == 'E') {
+                Writer::put32(m + OrderExecutedView::EXECUTED_SHARES, 10);
+            } else {
+                Writer::put32(m + OrderExecutedWithPriceView::EXECUTED_SHARES, 10);
+                m[OrderExecutedWithPriceView::PRINTABLE] = 'Y';
+                Writer::put32(m + OrderExecutedWithPriceView::EXECUTED_PRICE, 10500);
+            }
+        } else {
+            // Non-displayed trade
+            char *m = w.begin('P');
+            uint32_t s = rng() % SYMBOLS;
+            std::memset(m + TradeView::STOCK, ' ', 8);
+            std::memcpy(m + TradeView::STOCK, feed.symbols[s].data(), feed.symbols[s].size());
+            m[TradeView::BUY_SELL_INDICATOR] = 'B';
+            Writer::put32(m + TradeView::SHARES, 100);
+            Writer::put32(m + TradeView::PRICE, 10500);
+        }
+    }
+    w.endPayload();
+    return feed;
+}
+
+// Shift every sequence number in the feed by delta so the next round continues where the last one stopped
+static void renumber(Feed &feed, uint32_t delta) {
+    for (auto &[off, len] : feed.payloads) {
+        for (size_t pos = off; pos < off + len; pos += getMessageSize(feed.buf[pos])) {
+            uint32_t seq = htobe32(peekSequenceNumber(&feed.buf[pos]) + delta);
+            std::memcpy(&feed.buf[pos + 7], &seq, 4);
+        }
+    }
+}
+
+// Child: subscribe to the first `subscribed` symbols of a shuffled list (all of them with no filter at all when
+// negative), parse ROUNDS times and print the best
+static void runOnce(Feed &feed, int subscribed) {
+    std::vector<std::string> symbols = feed.symbols;
+    std::shuffle(symbols.begin(), symbols.end(), std::mt19937(7));
+    for (int i = 0; i < subscribed; i++) feedSubscriptions.subscribe(symbols[i]);
+    orderBooks.subscribedOnly = subscribed >= 0;
+
+    double best = 1e18;
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto &[off, len] : feed.payloads) parseMessage(feed.buf.data() + off, len);
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        renumber(feed, MESSAGES);
+    }
+    char label[32];
+    if (subscribed < 0) snprintf(label, sizeof(label), "no filter");
+    else snprintf(label, sizeof(label), "%5.1f%% (%d)", 100.0 * subscribed / SYMBOLS, subscribed);
+    printf("Subscribed %-14s: %.2f ns per message, %.1fM messages/sec, live orders %zu, books %zu, "
+           "order messages dropped as unsubscribed %lu\n", label, best / MESSAGES, MESSAGES / best * 1e3,
+           orderBooks.liveOrders(), orderBooks.bookCount(), orderBooks.unsubscribed / ROUNDS);
+}
+
+int main() {
+    Feed feed = makeFeed();
+    std::cout << "=== RESULTS ===\n";
+    printf("Symbols: %u, messages: %u in %zu payloads, rounds: %d\n", SYMBOLS, MESSAGES, feed.payloads.size(), ROUNDS);
+    fflush(stdout);
+    for (int subscribed : {-1, (int) SYMBOLS, (int) SYMBOLS / 10, (int) SYMBOLS / 100}) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            runOnce(feed, subscribed);
+            fflush(stdout);
+            _exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+}
@@ -0,0 +1,141 @@
+// The single ring receive loop (singleRingLoop in src/rx_loop.h, exactly what main.cpp runs over the NIC's ring)
+// over a TPACKET_V3 ring built in memory (src/synthetic_ring.h), so demux, parse and sequencing are measured at
+// memory speed without root, an interface or a sender. itch_data.bin is packed into payloads like the replay
+// server does, framed as Ethernet/IPv4/UDP to 239.1.1.1:30001 and laid out 10us apart in blocks of the given
+// size. Every run is a forked child with the feed handler's state fresh, walking the blocks once; reported are
+// the median of RUNS in nanoseconds and TSC ticks (reference cycles) per packet and per message, against a walk
+// of the same blocks that only finds every frame. With --resident the child runs residency.enable() first, so
+// the book tables don't fault in during the pass.
+// Build: g++ -std=c++20 -O3 -march=native benchmark_synthetic_ring.cpp ../../../src/parse.cpp -o benchmark_synthetic_ring
+// Run: ./benchmark_synthetic_ring [itch file, default ../replay_server/itch_data.bin] [block size kb, default 512] [--resident]
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../../../src/parse.h"
+#include "../../../src/rx_loop.h"
+#include "../../../src/synthetic_ring.h"
+#include "../../../src/residency.h"
+#include "../../../src/file_ingest.h"
+
+constexpr uint64_t START_NS = 1'700'000'000'000'000'000ULL;
+constexpr uint64_t PACKET_GAP_NS = 10'000;
+constexpr int RUNS = 15;
+
+// Written by each child into memory shared with the parent
+struct RunResult {
+    uint64_t    loopTicks;
+    uint64_t    walkTicks;
+    uint64_t    messages;
+    uint64_t    lost;
+    uint64_t    faults;
+};
+
+static uint64_t minorFaults() {
+    uint64_t minor, major;
+    threadFaults(minor, major);
+    return minor + major;
+}
+
+template<typename T>
+static T median(std::vector<RunResult> &runs, T RunResult::*field) {
+    std::sort(runs.begin(), runs.end(), [field](const RunResult &a, const RunResult &b) { return a.*field < b.*field; });
+    return runs[runs.size() / 2].*field;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "../replay_server/itch_data.bin";
+    uint32_t blockKb = BLOCK_SIZE >> 10;
+    bool resident = false;
+    for (int i = 1, positional = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--resident")) resident = true;
+        else if (positional++ == 0) path = argv[i];
+        else blockKb = atoi(argv[i]);
+    }
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return 1;
+    }
+    size_t nbytes = f.tellg();
+    std::vector<char> fileBuf(nbytes);
+    f.seekg(0);
+    f.read(fileBuf.data(), nbytes);
+
+    // Pack the file into payloads exactly like the replay server does, each one a frame in the ring
+    SyntheticRing synthetic(blockKb << 10);
+    char frame[SYNTHETIC_FRAME_HEADERS + MAX_UDP_PAYLOAD];
+    uint64_t packets = 0, ts = START_NS;
+    size_t msgCount = 0;
+    for (auto &[off, len] : packRawPayloads(fileBuf.data(), nbytes, msgCount)) {
+        size_t frameLen = syntheticFrame(frame, inet_addr("239.1.1.1"), htons(30001), fileBuf.data() + off, len);
+        if (!synthetic.add(frame, frameLen, ts)) {
+            std::cerr << "A frame doesn't fit in a " << blockKb << " KB block" << std::endl;
+            return 1;
+        }
+        packets++;
+        ts += PACKET_GAP_NS;
+    }
+    RxRing ring = synthetic.ring();
+
+    RunResult *result = (RunResult *) mmap(nullptr, sizeof(RunResult), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED) {
+        perror("mmap()");
+        return 1;
+    }
+
+    std::vector<RunResult> runs;
+    for (int run = 0; run < RUNS; run++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (resident) {
+                // What the residency setup prints isn't wanted here
+                fflush(stdout);
+                FILE *quiet = freopen("/dev/null", "w", stdout);
+                (void) quiet;
+                residency.enable();
+            }
+            feedChannels.add(inet_addr("239.1.1.1"), htons(30001));
+            // Floor: the same blocks walked with every frame found and touched, nothing done with it
+            uint64_t touched = 0;
+            uint64_t t0 = tscClock.ticks();
+            for (uint32_t b = 0; b < ring.blockNr; b++) {
+                forEachPacket(ring.block(b), [&](tpacket3_hdr *pkt) { touched += *((uint8_t *) pkt + pkt->tp_mac); });
+            }
+            uint64_t t1 = tscClock.ticks();
+            result->walkTicks = t1 - t0 + (touched == UINT64_MAX);
+
+            uint32_t blocks = 0;
+            uint64_t faults = minorFaults();
+            t0 = tscClock.ticks();
+            singleRingLoop(ring, GapClock::Packet, [&] { return ++blocks < ring.blockNr; });
+            t1 = tscClock.ticks();
+            result->loopTicks = t1 - t0;
+            result->faults = minorFaults() - faults;
+            result->messages = GlobalState::sequencer.stats.parsedMessages;
+            result->lost = GlobalState::sequencer.stats.lostMessages;
+            _exit(0);
+        }
+        waitpid(pid, nullptr, 0);
+        runs.push_back(*result);
+    }
+
+    // RESULTS
+    double nsPerTick = tscClock.ticksToNs(1'000'000) / 1e6;
+    uint64_t loopTicks = median(runs, &RunResult::loopTicks);
+    uint64_t walkTicks = median(runs, &RunResult::walkTicks);
+    uint64_t messages = runs[0].messages;
+    std::cout << "=== RESULTS ===\n";
+    printf("Packets: %lu, messages: %lu (lost %lu), blocks: %u of %u KB, median of %d runs%s\n", packets, messages,
+           runs[0].lost, ring.blockNr, blockKb, RUNS, resident ? ", --resident" : "");
+    printf("Receive loop: %.1f ticks (%.1f ns) per packet, %.2f ticks (%.2f ns) per message, %lu page faults\n",
+           (double) loopTicks / packets, loopTicks * nsPerTick / packets, (double) loopTicks / messages,
+           loopTicks * nsPerTick / messages, median(runs, &RunResult::faults));
+    printf("Block walk only: %.1f ticks (%.1f ns) per packet\n", (double) walkTicks / packets, walkTicks * nsPerTick / packets);
+    printf("Throughput: %.0f packets/sec, %.0f messages/sec\n", packets / (loopTicks * nsPerTick / 1e9),
+           messages / (loopTicks * nsPerTick / 1e9));
+}
@@ -0,0 +1,129 @@
+// Contention on the shared memory top of book table (src/top_of_book.h): a writer refreshes random symbols of a
+// small hot set as fast as it can while 0, 1, 2 and 4 reader threads on other cores read the table, and reports
+// what the readers cost the writer (time per update against no readers at all) and what the readers got.
+// Two kinds of reader:
+//   poll: takes the changed symbols from its dirty bitmap and reads only those (the intended use)
+//   hot:  rereads the hot symbols one after the other without looking at the bitmap, the most any reader can
+//         pull the writer's lines away from it
+// Every update changes the symbol's bid, so none is conflated away by the writer. The writer's time is its own
+// CPU time, so readers sharing its core (when there are fewer cores than threads) don't count against it, but
+// then the readers only run when the writer is preempted, often in the middle of an update, and spin on the
+// odd version until it runs again: the retries are only meaningful with the writer and readers on separate
+// cores, writer on the first argument and readers on the ones after it.
+// Build: g++ -std=c++20 -O3 -march=native -pthread benchmark_top_of_book.cpp -o benchmark_top_of_book
+// Run: ./benchmark_top_of_book [writer core, default unpinned]
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <string>
+#include <time.h>
+#include "../../../src/top_of_book.h"
+#include "../../../src/cpu.h"
+
+constexpr uint32_t HOT_SYMBOLS = 64;
+constexpr uint64_t UPDATES = 5'000'000;
+
+// CPU time of the calling thread
+static long long threadNs() {
+    timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return (long long) t.tv_sec * 1'000'000'000LL + t.tv_nsec;
+}
+
+struct ReaderStats {
+    uint64_t    reads = 0;
+    uint64_t    retries = 0;
+};
+
+struct Run {
+    const char  *mode;
+    int         readers;
+    double      updateNs;
+    ReaderStats total;
+};
+
+static Run runOnce(const char *name, const char *mode, int readers, int writerCpu) {
+    TopOfBookTable table;
+    if (!table.open(name)) exit(1);
+    std::vector<uint32_t> symbols(UPDATES);
+    std::mt19937 rng(42);
+    for (uint64_t i = 0; i < UPDATES; i++) symbols[i] = rng() % HOT_SYMBOLS;
+    // Every symbol exists before the readers start
+    std::vector<TopOfBook> tops(HOT_SYMBOLS);
+    for (uint32_t s = 0; s < HOT_SYMBOLS; s++) {
+        snprintf(tops[s].stock, sizeof(tops[s].stock), "SYM%u", s);
+        table.update(s, tops[s]);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> ready{0};
+    std::vector<ReaderStats> stats(readers);
+    std::vector<std::thread> threads;
+    bool poll = !strcmp(mode, "poll");
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&, i] {
+            if (writerCpu >= 0) pinToCpu(writerCpu + 1 + i);
+            TopOfBookReader reader;
+            if (!reader.open(name)) exit(1);
+            ready++;
+            ReaderStats &s = stats[i];
+            TopOfBook top;
+            uint64_t checksum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (poll) {
+                    s.reads += reader.pollChanged([&](size_t, const TopOfBook &tb) { checksum += tb.bidPrice; });
+                } else {
+                    for (uint32_t sym = 0; sym < HOT_SYMBOLS; sym++) {
+                        if (reader.read(sym, top)) checksum += top.bidPrice;
+                    }
+                    s.reads += HOT_SYMBOLS;
+                }
+            }
+            s.retries = reader.retries();
+            if (checksum == 1) printf(" "); // keep the reads
+        });
+    }
+    while (ready.load() < readers) std::this_thread::yield();
+
+    if (writerCpu >= 0) pinToCpu(writerCpu);
+    long long start = threadNs();
+    for (uint64_t i = 0; i < UPDATES; i++) {
+        TopOfBook &t = tops[symbols[i]];
+        t.bidPrice = (uint32_t) i + 1;
+        t.timestamp = i;
+        table.update(symbols[i], t);
+    }
+    double updateNs = (double) (threadNs() - start) / UPDATES;
+    stop.store(true);
+    for (std::thread &th : threads) th.join();
+
+    Run run{mode, readers, updateNs, {}};
+    for (const ReaderStats &s : stats) {
+        run.total.reads += s.reads;
+        run.total.retries += s.retries;
+    }
+    return run;
+}
+
+int main(int argc, char **argv) {
+    int writerCpu = argc > 1 ? atoi(argv[1]) : -1;
+    std::string name = "/benchmark_top_of_book_" + std::to_string(getpid());
+    std::vector<Run> runs;
+    for (const char *mode : {"poll", "hot"}) {
+        for (int readers : {0, 1, 2, 4}) runs.push_back(runOnce(name.c_str(), mode, readers, writerCpu));
+    }
+
+    // RESULTS
+    std::cout << "=== RESULTS ===\n";
+    printf("Updates per run: %lu over %u hot symbols\n", UPDATES, HOT_SYMBOLS);
+    double alone = runs[0].updateNs;
+    for (const Run &run : runs) {
+        printf("%-4s readers: %d, writer %.1f ns per update (%+.1f ns against no readers), snapshots read %lu, "
+               "seqlock retries %lu (%.3f%%)\n", run.mode, run.readers, run.updateNs, run.updateNs - alone,
+               run.total.reads, run.total.retries,
+               run.total.reads ? 100.0 * run.total.retries / run.total.reads : 0.0);
+    }
+}
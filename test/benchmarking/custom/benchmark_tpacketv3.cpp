@@ -13,6 +13,9 @@
 #include <sys/mman.h>
 #include "../../../src/parse.h"
 #include "../../../src/sequencer.h"
+#include "../../../src/clock.h"
+#include "../../../src/cpu.h"
+#include "../../../src/residency.h"
 #define MULTICAST_IP "239.1.1.1"
 #define PORT 30001
 #define LOG(x) std::cout << x << std::endl
@@ -97,17 +100,13 @@ int main() {
 
     std::cout << "LISTENING FOR FRAMES ON " << nic << std::endl;
 
-    // 7. Start timer thread for packet sequencer (for detecting losses when gaps opened in stream
-    // due to out-of-order messages)
-    GlobalState::timerIsRunning.store(true, std::memory_order_relaxed);
-    std::thread gapTimerThread(gapTimer);
+    // 7. Gaps opened in the stream by out-of-order messages are timed out inline by checkGapTimeout,
+    // no timer thread needed
     uint32_t NUM_MESSAGES = 10000000;
     auto now = std::chrono::steady_clock::now();
 
-    // Force the TLB to cache the seen array
-    for (size_t i = 0; i < WINDOW_SIZE; i += 1) {
-        GlobalState::seen[i].store(0, std::memory_order_relaxed);
-    }
+    // Hot state on hugepages, prefaulted and locked (the sequencer window included) before the first message
+    residency.enable();
     // 8. Loop over the shared ring buffer in modulo pattern so we continuously iterate
      // Ensure the frame index is always within the frame count of the shared ring buffer
     uint32_t mcast_ip = inet_addr(MULTICAST_IP);
@@ -184,19 +183,15 @@ int main() {
             // Then we can get the UDP payload size by taking away the UDP header from that value
             ssize_t payload_length = ntohs(ip_header->tot_len) - ip_header_length - 8;
             parseMessage(payload, payload_length);
-
-            // Check if timeout occured
-            if (GlobalState::gapTimeout.exchange(false, std::memory_order_acq_rel)) {
-                handleGapTimeout();
-            }
             current_packet = (tpacket3_hdr *)((uint8_t*) current_packet + current_packet->tp_next_offset);
         }
 
         release_block(block_ptr);
+
+        // Check the gap deadline once per block
+        checkGapTimeout(tscClock.nowNs());
     }
 
-    GlobalState::timerIsRunning.store(false, std::memory_order_relaxed);
-    gapTimerThread.join();
     auto end = std::chrono::steady_clock::now();
     long long time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(end - now).count();
     std::chrono::duration<double> time_taken_sec = end - now;
@@ -205,9 +200,9 @@ int main() {
     // RESULTS
     std::cout << "=== RESULTS ===\n";
     printf("Messages parsed: %d\n", NUM_MESSAGES);
-    printf("Messages lost: %u\n", GlobalState::lostMessages);
-    printf("Messages received out of order: %u\n", GlobalState::outOfOrderMessages);
-    printf("Messages recieved as duplicates: %u\n", GlobalState::duplicates);
+    printf("Messages lost: %u\n", GlobalState::sequencer.stats.lostMessages);
+    printf("Messages received out of order: %u\n", GlobalState::sequencer.stats.outOfOrderMessages);
+    printf("Messages recieved as duplicates: %u\n", GlobalState::sequencer.stats.duplicates);
     printf("Time taken: %lld\n", time_taken);
     printf("Time taken per message: %lld\n", time_taken/NUM_MESSAGES);
     printf("Throughput: %f messages/sec\n", NUM_MESSAGES / time_taken_sec.count());
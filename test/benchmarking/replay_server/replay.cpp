@@ -1,42 +1,299 @@
 // Create UDP replay server, reads bytes from itch_data.bin and sends to 239.1.1.1 (same multicast address)
+// With --ab every payload is also sent on line B (239.1.1.2:30002), optionally skewed against line A and
+// with independent random loss on each line, to exercise the handler's A/B arbitration on loopback.
+// The file is mmapped (any size) and the datagrams are handed to the kernel BATCH at a time with sendmmsg, paced
+// to --rate messages per second, sent evenly or in bursts (by default it sleeps 10us after every payload as before).
+// Every line can be impaired on its own (drop, duplicate, reorder, delay, all drawn from --seed) and with
+// --truth every impairment and a summary of every lap is written to a ground truth log. The summary comes from
+// the datagrams in the order they were handed to the kernel: messages sent on no line are what the handler
+// counts as lost (as long as each of its gaps fills within its 5ms gap timeout and nothing is retransmitted),
+// and on a single line the duplicated messages are its duplicates (late messages are what open its gaps, its out
+// of order count is every message received while one is open). Sequence numbers start again every lap, so run
+// --laps 1 to check a handler's counters exactly.
+// Usage: ./replay [--file <path>] [--ab] [--skew-us <n>] [--loss-a <p>] [--loss-b <p>] [--loss-burst <n>] [--dup <p>]
+//                 [--reorder <p>] [--reorder-depth <n>] [--delay <p>] [--delay-us <n>] [--rate <msgs/s>|max]
+//                 [--burst <n>] [--laps <n>] [--truth <path>] [--seed <n>] [--if <addr>] [--retransmit] [--mold]
+//   --file <path>        replay this file instead of itch_data.bin
+//   --skew-us <n>        delay line B by n microseconds (negative delays line A instead)
+//   --loss-a <p>         drop each line A payload with probability p (also applies without --ab)
+//   --loss-b <p>         drop each line B payload with probability p
+//   --loss-burst <n>     every loss drops n payloads in a row on its line (default 1)
+//   --dup <p>            send each payload twice with probability p, on every line
+//   --reorder <p>        hold each payload back with probability p until --reorder-depth more went out on its line (default 3)
+//   --delay <p>          hold each payload back with probability p for --delay-us microseconds (default 1000)
+//   --rate <msgs/s>      send this many messages per second, max for as fast as the socket takes them
+//   --burst <n>          with --rate, send n messages at once then wait, the same rate on average
+//   --laps <n>           stop after replaying the file n times (default never)
+//   --truth <path>       write every impairment and each lap's ground truth to this file
+//   --if <addr>          send out of the interface with this address (127.0.0.1 to test on loopback)
+//   --retransmit         also run a retransmit server on UDP port 30003, answering MoldUDP64 requests from fileBuf
+//   --mold               frame every payload as a MoldUDP64 packet (header + length prefixed messages)
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <iostream>
 #include <unistd.h>
-#include <fstream>
 #include <thread>
 #include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+#include "../../../src/itch.h"
 
 constexpr uint32_t PORT = 30001;
-constexpr uint32_t READ_BUFFER_SIZE = 3000000;
+constexpr uint32_t PORT_B = 30002;
 constexpr uint32_t SEND_BUFFER_SIZE = 1472;
 constexpr char MULTICAST_IP[] = "239.1.1.1";
+constexpr char MULTICAST_IP_B[] = "239.1.1.2";
+constexpr uint32_t RETRANSMIT_PORT = 30003;
+constexpr size_t BATCH = 64; // payloads packed (and datagrams sent per sendmmsg) before going to the kernel
+constexpr auto DEFAULT_PAYLOAD_GAP = std::chrono::microseconds(10);
+// Waits longer than this sleep (and spin the rest), shorter ones only spin
+constexpr auto SPIN_LIMIT = std::chrono::microseconds(100);
+constexpr const char *LINE_NAMES[2] = {"A", "B"};
 
-// ENUM for message sizes
-enum MessageSize {
-    Trade = 36,
-    OrderExecuted = 23,
-    OrderExecutedWithPrice = 28,
-    SystemEvent = 12,
-    OrderCancelled = 23
+// MoldUDP64 framing, same as src/moldudp64.h
+constexpr size_t MOLD_SESSION_LEN = 10;
+constexpr size_t MOLD_HEADER_LEN = 20;
+constexpr char MOLD_SESSION[MOLD_SESSION_LEN + 1] = "MDFHITCH01";
+
+using Clock = std::chrono::steady_clock;
+
+// A datagram queued for the next sendmmsg, pointing into a batch slot or a held payload
+struct Outgoing {
+    const char  *buf;
+    size_t      len;
+    int         line;
+    uint32_t    firstSeq;
+    uint16_t    count;
 };
 
-// Get size of each ITCH message, so we can pack them into the 1472 byte buffer properly
-// If we were to blindly send 1472 bytes at a time, we risk destroying message boundaries
-size_t getMessageSize(const char &msgType) {
-    switch (msgType){
-        case 'A': return MessageSize::Trade;
-        case 'P': return MessageSize::Trade;
-        case 'E': return MessageSize::OrderExecuted;
-        case 'X': return MessageSize::OrderExecutedWithPrice;
-        case 'S': return MessageSize::SystemEvent;
-        case 'C': return MessageSize::OrderCancelled;
-        default: return 0;
+// A payload held back on a line, by the skew or an impairment, until it is due and (reordered) releaseAfter
+// payloads have gone out on the line
+struct HeldSend {
+    Clock::time_point due;
+    uint64_t    releaseAfter;
+    int         line;
+    int         copies;
+    uint32_t    firstSeq;
+    uint16_t    count;
+    size_t      len;
+    char        buf[SEND_BUFFER_SIZE];
+};
+
+// Ground truth of a line for the lap, from the datagrams in the order they were handed to the kernel
+struct LineTruth {
+    uint64_t    datagrams = 0;
+    uint64_t    messages = 0;
+    uint64_t    dropped = 0;    // messages in payloads dropped on the line
+    uint64_t    duplicated = 0; // messages sent again on the line
+    uint64_t    late = 0;       // messages sent after a higher sequence number on the line
+    uint32_t    highest = 0;
+    std::vector<uint8_t> sent;  // by sequence number
+};
+
+// Create the socket address for a multicast line, returns false if the IP is invalid
+bool makeDestination(const char *ip, uint32_t port, sockaddr_in &dest) {
+    dest = sockaddr_in{};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    int rcode = inet_pton(AF_INET, ip, &dest.sin_addr);
+    if (rcode == 0) {
+        printf("%s is an Invalid string.\n", ip);
+        return false;
+    } else if (rcode < 0) {
+        perror("Failed to create binary form of IPv4 multicast address.\n");
+        return false;
     }
+    return true;
+}
+
+// Write a MoldUDP64 header: session, sequence number of the first message, message count (big endian)
+void writeMoldHeader(char *buf, uint64_t seq, uint16_t count) {
+    memcpy(buf, MOLD_SESSION, MOLD_SESSION_LEN);
+    for (int i = 0; i < 8; i++) buf[MOLD_SESSION_LEN + i] = seq >> (56 - 8 * i);
+    buf[MOLD_SESSION_LEN + 8] = count >> 8;
+    buf[MOLD_SESSION_LEN + 9] = count & 0xff;
 }
 
-int main() {
+// Stand-in retransmit server: answers every MoldUDP64 request (session, first sequence number, count) with
+// MoldUDP64 packets holding the requested messages, copied straight out of fileBuf
+void retransmitServer(const char *fileBuf, size_t nbytes) {
+    // Index every message by its sequence number (4 bytes after the type and the 6 byte timestamp)
+    std::vector<size_t> offsets;
+    for (size_t pos = 0; pos < nbytes; pos += messageSize(fileBuf[pos])) {
+        if (messageSize(fileBuf[pos]) == 0) break;
+        uint32_t seq;
+        memcpy(&seq, fileBuf + pos + 7, 4);
+        seq = ntohl(seq);
+        if (seq >= offsets.size()) offsets.resize(seq + 1, SIZE_MAX);
+        offsets[seq] = pos;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(RETRANSMIT_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (sock < 0 || bind(sock, (sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("Error creating retransmit server socket.\n");
+        return;
+    }
+    printf("Retransmit server listening on port %u (%zu messages indexed)\n", RETRANSMIT_PORT, offsets.size() - 1);
+
+    char req[64];
+    char out[SEND_BUFFER_SIZE];
+    uint64_t requests = 0, messages = 0;
+    for (;;) {
+        sockaddr_in from{};
+        socklen_t fromLen = sizeof(from);
+        ssize_t n = recvfrom(sock, req, sizeof(req), 0, (sockaddr*) &from, &fromLen);
+        if (n < (ssize_t) MOLD_HEADER_LEN || memcmp(req, MOLD_SESSION, MOLD_SESSION_LEN)) continue;
+        uint64_t first = 0;
+        for (int i = 0; i < 8; i++) first = first << 8 | (uint8_t) req[MOLD_SESSION_LEN + i];
+        uint16_t count = (uint8_t) req[MOLD_SESSION_LEN + 8] << 8 | (uint8_t) req[MOLD_SESSION_LEN + 9];
+        requests++;
+
+        // Pack the messages into as many packets as it takes, each with its own header. A MoldUDP64 packet's
+        // messages are consecutive from its sequence number, so one that isn't in the file ends the packet and
+        // the next one present starts a new one
+        size_t pos = MOLD_HEADER_LEN;
+        uint64_t packetSeq = first;
+        uint16_t inPacket = 0;
+        auto flush = [&] {
+            writeMoldHeader(out, packetSeq, inPacket);
+            sendto(sock, out, pos, 0, (sockaddr*) &from, fromLen);
+            pos = MOLD_HEADER_LEN;
+            inPacket = 0;
+        };
+        for (uint64_t seq = first; seq < first + count && seq < offsets.size(); seq++) {
+            if (offsets[seq] == SIZE_MAX) {
+                if (inPacket) flush();
+                continue;
+            }
+            const char *msg = fileBuf + offsets[seq];
+            size_t msgSize = messageSize(*msg);
+            if (pos + 2 + msgSize > SEND_BUFFER_SIZE) flush();
+            if (inPacket == 0) packetSeq = seq;
+            out[pos] = msgSize >> 8;
+            out[pos + 1] = msgSize & 0xff;
+            memcpy(out + pos + 2, msg, msgSize);
+            pos += 2 + msgSize;
+            inPacket++;
+            messages++;
+        }
+        if (inPacket) flush();
+        if (requests % 1000 == 0) printf("Retransmit server: %lu requests, %lu messages resent\n", requests, messages);
+    }
+}
+
+// Hand the queued datagrams to the kernel, BATCH per sendmmsg. A datagram the kernel refuses is reported and
+// skipped, like a failed sendto
+void sendQueued(int sock, const std::vector<Outgoing> &out, const sockaddr_in *dest) {
+    mmsghdr msgs[BATCH];
+    iovec iovs[BATCH];
+    for (size_t done = 0; done < out.size();) {
+        size_t n = std::min(BATCH, out.size() - done);
+        for (size_t i = 0; i < n; i++) {
+            const Outgoing &o = out[done + i];
+            iovs[i] = {(void *) o.buf, o.len};
+            msgs[i] = mmsghdr{};
+            msgs[i].msg_hdr.msg_name = (void *) &dest[o.line];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(sock, msgs, n, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            perror("Can't send bytes");
+            sent = 1;
+        }
+        done += sent;
+    }
+}
+
+// Sleep most of the way to a time point and spin the rest
+void waitUntil(Clock::time_point t) {
+    if (t - Clock::now() > SPIN_LIMIT) std::this_thread::sleep_until(t - SPIN_LIMIT / 2);
+    while (Clock::now() < t) {}
+}
+
+// Account a datagram handed to the kernel in its line's ground truth
+void recordSent(LineTruth &t, uint32_t firstSeq, uint16_t count) {
+    t.datagrams++;
+    t.messages += count;
+    if (t.sent.size() < (size_t) firstSeq + count) t.sent.resize((size_t) firstSeq + count);
+    for (uint32_t seq = firstSeq; seq < firstSeq + count; seq++) {
+        if (t.sent[seq]) t.duplicated++;
+        else if (seq < t.highest) t.late++;
+        t.sent[seq] = 1;
+        t.highest = std::max(t.highest, seq);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *path = "itch_data.bin";
+    bool ab = false;
+    long skewUs = 0;
+    double loss[2] = {0.0, 0.0};
+    int lossBurst = 1;
+    double dupP = 0.0, reorderP = 0.0, delayP = 0.0;
+    int reorderDepth = 3;
+    long delayUs = 1000;
+    double rate = 0.0; // messages per second, 0 for a DEFAULT_PAYLOAD_GAP sleep after every payload
+    bool unpaced = false;
+    uint64_t burst = 1;
+    uint64_t laps = 0;
+    const char *truthPath = nullptr;
+    unsigned seed = 42;
+    const char *ifaceIp = nullptr;
+    bool retransmit = false;
+    bool mold = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--file") && hasValue) path = argv[++i];
+        else if (!strcmp(argv[i], "--ab")) ab = true;
+        else if (!strcmp(argv[i], "--skew-us") && hasValue) skewUs = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--loss-a") && hasValue) loss[0] = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--loss-b") && hasValue) loss[1] = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--loss-burst") && hasValue) lossBurst = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--dup") && hasValue) dupP = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--reorder") && hasValue) reorderP = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--reorder-depth") && hasValue) reorderDepth = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--delay") && hasValue) delayP = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--delay-us") && hasValue) delayUs = std::max(0L, atol(argv[++i]));
+        else if (!strcmp(argv[i], "--rate") && hasValue) {
+            i++;
+            if (!strcmp(argv[i], "max")) unpaced = true;
+            else rate = atof(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--burst") && hasValue) burst = std::max(1L, atol(argv[++i]));
+        else if (!strcmp(argv[i], "--laps") && hasValue) laps = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--truth") && hasValue) truthPath = argv[++i];
+        else if (!strcmp(argv[i], "--seed") && hasValue) seed = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--if") && hasValue) ifaceIp = argv[++i];
+        else if (!strcmp(argv[i], "--retransmit")) retransmit = true;
+        else if (!strcmp(argv[i], "--mold")) mold = true;
+        else {
+            printf("Usage: %s [--file <path>] [--ab] [--skew-us <n>] [--loss-a <p>] [--loss-b <p>] [--loss-burst <n>] [--dup <p>]\n"
+                   "       [--reorder <p>] [--reorder-depth <n>] [--delay <p>] [--delay-us <n>] [--rate <msgs/s>|max]\n"
+                   "       [--burst <n>] [--laps <n>] [--truth <path>] [--seed <n>] [--if <addr>] [--retransmit] [--mold]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (rate < 0 || (!unpaced && rate == 0 && burst > 1)) {
+        printf("--burst needs a --rate\n");
+        return 1;
+    }
+
     std::cout << "=== ITCH MESSAGE UDP REPLAY SERVER ===\n";
     // Create socket and bind to 127.0.0.1
     int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -45,7 +302,7 @@ int main() {
         perror("Error creating socket.\n");
         return 1;
     }
-    
+
     std::cout << "Socket initialised.\n";
     // Only allow one hop for multicast traffic out of this socket
     int ttl = 1;
@@ -54,83 +311,235 @@ int main() {
         return 1;
     }
 
+    // Send out of a specific interface rather than the one the multicast route picks
+    if (ifaceIp) {
+        in_addr iface{};
+        if (inet_pton(AF_INET, ifaceIp, &iface) != 1 || setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0) {
+            perror("Error setting multicast interface.\n");
+            return 1;
+        }
+    }
+
     std::cout << "Socket options set.\n";
-    // Create socket address for multicast IP
-    sockaddr_in dest{};
-    dest.sin_family = AF_INET;
-    dest.sin_port = htons(PORT);
-    int rcode = inet_pton(AF_INET, MULTICAST_IP, &dest.sin_addr);
-    if (rcode == 0) {
-        printf("%s is an Invalid string.\n", MULTICAST_IP);
+    // Create socket addresses for the multicast line(s)
+    sockaddr_in dest[2];
+    if (!makeDestination(MULTICAST_IP, PORT, dest[0]) || !makeDestination(MULTICAST_IP_B, PORT_B, dest[1])) return 1;
+    int lineCount = ab ? 2 : 1;
+    // The line that is held back by the skew, -1 if neither
+    int laggingLine = !ab || skewUs == 0 ? -1 : (skewUs > 0 ? 1 : 0);
+    auto skew = std::chrono::microseconds(std::labs(skewUs));
+    std::mt19937 rng(seed);
+    std::bernoulli_distribution drop[2] = {std::bernoulli_distribution(loss[0]), std::bernoulli_distribution(loss[1])};
+    std::bernoulli_distribution dup(dupP), reorder(reorderP), delay(delayP);
+    uint64_t sent[2] = {0, 0}, dropped[2] = {0, 0};
+    int lossLeft[2] = {0, 0}; // payloads still to drop of the current loss burst
+
+    std::cout << "Multicast destination address set.\n";
+    if (ab) printf("Sending lines A (%s:%u) and B (%s:%u), skew %ldus, loss A %.4f B %.4f\n",
+                   MULTICAST_IP, PORT, MULTICAST_IP_B, PORT_B, skewUs, loss[0], loss[1]);
+    if (dupP || reorderP || delayP) printf("Impairments on every line: duplicate %.4f, reorder %.4f by %d, delay %.4f by %ldus\n",
+                                           dupP, reorderP, reorderDepth, delayP, delayUs);
+
+    FILE *truth = nullptr;
+    if (truthPath) {
+        truth = fopen(truthPath, "w");
+        if (!truth) {
+            perror("Error opening ground truth log.\n");
+            return 1;
+        }
+        fprintf(truth, "# replay ground truth, seed %u: <lap> <line> <event> <first seq> <messages> [<depth>|<us>], then a summary per lap\n", seed);
+    }
+
+    // Map the whole file, whatever its size, and read it front to back every lap
+    int fd = open(path, O_RDONLY);
+    struct stat st{};
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        printf("Failed to open %s, or it is empty\n", path);
         return 1;
-    } else if (rcode < 0) {
-        perror("Failed to create binary form of IPv4 multicast address.\n");
     }
+    size_t nbytes = st.st_size;
+    const char *fileBuf = (const char *) mmap(nullptr, nbytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (fileBuf == MAP_FAILED) {
+        perror("Failed to map the replay file.\n");
+        return 1;
+    }
+    madvise((void *) fileBuf, nbytes, MADV_SEQUENTIAL);
 
-    std::cout << "Multicast destination address set.\n";
+    // Only replay whole messages of known types, the packing loop can't step over anything else
+    size_t validBytes = 0;
+    while (validBytes < nbytes && messageSize(fileBuf[validBytes]) && validBytes + messageSize(fileBuf[validBytes]) <= nbytes) {
+        validBytes += messageSize(fileBuf[validBytes]);
+    }
+    if (validBytes < nbytes) printf("Replaying the first %zu of %zu bytes, the rest is not a whole known message\n", validBytes, nbytes);
+    nbytes = validBytes;
+    if (nbytes == 0) return 1;
 
-    // Read from the file (approx 2.4MB, allocate 3MB)
-    char* fileBuf = new char[READ_BUFFER_SIZE];
+    // The retransmit server only reads fileBuf, which is never written
+    if (retransmit) std::thread(retransmitServer, fileBuf, nbytes).detach();
 
-    // Read as bytes (std::ios::binary) and set read pointer position to end of file (std::ios::ate)
-    std::ifstream a("itch_data.bin", std::ios::binary | std::ios::ate);
+    // Payloads are packed straight into the slots of the batch (1472 bytes is max size of UDP payload, 20 byte IP
+    // header, 8 byte UDP header), and go out with sendmmsg once the batch is full or the schedule says to wait
+    std::vector<char> slots(BATCH * SEND_BUFFER_SIZE);
+    size_t slot = 0;
+    std::vector<Outgoing> out;
+    out.reserve(4 * BATCH);
+    std::deque<HeldSend> held;
+    uint64_t linePayloads[2] = {0, 0}; // payloads queued on each line, what reorders are released by
+    LineTruth lineTruth[2];
+    uint64_t lap = 1;
 
-    // Now that the read pointer is at the end of the file, call tellg() to tell us its position within the input stream
-    // i.e. number of bytes from beginning to end = size of file
-    size_t nbytes = a.tellg();
+    // Queue the held payloads that are due (all of them if forced), send everything queued and account it
+    auto flush = [&](bool force) {
+        Clock::time_point now = Clock::now();
+        size_t released = 0;
+        for (HeldSend &h : held) {
+            if (force || (h.due <= now && linePayloads[h.line] >= h.releaseAfter)) {
+                for (int c = 0; c < h.copies; c++) out.push_back({h.buf, h.len, h.line, h.firstSeq, h.count});
+                h.copies = 0;
+                released++;
+            }
+        }
+        sendQueued(sock, out, dest);
+        for (const Outgoing &o : out) recordSent(lineTruth[o.line], o.firstSeq, o.count);
+        if (released) held.erase(std::remove_if(held.begin(), held.end(), [](const HeldSend &h) { return h.copies == 0; }), held.end());
+        out.clear();
+        slot = 0;
+    };
 
-    // return read pointer to beginning, equivalent of seekg(0, std::ios::beg) = move read pointer to 0 bytes from beginning
-    a.seekg(0);
-    a.read(fileBuf, nbytes);
+    // Summary of the lap, to stdout and the ground truth log, then start over
+    auto endLap = [&] {
+        flush(true);
+        size_t seqs = std::max(lineTruth[0].sent.size(), lineTruth[1].sent.size());
+        uint64_t neverSent = 0;
+        for (size_t seq = 1; seq < seqs; seq++) {
+            bool any = false;
+            for (int line = 0; line < lineCount; line++) any |= seq < lineTruth[line].sent.size() && lineTruth[line].sent[seq];
+            neverSent += !any;
+        }
+        printf("Replayed file: sent A=%lu B=%lu, dropped A=%lu B=%lu\n", sent[0], sent[1], dropped[0], dropped[1]);
+        for (int line = 0; line < lineCount; line++) {
+            const LineTruth &t = lineTruth[line];
+            char summary[256];
+            snprintf(summary, sizeof(summary), "datagrams=%lu messages=%lu dropped=%lu duplicated=%lu late=%lu",
+                     t.datagrams, t.messages, t.dropped, t.duplicated, t.late);
+            printf("Lap %lu line %s: %s\n", lap, LINE_NAMES[line], summary);
+            if (truth) fprintf(truth, "%lu %s summary %s\n", lap, LINE_NAMES[line], summary);
+        }
+        printf("Lap %lu: %lu messages sent on no line\n", lap, neverSent);
+        if (truth) {
+            fprintf(truth, "%lu - summary never_sent=%lu\n", lap, neverSent);
+            fflush(truth);
+        }
+        for (LineTruth &t : lineTruth) t = LineTruth{};
+        lap++;
+    };
 
-    // Buffer for sending messages over UDP (1472 bytes is max size of UDP payload, 20 byte IP header, 8 byte UDP header)
-    char msgBuf[SEND_BUFFER_SIZE];
+    // MoldUDP64 packets start with a header and prefix every message with its length
+    size_t headerLen = mold ? MOLD_HEADER_LEN : 0;
+    size_t prefixLen = mold ? 2 : 0;
 
     size_t filePos = 0; // byte pointer for file buffer (fileBuf)
-    size_t msgPos = 0; // byte pointer for message buffer (msgBuf)
     size_t msgSize = 0; // variable for message size
+    uint64_t payloads = 0, messagesQueued = 0;
+    Clock::time_point start = Clock::now();
 
     std::cout << "Running UDP replay server...\n";
-    // Send bytes to the multicast IP indefinitely
-    while (1) {
-        // Read the entire files bytes
+    // Send bytes to the multicast IP, indefinitely unless --laps
+    while (laps == 0 || lap <= laps) {
+        // When this payload is due at the rate: the messages before it (in whole bursts) at --rate. Wait for it
+        // once the batch so far is sent, sending held payloads as they come due in the meantime
+        if (rate > 0) {
+            Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(messagesQueued / burst * burst / rate));
+            for (Clock::time_point now = Clock::now(); due > now; now = Clock::now()) {
+                flush(false);
+                Clock::time_point wake = due;
+                for (const HeldSend &h : held) {
+                    if (linePayloads[h.line] >= h.releaseAfter) wake = std::min(wake, h.due);
+                }
+                waitUntil(wake);
+            }
+        }
+
+        // Pack the next payload: as many whole messages as fit in 1472 bytes, none from the next lap
+        char *msgBuf = slots.data() + slot++ * SEND_BUFFER_SIZE;
+        size_t msgPos = headerLen; // byte pointer for message buffer (msgBuf)
+        uint16_t msgCount = 0; // messages in msgBuf
+        uint32_t firstSeq = 0; // sequence number of the first message in msgBuf
         while (filePos < nbytes) {
-            // If the next message would exceed 1472, break this loop
-            // and flush the buffer (send the data)
-            msgSize = getMessageSize(fileBuf[filePos]); 
-            if (msgPos + msgSize > SEND_BUFFER_SIZE) break;
-
-            // Otherwise copy the data from the file into the buffer,
-            // the incrememnt the msg and file positions by the copied
-            // ITCH messages' size
-            memcpy(msgBuf + msgPos, fileBuf + filePos, msgSize);
-            msgPos += msgSize;
+            msgSize = messageSize(fileBuf[filePos]);
+            if (msgPos + prefixLen + msgSize > SEND_BUFFER_SIZE) break;
+            if (msgCount++ == 0) {
+                memcpy(&firstSeq, fileBuf + filePos + 7, 4);
+                firstSeq = ntohl(firstSeq);
+            }
+            if (mold) {
+                msgBuf[msgPos] = msgSize >> 8;
+                msgBuf[msgPos + 1] = msgSize & 0xff;
+            }
+            memcpy(msgBuf + msgPos + prefixLen, fileBuf + filePos, msgSize);
+            msgPos += prefixLen + msgSize;
             filePos += msgSize;
         }
+        if (mold) writeMoldHeader(msgBuf, firstSeq, msgCount);
+        payloads++;
+        messagesQueued += msgCount;
+
+        // Once per line: dropped, or queued (twice if duplicated), or held back by an impairment or the skew
+        Clock::time_point now = Clock::now();
+        for (int line = 0; line < lineCount; line++) {
+            if (lossLeft[line] == 0 && drop[line](rng)) lossLeft[line] = lossBurst;
+            if (lossLeft[line] > 0) {
+                lossLeft[line]--;
+                dropped[line]++;
+                lineTruth[line].dropped += msgCount;
+                if (truth) fprintf(truth, "%lu %s drop %u %u\n", lap, LINE_NAMES[line], firstSeq, msgCount);
+                continue;
+            }
+            sent[line]++;
+            linePayloads[line]++;
+            int copies = dup(rng) ? 2 : 1;
+            if (copies == 2 && truth) fprintf(truth, "%lu %s dup %u %u\n", lap, LINE_NAMES[line], firstSeq, msgCount);
+            Clock::time_point due = now;
+            uint64_t releaseAfter = 0;
+            if (reorder(rng)) {
+                releaseAfter = linePayloads[line] + reorderDepth;
+                if (truth) fprintf(truth, "%lu %s reorder %u %u %d\n", lap, LINE_NAMES[line], firstSeq, msgCount, reorderDepth);
+            } else if (delay(rng)) {
+                due += std::chrono::microseconds(delayUs);
+                if (truth) fprintf(truth, "%lu %s delay %u %u %ld\n", lap, LINE_NAMES[line], firstSeq, msgCount, delayUs);
+            }
+            if (line == laggingLine) due += skew;
+            if (due == now && releaseAfter == 0) {
+                for (int c = 0; c < copies; c++) out.push_back({msgBuf, msgPos, line, firstSeq, msgCount});
+                continue;
+            }
+            HeldSend &h = held.emplace_back();
+            h.due = due;
+            h.releaseAfter = releaseAfter;
+            h.line = line;
+            h.copies = copies;
+            h.firstSeq = firstSeq;
+            h.count = msgCount;
+            h.len = msgPos;
+            memcpy(h.buf, msgBuf, msgPos);
+        }
 
-        // If we have reached the end of the fileBuf, reset the loop
         if (filePos == nbytes) {
+            // Every lap starts with a fresh payload and its own ground truth
             filePos = 0;
-            continue;
+            endLap();
+        } else if (slot == BATCH) {
+            flush(false);
         }
-
-        // We only get here if the msgBuf was going to be exceeded, so now
-        // we need to flush the buffer and reset the msgPos and start overwriting
-        // the buffer
-        ssize_t bytesSent = sendto(sock, msgBuf, msgPos, 0, (sockaddr*) &dest, sizeof(dest));
-
-        
-        if (bytesSent < 0) {
-            perror("Can't send bytes");
+        // Without a rate, a payload every 10us (and then some) like always
+        if (rate == 0 && !unpaced) {
+            flush(false);
+            std::this_thread::sleep_for(DEFAULT_PAYLOAD_GAP);
         }
-
-        msgPos = 0;
-        std::this_thread::sleep_for(std::chrono::microseconds(10));
     }
 
-    // Close the file
-    a.close();
-    // Free the heap array used to read the file
-    delete[] fileBuf;
+    if (truth) fclose(truth);
+    munmap((void *) fileBuf, nbytes);
+    close(fd);
 }
-
@@ -0,0 +1,113 @@
+#include "../../src/parse.h"
+#include "../../src/channels.h"
+#include "../../src/synthetic_ring.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+
+int main() {
+    std::cout << "=== RUNNING TEST CHANNELS ===\n";
+
+    // Malformed and repeated channels are refused
+    ChannelTable bad;
+    assert(!bad.addAll("239.1.1.1"));
+    assert(!bad.addAll("239.1.1.x:30001"));
+    assert(!bad.addAll("239.1.1.1:70000"));
+    assert(!bad.addAll(" , "));
+    assert(!bad.addAll("@/nonexistent/channels"));
+    ChannelTable twice;
+    assert(!twice.addAll("239.1.1.1:30001,239.1.1.1:30001"));
+
+    // 64 channels, the most there can be, all found again and nothing else
+    ChannelTable &table = feedChannels;
+    assert(table.addAll("239.1.1.1:30001, 239.1.1.2:30002"));
+    for (uint32_t c = 2; c < MAX_CHANNELS; c++) {
+        assert(table.add(inet_addr(("239.2.0." + std::to_string(c)).c_str()), htons(30001)));
+    }
+    assert(!table.add(inet_addr("239.3.0.1"), htons(30001)));
+    assert(table.count() == MAX_CHANNELS);
+    for (uint32_t c = 0; c < table.count(); c++) assert(table.find(table.at(c).group, table.at(c).port) == c);
+    assert(table.find(inet_addr("239.1.1.1"), htons(30002)) == NO_CHANNEL);
+    assert(table.find(inet_addr("239.2.0.2"), htons(30002)) == NO_CHANNEL);
+    // Channel 0 is the global sequencer, the rest have their own
+    assert(table.at(0).sequencer == &GlobalState::sequencer && table.at(1).sequencer != &GlobalState::sequencer);
+
+    // Demux selects the frame's channel as the one sequenced against, and counts it
+    char frame[128], zeros[40] = {};
+    ssize_t len;
+    size_t frameLen = syntheticFrame(frame, inet_addr("239.1.1.2"), htons(30002), zeros, sizeof(zeros));
+    char *payload = table.demux(frame, frameLen, len);
+    assert(payload == frame + frameLen - 40 && len == 40);
+    assert(GlobalState::current == table.at(1).sequencer);
+    assert(table.at(1).stats.packets.load() == 1 && table.at(1).stats.bytes.load() == 40);
+    // Truncated or for another group: nothing selected
+    assert(table.demux(frame, frameLen - 1, len) == nullptr);
+    frameLen = syntheticFrame(frame, inet_addr("239.9.9.9"), htons(30001), zeros, sizeof(zeros));
+    assert(table.demux(frame, frameLen, len) == nullptr && table.unknown() == 1);
+    assert(GlobalState::current == table.at(1).sequencer);
+
+    // Each channel is its own sequence stream
+    assert(checkAndSetGlobalState(1) && checkAndSetGlobalState(2));
+    frameLen = syntheticFrame(frame, inet_addr("239.1.1.1"), htons(30001), zeros, sizeof(zeros));
+    assert(table.demux(frame, frameLen, len) != nullptr && GlobalState::current == &GlobalState::sequencer);
+    assert(checkAndSetGlobalState(1) && !checkAndSetGlobalState(1));
+    assert(table.at(1).sequencer->stats.parsedMessages == 2 && GlobalState::sequencer.stats.duplicates == 1);
+    assert(!table.gapExists());
+
+    // A gap on channel 1 is timed out by its own deadline
+    frameLen = syntheticFrame(frame, inet_addr("239.1.1.2"), htons(30002), zeros, sizeof(zeros));
+    table.demux(frame, frameLen, len);
+    assert(checkAndSetGlobalState(5));
+    assert(table.gapExists() && !GlobalState::sequencer.gapExists());
+    table.serviceGaps(1000);
+    table.serviceGaps(1000 + GAP_TIMEOUT_NS);
+    assert(!table.gapExists());
+    assert(table.at(1).gapDeadline->expirations == 1 && table.at(1).sequencer->stats.lostMessages == 2);
+    assert(GlobalState::gapDeadline.expirations == 0);
+
+    // Recovery fills channel 0's gap (2 and 3) even while channel 1 is the one last selected
+    int server = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    socklen_t addrLen = sizeof(serverAddr);
+    assert(bind(server, (sockaddr *) &serverAddr, addrLen) == 0 && getsockname(server, (sockaddr *) &serverAddr, &addrLen) == 0);
+    assert(gapRecovery.open(serverAddr.sin_addr.s_addr, serverAddr.sin_port));
+    frameLen = syntheticFrame(frame, inet_addr("239.1.1.1"), htons(30001), zeros, sizeof(zeros));
+    table.demux(frame, frameLen, len);
+    assert(checkAndSetGlobalState(4) && GlobalState::sequencer.gapExists());
+    frameLen = syntheticFrame(frame, inet_addr("239.1.1.2"), htons(30002), zeros, sizeof(zeros));
+    table.demux(frame, frameLen, len);
+    uint32_t channel1Parsed = table.at(1).sequencer->stats.parsedMessages;
+    uint64_t t0 = 1'000'000'000;
+    table.serviceGaps(t0);
+    table.serviceGaps(t0 + RECOVERY_DELAY_NS);
+    char request[64];
+    sockaddr_in from{};
+    socklen_t fromLen = sizeof(from);
+    assert(recvfrom(server, request, sizeof(request), 0, (sockaddr *) &from, &fromLen) >= (ssize_t) MOLD_HEADER_LEN);
+    char response[MOLD_HEADER_LEN + 2 * (2 + 12)];
+    size_t pos = writeMoldHeader(response, MOLD_SESSION, 2, 2);
+    for (uint32_t seq = 2; seq <= 3; seq++, pos += 2 + 12) {
+        std::memset(response + pos, 0, 2 + 12);
+        response[pos + 1] = 12;
+        response[pos + 2] = 'S';
+        uint32_t be = htonl(seq);
+        std::memcpy(response + pos + 2 + 7, &be, 4);
+    }
+    assert(sendto(server, response, pos, 0, (sockaddr *) &from, fromLen) == (ssize_t) pos);
+    assert(GlobalState::current == table.at(1).sequencer);
+    for (int i = 0; i < 1000 && GlobalState::sequencer.gapExists(); i++) {
+        usleep(1000);
+        table.serviceGaps(t0 + RECOVERY_DELAY_NS + 1);
+    }
+    assert(!GlobalState::sequencer.gapExists() && GlobalState::sequencer.stats.lostMessages == 0);
+    assert(table.at(1).sequencer->stats.parsedMessages == channel1Parsed && table.at(1).sequencer->stats.duplicates == 0);
+    gapRecovery.close();
+    close(server);
+
+    printChannelStats(table);
+    std::cout << "\nPASSED\n";
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "../../src/journal.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Append a payload, giving the writer time to prepare the next segment if this one is full
+static void append(Journal &j, const char *payload, uint16_t len, uint64_t ts, uint32_t seq) {
+    while (!j.append(payload, len, ts, seq)) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+int main() {
+    std::cout << "=== RUNNING TEST JOURNAL ===\n";
+    std::string prefix = "/tmp/test_journal_" + std::to_string(getpid());
+
+    // Payloads of 100..1099 bytes, each holding 10 messages, into 256KB segments
+    char payload[1200];
+    {
+        Journal j;
+        assert(j.open(prefix, 256 * 1024));
+        for (uint32_t i = 0; i < 2000; i++) {
+            std::memset(payload, i & 0xff, sizeof(payload));
+            append(j, payload, 100 + i % 1000, 1000 + i, 1 + i * 10);
+            // Empty payloads leave nothing behind, the records after them are still read back
+            if (i % 500 == 0) assert(j.append(payload, 0, 1000 + i, 0));
+        }
+        assert(j.stats().payloads == 2000);
+        assert(j.stats().segments > 1);
+        j.close();
+    }
+
+    // Read every segment back in order, then seek into the middle of one
+    uint32_t expected = 0, segment = 0;
+    for (;; segment++) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%04u", segment);
+        if (access((prefix + suffix).c_str(), F_OK) != 0) break;
+        JournalReader r((prefix + suffix).c_str());
+        assert(r.ok() && r.header().segment == segment && r.header().dataEnd != 0);
+        const char *data;
+        uint32_t first = expected;
+        while (const JournalRecord *rec = r.next(data)) {
+            assert(rec->sequenceNumber == 1 + expected * 10);
+            assert(rec->tsNs == 1000 + expected);
+            assert(rec->len == 100 + expected % 1000);
+            assert((uint8_t) data[0] == (expected & 0xff) && (uint8_t) data[rec->len - 1] == (expected & 0xff));
+            expected++;
+        }
+        // A sequence number inside a payload finds the payload that holds it
+        uint32_t target = first + (expected - first) / 2;
+        assert(r.seek(1 + target * 10 + 5));
+        const JournalRecord *rec = r.next(data);
+        assert(rec && rec->sequenceNumber == 1 + target * 10);
+        assert(!r.seek(first * 10));
+        unlink((prefix + suffix).c_str());
+    }
+    assert(expected == 2000);
+    assert(segment > 1);
+
+    // A next segment that can't be created (a directory in its place) is retried with backoff and counted, and
+    // taken once it can be
+    {
+        std::string blocked = prefix + ".0001";
+        assert(mkdir(blocked.c_str(), 0755) == 0);
+        Journal j;
+        assert(j.open(prefix, 64 * 1024));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        uint64_t failures = j.stats().segmentFailures;
+        // Every writer sleep (1ms) would be an attempt without the backoff
+        assert(failures >= 1 && failures <= 12);
+        uint32_t i = 0;
+        while (j.append(payload, 1000, 1000 + i, 1 + i * 10)) i++;
+        assert(j.stats().dropped == 1 && j.stats().segments == 1);
+        rmdir(blocked.c_str());
+        append(j, payload, 1000, 1000 + i, 1 + i * 10);
+        assert(j.stats().segments == 2 && j.stats().segmentFailures >= failures);
+        j.close();
+        unlink((prefix + ".0000").c_str());
+        unlink(blocked.c_str());
+        unlink((prefix + ".0002").c_str());
+    }
+    std::cout << "\nPASSED\n";
+}
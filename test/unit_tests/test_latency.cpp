@@ -0,0 +1,118 @@
+#include "../../src/latency.h"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+static int64_t realtimeNow() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+}
+
+// Within the 1/32 resolution of the histogram
+static bool near(uint64_t got, uint64_t want) {
+    return got + want / 32 + 1 >= want && got <= want + want / 32 + 1;
+}
+
+int main() {
+    std::cout << "=== RUNNING TEST LATENCY ===\n";
+
+    // Exact below 64 ns, then every bucket holds the value it was given and is at most 1/32 of it wide
+    for (uint64_t v = 0; v < LATENCY_LINEAR; v++) assert(LatencyHistogram::bucketOf(v) == v);
+    size_t last = 0;
+    for (uint64_t v = 1; v < (1ULL << LATENCY_MAX_BITS); v += v / 7 + 1) {
+        size_t b = LatencyHistogram::bucketOf(v);
+        assert(b >= last && b < LATENCY_BUCKETS);
+        assert(LatencyHistogram::bucketLow(b) <= v && v <= LatencyHistogram::bucketHigh(b));
+        assert(LatencyHistogram::bucketHigh(b) - LatencyHistogram::bucketLow(b) <= std::max<uint64_t>(v / 32, 1));
+        last = b;
+    }
+    for (size_t b = 0; b + 1 < LATENCY_BUCKETS; b++) assert(LatencyHistogram::bucketHigh(b) + 1 == LatencyHistogram::bucketLow(b + 1));
+    assert(LatencyHistogram::bucketOf(UINT64_MAX) == LATENCY_BUCKETS - 1);
+
+    // Percentiles of 1..10000
+    auto h = std::make_unique<LatencyHistogram>();
+    assert(h->summary().count == 0);
+    for (uint64_t v = 1; v <= 10000; v++) h->record(v);
+    LatencySummary s = h->summary();
+    assert(s.count == 10000 && s.max == 10000 && s.mean == 5000.5);
+    assert(near(s.p50, 5000) && near(s.p90, 9000) && near(s.p99, 9900) && near(s.p999, 9990));
+    assert(s.p9999 <= s.max && s.negative == 0);
+
+    // Below zero is counted as 0 and on its own
+    h->reset();
+    h->recordSigned(-5);
+    h->recordSigned(7);
+    s = h->summary();
+    assert(s.count == 2 && s.negative == 1 && s.max == 7);
+
+    // Summarized by another thread while it is being written, counts only ever grow
+    h->reset();
+    std::thread writer([&] {
+        for (uint64_t i = 0; i < 2'000'000; i++) h->record(i % 5000);
+    });
+    uint64_t seen = 0;
+    for (int i = 0; i < 200; i++) {
+        uint64_t count = h->summary().count;
+        assert(count >= seen);
+        seen = count;
+    }
+    writer.join();
+    assert(h->summary().count == 2'000'000);
+
+    // The TSC mapped to CLOCK_REALTIME agrees with it
+    auto rec = std::make_unique<LatencyRecorder>();
+    int64_t diff = rec->realtimeNs(__rdtsc()) - realtimeNow();
+    assert(std::abs(diff) < 1'000'000);
+
+    // 1 in 4 packets timed, 2 messages each. The exchange histogram covers every message
+    rec->setSampling(4);
+    for (int p = 0; p < 8; p++) {
+        uint64_t kernelNs = realtimeNow() - 2000;
+        rec->beginPacket(kernelNs);
+        for (int m = 0; m < 2; m++) {
+            rec->parsed();
+            rec->sequenced();
+            rec->handled(kernelNs % NS_PER_DAY - 5000);
+        }
+    }
+    assert(rec->packets() == 8);
+    assert(rec->stage(LAT_RX_TO_DEQUEUE).summary().count == 2);
+    assert(rec->stage(LAT_RX_TO_DEQUEUE).summary().p50 >= 1900);
+    assert(rec->stage(LAT_PARSE).summary().count == 4);
+    assert(rec->stage(LAT_SEQUENCE).summary().count == 4);
+    assert(rec->stage(LAT_CALLBACK).summary().count == 4);
+    assert(rec->stage(LAT_RX_TO_HANDLED).summary().count == 4);
+    s = rec->stage(LAT_EXCHANGE_TO_RX).summary();
+    assert(s.count == 16 && s.p50 == 5000 && s.max == 5000);
+
+    // Without a kernel timestamp (files) only the stages from dequeue on, and across midnight the exchange's
+    // time of day is from the day before
+    rec->reset();
+    rec->setSampling(1);
+    rec->beginPacket(0);
+    rec->parsed();
+    rec->sequenced();
+    rec->handled(123);
+    assert(rec->stage(LAT_PARSE).summary().count == 1 && rec->stage(LAT_RX_TO_DEQUEUE).summary().count == 0);
+    assert(rec->stage(LAT_EXCHANGE_TO_RX).summary().count == 0);
+    uint64_t afterMidnight = (uint64_t) realtimeNow() / NS_PER_DAY * NS_PER_DAY + 1000;
+    rec->beginPacket(afterMidnight);
+    rec->handled(NS_PER_DAY - 1000);
+    s = rec->stage(LAT_EXCHANGE_TO_RX).summary();
+    assert(s.count == 1 && s.p50 == 2000 && s.negative == 0);
+
+    // Off records nothing at all
+    rec->reset();
+    rec->setSampling(0);
+    rec->beginPacket(realtimeNow());
+    rec->parsed();
+    rec->sequenced();
+    rec->handled(0);
+    for (uint32_t st = 0; st < LATENCY_STAGES; st++) assert(rec->stage((LatencyStage) st).summary().count == 0);
+
+    std::cout << "\nPASSED\n";
+    return 0;
+}
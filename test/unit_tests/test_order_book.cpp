@@ -0,0 +1,103 @@
+#include "../../src/parse.h"
+#include "../../src/orderbook.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+TradeMessage makeAdd(uint64_t ref, char side, uint32_t shares, uint32_t price, const char *stock) {
+    TradeMessage t{};
+    t.messageType = 'A';
+    t.orderRefNumber = ref;
+    t.buySellIndicator = side;
+    t.shares = shares;
+    t.price = price;
+    std::memcpy(t.stock, stock, 8);
+    return t;
+}
+
+int main() {
+    std::cout << "=== RUNNING TEST ORDER BOOK ===\n";
+    auto books = std::make_unique<BookManager>();
+
+    // Two bids at different prices and one ask
+    books->apply(makeAdd(1, 'B', 100, 1000, "AAPL\0\0\0\0"));
+    books->apply(makeAdd(2, 'B', 50, 1010, "AAPL\0\0\0\0"));
+    books->apply(makeAdd(3, 'B', 25, 1010, "AAPL\0\0\0\0"));
+    books->apply(makeAdd(4, 'S', 70, 1020, "AAPL\0\0\0\0"));
+    books->apply(makeAdd(5, 'S', 10, 500, "MSFT\0\0\0\0"));
+
+    const OrderBook *aapl = books->book("AAPL\0\0\0\0");
+    assert(aapl != nullptr);
+    assert(books->bookCount() == 2);
+    assert(aapl->bids.depth() == 2);
+    assert(aapl->bids.best()->price == 1010);
+    assert(aapl->bids.best()->shares == 75);
+    assert(aapl->bids.best()->orderCount == 2);
+    assert(aapl->bids.level(1)->price == 1000);
+    assert(aapl->asks.best()->price == 1020);
+
+    // Partial execution leaves the order and level in place
+    OrderExecutedMessage e{};
+    e.orderRefNumber = 2;
+    e.executedShares = 20;
+    books->apply(e);
+    assert(books->order(2)->shares == 30);
+    assert(aapl->bids.best()->shares == 55);
+    // and is the last trade, at the order's price
+    assert(aapl->lastPrice == 1010 && aapl->lastShares == 20);
+    assert(books->lastChanged() == 0);
+
+    // Cancelling the rest of both orders at 1010 removes the level
+    OrderCancelMessage c{};
+    c.orderRefNumber = 2;
+    c.cancelledShares = 30;
+    books->apply(c);
+    c.orderRefNumber = 3;
+    c.cancelledShares = 1000; // more than resting, clamped
+    books->apply(c);
+    assert(books->order(2) == nullptr);
+    assert(books->order(3) == nullptr);
+    assert(aapl->bids.depth() == 1);
+    assert(aapl->bids.best()->price == 1000);
+
+    // Executing the whole ask empties that side
+    OrderExecutedWithPriceMessage x{};
+    x.orderRefNumber = 4;
+    x.executedShares = 70;
+    x.executedPrice = 1019;
+    books->apply(x);
+    assert(aapl->asks.best() == nullptr);
+    assert(aapl->lastPrice == 1019 && aapl->lastShares == 70);
+
+    // A non-displayed trade only changes the last trade, of a book it creates if need be
+    TradeMessage p = makeAdd(0, 'B', 15, 505, "MSFT\0\0\0\0");
+    p.messageType = 'P';
+    books->apply(p);
+    const OrderBook *msft = books->book("MSFT\0\0\0\0");
+    assert(msft->lastPrice == 505 && msft->lastShares == 15 && msft->bids.best() == nullptr);
+    assert(books->lastChanged() == 1);
+
+    // Unknown order references are rejected, not applied
+    e.orderRefNumber = 99;
+    books->apply(e);
+    assert(books->rejected == 1);
+    assert(books->lastChanged() == BookManager::NO_BOOK);
+
+    // Re-adding an existing reference replaces the old order
+    books->apply(makeAdd(1, 'S', 5, 990, "AAPL\0\0\0\0"));
+    assert(aapl->bids.best() == nullptr);
+    assert(aapl->asks.best()->price == 990);
+    assert(books->liveOrders() == 2);
+
+    // Books go by the symbol's id in the directory and all 8 characters of the ticker: padding doesn't matter,
+    // the 8th character does
+    books->apply(makeAdd(6, 'B', 10, 100, "ABCDEFGH"));
+    books->apply(makeAdd(7, 'B', 20, 200, "ABCDEFGX"));
+    const OrderBook *h = books->book("ABCDEFGH"), *x8 = books->book("ABCDEFGX");
+    assert(h && x8 && h != x8 && books->bookCount() == 4);
+    assert(h->bids.best()->price == 100 && x8->bids.best()->price == 200);
+    assert(books->lastChanged() == symbolDirectory.find("ABCDEFGX") && !std::memcmp(x8->stock, "ABCDEFGX", 8));
+    assert(books->book("MSFT    ") == msft && !std::memcmp(msft->stock, "MSFT    ", 8));
+    std::cout << "\nPASSED\n";
+}
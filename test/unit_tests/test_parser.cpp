@@ -1,16 +1,28 @@
 #include "../src/parse.h"
 #include "../src/helper.h"
+#include "../src/sequencer.h"
+#include "../src/handler.h"
 #include <iostream>
 #include <cassert>
 #include <cstdint>
 #include <cstddef>
 #include <cstring>
 #include <arpa/inet.h>
+#include <sstream>
 
 // REMOVE WHEN RUNNING ON LINUX
 #include <libkern/OSByteOrder.h>
 #define htobe64(x) OSSwapHostToBigInt64(x)
 
+// Counts the callbacks it gets, everything else falls through to the defaults
+struct CountingHandler: FeedHandler<CountingHandler> {
+    int trades = 0, others = 0, unknown = 0;
+    uint32_t lastShares = 0;
+    void onTrade(const TradeView &v) { trades++; lastShares = v.shares(); }
+    void onOtherMessage(const MessageView &) { others++; }
+    void onUnknownMessage(const char *, size_t) { unknown++; }
+};
+
 int main() {
     // Fake a single Trade message buffer
     std::cout << "=== RUNNING TEST PARSER TRADE ===\n";
@@ -37,5 +49,67 @@ int main() {
     assert(msg.messageType == 'P');
     assert(msg.shares == 100);
     assert(msg.price == 12345);
+
+    // A view reads the same fields straight from the buffer
+    std::cout << "=== RUNNING TEST PARSER VIEWS ===\n";
+    TradeView view(reinterpret_cast<const char*>(buf));
+    assert(view.messageType() == msg.messageType);
+    assert(view.timestamp() == msg.timestamp);
+    assert(view.sequenceNumber() == msg.sequenceNumber);
+    assert(view.orderRefNumber() == msg.orderRefNumber);
+    assert(view.buySellIndicator() == msg.buySellIndicator);
+    assert(view.shares() == msg.shares);
+    assert(view.price() == msg.price);
+    assert(std::memcmp(view.stock(), msg.stock, 8) == 0);
+    assert(view.size() == getMessageSize('P'));
+
+    // The layout table decodes the same fields the typed parser does
+    std::cout << "=== RUNNING TEST PARSER LAYOUT TABLE ===\n";
+    const MessageLayout *layout = layoutOf('P');
+    assert(layout && layout->size == getMessageSize('P'));
+    const char *raw = reinterpret_cast<const char*>(buf);
+    assert(readField(raw, *layout->field("orderRefNumber")) == msg.orderRefNumber);
+    assert(readField(raw, *layout->field("shares")) == msg.shares);
+    assert(readField(raw, *layout->field("price")) == msg.price);
+    assert(readField(raw, *layout->field("sequenceNumber")) == msg.sequenceNumber);
+    assert(getMessageSize('Z') == 0 && layoutOf('Z') == nullptr);
+
+    // Unknown and truncated messages are counted and skipped instead of stalling the parse loop
+    std::cout << "=== RUNNING TEST PARSER INVALID MESSAGES ===\n";
+    uint8_t payload[64] = {};
+    std::memcpy(payload, buf, getMessageSize('P'));
+    payload[getMessageSize('P')] = 'Z';
+    parseMessage(reinterpret_cast<const char*>(payload), getMessageSize('P') + 8);
+    assert(parseStats.unknownMessages == 1);
+    parseMessage(reinterpret_cast<const char*>(payload), getMessageSize('P') - 1);
+    assert(parseStats.truncatedMessages == 1);
+
+    // A type only the layout table knows about is sequenced like any other
+    uint8_t del[32] = {};
+    del[0] = 'D';
+    uint32_t delSeq = htonl(2);
+    std::memcpy(del + 7, &delSeq, 4);
+    parseMessage(reinterpret_cast<const char*>(del), getMessageSize('D'));
+    assert(GlobalState::sequencer.nextExpected() == 3);
+
+    // A handler of its own gets the callback of each message type, and the loop stops at an unknown type
+    std::cout << "=== RUNNING TEST PARSER HANDLER ===\n";
+    CountingHandler handler;
+    std::memcpy(payload + getMessageSize('P'), del, getMessageSize('D'));
+    payload[getMessageSize('P') + getMessageSize('D')] = 'Z';
+    size_t decoded = handler.decode(reinterpret_cast<const char*>(payload), sizeof(payload));
+    assert(decoded == getMessageSize('P') + getMessageSize('D'));
+    assert(handler.trades == 1 && handler.lastShares == 100);
+    assert(handler.others == 1 && handler.unknown == 1);
+
+    // The async log formats a record into the same line the struct prints
+    std::cout << "=== RUNNING TEST PARSER LOG FORMAT ===\n";
+    char line[MAX_LOG_LINE];
+    size_t lineLen = formatLogRecord<LogLevel::VERBOSE>(reinterpret_cast<const char*>(buf), line);
+    std::ostringstream printed;
+    printed << msg;
+    assert(printed.str() == std::string(line, lineLen));
+    lineLen = formatLogRecord<LogLevel::RAW>(reinterpret_cast<const char*>(del), line);
+    assert(std::string(line, lineLen).find("sequenceNumber=2") != std::string::npos && line[lineLen - 1] == '\n');
     std::cout << "\nPASSED\n";
 }
@@ -0,0 +1,80 @@
+#include "../../src/parse.h"
+#include "../../src/residency.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <sys/mman.h>
+
+static uint64_t faultsNow() {
+    uint64_t minor, major;
+    threadFaults(minor, major);
+    return minor + major;
+}
+
+static void touch(void *p, size_t bytes) {
+    volatile char *c = (volatile char *) p;
+    for (size_t i = 0; i < bytes; i += SMALL_PAGE_SIZE) c[i] = 1;
+}
+
+int main() {
+    std::cout << "=== RUNNING TEST RESIDENCY ===\n";
+
+    // Off: whole 2 MB worth of lazily mapped pages, faulted in on first touch, nothing counted
+    assert(!hugePages.enabled());
+    assert(HugePages::roundUp(1) == HUGE_PAGE_SIZE && HugePages::roundUp(HUGE_PAGE_SIZE + 1) == 2 * HUGE_PAGE_SIZE);
+    HugePageAllocator<uint64_t> alloc;
+    uint64_t *lazy = alloc.allocate(1 << 16);
+    FaultWatch watch;
+    watch.update(); // not armed, nothing read
+    assert(!watch.armed() && watch.minorFaults() == 0);
+    watch.arm();
+    touch(lazy, (1 << 16) * sizeof(uint64_t));
+    watch.update();
+    assert(watch.minorFaults() >= 1);
+    alloc.deallocate(lazy, 1 << 16);
+    for (size_t b = 0; b < PAGE_BACKINGS; b++) assert(hugePages.bytes((PageBacking) b) == 0);
+
+    // The book tables start out lazily mapped, with an order in them
+    TradeMessage t{};
+    t.messageType = 'A';
+    t.orderRefNumber = 7;
+    t.buySellIndicator = 'B';
+    t.shares = 100;
+    t.price = 1000;
+    std::memcpy(t.stock, "AAPL\0\0\0\0", 8);
+    orderBooks.apply(t);
+    assert(orderBooks.bookCount() == 1 && orderBooks.order(7) != nullptr);
+
+    // On: the tables are allocated again (empty) on 2 MB aligned pages, at least the order table's worth
+    residency.enable();
+    assert(residency.enabled() && hugePages.enabled());
+    assert(orderBooks.bookCount() == 0 && orderBooks.order(7) == nullptr && orderBooks.liveOrders() == 0);
+    size_t placed = 0;
+    for (size_t b = 0; b < PAGE_BACKINGS; b++) placed += hugePages.bytes((PageBacking) b);
+    assert(placed >= MAX_ORDERS * sizeof(Order));
+
+    // Everything allocated from now on is there once allocated: hugepage tables, the heap and new mappings
+    // (when the process may lock memory). Populating a mapping counts its pages as faults, so the watch is only
+    // armed once it all is allocated
+    uint64_t *table = alloc.allocate(1 << 18);
+    assert(((uintptr_t) table & (HUGE_PAGE_SIZE - 1)) == 0);
+    char *heap = (char *) malloc(8 << 20);
+    void *later = residency.locked() ? mmap(nullptr, 1 << 20, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : nullptr;
+    FaultWatch steady;
+    steady.arm();
+    touch(table, (1 << 18) * sizeof(uint64_t));
+    touch(heap, 8 << 20);
+    if (later) touch(later, 1 << 20);
+    orderBooks.apply(t);
+    assert(orderBooks.bookCount() == 1 && orderBooks.order(7) != nullptr);
+    steady.update();
+    assert(steady.minorFaults() == 0 && steady.majorFaults() == 0);
+    assert(faultsNow() >= steady.minorFaults());
+    if (later) munmap(later, 1 << 20);
+    free(heap);
+    alloc.deallocate(table, 1 << 18);
+
+    std::cout << "\nPASSED\n";
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "../../src/sequencer.h"
+#include "../../src/clock.h"
+#include <iostream>
+#include <cassert>
+#include <memory>
+#include <vector>
+#include <utility>
+
+int main() {
+    std::cout << "=== RUNNING TEST BITSET SEQUENCER ===\n";
+    {
+        // In order, then a duplicate
+        auto s = std::make_unique<BitsetSequencer>();
+        for (uint32_t seq = 1; seq <= 100; seq++) assert(s->check(seq));
+        assert(!s->check(50));
+        assert(s->stats.parsedMessages == 100);
+        assert(s->stats.duplicates == 1);
+        assert(s->nextExpected() == 101);
+        assert(!s->gapExists());
+    }
+    {
+        // 3 and 4 arrive before 2, the gap closes as soon as 2 arrives
+        auto s = std::make_unique<BitsetSequencer>();
+        assert(s->check(1));
+        assert(s->check(3));
+        assert(s->check(4));
+        assert(!s->check(4)); // duplicate of a buffered message
+        assert(s->gapExists());
+        assert(s->check(2));
+        assert(!s->gapExists());
+        assert(s->nextExpected() == 5);
+        assert(s->stats.parsedMessages == 4);
+        assert(s->stats.outOfOrderMessages == 2);
+        assert(s->stats.duplicates == 1);
+    }
+    {
+        // Drain across a 64 bit word boundary
+        auto s = std::make_unique<BitsetSequencer>();
+        assert(s->check(10));
+        for (uint32_t seq = 12; seq < 200; seq++) assert(s->check(seq));
+        assert(s->check(11));
+        assert(s->nextExpected() == 200);
+        assert(s->stats.parsedMessages == 190);
+        assert(!s->gapExists());
+    }
+    {
+        // Missing runs are reported by forEachGap and counted as lost on a timeout
+        auto s = std::make_unique<BitsetSequencer>();
+        assert(s->check(1));
+        assert(s->check(5));
+        for (uint32_t seq = 100; seq <= 400; seq++) assert(s->check(seq));
+        std::vector<std::pair<uint32_t, uint32_t>> gaps;
+        s->forEachGap([&](uint32_t first, uint32_t count) { gaps.emplace_back(first, count); });
+        assert(gaps.size() == 2);
+        assert(gaps[0] == std::make_pair(2u, 3u));
+        assert(gaps[1] == std::make_pair(6u, 94u));
+        s->flushGaps();
+        assert(s->stats.lostMessages == 97);
+        assert(s->stats.parsedMessages == 303);
+        assert(s->nextExpected() == 401);
+        assert(!s->gapExists());
+        assert(s->check(401));
+    }
+    {
+        // A message further ahead than the window gives up on the oldest part of the gap
+        auto s = std::make_unique<BitsetSequencer>();
+        assert(s->check(1));
+        assert(s->check(3));
+        assert(s->check(WINDOW_SIZE + 10));
+        assert(s->nextExpected() == 11);
+        assert(s->stats.lostMessages == 8); // 2 and 4..10
+        s->flushGaps();
+        assert(s->nextExpected() == WINDOW_SIZE + 11);
+        assert(s->stats.lostMessages == 8 + WINDOW_SIZE - 1); // 11..WINDOW_SIZE + 9
+    }
+    {
+        // Whole datagrams: in order ranges are accepted outright, stale ones dropped, anything else per message
+        auto s = std::make_unique<BitsetSequencer>();
+        assert(s->checkRange(1, 10) == RangeCheck::InOrder);
+        assert(s->nextExpected() == 11);
+        assert(s->stats.parsedMessages == 10);
+        assert(s->checkRange(1, 10) == RangeCheck::Duplicate);
+        assert(s->stats.duplicates == 10);
+        assert(s->checkRange(5, 10) == RangeCheck::Mixed); // overlaps 5..10
+        assert(s->checkRange(21, 5) == RangeCheck::Mixed); // ahead, opens a gap
+        for (uint32_t seq = 21; seq < 26; seq++) assert(s->check(seq));
+        assert(s->checkRange(11, 10) == RangeCheck::Mixed); // fills the gap, but one is open
+        for (uint32_t seq = 11; seq < 21; seq++) assert(s->check(seq));
+        assert(!s->gapExists());
+        assert(s->checkRange(26, 4) == RangeCheck::InOrder);
+        assert(s->nextExpected() == 30);
+        assert(s->stats.parsedMessages == 29);
+    }
+    std::cout << "=== RUNNING TEST GAP DEADLINE ===\n";
+    {
+        // The gap is flushed by the first poll at or after GAP_TIMEOUT from when it was first seen
+        auto s = std::make_unique<BitsetSequencer>();
+        GapDeadline deadline;
+        VirtualClock clock;
+        assert(s->check(1));
+        assert(!deadline.poll(*s, clock.nowNs()));
+        assert(!deadline.armed());
+        assert(s->check(3));
+        clock.advanceBy(1000);
+        assert(!deadline.poll(*s, clock.nowNs())); // arms
+        assert(deadline.armed());
+        clock.advanceBy(GAP_TIMEOUT_NS - 1);
+        assert(!deadline.poll(*s, clock.nowNs()));
+        clock.advanceBy(1);
+        assert(deadline.poll(*s, clock.nowNs()));
+        assert(deadline.expirations == 1);
+        assert(s->stats.lostMessages == 1);
+        assert(s->nextExpected() == 4);
+        assert(!deadline.armed());
+    }
+    {
+        // A gap that closes before the deadline disarms it, the next gap gets a fresh deadline
+        auto s = std::make_unique<BitsetSequencer>();
+        GapDeadline deadline(100);
+        assert(s->check(1));
+        assert(s->check(3));
+        assert(!deadline.poll(*s, 0));
+        assert(s->check(2));
+        assert(!deadline.poll(*s, 50));
+        assert(!deadline.armed());
+        assert(s->check(5));
+        assert(!deadline.poll(*s, 150));
+        assert(!deadline.poll(*s, 200));
+        assert(deadline.poll(*s, 250));
+        assert(s->stats.lostMessages == 1);
+        assert(deadline.expirations == 1);
+    }
+    std::cout << "\nPASSED\n";
+}
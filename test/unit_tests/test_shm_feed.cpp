@@ -0,0 +1,83 @@
+#include "../../src/shm_feed.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+static void publish(ShmFeedPublisher &p, uint32_t seq) {
+    FeedEvent *e = p.claim();
+    std::memset(e, 0, sizeof(*e));
+    e->messageType = 'A';
+    e->sequenceNumber = seq;
+    e->price = seq * 100;
+    std::memcpy(e->stock, "AAPL    ", 8);
+    p.publish();
+}
+
+int main() {
+    std::cout << "=== RUNNING TEST SHM FEED ===\n";
+    std::string name = "/test_shm_feed_" + std::to_string(getpid());
+
+    ShmFeedPublisher p;
+    assert(p.open(name.c_str(), 6)); // rounded up to 8 slots
+    publish(p, 1);
+
+    // A reader starts at the next event published, not at what is already in the ring
+    ShmFeedReader r;
+    assert(r.open(name.c_str()));
+    assert(r.capacity() == 8);
+    FeedEvent e;
+    assert(r.poll(e) == ShmPoll::Empty);
+    for (uint32_t seq = 2; seq <= 4; seq++) publish(p, seq);
+    for (uint32_t seq = 2; seq <= 4; seq++) {
+        assert(r.poll(e) == ShmPoll::Event);
+        assert(e.sequenceNumber == seq && e.price == seq * 100 && e.messageType == 'A');
+        assert(!std::memcmp(e.stock, "AAPL    ", 8) && e.publishTsc != 0);
+    }
+    assert(r.poll(e) == ShmPoll::Empty);
+
+    // An event being written isn't read until it is published
+    FeedEvent *pending = p.claim();
+    pending->sequenceNumber = 5;
+    assert(r.poll(e) == ShmPoll::Empty);
+    p.publish();
+    assert(r.poll(e) == ShmPoll::Event && e.sequenceNumber == 5);
+
+    // A second reader, and both show up in the consumer table
+    ShmFeedReader slow;
+    assert(slow.open(name.c_str()));
+    ShmConsumerStatus status[SHM_FEED_MAX_CONSUMERS];
+    assert(p.consumers(status) == 2);
+
+    // The producer never waits: a reader that falls more than the ring behind is lapped, skips to the newest
+    // event and counts what it missed
+    for (uint32_t seq = 6; seq <= 26; seq++) publish(p, seq);
+    assert(p.consumers(status) == 2 && status[0].lapped && status[0].lag == 21);
+    assert(r.poll(e) == ShmPoll::Lapped);
+    assert(r.missed() == 21 && r.laps() == 1);
+    assert(r.poll(e) == ShmPoll::Empty);
+    publish(p, 27);
+    assert(r.poll(e) == ShmPoll::Event && e.sequenceNumber == 27);
+
+    // Lapped while the producer is rewriting the very slot the reader wants: r wants 28, which is still in
+    // the ring until the producer claims the slot for 36
+    for (uint32_t seq = 28; seq <= 35; seq++) publish(p, seq);
+    p.claim()->sequenceNumber = 36;
+    assert(r.poll(e) == ShmPoll::Lapped && r.missed() == 21 + 8);
+    // It rejoins at the event being written, and reads it once it is published
+    assert(r.poll(e) == ShmPoll::Empty);
+    p.publish();
+    assert(r.poll(e) == ShmPoll::Event && e.sequenceNumber == 36);
+
+    // Readers see the producer close, and a closed reader's slot is free again
+    slow.close();
+    assert(p.consumers(status) == 1 && status[0].pid == getpid() && status[0].laps == 2);
+    assert(!r.producerClosed());
+    p.close();
+    assert(r.producerClosed());
+    r.close();
+    ShmFeedReader gone;
+    assert(!gone.open(name.c_str()));
+    std::cout << "\nPASSED\n";
+}
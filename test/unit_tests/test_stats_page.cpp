@@ -0,0 +1,90 @@
+#include "../../src/parse.h"
+#include "../../src/stats_page.h"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+int main() {
+    std::cout << "=== RUNNING TEST STATS PAGE ===\n";
+    std::string name = "/test_stats_page_" + std::to_string(getpid());
+
+    // Gap histograms: a gap of 2 opens at 5 (3 and 4 missing), 4 arrives and 3 is given up on
+    Sequencer &seq = GlobalState::sequencer;
+    assert(seq.check(1) && seq.check(2) && seq.check(5));
+    assert(seq.stats.gapSizes[2] == 1);
+    assert(seq.check(4));
+    seq.flushGaps();
+    assert(seq.stats.lostMessages == 1 && seq.stats.gapLosses[1] == 1);
+    // A gap of 100 and all of it lost
+    assert(seq.check(106));
+    seq.flushGaps();
+    assert(seq.stats.gapSizes[std::bit_width(100u)] == 1 && seq.stats.gapLosses[std::bit_width(100u)] == 1);
+
+    // No page, nothing written and no ring lines
+    assert(!statsPage.enabled() && statsPage.ring(0) == nullptr);
+    statsPage.publishSequencer();
+    StatsPageReader missing;
+    assert(!missing.open(name.c_str()));
+    assert(!statsPage.open(name.c_str(), STATS_MAX_RINGS + 1));
+
+    assert(statsPage.open(name.c_str(), 2));
+    assert(statsPage.ring(1) != nullptr && statsPage.ring(2) == nullptr);
+    statsPage.publishSequencer();
+    StatsPageReader reader;
+    assert(reader.open(name.c_str()));
+    const StatsPageLayout &page = reader.page();
+    assert(page.ringCount == 2 && page.pid == getpid() && !reader.writerGone());
+    assert(page.sequencer.parsed.load() == seq.stats.parsedMessages);
+    assert(page.sequencer.lost.load() == 101 && page.sequencer.outOfOrder.load() == 3);
+    assert(page.sequencer.nextExpected.load() == 107 && page.sequencer.highest.load() == 106);
+    assert(page.sequencer.gapSizes[2].load() == 1 && page.sequencer.gapLosses[1].load() == 1);
+    assert(page.sequencer.updatedNs.load() >= page.startedNs);
+
+    // Counts only move on when the sequencer does
+    seq.check(107);
+    assert(page.sequencer.parsed.load() != seq.stats.parsedMessages);
+    statsPage.publishSequencer();
+    assert(page.sequencer.parsed.load() == seq.stats.parsedMessages);
+
+    // A ring of 8 blocks in plain memory: block 0 comes back marked losing with 2 blocks already waiting behind
+    // it, then block 1 with one
+    RxRing ring;
+    ring.blockSize = 4096;
+    ring.blockNr = 8;
+    ring.ptr = (uint8_t *) aligned_alloc(4096, ring.blockSize * ring.blockNr);
+    std::memset(ring.ptr, 0, ring.blockSize * ring.blockNr);
+    for (uint32_t b = 0; b < 3; b++) {
+        ring.block(b)->hdr.bh1.block_status = TP_STATUS_USER;
+        ring.block(b)->hdr.bh1.num_pkts = 10;
+    }
+    ring.block(0)->hdr.bh1.block_status |= TP_STATUS_LOSING;
+    RingStatsWriter writer;
+    writer.onBlock(ring, 0); // not attached, ignored
+    writer.attach(statsPage.ring(1), ring);
+    writer.onBlock(ring, 0);
+    ring.block(0)->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    writer.onBlock(ring, 1);
+    const RingStatsLines &lines = page.rings[1];
+    assert(lines.blocks.load() == 2 && lines.packets.load() == 20 && lines.blockNr.load() == 8);
+    assert(lines.losingBlocks.load() == 1);
+    assert(lines.occupancy[std::bit_width(2u)].load() == 1 && lines.occupancy[std::bit_width(1u)].load() == 1);
+    assert(lines.maxOccupancy.load() == 2);
+    // No socket, so nothing from the kernel
+    assert(lines.kernelPackets.load() == 0 && lines.kernelDrops.load() == 0);
+    // Every block ready, the scan stops short of coming round to the block itself
+    for (uint32_t b = 0; b < 8; b++) ring.block(b)->hdr.bh1.block_status = TP_STATUS_USER;
+    writer.onBlock(ring, 3);
+    assert(lines.maxOccupancy.load() == 7);
+    assert(page.rings[0].blocks.load() == 0);
+    free(ring.ptr);
+
+    statsPage.close();
+    assert(reader.writerGone());
+    assert(!statsPage.enabled());
+
+    std::cout << "\nPASSED\n";
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "../../src/parse.h"
+#include "../../src/symbols.h"
+#include "../../src/sequencer.h"
+#include "../../src/orderbook.h"
+#include "../../src/moldudp64.h"
+#include "../../src/shm_feed.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+int main() {
+    std::cout << "=== RUNNING TEST SYMBOLS ===\n";
+
+    // Space padded as on the wire and null padded as in the message structs are the same symbol
+    assert(tickerKey("AAPL    ") == tickerKey("AAPL\0\0\0\0"));
+    assert(tickerKey("AAPL    ") != tickerKey("AAPLX   "));
+    assert(tickerKey("ABCDEFGH") == tickerKey("ABCDEFGH"));
+
+    // Ids are dense, in the order symbols are first interned, and every one is found again
+    auto dir = std::make_unique<SymbolDirectory>();
+    assert(dir->find("AAPL    ") == NO_SYMBOL);
+    char stock[9];
+    for (uint32_t i = 0; i < 10000; i++) {
+        snprintf(stock, sizeof(stock), "S%-7u", i);
+        assert(dir->intern(stock) == i);
+    }
+    assert(dir->size() == 10000);
+    for (uint32_t i = 0; i < 10000; i++) {
+        snprintf(stock, sizeof(stock), "S%-7u", i);
+        assert(dir->find(stock) == i && dir->intern(stock) == i);
+        assert(!std::memcmp(dir->ticker(i), stock, 8));
+    }
+    assert(dir->find("S10000  ") == NO_SYMBOL);
+    for (uint32_t i = 10000; i < MAX_SYMBOLS; i++) {
+        snprintf(stock, sizeof(stock), "S%-7u", i);
+        assert(dir->intern(stock) == i);
+    }
+    assert(dir->intern("FULL    ") == NO_SYMBOL && dir->find("FULL    ") == NO_SYMBOL);
+
+    // No subscription lets everything through, then only what is subscribed (lists are trimmed)
+    SymbolDirectory symbols;
+    SubscriptionFilter filter(symbols);
+    assert(!filter.active() && filter.subscribed("MSFT    "));
+    assert(filter.subscribeAll("AAPL, MSFT ,,NVDA"));
+    assert(filter.active() && filter.count() == 3);
+    assert(filter.subscribed("AAPL    ") && filter.subscribed("MSFT\0\0\0\0") && filter.subscribed("NVDA    "));
+    assert(!filter.subscribed("GOOG    ") && !filter.subscribed("AAPLX   "));
+    filter.unsubscribe("MSFT");
+    assert(!filter.subscribed("MSFT    ") && filter.count() == 2 && filter.active());
+    assert(!filter.subscribeAll(" , "));
+    assert(!filter.subscribeAll("@/nonexistent/subscriptions"));
+
+    // The copy-out decoders filter like the receive path: an unsubscribed symbol is sequenced, not booked
+    assert(feedSubscriptions.subscribeAll("AAPL"));
+    orderBooks.subscribedOnly = true;
+    char add[36] = {};
+    TradeMessage t;
+    for (uint32_t seq = 1; seq <= 2; seq++) {
+        add[0] = 'A';
+        uint32_t be = htonl(seq);
+        std::memcpy(add + 7, &be, 4);
+        uint64_t ref = htobe64(seq);
+        std::memcpy(add + fieldOffset('A', "orderRefNumber"), &ref, 8);
+        add[fieldOffset('A', "buySellIndicator")] = 'B';
+        uint32_t shares = htonl(100), price = htonl(1'500'000);
+        std::memcpy(add + fieldOffset('A', "shares"), &shares, 4);
+        std::memcpy(add + fieldOffset('A', "price"), &price, 4);
+        std::memcpy(add + fieldOffset('A', "stock"), seq == 1 ? "AAPL    " : "GOOG    ", 8);
+        assert(parseTrade(add, t) == (ssize_t) sizeof(add));
+    }
+    assert(GlobalState::sequencer.stats.parsedMessages == 2);
+    assert(orderBooks.order(1) != nullptr && orderBooks.order(2) == nullptr && orderBooks.bookCount() == 1);
+
+    // The other types that carry a stock are filtered on it too, the ones without one all go through
+    std::string feed = "/mdfh_test_symbols_" + std::to_string(getpid());
+    assert(feedPublisher.open(feed.c_str(), 64));
+    char payload[2 * messageSize('R') + messageSize('S')] = {};
+    char *msg = payload;
+    for (uint32_t seq = 3; seq <= 5; seq++) {
+        msg[0] = seq < 5 ? 'R' : 'S';
+        uint32_t be = htonl(seq);
+        std::memcpy(msg + 7, &be, 4);
+        if (seq < 5) std::memcpy(msg + fieldOffset('R', "stock"), seq == 3 ? "AAPL    " : "GOOG    ", 8);
+        msg += messageSize(msg[0]);
+    }
+    parsePayload(payload, sizeof(payload));
+    assert(GlobalState::sequencer.stats.parsedMessages == 5 && feedPublisher.published() == 2);
+    feedPublisher.close();
+    std::cout << "\nPASSED\n";
+}
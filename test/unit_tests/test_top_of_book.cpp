@@ -0,0 +1,74 @@
+#include "../../src/top_of_book.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static TopOfBook makeTop(const char *stock, uint32_t bid, uint32_t ask, uint64_t timestamp) {
+    TopOfBook t{};
+    std::memcpy(t.stock, stock, 8);
+    t.bidPrice = bid;
+    t.bidOrders = 1;
+    t.bidShares = 100;
+    t.askPrice = ask;
+    t.askOrders = 1;
+    t.askShares = 200;
+    t.timestamp = timestamp;
+    return t;
+}
+
+int main() {
+    std::cout << "=== RUNNING TEST TOP OF BOOK ===\n";
+    std::string name = "/test_top_of_book_" + std::to_string(getpid());
+
+    TopOfBookTable table;
+    assert(table.open(name.c_str()));
+    table.update(0, makeTop("AAPL    ", 1000, 1010, 1));
+    table.update(1, makeTop("MSFT    ", 500, 501, 2));
+
+    // A new reader gets every symbol from its first poll
+    TopOfBookReader r;
+    assert(r.open(name.c_str()));
+    assert(r.symbols() == 2);
+    std::vector<size_t> changed;
+    TopOfBook t;
+    assert(r.pollChanged([&](size_t i, const TopOfBook &) { changed.push_back(i); }) == 2);
+    assert(changed == std::vector<size_t>({0, 1}));
+    assert(r.pollChanged([](size_t, const TopOfBook &) {}) == 0);
+    assert(r.find("MSFT    ") == 1 && r.find("MSFT\0\0\0\0") == 1 && r.find("MSFT   X") == -1 && r.find("GOOG    ") == -1);
+    assert(r.read(1, t) && t.bidPrice == 500 && t.askShares == 200 && t.timestamp == 2);
+    assert(!r.read(2, t));
+
+    // Several changes to a symbol before the reader polls are conflated into one, and an update that changes
+    // nothing but the timestamp isn't a change
+    table.update(0, makeTop("AAPL    ", 1001, 1010, 3));
+    table.update(0, makeTop("AAPL    ", 1002, 1010, 4));
+    table.update(1, makeTop("MSFT    ", 500, 501, 5));
+    assert(table.changes() == 4);
+    changed.clear();
+    assert(r.pollChanged([&](size_t i, const TopOfBook &top) { changed.push_back(i); t = top; }) == 1);
+    assert(changed == std::vector<size_t>({0}) && t.bidPrice == 1002 && t.timestamp == 4);
+
+    // Symbols beyond the first bitmap word, and every reader has a bitmap of its own
+    TopOfBookReader other;
+    assert(other.open(name.c_str()));
+    assert(other.pollChanged([](size_t, const TopOfBook &) {}) == 2);
+    table.update(100, makeTop("IBM     ", 10, 11, 6));
+    assert(r.symbols() == 101);
+    changed.clear();
+    assert(r.pollChanged([&](size_t i, const TopOfBook &) { changed.push_back(i); }) == 1 && changed[0] == 100);
+    assert(other.pollChanged([&](size_t i, const TopOfBook &) { changed.push_back(i); }) == 1 && changed[1] == 100);
+    assert(r.retries() == 0);
+
+    // A closed reader stops being marked, and readers see the writer close
+    other.close();
+    table.update(100, makeTop("IBM     ", 10, 12, 7));
+    assert(r.pollChanged([](size_t, const TopOfBook &) {}) == 1);
+    assert(!r.writerClosed());
+    table.close();
+    assert(r.writerClosed());
+    r.close();
+    std::cout << "\nPASSED\n";
+}